@@ -0,0 +1,130 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7148" # git grep '\<7148\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd_ec_parity_delta_writes=true "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function setup_osds() {
+    local dir=$1
+    local count=$2
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    for id in $(seq 0 $(expr $count - 1)) ; do
+        run_osd_bluestore $dir $id || return 1
+    done
+}
+
+function create_ec_pool() {
+    local poolname=$1
+
+    # with k=2 m=1 an overwrite of a single chunk reads and writes two
+    # chunks of the stripe instead of three, and is done as a delta
+    ceph osd erasure-code-profile set myprofile \
+        plugin=jerasure technique=reed_sol_van \
+        k=2 m=1 crush-failure-domain=osd || return 1
+    create_pool $poolname 1 1 erasure myprofile || return 1
+    ceph osd pool set $poolname allow_ec_overwrites true || return 1
+    wait_for_clean || return 1
+}
+
+function TEST_parity_delta_rados() {
+    local dir=$1
+    local poolname=ecpool
+
+    setup_osds $dir 3 || return 1
+    create_ec_pool $poolname || return 1
+
+    # ceph_test_rados checks every read it gets back against the
+    # writes it made, small strides make most writes partial stripe
+    # overwrites
+    ceph_test_rados --no-omap --max-ops 2000 --objects 20 \
+        --max-in-flight 16 --size 65536 \
+        --min-stride-size 1024 --max-stride-size 4096 \
+        --max-seconds 120 --pool $poolname \
+        --op read 100 --op write 50 --op append 10 --op delete 5 || return 1
+
+    local primary=$(get_primary $poolname obj)
+    CEPH_ARGS='' ceph daemon $(get_asok_path osd.$primary) log flush || return 1
+    grep -q 'handle_delta_read' $dir/osd.$primary.log || return 1
+
+    # the parity updated from deltas must match the data
+    local pgid=$(get_pg $poolname obj)
+    local last_scrub=$(get_last_scrub_stamp $pgid)
+    ceph pg deep-scrub $pgid || return 1
+    wait_for_scrub $pgid "$last_scrub" || return 1
+    ! ceph pg dump pgs 2>/dev/null | grep "^$pgid" | grep -q inconsistent || return 1
+}
+
+function TEST_parity_delta_read_error() {
+    local dir=$1
+    local poolname=ecpool
+    local objname=obj
+
+    setup_osds $dir 3 || return 1
+    create_ec_pool $poolname || return 1
+
+    dd if=/dev/urandom of=$dir/ORIGINAL bs=4096 count=4 || return 1
+    rados --pool $poolname put $objname $dir/ORIGINAL || return 1
+
+    # the data chunk at offset 4096 is on shard 1: make reading it fail
+    # so the delta read gives up and the write falls back to a plain
+    # rmw, reconstructing the stripe from the other shards
+    local -a osds=($(get_osds $poolname $objname))
+    local primary=${osds[0]}
+    set_config osd ${osds[1]} bluestore_debug_inject_read_err true || return 1
+    inject_eio ec data $poolname $objname $dir 1 || return 1
+
+    dd if=/dev/urandom of=$dir/CHUNK bs=4096 count=1 || return 1
+    rados --pool $poolname put $objname $dir/CHUNK --offset 4096 || return 1
+    dd if=$dir/CHUNK of=$dir/ORIGINAL bs=4096 seek=1 conv=notrunc || return 1
+
+    CEPH_ARGS='' ceph daemon $(get_asok_path osd.$primary) log flush || return 1
+    grep -q 'delta read failed' $dir/osd.$primary.log || return 1
+
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+
+    # once the error is gone every shard must agree with the data
+    set_config osd ${osds[1]} bluestore_debug_inject_read_err false || return 1
+    local pgid=$(get_pg $poolname $objname)
+    local last_scrub=$(get_last_scrub_stamp $pgid)
+    ceph pg deep-scrub $pgid || return 1
+    wait_for_scrub $pgid "$last_scrub" || return 1
+    ! ceph pg dump pgs 2>/dev/null | grep "^$pgid" | grep -q inconsistent || return 1
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+}
+
+main test-erasure-delta "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/erasure-code/test-erasure-delta.sh"
+# End:
@@ -0,0 +1,152 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7141" # git grep '\<7141\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd_pool_default_size=1 "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function get_op_inline() {
+    CEPH_ARGS='' ceph --format=json daemon $(get_asok_path osd.0) \
+        perf dump osd | jq '.osd.op_inline'
+}
+
+function read_object() {
+    local poolname=$1
+    local objname=$2
+    local dir=$3
+
+    for i in $(seq 1 10) ; do
+        rados --pool $poolname get $objname $dir/COPY || return 1
+        diff $dir/ORIGINAL $dir/COPY || return 1
+    done
+}
+
+function setup_osd() {
+    local dir=$1
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    run_osd_bluestore $dir 0 \
+        --osd_op_run_to_completion=true \
+        --osd_debug_op_order=true || return 1
+    dd if=/dev/urandom of=$dir/ORIGINAL bs=4096 count=4 || return 1
+}
+
+function TEST_inline_read() {
+    local dir=$1
+    local poolname=test
+
+    setup_osd $dir || return 1
+    create_pool $poolname 1 1 || return 1
+    wait_for_clean || return 1
+
+    rados --pool $poolname put obj $dir/ORIGINAL || return 1
+    # the first read brings the onode and the data into the cache
+    rados --pool $poolname get obj $dir/COPY || return 1
+
+    local before=$(get_op_inline)
+    read_object $poolname obj $dir || return 1
+    local after=$(get_op_inline)
+    test $after -gt $before || return 1
+}
+
+function TEST_inline_read_not_clean() {
+    local dir=$1
+    local poolname=test
+
+    setup_osd $dir || return 1
+    create_pool $poolname 1 1 || return 1
+    wait_for_clean || return 1
+    # with a single osd the pg stays active+undersized
+    ceph osd pool set $poolname min_size 1 || return 1
+    ceph osd pool set $poolname size 2 || return 1
+    for i in $(seq 1 30) ; do
+        ceph pg dump pgs 2>/dev/null | grep -q 'active+undersized' && break
+        sleep 1
+    done
+    ceph pg dump pgs 2>/dev/null | grep -q 'active+undersized' || return 1
+
+    rados --pool $poolname put obj $dir/ORIGINAL || return 1
+    rados --pool $poolname get obj $dir/COPY || return 1
+
+    local before=$(get_op_inline)
+    read_object $poolname obj $dir || return 1
+    local after=$(get_op_inline)
+    test $after -eq $before || return 1
+}
+
+function TEST_inline_read_pg_busy() {
+    local dir=$1
+    local poolname=test
+
+    setup_osd $dir || return 1
+    create_pool $poolname 1 1 || return 1
+    wait_for_clean || return 1
+
+    rados --pool $poolname put obj $dir/ORIGINAL || return 1
+    rados --pool $poolname get obj $dir/COPY || return 1
+
+    # the deep scrub sleeps with the pg locked, so the reads issued
+    # meanwhile find the pg slot busy and must be queued
+    local pgid=$(get_pg $poolname obj)
+    ceph tell osd.0 injectargs -- --osd_debug_deep_scrub_sleep=5 || return 1
+    ceph pg deep-scrub $pgid || return 1
+    sleep 1
+    local before=$(get_op_inline)
+    rados --pool $poolname get obj $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+    local after=$(get_op_inline)
+    test $after -eq $before || return 1
+    ceph tell osd.0 injectargs -- --osd_debug_deep_scrub_sleep=0 || return 1
+}
+
+function TEST_inline_read_op_order() {
+    local dir=$1
+    local poolname=test
+
+    setup_osd $dir || return 1
+    create_pool $poolname 4 4 || return 1
+    wait_for_clean || return 1
+
+    # osd_debug_op_order makes the osd assert if a client's ops on an
+    # object are reordered; ceph_test_rados checks every read it gets
+    # back against the writes it made
+    ceph_test_rados --max-ops 2000 --objects 20 --max-in-flight 16 \
+        --size 65536 --min-stride-size 4096 --max-stride-size 16384 \
+        --max-seconds 60 --pool $poolname \
+        --op read 100 --op write 20 --op append 10 --op delete 5 || return 1
+    test $(get_op_inline) -gt 0 || return 1
+    ceph osd dump | grep -q 'osd.0 up' || return 1
+}
+
+main osd-inline-read "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/osd/osd-inline-read.sh"
+# End:
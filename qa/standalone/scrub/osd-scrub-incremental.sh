@@ -0,0 +1,133 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7147" # git grep '\<7147\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd_pool_default_size=1 "
+    # passed to the osd again when objectstore_tool restarts it
+    CEPH_ARGS+="--osd_deep_scrub_incremental=true "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function osd_config_set() {
+    CEPH_ARGS='' ceph daemon $(get_asok_path osd.0) config set "$@"
+}
+
+function count_verified() {
+    local dir=$1
+    grep -c "verified, stored digest" $dir/osd.0.log
+}
+
+function TEST_deep_scrub_incremental() {
+    local dir=$1
+    local poolname=test
+    local objects=4
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    run_osd_bluestore $dir 0 || return 1
+    create_pool $poolname 1 1 || return 1
+    wait_for_clean || return 1
+
+    dd if=/dev/urandom of=$dir/ORIGINAL bs=64k count=1 || return 1
+    for i in $(seq 1 $objects) ; do
+        rados --pool $poolname put obj$i $dir/ORIGINAL || return 1
+    done
+    local pgid=$(get_pg $poolname obj1)
+
+    # a full object write records the data digest, so the store's
+    # checksums are checked instead of hashing the data
+    local before=$(count_verified $dir)
+    pg_deep_scrub $pgid || return 1
+    test $(count_verified $dir) -ge $(expr $before + $objects) || return 1
+    ceph pg dump pgs | grep ^$pgid | grep -q -- +inconsistent && return 1
+
+    # new data under the old object_info: the store's checksums match
+    # what it holds, so only hashing the data can tell
+    dd if=/dev/urandom of=$dir/CORRUPT bs=64k count=1 || return 1
+    objectstore_tool $dir 0 obj1 set-bytes $dir/CORRUPT || return 1
+    pg_deep_scrub $pgid || return 1
+    ceph pg dump pgs | grep ^$pgid | grep -q -- +inconsistent && return 1
+
+    # once the last full deep scrub is too old, the next one hashes
+    # everything and finds it
+    osd_config_set osd_deep_scrub_incremental_max_age 1 || return 1
+    sleep 2
+    before=$(count_verified $dir)
+    pg_deep_scrub $pgid || return 1
+    grep -q "is too old, hashing all data" $dir/osd.0.log || return 1
+    test $(count_verified $dir) -eq $before || return 1
+    ceph pg dump pgs | grep ^$pgid | grep -q -- +inconsistent || return 1
+    rados list-inconsistent-obj $pgid | jq '.inconsistents[].object.name' | \
+        grep -q obj1 || return 1
+
+    # that scrub counts as a full one
+    osd_config_set osd_deep_scrub_incremental_max_age 3600 || return 1
+    before=$(count_verified $dir)
+    pg_deep_scrub $pgid || return 1
+    test $(count_verified $dir) -gt $before || return 1
+}
+
+function TEST_scrub_max_bytes_per_sec() {
+    local dir=$1
+    local poolname=test
+    local objects=8
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    run_osd_bluestore $dir 0 || return 1
+    create_pool $poolname 1 1 || return 1
+    wait_for_clean || return 1
+
+    dd if=/dev/urandom of=$dir/ORIGINAL bs=1M count=1 || return 1
+    for i in $(seq 1 $objects) ; do
+        rados --pool $poolname put obj$i $dir/ORIGINAL || return 1
+    done
+    local pgid=$(get_pg $poolname obj1)
+
+    # checking csums is charged like reading the data: at 1M/s the 8M
+    # take about 7.5s, since nothing waits for the last stride
+    osd_config_set osd_scrub_max_bytes_per_sec 1048576 || return 1
+    local start=$(date +%s)
+    pg_deep_scrub $pgid || return 1
+    local elapsed=$(expr $(date +%s) - $start)
+    test $(count_verified $dir) -ge $objects || return 1
+    grep -q "over scrub read budget, sleeping" $dir/osd.0.log || return 1
+    test $elapsed -ge 6 || return 1
+
+    osd_config_set osd_scrub_max_bytes_per_sec 0 || return 1
+    start=$(date +%s)
+    pg_deep_scrub $pgid || return 1
+    elapsed=$(expr $(date +%s) - $start)
+    test $elapsed -lt 6 || return 1
+}
+
+main osd-scrub-incremental "$@"
+
+# Local Variables:
+# compile-command: "cd build ; make -j4 && \
+#    ../qa/run-standalone.sh osd-scrub-incremental.sh"
+# End:
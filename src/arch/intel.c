@@ -23,6 +23,7 @@ int ceph_arch_intel_ssse3 = 0;
 int ceph_arch_intel_sse3 = 0;
 int ceph_arch_intel_sse2 = 0;
 int ceph_arch_intel_aesni = 0;
+int ceph_arch_intel_avx2 = 0;
 
 #ifdef __x86_64__
 #include <cpuid.h>
@@ -36,6 +37,12 @@ int ceph_arch_intel_aesni = 0;
 #define CPUID_SSE3	(1)
 #define CPUID_SSE2	(1 << 26)
 #define CPUID_AESNI (1 << 25)
+#define CPUID_OSXSAVE	(1 << 27)
+#define CPUID_AVX	(1 << 28)
+/* leaf 7, ebx */
+#define CPUID_AVX2	(1 << 5)
+/* xcr0: the os saves and restores xmm and ymm state */
+#define XCR0_SSE_AVX	0x6
 
 int ceph_arch_intel_probe(void)
 {
@@ -65,6 +72,18 @@ int ceph_arch_intel_probe(void)
   if ((ecx & CPUID_AESNI) != 0) {
           ceph_arch_intel_aesni = 1;
   }
+	if ((ecx & CPUID_OSXSAVE) != 0 && (ecx & CPUID_AVX) != 0) {
+		/* avx instructions fault unless the os enabled ymm state */
+		unsigned int xcr0_lo, xcr0_hi;
+		__asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+		if ((xcr0_lo & XCR0_SSE_AVX) == XCR0_SSE_AVX &&
+		    __get_cpuid_max(0, NULL) >= 7) {
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			if ((ebx & CPUID_AVX2) != 0) {
+				ceph_arch_intel_avx2 = 1;
+			}
+		}
+	}
 
 	return 0;
 }
@@ -5,6 +5,8 @@
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
 #include "xxHash/xxhash.h"
+#include "include/crc32c.h"
+#include "common/xxhash_multi.h"
 
 class Checksummer {
 public:
@@ -17,6 +19,9 @@ public:
     CSUM_CRC32C_8 = 6,  // low 8 bits of crc32c
     CSUM_MAX,
   };
+
+  /// max number of csum blocks handed to an Alg::calc_multi() at once
+  static constexpr unsigned MULTI_BATCH = 16;
   static const char *get_csum_type_string(unsigned t) {
     switch (t) {
     case CSUM_NONE: return "none";
@@ -86,6 +91,24 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const unsigned char * const *data,
+      unsigned n,
+      value_t *out
+      ) {
+      uint32_t crc[MULTI_BATCH];
+      unsigned length[MULTI_BATCH];
+      for (unsigned i = 0; i < n; ++i) {
+	crc[i] = init_value;
+	length[i] = len;
+      }
+      ceph_crc32c_multi(crc, data, length, n);
+      for (unsigned i = 0; i < n; ++i) {
+	out[i] = crc[i];
+      }
+    }
   };
 
   struct crc32c_16 {
@@ -107,6 +130,24 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const unsigned char * const *data,
+      unsigned n,
+      value_t *out
+      ) {
+      uint32_t crc[MULTI_BATCH];
+      unsigned length[MULTI_BATCH];
+      for (unsigned i = 0; i < n; ++i) {
+	crc[i] = init_value;
+	length[i] = len;
+      }
+      ceph_crc32c_multi(crc, data, length, n);
+      for (unsigned i = 0; i < n; ++i) {
+	out[i] = crc[i] & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -128,6 +169,24 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const unsigned char * const *data,
+      unsigned n,
+      value_t *out
+      ) {
+      uint32_t crc[MULTI_BATCH];
+      unsigned length[MULTI_BATCH];
+      for (unsigned i = 0; i < n; ++i) {
+	crc[i] = init_value;
+	length[i] = len;
+      }
+      ceph_crc32c_multi(crc, data, length, n);
+      for (unsigned i = 0; i < n; ++i) {
+	out[i] = crc[i] & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -157,6 +216,19 @@ public:
       }
       return XXH32_digest(state);
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const unsigned char * const *data,
+      unsigned n,
+      value_t *out
+      ) {
+      uint32_t v[MULTI_BATCH];
+      ceph_xxhash32_multi(init_value, data, len, n, v);
+      for (unsigned i = 0; i < n; ++i) {
+	out[i] = v[i];
+      }
+    }
   };
 
   struct xxhash64 {
@@ -186,6 +258,19 @@ public:
       }
       return XXH64_digest(state);
     }
+    static void calc_multi(
+      init_value_t init_value,
+      size_t len,
+      const unsigned char * const *data,
+      unsigned n,
+      value_t *out
+      ) {
+      uint64_t v[MULTI_BATCH];
+      ceph_xxhash64_multi(init_value, data, len, n, v);
+      for (unsigned i = 0; i < n; ++i) {
+	out[i] = v[i];
+      }
+    }
   };
 
   template<class Alg>
@@ -221,10 +306,14 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
-    }
+    _calc_blocks<Alg>(
+      state, init_value, csum_block_size, blocks, p,
+      [&](const typename Alg::value_t *v, unsigned n) {
+	for (unsigned i = 0; i < n; ++i) {
+	  *pv++ = v[i];
+	}
+	return true;
+      });
     Alg::fini(&state);
     return 0;
   }
@@ -249,21 +338,76 @@ public:
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
     size_t pos = offset;
-    while (length > 0) {
-      typename Alg::value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+    int bad = -1;
+    _calc_blocks<Alg>(
+      state, -1, csum_block_size, length / csum_block_size, p,
+      [&](const typename Alg::value_t *v, unsigned n) {
+	for (unsigned i = 0; i < n; ++i) {
+	  if (*pv != v[i]) {
+	    if (bad_csum) {
+	      *bad_csum = v[i];
+	    }
+	    bad = pos;
+	    return false;
+	  }
+	  ++pv;
+	  pos += csum_block_size;
+	}
+	return true;
+      });
+    Alg::fini(&state);
+    return bad;  // -1 if no errors
+  }
+
+private:
+  /**
+   * checksum consecutive blocks starting at p
+   *
+   * Blocks that sit in a single bufferptr are batched up and passed to
+   * Alg::calc_multi(), which can work on several at once; a block that
+   * straddles bufferptrs goes through Alg::calc() on its own.  f is
+   * called with the values in block order and returns false to stop.
+   */
+  template<class Alg, class F>
+  static void _calc_blocks(
+    typename Alg::state_t state,
+    typename Alg::init_value_t init_value,
+    size_t csum_block_size,
+    size_t blocks,
+    bufferlist::const_iterator& p,
+    F&& f) {
+    const unsigned char *data[MULTI_BATCH];
+    typename Alg::value_t v[MULTI_BATCH];
+    unsigned n = 0;
+    while (blocks--) {
+      const char *d;
+      size_t l = p.get_ptr_and_advance(csum_block_size, &d);
+      if (l == csum_block_size) {
+	data[n++] = reinterpret_cast<const unsigned char*>(d);
+	if (n < MULTI_BATCH) {
+	  continue;
+	}
+      } else {
+	p.advance(-(int)l);
+      }
+      if (n) {
+	Alg::calc_multi(init_value, csum_block_size, data, n, v);
+	if (!f(v, n)) {
+	  return;
+	}
+	n = 0;
+      }
+      if (l != csum_block_size) {
+	v[0] = Alg::calc(state, init_value, csum_block_size, p);
+	if (!f(v, 1)) {
+	  return;
 	}
-	Alg::fini(&state);
-	return pos;
       }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
     }
-    Alg::fini(&state);
-    return -1;  // no errors
+    if (n) {
+      Alg::calc_multi(init_value, csum_block_size, data, n, v);
+      f(v, n);
+    }
   }
 };
 
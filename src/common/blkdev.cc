@@ -230,6 +230,32 @@ int block_device_serial(const char *devname, char *serial, size_t max)
   return get_block_device_string_property(devname, "device/serial", serial, max);
 }
 
+int block_device_numa_node(const char *devname, int *node)
+{
+  // nvme namespaces hang off the controller, whose parent is the pci device
+  char buf[32];
+  int r = get_block_device_string_property(devname, "device/numa_node",
+					   buf, sizeof(buf));
+  if (r < 0) {
+    r = get_block_device_string_property(devname, "device/device/numa_node",
+					 buf, sizeof(buf));
+  }
+  if (r < 0) {
+    return r;
+  }
+  char *endptr = 0;
+  long n = strtol(buf, &endptr, 10);
+  if (endptr == buf || *endptr) {
+    return -EINVAL;
+  }
+  if (n < 0) {
+    // the platform did not report an affinity
+    return -ENOENT;
+  }
+  *node = n;
+  return 0;
+}
+
 int get_device_by_fd(int fd, char *partition, char *device, size_t max)
 {
   struct stat st;
@@ -474,6 +500,11 @@ bool block_device_is_rotational(const char *devname)
   return false;
 }
 
+int block_device_numa_node(const char *devname, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
 void get_dm_parents(const std::string& dev, std::set<std::string> *ls)
 {
 }
@@ -519,6 +550,11 @@ bool block_device_is_rotational(const char *devname)
   return false;
 }
 
+int block_device_numa_node(const char *devname, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
 int get_device_by_fd(int fd, char *partition, char *device, size_t max)
 {
   return -EOPNOTSUPP;
@@ -570,6 +606,11 @@ bool block_device_is_rotational(const char *devname)
   return false;
 }
 
+int block_device_numa_node(const char *devname, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
 int get_device_by_fd(int fd, char *partition, char *device, size_t max)
 {
   return -EOPNOTSUPP;
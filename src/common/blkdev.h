@@ -26,6 +26,7 @@ extern bool block_device_is_rotational(const char *devname);
 extern int block_device_vendor(const char *devname, char *vendor, size_t max);
 extern int block_device_model(const char *devname, char *model, size_t max);
 extern int block_device_serial(const char *devname, char *serial, size_t max);
+extern int block_device_numa_node(const char *devname, int *node);
 
 extern void get_dm_parents(const std::string& dev, std::set<std::string> *ls);
 extern std::string get_device_id(const std::string& devname);
@@ -2453,6 +2453,52 @@ __u32 buffer::list::crc32c(__u32 crc) const
   return crc;
 }
 
+void buffer::list::crc32c_multi(unsigned n, const list * const *ls,
+				uint32_t *crcs)
+{
+  // lists held in a single buffer whose crc isn't cached go through
+  // the multi-buffer crc together; everything else (and any caching
+  // of partial results) is left to crc32c().
+  static constexpr unsigned MAX = 8;
+  unsigned char const *data[MAX];
+  unsigned length[MAX];
+  uint32_t crc[MAX];
+  unsigned which[MAX];
+  unsigned batch = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    const list *l = ls[i];
+    if (batch < MAX && l->_buffers.size() == 1 && l->length()) {
+      const ptr& p = l->_buffers.front();
+      pair<size_t, size_t> ofs(p.offset(), p.offset() + p.length());
+      pair<uint32_t, uint32_t> ccrc;
+      if (!p.get_raw()->get_crc(ofs, &ccrc)) {
+	data[batch] = (unsigned char*)p.c_str();
+	length[batch] = p.length();
+	crc[batch] = crcs[i];
+	which[batch] = i;
+	++batch;
+	continue;
+      }
+    }
+    crcs[i] = l->crc32c(crcs[i]);
+  }
+  if (!batch) {
+    return;
+  }
+  uint32_t base[MAX];
+  std::copy(crc, crc + batch, base);
+  ceph_crc32c_multi(crc, data, length, batch);
+  for (unsigned j = 0; j < batch; ++j) {
+    const ptr& p = ls[which[j]]->_buffers.front();
+    pair<size_t, size_t> ofs(p.offset(), p.offset() + p.length());
+    p.get_raw()->set_crc(ofs, make_pair(base[j], crc[j]));
+    crcs[which[j]] = crc[j];
+  }
+  if (buffer_track_crc) {
+    buffer_missed_crc += batch;
+  }
+}
+
 void buffer::list::invalidate_crc()
 {
   for (std::list<ptr>::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
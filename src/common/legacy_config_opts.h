@@ -397,6 +397,8 @@ OPTION(objecter_completion_locks_per_session, OPT_U64) // num of completion lock
 OPTION(objecter_inject_no_watch_ping, OPT_BOOL)   // suppress watch pings
 OPTION(objecter_retry_writes_after_first_reply, OPT_BOOL)   // ignore the first reply for each write, and resend the osd op instead
 OPTION(objecter_debug_inject_relock_delay, OPT_BOOL)
+OPTION(objecter_ec_direct_reads, OPT_BOOL) // read large objects of ec pools straight from the data shards
+OPTION(objecter_ec_direct_read_min_bytes, OPT_U64)
 
 // Max number of deletes at once in a single Filer::purge call
 OPTION(filer_max_purge_ops, OPT_U32)
@@ -621,6 +623,7 @@ OPTION(osd_op_num_threads_per_shard, OPT_INT)
 OPTION(osd_op_num_threads_per_shard_hdd, OPT_INT)
 OPTION(osd_op_num_threads_per_shard_ssd, OPT_INT)
 OPTION(osd_op_num_shards, OPT_INT)
+OPTION(osd_op_run_to_completion, OPT_BOOL)
 OPTION(osd_op_num_shards_hdd, OPT_INT)
 OPTION(osd_op_num_shards_ssd, OPT_INT)
 
@@ -665,6 +668,7 @@ OPTION(osd_ignore_stale_divergent_priors, OPT_BOOL) // do not assert on divergen
 // If set to true even after reading enough shards to
 // decode the object, any error will be reported.
 OPTION(osd_read_ec_check_for_errors, OPT_BOOL) // return error if any ec shard has an error
+OPTION(osd_ec_parity_delta_writes, OPT_BOOL) // update parity from data chunk deltas on small ec overwrites
 
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
@@ -735,11 +739,14 @@ OPTION(osd_scrub_backoff_ratio, OPT_DOUBLE)   // the probability to back off the
 OPTION(osd_scrub_chunk_min, OPT_INT)
 OPTION(osd_scrub_chunk_max, OPT_INT)
 OPTION(osd_scrub_sleep, OPT_FLOAT)   // sleep between [deep]scrub ops
+OPTION(osd_scrub_max_bytes_per_sec, OPT_U64)   // scrub read budget per osd, 0 for unlimited
 OPTION(osd_scrub_auto_repair, OPT_BOOL)   // whether auto-repair inconsistencies upon deep-scrubbing
 OPTION(osd_scrub_auto_repair_num_errors, OPT_U32)   // only auto-repair when number of errors is below this threshold
 OPTION(osd_deep_scrub_interval, OPT_FLOAT) // once a week
 OPTION(osd_deep_scrub_randomize_ratio, OPT_FLOAT) // scrubs will randomly become deep scrubs at this rate (0.15 -> 15% of scrubs are deep)
 OPTION(osd_deep_scrub_stride, OPT_INT)
+OPTION(osd_deep_scrub_incremental, OPT_BOOL)   // verify store checksums against recorded digests
+OPTION(osd_deep_scrub_incremental_max_age, OPT_FLOAT) // hash all data at least this often
 OPTION(osd_deep_scrub_keys, OPT_INT)
 OPTION(osd_deep_scrub_update_digest_min_age, OPT_INT)   // objects must be this old (seconds) before we update the whole-object digest on scrub
 OPTION(osd_skip_data_digest, OPT_BOOL)
@@ -844,6 +851,7 @@ OPTION(rocksdb_collect_compaction_stats, OPT_BOOL) //For rocksdb, this behavior
 OPTION(rocksdb_collect_extended_stats, OPT_BOOL) //For rocksdb, this behavior will be an overhead of 5%~10%, collected only rocksdb_perf is enabled.
 OPTION(rocksdb_collect_memory_stats, OPT_BOOL) //For rocksdb, this behavior will be an overhead of 5%~10%, collected only rocksdb_perf is enabled.
 OPTION(rocksdb_enable_rmrange, OPT_BOOL) // see https://github.com/facebook/rocksdb/blob/master/include/rocksdb/db.h#L253
+OPTION(rocksdb_delete_range_threshold, OPT_U64)
 
 // rocksdb options that will be used for omap(if omap_backend is rocksdb)
 OPTION(filestore_rocksdb_options, OPT_STR)
@@ -915,6 +923,7 @@ OPTION(osd_discard_disconnected_ops, OPT_BOOL)
 OPTION(memstore_device_bytes, OPT_U64)
 OPTION(memstore_page_set, OPT_BOOL)
 OPTION(memstore_page_size, OPT_U64)
+OPTION(memstore_finisher_shards, OPT_U64)
 
 OPTION(bdev_debug_inflight_ios, OPT_BOOL)
 OPTION(bdev_inject_crash, OPT_INT)  // if N>0, then ~ 1/N IOs will complete before we crash on flush.
@@ -923,6 +932,9 @@ OPTION(bdev_aio, OPT_BOOL)
 OPTION(bdev_aio_poll_ms, OPT_INT)  // milliseconds
 OPTION(bdev_aio_max_queue_depth, OPT_INT)
 OPTION(bdev_aio_reap_max, OPT_INT)
+OPTION(bdev_ioring, OPT_BOOL)
+OPTION(bdev_ioring_hipri, OPT_BOOL)
+OPTION(bdev_ioring_sqthread_poll, OPT_BOOL)
 OPTION(bdev_block_size, OPT_INT)
 OPTION(bdev_debug_aio, OPT_BOOL)
 OPTION(bdev_debug_aio_suicide_timeout, OPT_FLOAT)
@@ -1005,6 +1017,18 @@ OPTION(bluestore_gc_enable_blob_threshold, OPT_INT)
  * 
  */
 OPTION(bluestore_gc_enable_total_threshold, OPT_INT)  
+OPTION(bluestore_defrag_enable, OPT_BOOL)
+OPTION(bluestore_defrag_interval, OPT_DOUBLE)
+OPTION(bluestore_defrag_min_score, OPT_DOUBLE)
+OPTION(bluestore_defrag_max_object_size, OPT_U64)
+OPTION(bluestore_defrag_bytes_per_sec, OPT_U64)
+OPTION(bluestore_defrag_busy_bytes, OPT_U64)
+OPTION(bluestore_inline_data_max_size, OPT_U32)
+OPTION(bluestore_tier_placement, OPT_BOOL)
+OPTION(bluestore_tier_fast_zone_ratio, OPT_FLOAT)
+OPTION(bluestore_tier_hot_threshold, OPT_U32)
+OPTION(bluestore_tier_decay_interval, OPT_U32)
+OPTION(bluestore_tier_migrate_max_bytes, OPT_U64)
 
 OPTION(bluestore_max_blob_size, OPT_U32)
 OPTION(bluestore_max_blob_size_hdd, OPT_U32)
@@ -1015,7 +1039,11 @@ OPTION(bluestore_max_blob_size_ssd, OPT_U32)
  * And ask for compressing at least 12.5%(1/8) off, by default.
  */
 OPTION(bluestore_compression_required_ratio, OPT_DOUBLE)
+OPTION(bluestore_compression_sample_bytes, OPT_U64)
+OPTION(bluestore_compression_entropy_max, OPT_DOUBLE)
+OPTION(bluestore_compression_skip_after_rejects, OPT_U32)
 OPTION(bluestore_extent_map_shard_max_size, OPT_U32)
+OPTION(bluestore_onode_delta_max, OPT_U32)
 OPTION(bluestore_extent_map_shard_target_size, OPT_U32)
 OPTION(bluestore_extent_map_shard_min_size, OPT_U32)
 OPTION(bluestore_extent_map_shard_target_size_slop, OPT_DOUBLE)
@@ -1030,8 +1058,11 @@ OPTION(bluestore_cache_size_hdd, OPT_U64)
 OPTION(bluestore_cache_size_ssd, OPT_U64)
 OPTION(bluestore_cache_meta_ratio, OPT_DOUBLE)
 OPTION(bluestore_cache_kv_ratio, OPT_DOUBLE)
+OPTION(bluestore_cache_priority_meta_ratio, OPT_DOUBLE)
+OPTION(bluestore_cache_priority_data_ratio, OPT_DOUBLE)
 OPTION(bluestore_kvbackend, OPT_STR)
 OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap
+OPTION(bluestore_alloc_snapshot, OPT_BOOL)
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT)
 OPTION(bluestore_bitmapallocator_blocks_per_zone, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_bitmapallocator_span_size, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
@@ -1043,7 +1074,10 @@ OPTION(bluestore_fsck_on_umount, OPT_BOOL)
 OPTION(bluestore_fsck_on_umount_deep, OPT_BOOL)
 OPTION(bluestore_fsck_on_mkfs, OPT_BOOL)
 OPTION(bluestore_fsck_on_mkfs_deep, OPT_BOOL)
+OPTION(bluestore_fsck_threads, OPT_U32)
 OPTION(bluestore_sync_submit_transaction, OPT_BOOL) // submit kv txn in queueing thread (not kv_sync_thread)
+OPTION(bluestore_kv_sync_lanes, OPT_U32)
+OPTION(bluestore_kv_numa_affinity, OPT_BOOL)
 OPTION(bluestore_throttle_bytes, OPT_U64)
 OPTION(bluestore_throttle_deferred_bytes, OPT_U64)
 OPTION(bluestore_throttle_cost_per_io_hdd, OPT_U64)
@@ -1052,6 +1086,8 @@ OPTION(bluestore_throttle_cost_per_io, OPT_U64)
 OPTION(bluestore_deferred_batch_ops, OPT_U64)
 OPTION(bluestore_deferred_batch_ops_hdd, OPT_U64)
 OPTION(bluestore_deferred_batch_ops_ssd, OPT_U64)
+OPTION(bluestore_deferred_coalesce_hdd, OPT_BOOL)
+OPTION(bluestore_deferred_coalesce_ssd, OPT_BOOL)
 OPTION(bluestore_nid_prealloc, OPT_INT)
 OPTION(bluestore_blobid_prealloc, OPT_U64)
 OPTION(bluestore_clone_cow, OPT_BOOL)  // do copy-on-write for clones
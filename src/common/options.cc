@@ -1986,6 +1986,17 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("objecter_ec_direct_reads", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Read large objects of erasure coded pools directly from the data shards")
+    .set_long_description("Plain reads of at least objecter_ec_direct_read_min_bytes from an erasure coded pool fetch the data chunks from each data shard OSD and reassemble them in the client, instead of going through the primary. The read falls back to the primary if a data shard is unavailable, degraded, has uncommitted writes to the object, or disagrees on the object version, and when this client has a write to the object in flight. Reads with a truncate_seq always go through the primary, as do reads from PGs with an acting OSD that does not advertise the OSD_EC_DIRECT_READ feature.")
+    .add_see_also("objecter_ec_direct_read_min_bytes"),
+
+    Option("objecter_ec_direct_read_min_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(1_M)
+    .set_description("Minimum read size for objecter_ec_direct_reads")
+    .add_see_also("objecter_ec_direct_reads"),
+
     Option("filer_max_purge_ops", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description("Max in-flight operations for purging a striped range (e.g., MDS journal)"),
@@ -2385,6 +2396,12 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_STARTUP)
     .set_description(""),
 
+    Option("osd_op_run_to_completion", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Execute simple client reads inline on the messenger thread")
+    .set_long_description("If enabled, a client op that only reads (stat, read, getxattr, omap reads) is executed on the messenger thread that received it, instead of being queued for an op worker, provided that the PG is active+clean, its lock is uncontended and nothing else is queued on its op shard.  Otherwise the op is queued as usual.  This saves a thread wakeup and context switch per read on fast devices.")
+    .add_see_also("osd_op_queue"),
+
     Option("osd_skip_data_digest", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Do not store full-object checksums if the backend (bluestore) does its own checksums.  Only usable with all BlueStore OSDs."),
@@ -2868,6 +2885,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Update parity from the modified data chunks on small partial-stripe overwrites of erasure coded objects")
+    .set_long_description("When the erasure code plugin supports it and a partial overwrite modifies few enough data chunks of a stripe, read and write only those chunks and the coding chunks instead of reading and rewriting the whole stripe."),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -3113,6 +3135,12 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description("Duration to inject a delay during scrubbing"),
 
+    Option("osd_scrub_max_bytes_per_sec", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Maximum rate at which an OSD reads object data for scrub (0 for no limit)")
+    .set_long_description("The budget is shared by all PGs scrubbing on the OSD.  A PG that overdraws it is requeued once enough time has passed instead of reading the rest of its chunk right away.")
+    .add_see_also("osd_scrub_sleep"),
+
     Option("osd_scrub_auto_repair", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description("Automatically repair damaged objects detected during scrub"),
@@ -3140,6 +3168,18 @@ std::vector<Option> get_global_options() {
     .set_default(512_K)
     .set_description("Number of bytes to read from an object at a time during deep scrub"),
 
+    Option("osd_deep_scrub_incremental", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Verify object store checksums instead of hashing object data during deep scrub")
+    .set_long_description("For objects with a digest recorded at write time (the object_info data digest, or the chunk hashes of an erasure coded object), deep scrub asks the object store to check the data against its own checksums and reports the recorded digest instead of reading and hashing the data.  Objects without a recorded digest, or that the store keeps no checksums for, are read in full as before.  A deep scrub still reads and hashes everything once osd_deep_scrub_incremental_max_age has passed since the last one that did, and when repairing.")
+    .add_see_also({"osd_deep_scrub_stride", "osd_deep_scrub_incremental_max_age"}),
+
+    Option("osd_deep_scrub_incremental_max_age", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(28_day)
+    .set_description("Read and hash all object data in a deep scrub at least this often (seconds), even with osd_deep_scrub_incremental (0 for never)")
+    .set_long_description("Store checksums only show that the data is what the store wrote; they cannot catch data that no longer matches the recorded digest, e.g. because of a bug above the store.  Once this much time has passed since a PG's last full deep scrub, its next deep scrub hashes everything.")
+    .add_see_also("osd_deep_scrub_incremental"),
+
     Option("osd_deep_scrub_keys", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(1024)
     .set_description("Number of keys to read from an object at a time during deep scrub"),
@@ -3521,7 +3561,13 @@ std::vector<Option> get_global_options() {
 
     Option("rocksdb_enable_rmrange", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
-    .set_description(""),
+    .set_description("Always delete key ranges with a single range tombstone")
+    .add_see_also("rocksdb_delete_range_threshold"),
+
+    Option("rocksdb_delete_range_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1_M)
+    .set_description("Delete a key range with a range tombstone rather than key by key once it holds more than this many keys")
+    .set_long_description("Removing a large omap (e.g., a bucket index shard, or an object holding one) key by key puts every key through the memtable and leaves a tombstone per key for compaction.  Above this many keys a single DeleteRange is used instead."),
 
     Option("rocksdb_bloom_bits_per_key", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(20)
@@ -3705,6 +3751,11 @@ std::vector<Option> get_global_options() {
     .set_default(64_K)
     .set_description(""),
 
+    Option("memstore_finisher_shards", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_description("Number of threads completing memstore transactions")
+    .set_long_description("Completions of a collection are always queued to the same thread, so they stay in order."),
+
     Option("objectstore_blackhole", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -3740,6 +3791,21 @@ std::vector<Option> get_global_options() {
     .set_default(16)
     .set_description(""),
 
+    Option("bdev_ioring", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use the Linux io_uring API instead of libaio for block device IO")
+    .set_long_description("The block device fds are registered with the ring and all aios of a batch are submitted with a single syscall. Falls back to libaio if ceph was built without liburing or the kernel does not support io_uring."),
+
+    Option("bdev_ioring_hipri", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use polled IO completions (IORING_SETUP_IOPOLL) with io_uring")
+    .add_see_also("bdev_ioring"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Offload io_uring submission to a kernel polling thread (IORING_SETUP_SQPOLL)")
+    .add_see_also("bdev_ioring"),
+
     Option("bdev_block_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description(""),
@@ -3810,6 +3876,7 @@ std::vector<Option> get_global_options() {
 
     Option("bluefs_allocator", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("bitmap")
+    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid"})
     .set_description(""),
 
     Option("bluefs_preextend_wal_files", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
@@ -4031,6 +4098,74 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description(""),
 
+    Option("bluestore_defrag_enable", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Periodically rewrite fragmented objects in the background")
+    .set_long_description("A background thread scans all objects, scores how fragmented their data is on disk and rewrites those above bluestore_defrag_min_score so that their data becomes contiguous again.  A pass can also be started and stopped via the 'bluestore defrag' admin socket commands.")
+    .add_see_also({"bluestore_defrag_interval", "bluestore_defrag_min_score", "bluestore_defrag_bytes_per_sec"}),
+
+    Option("bluestore_defrag_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(86400)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Seconds between the end of a defragmentation pass and the start of the next"),
+
+    Option("bluestore_defrag_min_score", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(8)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Rewrite objects whose data is in at least this many times more disk extents than necessary"),
+
+    Option("bluestore_defrag_max_object_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(16_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Objects larger than this are not defragmented"),
+
+    Option("bluestore_defrag_bytes_per_sec", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(8_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Max rate at which the defragmenter rewrites data"),
+
+    Option("bluestore_defrag_busy_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(4_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Pause defragmentation while more than this many bytes of transactions are in flight (0 never pauses)"),
+
+    Option("bluestore_inline_data_max_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Store data of objects up to this size in the onode instead of in blobs (0 disables)")
+    .set_long_description("Small objects then need no allocation and no device I/O of their own; their data is read and written with the onode key.  An object that grows past this size is moved to blobs.  Turning it on from 0 takes effect at the next mount, which raises the store's min_compat_ondisk_format; from then on releases that do not know about inline data refuse to mount the store."),
+
+    Option("bluestore_tier_placement", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Place data of hot objects at the start of the main device")
+    .set_long_description("Track a decaying read and write count per object.  Writes to objects above bluestore_tier_hot_threshold allocate from the fast zone at the start of the main device (outer tracks on HDDs), other writes from past it.  The defrag thread periodically moves extents that sit in the wrong zone for their object's heat, so objects that are only read also move.  Data never leaves the main device; the DB device is not used as a tier.  The avl and hybrid allocators ignore the hint once they switch to best-fit.")
+    .add_see_also({"bluestore_tier_fast_zone_ratio", "bluestore_tier_hot_threshold", "bluestore_tier_migrate_max_bytes", "bluestore_defrag_interval"}),
+
+    Option("bluestore_tier_fast_zone_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.1)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Fraction of the main device, from its start, treated as the fast zone")
+    .add_see_also("bluestore_tier_placement"),
+
+    Option("bluestore_tier_hot_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Decayed access count at which an object is considered hot")
+    .add_see_also("bluestore_tier_decay_interval"),
+
+    Option("bluestore_tier_decay_interval", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(60)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Seconds after which an object's access count is halved"),
+
+    Option("bluestore_tier_migrate_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Max bytes around a write rewritten to the zone matching the object's heat (0 leaves migration to the defrag thread)")
+    .add_see_also("bluestore_tier_placement"),
+
     Option("bluestore_max_blob_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4052,6 +4187,26 @@ std::vector<Option> get_global_options() {
     .set_description("Compression ratio required to store compressed data")
     .set_long_description("If we compress data and get less than this we discard the result and store the original uncompressed data."),
 
+    Option("bluestore_compression_sample_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(4_K)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Bytes sampled to estimate the entropy of a blob before compressing it")
+    .set_long_description("Before compressing a blob, BlueStore estimates its entropy from this many bytes spread across it and leaves it uncompressed if the estimate exceeds bluestore_compression_entropy_max.  0 disables the estimate.")
+    .add_see_also("bluestore_compression_entropy_max"),
+
+    Option("bluestore_compression_entropy_max", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(7.8)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Estimated entropy (bits per byte) above which data is not compressed")
+    .set_long_description("Encrypted or already compressed data samples at close to 8 bits per byte.")
+    .add_see_also("bluestore_compression_sample_bytes"),
+
+    Option("bluestore_compression_skip_after_rejects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Stop compressing an object after this many consecutive blobs did not compress")
+    .set_long_description("Once this many blobs of an object in a row were not worth compressing, further blobs of that object are written uncompressed, except for an occasional probe.  A blob that compresses well resets the count.  0 disables this."),
+
     Option("bluestore_extent_map_shard_max_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(1200)
     .set_description("Max size (bytes) for a single extent map shard before splitting"),
@@ -4072,6 +4227,11 @@ std::vector<Option> get_global_options() {
     .set_default(256)
     .set_description("Preallocated buffer for inline shards"),
 
+    Option("bluestore_onode_delta_max", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(0)
+    .set_description("Max consecutive shard-only updates of a sharded onode before its key is rewritten")
+    .set_long_description("When an update to a sharded onode changes nothing but extent map shards, only the dirty shard keys are written and the onode key is left with stale shard size hints.  After this many such updates in a row the full onode is written again.  0 always writes the full onode.  Releases that predate this option assert on a stale shard size hint, so once it has been enabled the OSD cannot be downgraded to one of them."),
+
     Option("bluestore_cache_trim_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(.05)
     .set_description("How frequently we trim the bluestore cache"),
@@ -4116,6 +4276,17 @@ std::vector<Option> get_global_options() {
     .add_see_also("bluestore_cache_size")
     .set_description("Ratio of bluestore cache to devote to kv database (rocksdb)"),
 
+    Option("bluestore_cache_priority_meta_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.1)
+    .add_see_also("bluestore_cache_meta_ratio")
+    .set_description("Ratio of bluestore cache reserved for metadata of pools with cache_priority set")
+    .set_long_description("Onodes of pools with a non-zero cache_priority pool option live in their own cache shards.  This much of the cache is handed to them before any other cache is sized, so that scans of bulk data pools cannot evict them.  Any part of the reservation they do not use goes back to the other caches."),
+
+    Option("bluestore_cache_priority_data_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.05)
+    .add_see_also("bluestore_cache_priority_meta_ratio")
+    .set_description("Ratio of bluestore cache reserved for data buffers of pools with cache_priority set"),
+
     Option("bluestore_cache_autotune", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .add_see_also("bluestore_cache_size")
@@ -4139,8 +4310,30 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("bitmap")
-    .set_enum_allowed({"bitmap", "stupid"})
-    .set_description("Allocator policy"),
+    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid"})
+    .set_description("Allocator policy")
+    .set_long_description("Allocator to use for bluestore.  Stupid should only be used for testing; avl keeps free extents in an offset and a size ordered tree; hybrid is avl with a bounded memory footprint that spills the smallest free extents into a bitmap."),
+
+    Option("bluestore_alloc_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Persist allocator state on clean shutdown to speed up the next mount")
+    .set_long_description("On clean umount the allocator's free extents are written to a checksummed BlueFS file, which the next mount loads with a single sequential read instead of walking the whole freelist in the key/value store.  The file is removed as soon as it is loaded, so after an unclean shutdown the freelist is walked as before.  Only used when BlueFS is enabled."),
+
+    Option("bluestore_avl_alloc_bf_threshold", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(128_K)
+    .set_description("Sets threshold at which shrinking max free chunk size triggers enabling best-fit mode.")
+    .set_long_description("AVL allocator works in two modes: near-fit and best-fit. By default, it uses very fast near-fit mode, in which it tries to fit a new block near the last allocated block of similar size. The second mode is much slower best-fit mode, in which it tries to find an exact match for the requested allocation. This mode is used when either the device gets fragmented or when it is low on free space. When the largest free block is smaller than 'bluestore_avl_alloc_bf_threshold', best-fit mode is used.")
+    .add_see_also("bluestore_avl_alloc_bf_free_pct"),
+
+    Option("bluestore_avl_alloc_bf_free_pct", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4)
+    .set_description("Sets threshold at which shrinking free space (in %, integer) triggers enabling best-fit mode.")
+    .set_long_description("When free space is below 'bluestore_avl_alloc_bf_free_pct' percent of the device, the AVL allocator switches to best-fit mode.")
+    .add_see_also("bluestore_avl_alloc_bf_threshold"),
+
+    Option("bluestore_hybrid_alloc_mem_cap", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(64_M)
+    .set_description("Maximum RAM hybrid allocator should use before enabling bitmap supplement"),
 
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(128)
@@ -4167,8 +4360,9 @@ std::vector<Option> get_global_options() {
     .set_description("Enable use of rocksdb column families for bluestore metadata"),
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
-    .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_default("M(3,0-8)= P= L= O(3,0-13)=")
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("A name of the form P(n) or P(n,l-h) hashes the keys of prefix P over n column families, using key bytes [l,h).  The omap (M) keys are hashed by object id and the onode (O) keys by pool and placement hash.  This only applies to new stores; use ceph-bluestore-tool reshard to change an existing one."),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4194,10 +4388,29 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Run deep fsck after mkfs"),
 
+    Option("bluestore_fsck_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min(1)
+    .set_description("Number of threads checking objects during fsck")
+    .set_long_description("The onode keyspace is still iterated by a single thread which hands out batches of objects to the checking threads; extent, nid and omap usage is tracked per thread and merged once the walk completes.")
+    .add_see_also("bluestore_fsck_on_mount"),
+
     Option("bluestore_sync_submit_transaction", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_sync_lanes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min(1)
+    .set_description("Number of threads submitting metadata transactions to rocksdb")
+    .set_long_description("With more than one lane, transactions are partitioned by collection across lanes that submit to rocksdb concurrently, letting rocksdb batch them into shared write groups, while a single kv_sync thread issues the final synchronous commit. One lane keeps all submission in the kv_sync thread.")
+    .add_see_also("bluestore_sync_submit_transaction"),
+
+    Option("bluestore_kv_numa_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Bind kv commit threads to the numa node of the main block device")
+    .set_long_description("The kv_sync, kv_finalize and kv submit lane threads are restricted to the cpus of the numa node the main device is attached to, so that the transaction state they touch (and allocate) stays local to that node."),
+
     Option("bluestore_throttle_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4239,6 +4452,15 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Default bluestore_deferred_batch_ops for non-rotational (solid state) media"),
 
+    Option("bluestore_deferred_coalesce_hdd", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Batch deferred writes of all collections together on rotational media")
+    .set_long_description("Instead of flushing deferred writes per collection, collect them in a single batch so that overlapping and adjacent extents from different collections are merged and each flush is issued in LBA order."),
+
+    Option("bluestore_deferred_coalesce_ssd", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Batch deferred writes of all collections together on non-rotational (solid state) media"),
+
     Option("bluestore_nid_prealloc", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(1024)
     .set_description("Number of unique object ids to preallocate at a time"),
@@ -0,0 +1,159 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <string.h>
+
+#include "xxhash.h"
+#include "arch/intel.h"
+#include "common/xxhash_multi.h"
+
+#ifdef __x86_64__
+
+#include <immintrin.h>
+
+#define PRIME32_1 2654435761U
+#define PRIME32_2 2246822519U
+#define PRIME32_3 3266489917U
+#define PRIME32_4 668265263U
+#define PRIME32_5 374761393U
+
+#define XXH_STRIPE 16
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t load32(unsigned char const *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/*
+ * everything after the stripe loop, as XXH32 does it: merge the four
+ * accumulators, then the < 16 byte tail, then the avalanche.
+ */
+static uint32_t xxh32_finish(const uint32_t *acc,
+			     unsigned char const *p, unsigned length)
+{
+  uint32_t h = rotl32(acc[0], 1) + rotl32(acc[1], 7) +
+    rotl32(acc[2], 12) + rotl32(acc[3], 18);
+  unsigned left = length % XXH_STRIPE;
+  h += length;
+  p += length - left;
+  for (; left >= 4; left -= 4, p += 4) {
+    h += load32(p) * PRIME32_3;
+    h = rotl32(h, 17) * PRIME32_4;
+  }
+  for (; left; --left, ++p) {
+    h += (*p) * PRIME32_5;
+    h = rotl32(h, 11) * PRIME32_1;
+  }
+  h ^= h >> 15;
+  h *= PRIME32_2;
+  h ^= h >> 13;
+  h *= PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i xxh32_round_x2(__m256i acc, unsigned char const *a,
+				     unsigned char const *b)
+{
+  const __m256i prime1 = _mm256_set1_epi32(PRIME32_1);
+  const __m256i prime2 = _mm256_set1_epi32(PRIME32_2);
+  __m256i in = _mm256_inserti128_si256(
+    _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)a)),
+    _mm_loadu_si128((const __m128i *)b), 1);
+  acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(in, prime2));
+  acc = _mm256_or_si256(_mm256_slli_epi32(acc, 13),
+			_mm256_srli_epi32(acc, 32 - 13));
+  return _mm256_mullo_epi32(acc, prime1);
+}
+
+/*
+ * Each 256-bit register holds the four 32-bit accumulators of two
+ * buffers, so a stripe of each is a single unaligned load per buffer
+ * and no transposition is needed.  Four registers in flight cover the
+ * latency of vpmulld.
+ */
+__attribute__((target("avx2")))
+static unsigned xxh32_multi_avx2(uint32_t seed,
+				 unsigned char const * const *data,
+				 unsigned length,
+				 unsigned n,
+				 uint32_t *out)
+{
+  const __m256i init = _mm256_setr_epi32(
+    seed + PRIME32_1 + PRIME32_2, seed + PRIME32_2, seed, seed - PRIME32_1,
+    seed + PRIME32_1 + PRIME32_2, seed + PRIME32_2, seed, seed - PRIME32_1);
+  unsigned stripes_end = length - length % XXH_STRIPE;
+  uint32_t acc[16] __attribute__((aligned(32)));
+  unsigned i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v0 = init, v1 = init, v2 = init, v3 = init;
+    for (unsigned off = 0; off < stripes_end; off += XXH_STRIPE) {
+      v0 = xxh32_round_x2(v0, data[i] + off, data[i + 1] + off);
+      v1 = xxh32_round_x2(v1, data[i + 2] + off, data[i + 3] + off);
+      v2 = xxh32_round_x2(v2, data[i + 4] + off, data[i + 5] + off);
+      v3 = xxh32_round_x2(v3, data[i + 6] + off, data[i + 7] + off);
+    }
+    _mm256_store_si256((__m256i *)acc, v0);
+    out[i] = xxh32_finish(acc, data[i], length);
+    out[i + 1] = xxh32_finish(acc + 4, data[i + 1], length);
+    _mm256_store_si256((__m256i *)acc, v1);
+    out[i + 2] = xxh32_finish(acc, data[i + 2], length);
+    out[i + 3] = xxh32_finish(acc + 4, data[i + 3], length);
+    _mm256_store_si256((__m256i *)acc, v2);
+    out[i + 4] = xxh32_finish(acc, data[i + 4], length);
+    out[i + 5] = xxh32_finish(acc + 4, data[i + 5], length);
+    _mm256_store_si256((__m256i *)acc, v3);
+    out[i + 6] = xxh32_finish(acc, data[i + 6], length);
+    out[i + 7] = xxh32_finish(acc + 4, data[i + 7], length);
+  }
+  for (; i + 2 <= n; i += 2) {
+    __m256i v = init;
+    for (unsigned off = 0; off < stripes_end; off += XXH_STRIPE) {
+      v = xxh32_round_x2(v, data[i] + off, data[i + 1] + off);
+    }
+    _mm256_store_si256((__m256i *)acc, v);
+    out[i] = xxh32_finish(acc, data[i], length);
+    out[i + 1] = xxh32_finish(acc + 4, data[i + 1], length);
+  }
+  return i;
+}
+
+#endif
+
+void ceph_xxhash32_multi(uint32_t seed,
+			 unsigned char const * const *data,
+			 unsigned length,
+			 unsigned n,
+			 uint32_t *out)
+{
+  unsigned i = 0;
+#ifdef __x86_64__
+  // short inputs skip the stripe loop entirely; nothing to vectorize
+  if (ceph_arch_intel_avx2 && length >= XXH_STRIPE && n >= 2) {
+    i = xxh32_multi_avx2(seed, data, length, n, out);
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = XXH32(data[i], length, seed);
+  }
+}
+
+void ceph_xxhash64_multi(uint64_t seed,
+			 unsigned char const * const *data,
+			 unsigned length,
+			 unsigned n,
+			 uint64_t *out)
+{
+  for (unsigned i = 0; i < n; ++i) {
+    out[i] = XXH64(data[i], length, seed);
+  }
+}
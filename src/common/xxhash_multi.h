@@ -0,0 +1,43 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_COMMON_XXHASH_MULTI_H
+#define CEPH_COMMON_XXHASH_MULTI_H
+
+#include "include/int_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * xxhash32 of several buffers of the same length at once
+ *
+ * Same as out[i] = XXH32(data[i], length, seed) for each i < n.  With
+ * AVX2 the main loop runs two buffers per vector register and four
+ * registers at a time.
+ */
+extern void ceph_xxhash32_multi(uint32_t seed,
+				unsigned char const * const *data,
+				unsigned length,
+				unsigned n,
+				uint32_t *out);
+
+/**
+ * xxhash64 of several buffers of the same length at once
+ *
+ * Same as out[i] = XXH64(data[i], length, seed) for each i < n.  AVX2
+ * has no 64-bit multiply, so this is a plain loop for now; it exists
+ * so that callers can batch regardless of the hash.
+ */
+extern void ceph_xxhash64_multi(uint64_t seed,
+				unsigned char const * const *data,
+				unsigned length,
+				unsigned n,
+				uint64_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,6 +12,7 @@
  *
  */
 
+#include <cmath>
 #include <random>
 #include <sstream>
 #include <iterator>
@@ -100,3 +101,52 @@ CompressorRef Compressor::create(CephContext *cct, int alg)
   std::string type_name = get_comp_alg_name(alg);
   return create(cct, type_name);
 }
+
+double Compressor::estimate_entropy(const ceph::bufferlist &in,
+				    size_t sample_bytes)
+{
+  // sample short runs rather than single bytes so that we still see
+  // the local structure (repeated words, runs of zeros) compressors
+  // feed on
+  static constexpr size_t RUN = 64;
+  const size_t len = in.length();
+  if (len == 0 || sample_bytes == 0) {
+    return 0;
+  }
+  size_t runs = std::max<size_t>(1, std::min(len, sample_bytes) / RUN);
+  size_t stride = len / runs;
+  size_t run = std::min(RUN, len);
+
+  uint32_t hist[256] = {0};
+  size_t total = 0;
+  auto p = in.begin();
+  size_t pos = 0;
+  for (size_t i = 0; i < runs; ++i) {
+    size_t off = i * stride;
+    if (off + run > len) {
+      off = len - run;
+    }
+    p.advance(off - pos);
+    pos = off;
+    size_t want = run;
+    while (want) {
+      const char *d;
+      size_t got = p.get_ptr_and_advance(want, &d);
+      for (size_t j = 0; j < got; ++j) {
+	++hist[(unsigned char)d[j]];
+      }
+      want -= got;
+      pos += got;
+    }
+    total += run;
+  }
+
+  double entropy = 0;
+  for (auto c : hist) {
+    if (c) {
+      double f = (double)c / total;
+      entropy -= f * std::log2(f);
+    }
+  }
+  return entropy;
+}
@@ -97,6 +97,21 @@ public:
   static CompressorRef create(CephContext *cct, const std::string &type);
   static CompressorRef create(CephContext *cct, int alg);
 
+  /**
+   * estimate the Shannon entropy of the input, in bits per byte
+   *
+   * Only up to sample_bytes are looked at, taken as short runs spread
+   * evenly across the buffer, so the cost is independent of the input
+   * size.  Values close to 8 indicate random (encrypted, already
+   * compressed) data that no compressor will do much with.
+   *
+   * @param in data to look at
+   * @param sample_bytes upper bound on the number of bytes sampled
+   * @return estimated entropy in [0, 8]; 0 for empty input
+   */
+  static double estimate_entropy(const ceph::bufferlist &in,
+				 size_t sample_bytes);
+
 protected:
   CompressionAlgorithm alg;
   std::string type;
@@ -16,6 +16,7 @@
  */
 
 #include <errno.h>
+#include <string.h>
 #include <algorithm>
 
 #include "ErasureCode.h"
@@ -346,3 +347,37 @@ int ErasureCode::decode_concat(const map<int, bufferlist> &chunks,
   }
   return r;
 }
+
+int ErasureCode::encode_delta(const bufferlist &old_data,
+			      const bufferlist &new_data,
+			      bufferlist *delta)
+{
+  // subtraction is xor in GF(2^w), which all the codes supporting
+  // parity delta updates work in
+  if (old_data.length() != new_data.length())
+    return -EINVAL;
+  unsigned length = old_data.length();
+  bufferptr out(buffer::create_aligned(length, SIMD_ALIGN));
+  const char *o = const_cast<bufferlist&>(old_data).c_str();
+  const char *n = const_cast<bufferlist&>(new_data).c_str();
+  char *d = out.c_str();
+  unsigned i = 0;
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    uint64_t a, b;
+    memcpy(&a, o + i, sizeof(a));
+    memcpy(&b, n + i, sizeof(b));
+    a ^= b;
+    memcpy(d + i, &a, sizeof(a));
+  }
+  for (; i < length; i++)
+    d[i] = o[i] ^ n[i];
+  delta->clear();
+  delta->push_back(std::move(out));
+  return 0;
+}
+
+int ErasureCode::apply_delta(const map<int, bufferlist> &deltas,
+			     map<int, bufferlist> *coding)
+{
+  return -EOPNOTSUPP;
+}
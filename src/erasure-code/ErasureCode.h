@@ -120,6 +120,17 @@ namespace ceph {
     int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) override;
 
+    bool supports_parity_delta() const override {
+      return false;
+    }
+
+    int encode_delta(const bufferlist &old_data,
+		     const bufferlist &new_data,
+		     bufferlist *delta) override;
+
+    int apply_delta(const std::map<int, bufferlist> &deltas,
+		    std::map<int, bufferlist> *coding) override;
+
   protected:
     int parse(const ErasureCodeProfile &profile,
 	      std::ostream *ss);
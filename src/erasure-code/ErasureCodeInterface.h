@@ -459,6 +459,55 @@ namespace ceph {
      */
     virtual int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) = 0;
+
+    /**
+     * Return true if the coding chunks can be updated from the
+     * change made to some data chunks without reading the other
+     * data chunks, i.e. if **encode_delta** and **apply_delta** are
+     * implemented. This is the case for linear codes such as
+     * Reed-Solomon and allows a partial overwrite to read and write
+     * only the modified data chunks and the coding chunks.
+     *
+     * @return true if parity delta updates are supported
+     */
+    virtual bool supports_parity_delta() const = 0;
+
+    /**
+     * Compute in **delta** the change from **old_data** to
+     * **new_data**, the previous and new content of the same data
+     * chunk, in the form expected by **apply_delta**. Both buffers
+     * must have the same size.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] old_data previous content of the data chunk
+     * @param [in] new_data new content of the data chunk
+     * @param [out] delta change to pass to apply_delta
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_delta(const bufferlist &old_data,
+			     const bufferlist &new_data,
+			     bufferlist *delta) = 0;
+
+    /**
+     * Update the coding chunks found in **coding** in place so that
+     * they reflect the changes found in **deltas**, as computed by
+     * **encode_delta**. The **coding** map must contain every coding
+     * chunk index and all buffers of both maps must have the same
+     * size.
+     *
+     * Chunk indexes are those used by **encode_chunks**, before any
+     * remapping (see **get_chunk_mapping**).
+     *
+     * Returns 0 on success or -EOPNOTSUPP if
+     * **supports_parity_delta** is false.
+     *
+     * @param [in] deltas map data chunk indexes to their delta
+     * @param [in,out] coding map coding chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int apply_delta(const std::map<int, bufferlist> &deltas,
+			    std::map<int, bufferlist> *coding) = 0;
   };
 
   typedef std::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
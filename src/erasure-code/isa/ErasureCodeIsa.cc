@@ -131,6 +131,51 @@ ErasureCodeIsaDefault::isa_encode(char **data,
 
 // -----------------------------------------------------------------------------
 
+int
+ErasureCodeIsaDefault::apply_delta(const map<int, bufferlist> &deltas,
+                                   map<int, bufferlist> *coding)
+{
+  unsigned char *parity[m];
+  unsigned blocksize = 0;
+  for (int i = 0; i < m; i++) {
+    auto chunk = coding->find(k + i);
+    if (chunk == coding->end())
+      return -EINVAL;
+    if (i == 0)
+      blocksize = chunk->second.length();
+    else if (chunk->second.length() != blocksize)
+      return -EINVAL;
+    chunk->second.rebuild_aligned(EC_ISA_ADDRESS_ALIGNMENT);
+    parity[i] = (unsigned char*) chunk->second.c_str();
+  }
+
+  for (auto &&d : deltas) {
+    if (d.first < 0 || d.first >= k || d.second.length() != blocksize)
+      return -EINVAL;
+    bufferlist delta = d.second;
+    delta.rebuild_aligned(EC_ISA_ADDRESS_ALIGNMENT);
+    if (m == 1) {
+      // single parity stripe, see isa_encode
+      unsigned char *src[2] = {
+        parity[0], (unsigned char*) delta.c_str()
+      };
+      bufferptr out(buffer::create_aligned(blocksize,
+                                           EC_ISA_ADDRESS_ALIGNMENT));
+      region_xor(src, (unsigned char*) out.c_str(), 2, blocksize);
+      bufferlist &chunk = (*coding)[k];
+      chunk.clear();
+      chunk.push_back(std::move(out));
+      parity[0] = (unsigned char*) chunk.c_str();
+    } else {
+      ec_encode_data_update(blocksize, k, m, d.first, encode_tbls,
+                            (unsigned char*) delta.c_str(), parity);
+    }
+  }
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+
 bool
 ErasureCodeIsaDefault::erasure_contains(int *erasures, int i)
 {
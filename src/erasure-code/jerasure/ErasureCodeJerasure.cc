@@ -130,6 +130,49 @@ int ErasureCodeJerasure::decode_chunks(const set<int> &want_to_read,
   return jerasure_decode(erasures, data, coding, blocksize);
 }
 
+int ErasureCodeJerasure::matrix_apply_delta(const int *matrix,
+					    const map<int, bufferlist> &deltas,
+					    map<int, bufferlist> *coding)
+{
+  // coding chunk j is the sum over the data chunks i of
+  // matrix[j * k + i] * data[i], so a change to data chunk i adds
+  // matrix[j * k + i] * delta[i] to it
+  for (int j = k; j < k + m; j++) {
+    if (coding->find(j) == coding->end())
+      return -EINVAL;
+  }
+  for (auto &&d : deltas) {
+    if (d.first < 0 || d.first >= k)
+      return -EINVAL;
+    bufferlist delta = d.second;
+    delta.rebuild_aligned(SIMD_ALIGN);
+    for (int j = 0; j < m; j++) {
+      bufferlist &chunk = (*coding)[k + j];
+      if (chunk.length() != delta.length())
+	return -EINVAL;
+      chunk.rebuild_aligned(SIMD_ALIGN);
+      int multby = matrix[j * k + d.first];
+      switch (w) {
+      case 8:
+	galois_w08_region_multiply(delta.c_str(), multby, delta.length(),
+				   chunk.c_str(), 1);
+	break;
+      case 16:
+	galois_w16_region_multiply(delta.c_str(), multby, delta.length(),
+				   chunk.c_str(), 1);
+	break;
+      case 32:
+	galois_w32_region_multiply(delta.c_str(), multby, delta.length(),
+				   chunk.c_str(), 1);
+	break;
+      default:
+	return -EINVAL;
+      }
+    }
+  }
+  return 0;
+}
+
 bool ErasureCodeJerasure::is_prime(int value)
 {
   int prime55[] = {
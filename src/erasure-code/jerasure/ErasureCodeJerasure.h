@@ -77,6 +77,9 @@ public:
   static bool is_prime(int value);
 protected:
   virtual int parse(ErasureCodeProfile &profile, std::ostream *ss);
+  int matrix_apply_delta(const int *matrix,
+			 const std::map<int, bufferlist> &deltas,
+			 std::map<int, bufferlist> *coding);
 };
 
 class ErasureCodeJerasureReedSolomonVandermonde : public ErasureCodeJerasure {
@@ -105,6 +108,13 @@ public:
                                int blocksize) override;
   unsigned get_alignment() const override;
   void prepare() override;
+  bool supports_parity_delta() const override {
+    return true;
+  }
+  int apply_delta(const std::map<int, bufferlist> &deltas,
+		  std::map<int, bufferlist> *coding) override {
+    return matrix_apply_delta(matrix, deltas, coding);
+  }
 private:
   int parse(ErasureCodeProfile &profile, std::ostream *ss) override;
 };
@@ -134,6 +144,13 @@ public:
                                int blocksize) override;
   unsigned get_alignment() const override;
   void prepare() override;
+  bool supports_parity_delta() const override {
+    return true;
+  }
+  int apply_delta(const std::map<int, bufferlist> &deltas,
+		  std::map<int, bufferlist> *coding) override {
+    return matrix_apply_delta(matrix, deltas, coding);
+  }
 private:
   int parse(ErasureCodeProfile &profile, std::ostream *ss) override;
 };
@@ -937,6 +937,10 @@ namespace buffer CEPH_BUFFER_API {
       }
     }
     uint32_t crc32c(uint32_t crc) const;
+    /// crc32c of n independent lists at once; crcs[i] holds the initial
+    /// value for ls[i] on entry and its crc on return
+    static void crc32c_multi(unsigned n, const list * const *ls,
+			     uint32_t *crcs);
     void invalidate_crc();
 
     // These functions return a bufferlist with a pointer to a single
@@ -134,6 +134,7 @@ DEFINE_CEPH_FEATURE(42, 1, MSGR_KEEPALIVE2)
 DEFINE_CEPH_FEATURE(43, 1, OSD_POOLRESEND)
 DEFINE_CEPH_FEATURE_DEPRECATED(44, 1, ERASURE_CODE_PLUGINS_V2, MIMIC)
 DEFINE_CEPH_FEATURE_RETIRED(45, 1, OSD_SET_ALLOC_HINT, JEWEL, LUMINOUS)
+DEFINE_CEPH_FEATURE(45, 3, OSD_EC_DIRECT_READ)
 
 DEFINE_CEPH_FEATURE(46, 1, OSD_FADVISE_FLAGS)
 DEFINE_CEPH_FEATURE_RETIRED(46, 1, OSD_REPOP, JEWEL, LUMINOUS) // overlap
@@ -233,6 +234,7 @@ DEFINE_CEPH_FEATURE_DEPRECATED(63, 1, RESERVED_BROKEN, LUMINOUS) // client-facin
 	 CEPH_FEATURE_RECOVERY_RESERVATION_2 |	\
 	 CEPH_FEATURE_SERVER_NAUTILUS |		\
 	 CEPH_FEATURE_CEPHX_V2 | \
+	 CEPH_FEATURE_OSD_EC_DIRECT_READ |	\
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
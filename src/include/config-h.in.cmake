@@ -92,6 +92,7 @@
 
 /* Defined if you have libaio */
 #cmakedefine HAVE_LIBAIO
+#cmakedefine HAVE_LIBURING
 
 /* Defined if OpenLDAP enabled */
 #cmakedefine HAVE_OPENLDAP
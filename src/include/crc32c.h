@@ -50,6 +50,40 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+typedef void (*ceph_crc32c_multi_func_t)(uint32_t *crc,
+					 unsigned char const * const *data,
+					 unsigned const *length,
+					 unsigned n);
+
+/*
+ * static global with the chosen multi-buffer crc32c implementation
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void);
+
+/**
+ * calculate crc32c of several independent buffers at once
+ *
+ * Same as crc[i] = ceph_crc32c(crc[i], data[i], length[i]) for each
+ * i < n, but where the CPU allows the streams are interleaved so that
+ * the latency of each crc step is hidden behind the others.  This pays
+ * off for many short buffers (checksum blocks, message segments) that
+ * are each too small for the single stream implementation to split.
+ *
+ * @param crc initial values on entry, results on return
+ * @param data buffer pointers; must not be NULL
+ * @param length buffer lengths
+ * @param n number of buffers
+ */
+static inline void ceph_crc32c_multi(uint32_t *crc,
+				     unsigned char const * const *data,
+				     unsigned const *length,
+				     unsigned n)
+{
+  ceph_crc32c_multi_func(crc, data, length, n);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,7 @@
 #include <set>
 #include <vector>
 #include <list>
+#include <deque>
 #include <mutex>
 #include <atomic>
 #include <typeinfo>
@@ -429,12 +430,22 @@ public:
     template<typename v>						\
     using vector = std::vector<v,pool_allocator<v>>;			\
                                                                         \
+    template<typename v>						\
+    using deque = std::deque<v,pool_allocator<v>>;			\
+                                                                        \
     template<typename k, typename v,					\
 	     typename h=std::hash<k>,					\
 	     typename eq = std::equal_to<k>>				\
     using unordered_map =						\
       std::unordered_map<k,v,h,eq,pool_allocator<std::pair<const k,v>>>;\
                                                                         \
+    template<typename k, typename v,					\
+	     typename h=std::hash<k>,					\
+	     typename eq = std::equal_to<k>>				\
+    using unordered_multimap =						\
+      std::unordered_multimap<k,v,h,eq,					\
+			      pool_allocator<std::pair<const k,v>>>;	\
+                                                                        \
     inline size_t allocated_bytes() {					\
       return mempool::get_pool(id).allocated_bytes();			\
     }									\
@@ -27,6 +27,10 @@ public:
    *  See RocksDB's definition of a column family(CF) and how to use it.
    *  The interfaces of KeyValueDB is extended, when a column family is created.
    *  Prefix will be the name of column family to use.
+   *
+   *  A name of the form "P(n)" or "P(n,l-h)" shards prefix P over n column
+   *  families, picking one by a hash of key bytes [l,h) (the whole key if
+   *  no range is given).
    */
   struct ColumnFamily {
     string name;      //< name of this individual column family
@@ -166,6 +170,12 @@ public:
   /// Try to repair K/V database. leveldb and rocksdb require that database must be not opened.
   virtual int repair(std::ostream &out) { return 0; }
 
+  /// Move keys into the column family layout described by new_cfs.  The
+  /// database must be initialized but not opened.
+  virtual int reshard(const vector<ColumnFamily>& new_cfs, std::ostream &out) {
+    return -EOPNOTSUPP;
+  }
+
   virtual Transaction get_transaction() = 0;
   virtual int submit_transaction(Transaction) = 0;
   virtual int submit_transaction_sync(Transaction t) {
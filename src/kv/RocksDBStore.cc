@@ -1,6 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <algorithm>
 #include <set>
 #include <map>
 #include <string>
@@ -22,6 +23,7 @@ using std::string;
 #include "common/perf_counters.h"
 #include "common/debug.h"
 #include "common/PriorityCache.h"
+#include "include/ceph_hash.h"
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
@@ -53,6 +55,141 @@ static rocksdb::SliceParts prepare_sliceparts(const bufferlist &bl,
   return rocksdb::SliceParts(slices->data(), slices->size());
 }
 
+//
+// Column family specs.  "P" keeps prefix P in a column family of its own,
+// "P(n)" or "P(n,l-h)" spreads it over column families P-0 .. P-<n-1> by a
+// hash of key bytes [l,h).  The layout of the sharded prefixes is recorded
+// in a "sharding" file next to the db, since it can't be recovered from
+// the column family names alone.
+//
+struct cf_spec_t {
+  string prefix;
+  string option;
+  unsigned shards = 1;
+  uint32_t hash_l = 0;
+  uint32_t hash_h = UINT32_MAX;
+
+  bool same_layout(const cf_spec_t& o) const {
+    return shards == o.shards && hash_l == o.hash_l && hash_h == o.hash_h;
+  }
+  string to_str() const {
+    string s = prefix;
+    if (shards > 1) {
+      s += "(" + stringify(shards);
+      if (hash_l != 0 || hash_h != UINT32_MAX) {
+	s += "," + stringify(hash_l) + "-";
+	if (hash_h != UINT32_MAX) {
+	  s += stringify(hash_h);
+	}
+      }
+      s += ")";
+    }
+    return s;
+  }
+};
+
+static int parse_cf_spec(const string& name, cf_spec_t *spec)
+{
+  auto open = name.find('(');
+  if (open == string::npos) {
+    spec->prefix = name;
+    return 0;
+  }
+  if (open == 0 || name.back() != ')') {
+    return -EINVAL;
+  }
+  spec->prefix = name.substr(0, open);
+  string args = name.substr(open + 1, name.size() - open - 2);
+  string range;
+  auto comma = args.find(',');
+  if (comma != string::npos) {
+    range = args.substr(comma + 1);
+    args.resize(comma);
+  }
+  string err;
+  int n = strict_strtol(args.c_str(), 10, &err);
+  if (!err.empty() || n < 1) {
+    return -EINVAL;
+  }
+  spec->shards = n;
+  if (!range.empty()) {
+    auto dash = range.find('-');
+    if (dash == string::npos) {
+      return -EINVAL;
+    }
+    int l = strict_strtol(range.substr(0, dash).c_str(), 10, &err);
+    if (!err.empty() || l < 0) {
+      return -EINVAL;
+    }
+    spec->hash_l = l;
+    if (dash + 1 < range.size()) {
+      int h = strict_strtol(range.substr(dash + 1).c_str(), 10, &err);
+      if (!err.empty() || h <= l) {
+	return -EINVAL;
+      }
+      spec->hash_h = h;
+    }
+  }
+  if (spec->shards == 1) {
+    spec->hash_l = 0;
+    spec->hash_h = UINT32_MAX;
+  }
+  return 0;
+}
+
+static int parse_cf_specs(const vector<KeyValueDB::ColumnFamily>& cfs,
+			  map<string,cf_spec_t> *specs)
+{
+  for (auto& i : cfs) {
+    cf_spec_t spec;
+    if (parse_cf_spec(i.name, &spec) < 0) {
+      return -EINVAL;
+    }
+    spec.option = i.option;
+    (*specs)[spec.prefix] = spec;
+  }
+  return 0;
+}
+
+static string shard_cf_name(const string& prefix, unsigned i)
+{
+  return prefix + "-" + stringify(i);
+}
+
+static int read_sharding(rocksdb::Env *env, const string& fn,
+			 map<string,cf_spec_t> *specs)
+{
+  if (!env->FileExists(fn).ok()) {
+    return 0;
+  }
+  string s;
+  rocksdb::Status status = rocksdb::ReadFileToString(env, fn, &s);
+  if (!status.ok()) {
+    return -EIO;
+  }
+  for (auto& i : get_str_list(s, " \t\n")) {
+    cf_spec_t spec;
+    if (parse_cf_spec(i, &spec) < 0) {
+      return -EINVAL;
+    }
+    (*specs)[spec.prefix] = spec;
+  }
+  return 0;
+}
+
+static int write_sharding(rocksdb::Env *env, const string& fn,
+			  const map<string,cf_spec_t>& specs)
+{
+  string s;
+  for (auto& p : specs) {
+    if (p.second.shards > 1) {
+      s += p.second.to_str() + "\n";
+    }
+  }
+  rocksdb::Status status = rocksdb::WriteStringToFile(env, s, fn, true);
+  return status.ok() ? 0 : -EIO;
+}
+
 
 //
 // One of these for the default rocksdb column family, routing each prefix
@@ -77,6 +214,9 @@ public:
     for (auto& p : store.cf_handles) {
       names.erase(p.first);
     }
+    for (auto& p : store.cf_shards) {
+      names.erase(p.first);
+    }
     for (auto& p : names) {
       store.assoc_name += '.';
       store.assoc_name += p.first;
@@ -310,6 +450,36 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf_handle(
+  const string& prefix, const char *key, size_t keylen)
+{
+  if (!cf_shards.empty()) {
+    auto p = cf_shards.find(prefix);
+    if (p != cf_shards.end()) {
+      auto& ps = p->second;
+      size_t l = std::min<size_t>(ps.hash_l, keylen);
+      size_t h = std::min<size_t>(ps.hash_h, keylen);
+      uint32_t hash = ceph_str_hash_rjenkins(key + l, h - l);
+      return ps.handles[hash % ps.handles.size()];
+    }
+  }
+  return get_cf_handle(prefix);
+}
+
+std::vector<rocksdb::ColumnFamilyHandle*> RocksDBStore::get_cf_handles(
+  const string& prefix)
+{
+  auto p = cf_shards.find(prefix);
+  if (p != cf_shards.end()) {
+    return p->second.handles;
+  }
+  auto cf = get_cf_handle(prefix);
+  if (cf) {
+    return { cf };
+  }
+  return {};
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const vector<ColumnFamily>& cfs)
 {
@@ -452,6 +622,60 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
   return 0;
 }
 
+int RocksDBStore::create_cf(const string& prefix, unsigned shards,
+			    uint32_t hash_l, uint32_t hash_h,
+			    const string& option, const rocksdb::Options& opt)
+{
+  // copy default CF settings, block cache, merge operators as
+  // the base for new CF
+  rocksdb::ColumnFamilyOptions cf_opt(opt);
+  // user input options will override the base options
+  rocksdb::Status status = rocksdb::GetColumnFamilyOptionsFromString(
+    cf_opt, option, &cf_opt);
+  if (!status.ok()) {
+    derr << __func__ << " invalid db column family option string for CF: "
+	 << prefix << dendl;
+    return -EINVAL;
+  }
+  install_cf_mergeop(prefix, &cf_opt);
+  prefix_shards *ps = nullptr;
+  if (shards > 1) {
+    ps = &cf_shards[prefix];
+    ps->hash_l = hash_l;
+    ps->hash_h = hash_h;
+    ps->handles.clear();
+  }
+  for (unsigned i = 0; i < shards; ++i) {
+    string name = ps ? shard_cf_name(prefix, i) : prefix;
+    rocksdb::ColumnFamilyHandle *cf;
+    status = db->CreateColumnFamily(cf_opt, name, &cf);
+    if (!status.ok()) {
+      derr << __func__ << " Failed to create rocksdb column family: "
+	   << name << dendl;
+      return -EINVAL;
+    }
+    // store the new CF handle
+    add_column_family(name, static_cast<void*>(cf));
+    if (ps) {
+      ps->handles.push_back(cf);
+    }
+  }
+  return 0;
+}
+
+void RocksDBStore::drop_column_family(const string& cf_name)
+{
+  auto cf = get_cf_handle(cf_name);
+  assert(cf);
+  rocksdb::Status status = db->DropColumnFamily(cf);
+  if (!status.ok()) {
+    derr << __func__ << " failed to drop " << cf_name << ": "
+	 << status.ToString() << dendl;
+  }
+  db->DestroyColumnFamilyHandle(cf);
+  cf_handles.erase(cf_name);
+}
+
 int RocksDBStore::do_open(ostream &out, bool create_if_missing,
 			  const vector<ColumnFamily>* cfs)
 {
@@ -461,6 +685,11 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
     dout(1) << __func__ << " load rocksdb options failed" << dendl;
     return r;
   }
+  map<string,cf_spec_t> specs;
+  if (cfs && parse_cf_specs(*cfs, &specs) < 0) {
+    derr << __func__ << " invalid column family spec" << dendl;
+    return -EINVAL;
+  }
   rocksdb::Status status;
   if (create_if_missing) {
     status = rocksdb::DB::Open(opt, path, &db);
@@ -469,33 +698,37 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
       return -EINVAL;
     }
     // create and open column families
-    if (cfs) {
-      for (auto& p : *cfs) {
-	// copy default CF settings, block cache, merge operators as
-	// the base for new CF
-	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	// user input options will override the base options
-	status = rocksdb::GetColumnFamilyOptionsFromString(
-	  cf_opt, p.option, &cf_opt);
-	if (!status.ok()) {
-	  derr << __func__ << " invalid db column family option string for CF: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	install_cf_mergeop(p.name, &cf_opt);
-	rocksdb::ColumnFamilyHandle *cf;
-	status = db->CreateColumnFamily(cf_opt, p.name, &cf);
-	if (!status.ok()) {
-	  derr << __func__ << " Failed to create rocksdb column family: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	// store the new CF handle
-	add_column_family(p.name, static_cast<void*>(cf));
+    for (auto& p : specs) {
+      auto& spec = p.second;
+      r = create_cf(spec.prefix, spec.shards, spec.hash_l, spec.hash_h,
+		    spec.option, opt);
+      if (r < 0) {
+	return r;
+      }
+    }
+    if (!cf_shards.empty()) {
+      r = write_sharding(opt.env, path + "/sharding", specs);
+      if (r < 0) {
+	derr << __func__ << " failed to record sharding: " << cpp_strerror(r)
+	     << dendl;
+	return r;
       }
     }
     default_cf = db->DefaultColumnFamily();
   } else {
+    if (!resharding &&
+	opt.env->FileExists(path + "/sharding.reshard").ok()) {
+      derr << __func__ << " an interrupted reshard left keys in transit;"
+	   << " rerun the reshard to complete it" << dendl;
+      return -EBUSY;
+    }
+    map<string,cf_spec_t> sharding;
+    r = read_sharding(opt.env, path + "/sharding", &sharding);
+    if (r < 0) {
+      derr << __func__ << " failed to read sharding: " << cpp_strerror(r)
+	   << dendl;
+      return r;
+    }
     std::vector<string> existing_cfs;
     status = rocksdb::DB::ListColumnFamilies(
       rocksdb::DBOptions(opt),
@@ -514,27 +747,41 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
       // we cannot change column families for a created database.  so, map
       // what options we are given to whatever cf's already exist.
       std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+      std::vector<string> cf_prefix;  // prefix each cf belongs to
+      std::vector<int> cf_shard;      // shard of that prefix, or -1
       for (auto& n : existing_cfs) {
+	string prefix = n;
+	int shard = -1;
+	auto dash = n.rfind('-');
+	if (dash != string::npos) {
+	  auto p = sharding.find(n.substr(0, dash));
+	  if (p != sharding.end()) {
+	    string err;
+	    int i = strict_strtol(n.substr(dash + 1).c_str(), 10, &err);
+	    if (err.empty() && i >= 0 && i < (int)p->second.shards) {
+	      prefix = p->first;
+	      shard = i;
+	    }
+	  }
+	}
+	cf_prefix.push_back(prefix);
+	cf_shard.push_back(shard);
 	// copy default CF settings, block cache, merge operators as
 	// the base for new CF
 	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	bool found = false;
-	if (cfs) {
-	  for (auto& i : *cfs) {
-	    if (i.name == n) {
-	      found = true;
-	      status = rocksdb::GetColumnFamilyOptionsFromString(
-		cf_opt, i.option, &cf_opt);
-	      if (!status.ok()) {
-		derr << __func__ << " invalid db column family options for CF '"
-		     << i.name << "': " << i.option << dendl;
-		return -EINVAL;
-	      }
-	    }
+	auto i = specs.find(prefix);
+	bool found = i != specs.end();
+	if (found) {
+	  status = rocksdb::GetColumnFamilyOptionsFromString(
+	    cf_opt, i->second.option, &cf_opt);
+	  if (!status.ok()) {
+	    derr << __func__ << " invalid db column family options for CF '"
+		 << n << "': " << i->second.option << dendl;
+	    return -EINVAL;
 	  }
 	}
 	if (n != rocksdb::kDefaultColumnFamilyName) {
-	  install_cf_mergeop(n, &cf_opt);
+	  install_cf_mergeop(prefix, &cf_opt);
 	}
 	column_families.push_back(rocksdb::ColumnFamilyDescriptor(n, cf_opt));
 	if (!found && n != rocksdb::kDefaultColumnFamilyName) {
@@ -553,14 +800,54 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing,
 	if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
 	  default_cf = handles[i];
 	  must_close_default_cf = true;
-	} else {
-	  add_column_family(existing_cfs[i], static_cast<void*>(handles[i]));
+	  continue;
+	}
+	add_column_family(existing_cfs[i], static_cast<void*>(handles[i]));
+	if (cf_shard[i] >= 0) {
+	  auto& spec = sharding[cf_prefix[i]];
+	  auto& ps = cf_shards[cf_prefix[i]];
+	  ps.hash_l = spec.hash_l;
+	  ps.hash_h = spec.hash_h;
+	  ps.handles.resize(spec.shards);
+	  ps.handles[cf_shard[i]] = handles[i];
 	}
       }
+      for (auto& p : cf_shards) {
+	for (unsigned i = 0; i < p.second.handles.size(); ++i) {
+	  if (!p.second.handles[i] && !resharding) {
+	    derr << __func__ << " missing column family "
+		 << shard_cf_name(p.first, i) << dendl;
+	    return -EIO;
+	  }
+	}
+      }
+    }
+    for (auto& p : specs) {
+      cf_spec_t cur;
+      cur.prefix = p.first;
+      auto s = sharding.find(p.first);
+      if (s != sharding.end() && cf_shards.count(p.first)) {
+	cur = s->second;
+      } else if (!get_cf_handle(p.first)) {
+	cur.shards = 0;
+      }
+      if (!cur.same_layout(p.second)) {
+	dout(1) << __func__ << " prefix '" << p.first << "' is stored as '"
+		<< (cur.shards ? cur.to_str() : string("default"))
+		<< "', not '" << p.second.to_str()
+		<< "'; reshard the db to change it" << dendl;
+      }
     }
   }
   assert(default_cf != nullptr);
-  
+
+  if (resharding) {
+    r = do_reshard(out, cfs ? *cfs : vector<ColumnFamily>(), opt);
+    if (r < 0) {
+      return r;
+    }
+  }
+
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
   plb.add_u64_counter(l_rocksdb_txns, "submit_transaction", "Submit transactions");
@@ -658,6 +945,197 @@ int RocksDBStore::repair(std::ostream &out)
   }
 }
 
+int RocksDBStore::reshard(const vector<ColumnFamily>& new_cfs, ostream &out)
+{
+  resharding = true;
+  int r = do_open(out, false, &new_cfs);
+  resharding = false;
+  return r;
+}
+
+int RocksDBStore::reshard_move(const string& prefix,
+			       const vector<rocksdb::ColumnFamilyHandle*>& from,
+			       ostream &out)
+{
+  const unsigned batch_keys = 10000;
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  rocksdb::WriteBatch bat;
+  uint64_t moved = 0;
+  auto flush = [&]() {
+    rocksdb::Status status = db->Write(woptions, &bat);
+    bat.Clear();
+    if (!status.ok()) {
+      derr << __func__ << " " << prefix << ": " << status.ToString() << dendl;
+      return -EIO;
+    }
+    return 0;
+  };
+  if (!from.empty()) {
+    // out of the prefix' column families into the default one
+    for (auto cf : from) {
+      std::unique_ptr<rocksdb::Iterator> it(
+	db->NewIterator(rocksdb::ReadOptions(), cf));
+      for (it->SeekToFirst(); it->Valid(); it->Next()) {
+	bat.Put(default_cf, combine_strings(prefix, it->key().ToString()),
+		it->value());
+	bat.Delete(cf, it->key());
+	if (++moved % batch_keys == 0 && flush() < 0) {
+	  return -EIO;
+	}
+      }
+      if (!it->status().ok()) {
+	return -EIO;
+      }
+    }
+  } else {
+    // out of the default column family into wherever the prefix lives now
+    string start = combine_strings(prefix, string());
+    string end = past_prefix(prefix);
+    std::unique_ptr<rocksdb::Iterator> it(
+      db->NewIterator(rocksdb::ReadOptions(), default_cf));
+    for (it->Seek(start);
+	 it->Valid() && it->key().compare(rocksdb::Slice(end)) < 0;
+	 it->Next()) {
+      rocksdb::Slice k(it->key().data() + start.size(),
+		       it->key().size() - start.size());
+      bat.Put(get_cf_handle(prefix, k.data(), k.size()), k, it->value());
+      bat.Delete(default_cf, it->key());
+      if (++moved % batch_keys == 0 && flush() < 0) {
+	return -EIO;
+      }
+    }
+    if (!it->status().ok()) {
+      return -EIO;
+    }
+  }
+  if (bat.Count() && flush() < 0) {
+    return -EIO;
+  }
+  if (moved) {
+    out << "moved " << moved << " keys of prefix '" << prefix << "' "
+	<< (from.empty() ? "out of" : "into") << " the default column family"
+	<< std::endl;
+  }
+  return 0;
+}
+
+/*
+ * Keys are first moved out of every column family whose layout changes
+ * into the default column family, and the emptied column families are
+ * dropped.  Then the new ones are created and filled.  Each batch moves
+ * keys atomically, so a key is never lost, but the db is only usable
+ * again once all of this is done; the sharding.reshard marker makes a
+ * normal open fail in the meantime, and running the reshard again picks
+ * up where the interrupted one stopped.
+ */
+int RocksDBStore::do_reshard(ostream &out, const vector<ColumnFamily>& new_cfs,
+			     const rocksdb::Options& opt)
+{
+  map<string,cf_spec_t> specs;
+  int r = parse_cf_specs(new_cfs, &specs);
+  if (r < 0) {
+    return r;
+  }
+  string marker = path + "/sharding.reshard";
+  string target;
+  for (auto& p : specs) {
+    if (!target.empty()) {
+      target += " ";
+    }
+    target += p.second.to_str();
+  }
+  dout(1) << __func__ << " to '" << target << "'" << dendl;
+  rocksdb::Status status = rocksdb::WriteStringToFile(
+    opt.env, target, marker, true);
+  if (!status.ok()) {
+    derr << __func__ << " failed to write " << marker << dendl;
+    return -EIO;
+  }
+
+  // move prefixes whose layout changes back into the default cf
+  for (auto p = cf_shards.begin(); p != cf_shards.end(); ) {
+    auto& ps = p->second;
+    vector<rocksdb::ColumnFamilyHandle*> from;
+    for (auto cf : ps.handles) {
+      if (cf) {
+	from.push_back(cf);
+      }
+    }
+    auto s = specs.find(p->first);
+    if (s != specs.end() &&
+	from.size() == ps.handles.size() &&
+	s->second.shards == ps.handles.size() &&
+	s->second.hash_l == ps.hash_l &&
+	s->second.hash_h == ps.hash_h) {
+      ++p;
+      continue;
+    }
+    r = reshard_move(p->first, from, out);
+    if (r < 0) {
+      return r;
+    }
+    for (unsigned i = 0; i < ps.handles.size(); ++i) {
+      if (ps.handles[i]) {
+	drop_column_family(shard_cf_name(p->first, i));
+      }
+    }
+    p = cf_shards.erase(p);
+  }
+  std::set<string> keep;
+  for (auto& p : cf_shards) {
+    for (unsigned i = 0; i < p.second.handles.size(); ++i) {
+      keep.insert(shard_cf_name(p.first, i));
+    }
+  }
+  vector<string> plain;
+  for (auto& p : cf_handles) {
+    if (!keep.count(p.first)) {
+      plain.push_back(p.first);
+    }
+  }
+  for (auto& name : plain) {
+    auto s = specs.find(name);
+    if (s != specs.end() && s->second.shards == 1) {
+      continue;
+    }
+    r = reshard_move(name, { get_cf_handle(name) }, out);
+    if (r < 0) {
+      return r;
+    }
+    drop_column_family(name);
+  }
+
+  // record the new layout before creating it, so that an interrupted
+  // reshard can find the new column families again
+  r = write_sharding(opt.env, path + "/sharding", specs);
+  if (r < 0) {
+    return r;
+  }
+  for (auto& p : specs) {
+    auto& spec = p.second;
+    if (!get_cf_handle(spec.prefix) && !cf_shards.count(spec.prefix)) {
+      r = create_cf(spec.prefix, spec.shards, spec.hash_l, spec.hash_h,
+		    spec.option, opt);
+      if (r < 0) {
+	return r;
+      }
+    }
+    r = reshard_move(spec.prefix, {}, out);
+    if (r < 0) {
+      return r;
+    }
+  }
+
+  status = opt.env->DeleteFile(marker);
+  if (!status.ok()) {
+    derr << __func__ << " failed to remove " << marker << dendl;
+    return -EIO;
+  }
+  out << "reshard to '" << target << "' complete" << std::endl;
+  return 0;
+}
+
 void RocksDBStore::split_stats(const std::string &s, char delim, std::vector<std::string> &elems) {
     std::stringstream ss;
     ss.str(s);
@@ -833,7 +1311,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     put_bat(bat, cf, k, to_set_bl);
   } else {
@@ -847,7 +1325,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     string key(k, keylen);  // fixme?
     put_bat(bat, cf, key, to_set_bl);
@@ -861,7 +1339,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k));
   } else {
@@ -873,7 +1351,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k, keylen));
   } else {
@@ -886,7 +1364,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.SingleDelete(cf, k);
   } else {
@@ -896,33 +1374,58 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
+  auto cfs = db->get_cf_handles(prefix);
+  if (!cfs.empty()) {
+    string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
     if (db->enable_rmrange) {
-      string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
-      bat.DeleteRange(cf, string(), endprefix);
+      for (auto cf : cfs) {
+	bat.DeleteRange(cf, string(), endprefix);
+      }
     } else {
+      uint64_t cnt = db->delete_range_threshold;
+      bat.SetSavePoint();
       auto it = db->get_iterator(prefix);
       for (it->seek_to_first();
 	   it->valid();
 	   it->next()) {
-	bat.Delete(cf, rocksdb::Slice(it->key()));
+	if (!cnt) {
+	  bat.RollbackToSavePoint();
+	  for (auto cf : cfs) {
+	    bat.DeleteRange(cf, string(), endprefix);
+	  }
+	  return;
+	}
+	string k = it->key();
+	bat.Delete(db->get_cf_handle(prefix, k), rocksdb::Slice(k));
+	--cnt;
       }
+      bat.PopSavePoint();
     }
   } else {
+    string endprefix = prefix;
+    endprefix.push_back('\x01');
     if (db->enable_rmrange) {
-      string endprefix = prefix;
-      endprefix.push_back('\x01');
       bat.DeleteRange(db->default_cf,
 		      combine_strings(prefix, string()),
 		      combine_strings(endprefix, string()));
     } else {
+      uint64_t cnt = db->delete_range_threshold;
+      bat.SetSavePoint();
       auto it = db->get_iterator(prefix);
       for (it->seek_to_first();
 	   it->valid();
 	   it->next()) {
+	if (!cnt) {
+	  bat.RollbackToSavePoint();
+	  bat.DeleteRange(db->default_cf,
+			  combine_strings(prefix, string()),
+			  combine_strings(endprefix, string()));
+	  return;
+	}
 	bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
+	--cnt;
       }
+      bat.PopSavePoint();
     }
   }
 }
@@ -931,20 +1434,37 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
+  // Point deletes keep reads cheap but cost a memtable entry per key; a
+  // range tombstone is one entry but every read crossing it pays until
+  // compaction drops it.  Use the latter only for large ranges.
+  auto cfs = db->get_cf_handles(prefix);
+  if (!cfs.empty()) {
     if (db->enable_rmrange) {
-      bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+      for (auto cf : cfs) {
+	bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+      }
     } else {
+      uint64_t cnt = db->delete_range_threshold;
+      bat.SetSavePoint();
       auto it = db->get_iterator(prefix);
       it->lower_bound(start);
       while (it->valid()) {
-	if (it->key() >= end) {
+	string k = it->key();
+	if (k >= end) {
 	  break;
 	}
-	bat.Delete(cf, rocksdb::Slice(it->key()));
+	if (!cnt) {
+	  bat.RollbackToSavePoint();
+	  for (auto cf : cfs) {
+	    bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+	  }
+	  return;
+	}
+	bat.Delete(db->get_cf_handle(prefix, k), rocksdb::Slice(k));
+	--cnt;
 	it->next();
       }
+      bat.PopSavePoint();
     }
   } else {
     if (db->enable_rmrange) {
@@ -953,16 +1473,28 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
 	rocksdb::Slice(combine_strings(prefix, start)),
 	rocksdb::Slice(combine_strings(prefix, end)));
     } else {
+      uint64_t cnt = db->delete_range_threshold;
+      bat.SetSavePoint();
       auto it = db->get_iterator(prefix);
       it->lower_bound(start);
       while (it->valid()) {
 	if (it->key() >= end) {
 	  break;
 	}
+	if (!cnt) {
+	  bat.RollbackToSavePoint();
+	  bat.DeleteRange(
+	    db->default_cf,
+	    rocksdb::Slice(combine_strings(prefix, start)),
+	    rocksdb::Slice(combine_strings(prefix, end)));
+	  return;
+	}
 	bat.Delete(db->default_cf,
 		   combine_strings(prefix, it->key()));
+	--cnt;
 	it->next();
       }
+      bat.PopSavePoint();
     }
   }
 }
@@ -972,7 +1504,7 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     // bufferlist::c_str() is non-constant, so we can't call c_str()
     if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
@@ -1013,33 +1545,26 @@ int RocksDBStore::get(
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
-  auto cf = get_cf_handle(prefix);
-  if (cf) {
-    for (auto& key : keys) {
-      std::string value;
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(cct, status.ToString());
-      }
-    }
-  } else {
-    for (auto& key : keys) {
-      std::string value;
+  for (auto& key : keys) {
+    std::string value;
+    rocksdb::Status status;
+    auto cf = get_cf_handle(prefix, key);
+    if (cf) {
+      status = db->Get(rocksdb::ReadOptions(),
+		       cf,
+		       rocksdb::Slice(key),
+		       &value);
+    } else {
       string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(cct, status.ToString());
-      }
+      status = db->Get(rocksdb::ReadOptions(),
+		       default_cf,
+		       rocksdb::Slice(k),
+		       &value);
+    }
+    if (status.ok()) {
+      (*out)[key].append(value);
+    } else if (status.IsIOError()) {
+      ceph_abort_msg(cct, status.ToString());
     }
   }
   utime_t lat = ceph_clock_now() - start;
@@ -1058,7 +1583,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1095,7 +1620,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key, keylen);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1515,8 +2040,166 @@ public:
   }
 };
 
+//
+// Iterator over a prefix sharded over several column families.  Keeps one
+// rocksdb iterator per shard, all reading the same snapshot, ordered so
+// that iters[0] is positioned on the current key.  A key lives in exactly
+// one shard, so the others never sit on the current key.
+//
+class ShardMergeIteratorImpl : public KeyValueDB::IteratorImpl {
+  rocksdb::DB *db;
+  const rocksdb::Snapshot *snapshot;
+  string prefix;
+  std::vector<rocksdb::Iterator*> iters;
+  bool reverse = false;  ///< iters[1..] sit before the current key
+
+  // valid iterators first, in iteration order
+  bool before(rocksdb::Iterator *a, rocksdb::Iterator *b) const {
+    if (!a->Valid()) {
+      return false;
+    }
+    if (!b->Valid()) {
+      return true;
+    }
+    int c = a->key().compare(b->key());
+    return reverse ? c > 0 : c < 0;
+  }
+  void sort() {
+    std::sort(iters.begin(), iters.end(),
+	      [this](rocksdb::Iterator *a, rocksdb::Iterator *b) {
+		return before(a, b);
+	      });
+  }
+  /// put iters[0] back in place after it moved
+  void resort_front() {
+    for (size_t i = 1; i < iters.size() && before(iters[i], iters[i - 1]); ++i) {
+      std::swap(iters[i - 1], iters[i]);
+    }
+  }
+
+public:
+  ShardMergeIteratorImpl(rocksdb::DB *db, const std::string& p,
+			 const std::vector<rocksdb::ColumnFamilyHandle*>& handles)
+    : db(db), snapshot(db->GetSnapshot()), prefix(p) {
+    rocksdb::ReadOptions options;
+    options.snapshot = snapshot;
+    for (auto cf : handles) {
+      iters.push_back(db->NewIterator(options, cf));
+    }
+  }
+  ~ShardMergeIteratorImpl() override {
+    for (auto it : iters) {
+      delete it;
+    }
+    db->ReleaseSnapshot(snapshot);
+  }
+
+  int seek_to_first() override {
+    for (auto it : iters) {
+      it->SeekToFirst();
+    }
+    reverse = false;
+    sort();
+    return status();
+  }
+  int seek_to_last() override {
+    for (auto it : iters) {
+      it->SeekToLast();
+    }
+    reverse = true;
+    sort();
+    return status();
+  }
+  int upper_bound(const string &after) override {
+    lower_bound(after);
+    if (valid() && (key() == after)) {
+      next();
+    }
+    return status();
+  }
+  int lower_bound(const string &to) override {
+    rocksdb::Slice slice_bound(to);
+    for (auto it : iters) {
+      it->Seek(slice_bound);
+    }
+    reverse = false;
+    sort();
+    return status();
+  }
+  int next(bool validate=true) override {
+    if (!valid()) {
+      return status();
+    }
+    if (reverse) {
+      string cur = iters[0]->key().ToString();
+      for (size_t i = 1; i < iters.size(); ++i) {
+	iters[i]->Seek(cur);
+      }
+      reverse = false;
+      iters[0]->Next();
+      sort();
+    } else {
+      iters[0]->Next();
+      resort_front();
+    }
+    return status();
+  }
+  int prev(bool validate=true) override {
+    if (!valid()) {
+      return status();
+    }
+    if (!reverse) {
+      string cur = iters[0]->key().ToString();
+      for (size_t i = 1; i < iters.size(); ++i) {
+	iters[i]->Seek(cur);
+	if (iters[i]->Valid()) {
+	  iters[i]->Prev();
+	} else {
+	  iters[i]->SeekToLast();
+	}
+      }
+      reverse = true;
+      iters[0]->Prev();
+      sort();
+    } else {
+      iters[0]->Prev();
+      resort_front();
+    }
+    return status();
+  }
+  bool valid() override {
+    return iters[0]->Valid();
+  }
+  string key() override {
+    return iters[0]->key().ToString();
+  }
+  std::pair<std::string, std::string> raw_key() override {
+    return make_pair(prefix, key());
+  }
+  bufferlist value() override {
+    return to_bufferlist(iters[0]->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = iters[0]->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    for (auto it : iters) {
+      if (!it->status().ok()) {
+	return -1;
+      }
+    }
+    return 0;
+  }
+};
+
 KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
 {
+  auto p = cf_shards.find(prefix);
+  if (p != cf_shards.end()) {
+    return std::make_shared<ShardMergeIteratorImpl>(
+      db, prefix, p->second.handles);
+  }
   rocksdb::ColumnFamilyHandle *cf_handle =
     static_cast<rocksdb::ColumnFamilyHandle*>(get_cf_handle(prefix));
   if (cf_handle) {
@@ -86,6 +86,25 @@ class RocksDBStore : public KeyValueDB {
   bool must_close_default_cf = false;
   rocksdb::ColumnFamilyHandle *default_cf = nullptr;
 
+  /// a prefix whose keys are spread over several column families
+  struct prefix_shards {
+    uint32_t hash_l = 0;           ///< first key byte fed to the hash
+    uint32_t hash_h = UINT32_MAX;  ///< one past the last key byte hashed
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  };
+  std::unordered_map<std::string, prefix_shards> cf_shards;
+  bool resharding = false;  ///< open a layout left behind by a failed reshard
+
+  int create_cf(const std::string& prefix, unsigned shards,
+		uint32_t hash_l, uint32_t hash_h,
+		const std::string& option, const rocksdb::Options& opt);
+  void drop_column_family(const std::string& cf_name);
+  int reshard_move(const std::string& prefix,
+		   const std::vector<rocksdb::ColumnFamilyHandle*>& from,
+		   ostream &out);
+  int do_reshard(ostream &out, const vector<ColumnFamily>& new_cfs,
+		 const rocksdb::Options& opt);
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
   int create_db_dir();
@@ -119,6 +138,7 @@ public:
   bool compact_on_mount;
   bool disableWAL;
   bool enable_rmrange;
+  uint64_t delete_range_threshold; ///< keys before a range delete
   void compact() override;
   int64_t high_pri_watermark;
 
@@ -160,6 +180,7 @@ public:
     compact_on_mount(false),
     disableWAL(false),
     enable_rmrange(cct->_conf->rocksdb_enable_rmrange),
+    delete_range_threshold(cct->_conf->rocksdb_delete_range_threshold),
     high_pri_watermark(0)
   {}
 
@@ -183,7 +204,18 @@ public:
     else
       return static_cast<rocksdb::ColumnFamilyHandle*>(iter->second);
   }
+  /// column family holding key of prefix, nullptr for the default one
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const char *key, size_t keylen);
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const std::string& key) {
+    return get_cf_handle(prefix, key.data(), key.size());
+  }
+  /// all column families of prefix, empty for the default one
+  std::vector<rocksdb::ColumnFamilyHandle*> get_cf_handles(
+    const std::string& prefix);
   int repair(std::ostream &out) override;
+  int reshard(const vector<ColumnFamily>& new_cfs, std::ostream &out) override;
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
 
@@ -288,10 +288,27 @@ Message *decode_message(CephContext *cct, int crcflags,
 			bufferlist& front, bufferlist& middle,
 			bufferlist& data, Connection* conn)
 {
-  // verify crc
+  // verify crc; the segments are independent, so do them together
+  const bufferlist *bls[3] = { &front, &middle, &data };
+  uint32_t crcs[3] = { 0, 0, 0 };
+  unsigned num_crcs = 0;
   if (crcflags & MSG_CRC_HEADER) {
-    __u32 front_crc = front.crc32c(0);
-    __u32 middle_crc = middle.crc32c(0);
+    num_crcs = 2;
+  }
+  if ((crcflags & MSG_CRC_DATA) &&
+      (footer.flags & CEPH_MSG_FOOTER_NOCRC) == 0) {
+    if (num_crcs) {
+      num_crcs = 3;
+    } else {
+      bls[0] = &data;
+      num_crcs = 1;
+    }
+  }
+  bufferlist::crc32c_multi(num_crcs, bls, crcs);
+
+  if (crcflags & MSG_CRC_HEADER) {
+    __u32 front_crc = crcs[0];
+    __u32 middle_crc = crcs[1];
 
     if (front_crc != footer.front_crc) {
       if (cct) {
@@ -314,7 +331,7 @@ Message *decode_message(CephContext *cct, int crcflags,
   }
   if (crcflags & MSG_CRC_DATA) {
     if ((footer.flags & CEPH_MSG_FOOTER_NOCRC) == 0) {
-      __u32 data_crc = data.crc32c(0);
+      __u32 data_crc = crcs[num_crcs - 1];
       if (data_crc != footer.data_crc) {
 	if (cct) {
 	  ldout(cct, 0) << "bad crc in data " << data_crc << " != exp " << footer.data_crc << dendl;
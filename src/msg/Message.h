@@ -433,8 +433,11 @@ public:
 			     sizeof(header) - sizeof(header.crc));
   }
   void calc_front_crc() {
-    footer.front_crc = payload.crc32c(0);
-    footer.middle_crc = middle.crc32c(0);
+    const bufferlist *bls[2] = { &payload, &middle };
+    uint32_t crcs[2] = { 0, 0 };
+    bufferlist::crc32c_multi(2, bls, crcs);
+    footer.front_crc = crcs[0];
+    footer.middle_crc = crcs[1];
   }
   void calc_data_crc() {
     footer.data_crc = data.crc32c(0);
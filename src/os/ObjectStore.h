@@ -1655,6 +1655,53 @@ public:
      bufferlist& bl,
      uint32_t op_flags = 0) = 0;
 
+  /**
+   * verify_checksums -- check a byte range of an object's data
+   *
+   * Reads the range from the backing device and checks it against the
+   * checksums the store keeps for it, without returning the data.
+   *
+   * @param cid collection for object
+   * @param oid oid of object
+   * @param offset location offset of first byte to be checked
+   * @param len number of bytes to be checked
+   * @param op_flags is CEPH_OSD_OP_FLAG_*
+   * @returns 0 if the range checked out, -EIO on a checksum or read error,
+   *          -EOPNOTSUPP if the store keeps no checksums for (part of) the
+   *          range, or another negative error code on failure.
+   */
+   virtual int verify_checksums(
+     CollectionHandle &c,
+     const ghobject_t& oid,
+     uint64_t offset,
+     size_t len,
+     uint32_t op_flags = 0) {
+     return -EOPNOTSUPP;
+   }
+
+  /**
+   * is_cached -- tell whether a read would be served from memory
+   *
+   * Does no I/O and leaves the cache as it is: nothing is promoted in
+   * the LRU nor counted as a hit or miss.  The answer is a snapshot:
+   * the cache may be trimmed before a following read.
+   *
+   * @param cid collection for object
+   * @param oid oid of object
+   * @param offset location offset of first byte to be read
+   * @param len number of bytes to be read; 0 to only ask about the
+   *            object's metadata (stat and xattrs)
+   * @returns true if the object's metadata and the byte range are cached;
+   *          false if not, or if the store cannot tell.
+   */
+   virtual bool is_cached(
+     CollectionHandle &c,
+     const ghobject_t& oid,
+     uint64_t offset,
+     size_t len) {
+     return false;
+   }
+
   /**
    * fiemap -- get extent map of data of an object
    *
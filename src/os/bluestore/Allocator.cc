@@ -4,21 +4,112 @@
 #include "Allocator.h"
 #include "StupidAllocator.h"
 #include "BitmapAllocator.h"
+#include "AvlAllocator.h"
+#include "HybridAllocator.h"
 #include "common/debug.h"
+#include "include/intarith.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
 
 #define dout_subsys ceph_subsys_bluestore
 
+class Allocator::SocketHook : public AdminSocketHook {
+  CephContext* cct;
+  Allocator *alloc;
+  std::string name;
+
+  friend class Allocator;
+public:
+  SocketHook(CephContext* cct, Allocator *alloc, const std::string& _name)
+    : cct(cct), alloc(alloc), name(_name)
+  {
+    AdminSocket *admin_socket = cct->get_admin_socket();
+    int r = admin_socket->register_command(
+      "bluestore allocator dump " + name,
+      "bluestore allocator dump " + name,
+      this,
+      "dump allocator free regions");
+    if (r != 0) {
+      // another instance already owns this name (e.g. in tests)
+      this->alloc = nullptr;
+      return;
+    }
+    r = admin_socket->register_command(
+      "bluestore allocator score " + name,
+      "bluestore allocator score " + name,
+      this,
+      "give score on allocator fragmentation (0-no fragmentation, 1-absolute fragmentation)");
+    assert(r == 0);
+  }
+  ~SocketHook() override
+  {
+    if (alloc) {
+      cct->get_admin_socket()->unregister_commands(this);
+    }
+  }
+
+  bool call(std::string_view command, const cmdmap_t& cmdmap,
+	    std::string_view format, bufferlist& out) override {
+    std::unique_ptr<Formatter> f(Formatter::create(format, "json-pretty",
+						   "json-pretty"));
+    if (command == "bluestore allocator dump " + name) {
+      f->open_object_section("free_regions");
+      f->dump_unsigned("capacity", alloc->get_free());
+      f->open_array_section("extents");
+      auto iterated_allocation = [&](uint64_t off, uint64_t len) {
+	assert(len > 0);
+	f->open_object_section("free");
+	char off_hex[30];
+	char len_hex[30];
+	snprintf(off_hex, sizeof(off_hex) - 1, "0x%lx", off);
+	snprintf(len_hex, sizeof(len_hex) - 1, "0x%lx", len);
+	f->dump_string("offset", off_hex);
+	f->dump_string("length", len_hex);
+	f->close_section();
+      };
+      alloc->dump(iterated_allocation);
+      f->close_section();
+      f->close_section();
+    } else if (command == "bluestore allocator score " + name) {
+      f->open_object_section("fragmentation_score");
+      f->dump_float("fragmentation_rating", alloc->get_fragmentation_score());
+      f->close_section();
+    } else {
+      return false;
+    }
+    f->flush(out);
+    return true;
+  }
+};
+
+Allocator::~Allocator()
+{
+  delete asok_hook;
+}
+
 Allocator *Allocator::create(CephContext* cct, string type,
-                             int64_t size, int64_t block_size)
+                             int64_t size, int64_t block_size,
+                             const std::string& name)
 {
+  Allocator* alloc = nullptr;
   if (type == "stupid") {
-    return new StupidAllocator(cct);
+    alloc = new StupidAllocator(cct);
   } else if (type == "bitmap") {
-    return new BitmapAllocator(cct, size, block_size);
+    alloc = new BitmapAllocator(cct, size, block_size);
+  } else if (type == "avl") {
+    alloc = new AvlAllocator(cct, size, block_size);
+  } else if (type == "hybrid") {
+    alloc = new HybridAllocator(cct, size, block_size,
+      cct->_conf.get_val<Option::size_t>("bluestore_hybrid_alloc_mem_cap"));
+  } else {
+    lderr(cct) << "Allocator::" << __func__ << " unknown alloc type "
+	       << type << dendl;
+    return nullptr;
   }
-  lderr(cct) << "Allocator::" << __func__ << " unknown alloc type "
-	     << type << dendl;
-  return nullptr;
+  if (!name.empty()) {
+    alloc->asok_hook = new SocketHook(cct, alloc, name);
+  }
+  return alloc;
 }
 
 void Allocator::release(const PExtentVector& release_vec)
@@ -29,3 +120,41 @@ void Allocator::release(const PExtentVector& release_vec)
   }
   release(release_set);
 }
+
+double Allocator::get_fragmentation_score()
+{
+  // this value represents how much worth is 2X bytes in one chunk then in X + X bytes
+  static const double double_size_worth = 1.1;
+  std::vector<double> scales{1};
+  double score_sum = 0;
+  size_t sum = 0;
+
+  auto get_score = [&](size_t v) -> double {
+    size_t sc = sizeof(v) * 8 - clz(v) - 1; //assign to grade depending on log2(len)
+    while (scales.size() <= sc + 1) {
+      //unlikely expand scales vector
+      scales.push_back(scales[scales.size() - 1] * double_size_worth);
+    }
+
+    size_t sc_shifted = size_t(1) << sc;
+    double x = double(v - sc_shifted) / sc_shifted; //x is <0,1) in its scale grade
+    // linear extrapolation in its scale grade
+    double score = (sc_shifted    ) * scales[sc]   * (1-x) +
+                   (sc_shifted * 2) * scales[sc+1] * x;
+    return score;
+  };
+
+  auto iterated_allocation = [&](uint64_t off, uint64_t len) {
+    assert(len > 0);
+    score_sum += get_score(len);
+    sum += len;
+  };
+  dump(iterated_allocation);
+
+  if (sum == 0) {
+    return 0.0;
+  }
+  double ideal = get_score(sum);
+  double terrible = sum * get_score(1);
+  return (ideal - score_sum) / (ideal - terrible);
+}
@@ -13,12 +13,13 @@
 #define CEPH_OS_BLUESTORE_ALLOCATOR_H
 
 #include <ostream>
+#include <functional>
 #include "include/assert.h"
 #include "os/bluestore/bluestore_types.h"
 
 class Allocator {
 public:
-  virtual ~Allocator() {}
+  virtual ~Allocator();
 
   /*
    * Allocate required number of blocks in n number of extents.
@@ -44,6 +45,9 @@ public:
   void release(const PExtentVector& release_set);
 
   virtual void dump() = 0;
+  /// iterate over all free extents; callers must not call back into
+  /// the allocator from notify
+  virtual void dump(std::function<void(uint64_t offset, uint64_t length)> notify) = 0;
 
   virtual void init_add_free(uint64_t offset, uint64_t length) = 0;
   virtual void init_rm_free(uint64_t offset, uint64_t length) = 0;
@@ -53,10 +57,23 @@ public:
   {
     return 0.0;
   }
+  /// Free space fragmentation rating in [0, 1]: 0 when all free space is
+  /// a single extent, 1 when it is split into alloc unit sized pieces.
+  /// Unlike get_fragmentation() it is based on the actual free extent
+  /// size distribution and is comparable across allocator types.
+  double get_fragmentation_score();
 
   virtual void shutdown() = 0;
+
+  /// create an allocator of the given type; a non-empty name also
+  /// registers "bluestore allocator {dump,score} <name>" admin socket
+  /// commands for it
   static Allocator *create(CephContext* cct, string type, int64_t size,
-			   int64_t block_size);
+			   int64_t block_size, const std::string& name = "");
+
+private:
+  class SocketHook;
+  SocketHook* asok_hook = nullptr;
 };
 
 #endif
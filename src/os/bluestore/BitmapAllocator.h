@@ -27,6 +27,7 @@ public:
     uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
     int64_t hint, PExtentVector *extents) override;
 
+  using Allocator::release;
   void release(
     const interval_set<uint64_t>& release_set) override;
 
@@ -38,6 +39,10 @@ public:
   void dump() override
   {
   }
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify) override
+  {
+    foreach_free(notify);
+  }
   double get_fragmentation(uint64_t) override
   {
     return _get_fragmentation();
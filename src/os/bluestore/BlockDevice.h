@@ -148,6 +148,10 @@ public:
   virtual int get_devname(std::string *out) {
     return -ENOENT;
   }
+  /// numa node the device is attached to, if known
+  virtual int get_numa_node(int *node) const {
+    return -EOPNOTSUPP;
+  }
   virtual int get_devices(std::set<std::string> *ls) {
     std::string s;
     if (get_devname(&s) == 0) {
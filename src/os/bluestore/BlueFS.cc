@@ -395,9 +395,13 @@ void BlueFS::_init_alloc()
       continue;
     }
     assert(bdev[id]->get_size());
+    static const char* alloc_names[MAX_BDEV] = {
+      "bluefs-wal", "bluefs-db", "bluefs-slow"
+    };
     alloc[id] = Allocator::create(cct, cct->_conf->bluefs_allocator,
 				  bdev[id]->get_size(),
-				  cct->_conf->bluefs_alloc_size);
+				  cct->_conf->bluefs_alloc_size,
+				  alloc_names[id]);
     interval_set<uint64_t>& p = block_all[id];
     for (interval_set<uint64_t>::iterator q = p.begin(); q != p.end(); ++q) {
       alloc[id]->init_add_free(q.get_start(), q.get_len());
@@ -1619,7 +1623,8 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   return 0;
 }
 
-int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
+int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+			 std::unique_lock<std::mutex> *l)
 {
   dout(10) << __func__ << " " << h << " pos 0x" << std::hex << h->pos
 	   << " 0x" << offset << "~" << length << std::dec
@@ -1729,12 +1734,6 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     x_off -= partial;
     offset -= partial;
     length += partial;
-    dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
-    for (auto p : h->iocv) {
-      if (p) {
-	p->aio_wait();
-      }
-    }
   }
   if (length == partial + h->buffer.length()) {
     bl.claim_append_piecewise(h->buffer);
@@ -1765,6 +1764,14 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   h->pos = offset + length;
   h->tail_block.clear();
 
+  // carve the io up while we still hold the lock; fnode extents may
+  // change underneath us once it is dropped
+  struct pending_write_t {
+    uint8_t bdev;
+    uint64_t offset;
+    bufferlist bl;
+  };
+  vector<pending_write_t> writes;
   uint64_t bloff = 0;
   uint64_t bytes_written_slow = 0;
   while (length > 0) {
@@ -1796,15 +1803,11 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
 	t.append_zero(zlen);
       }
     }
-    if (cct->_conf->bluefs_sync_write) {
-      bdev[p->bdev]->write(p->offset + x_off, t, buffered);
-    } else {
-      bdev[p->bdev]->aio_write(p->offset + x_off, t, h->iocv[p->bdev], buffered);
-    }
     h->dirty_devs[p->bdev] = true;
     if (p->bdev == BDEV_SLOW) {
       bytes_written_slow += t.length();
     }
+    writes.push_back(pending_write_t{p->bdev, p->offset + x_off, t});
 
     bloff += x_len;
     length -= x_len;
@@ -1812,6 +1815,30 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     x_off = 0;
   }
   logger->inc(l_bluefs_bytes_written_slow, bytes_written_slow);
+
+  // regular files are serialized by h->lock, so their data io does not
+  // need to hold up everyone else.  the log (and its compacted
+  // replacement) is written with the lock held.
+  bool unlocked = false;
+  if (l && h->file->fnode.ino > 1) {
+    l->unlock();
+    unlocked = true;
+  }
+  if (partial) {
+    dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
+    for (auto p : h->iocv) {
+      if (p) {
+	p->aio_wait();
+      }
+    }
+  }
+  for (auto& w : writes) {
+    if (cct->_conf->bluefs_sync_write) {
+      bdev[w.bdev]->write(w.offset, w.bl, buffered);
+    } else {
+      bdev[w.bdev]->aio_write(w.offset, w.bl, h->iocv[w.bdev], buffered);
+    }
+  }
   for (unsigned i = 0; i < MAX_BDEV; ++i) {
     if (bdev[i]) {
       assert(h->iocv[i]);
@@ -1820,6 +1847,9 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
       }
     }
   }
+  if (unlocked) {
+    l->lock();
+  }
   dout(20) << __func__ << " h " << h << " pos now 0x"
            << std::hex << h->pos << std::dec << dendl;
   return 0;
@@ -1853,7 +1883,8 @@ void BlueFS::wait_for_aio(FileWriter *h)
 }
 #endif
 
-int BlueFS::_flush(FileWriter *h, bool force)
+int BlueFS::_flush(FileWriter *h, bool force,
+		  std::unique_lock<std::mutex> *l)
 {
   h->buffer_appender.flush();
   uint64_t length = h->buffer.length();
@@ -1874,10 +1905,11 @@ int BlueFS::_flush(FileWriter *h, bool force)
            << std::hex << offset << "~" << length << std::dec
 	   << " to " << h->file->fnode << dendl;
   assert(h->pos <= h->file->fnode.size);
-  return _flush_range(h, offset, length);
+  return _flush_range(h, offset, length, l);
 }
 
-int BlueFS::_truncate(FileWriter *h, uint64_t offset)
+int BlueFS::_truncate(FileWriter *h, uint64_t offset,
+		     std::unique_lock<std::mutex>& l)
 {
   dout(10) << __func__ << " 0x" << std::hex << offset << std::dec
            << " file " << h->file->fnode << dendl;
@@ -1902,7 +1934,7 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
     assert(0 == "actually this shouldn't happen");
   }
   if (h->buffer.length()) {
-    int r = _flush(h, true);
+    int r = _flush(h, true, &l);
     if (r < 0)
       return r;
   }
@@ -1921,7 +1953,7 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
 int BlueFS::_fsync(FileWriter *h, std::unique_lock<std::mutex>& l)
 {
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
-  int r = _flush(h, true);
+  int r = _flush(h, true, &l);
   if (r < 0)
      return r;
   uint64_t old_dirty_seq = h->file->dirty_seq;
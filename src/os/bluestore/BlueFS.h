@@ -273,8 +273,12 @@ private:
 
   int _allocate(uint8_t bdev, uint64_t len,
 		bluefs_fnode_t* node);
-  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
-  int _flush(FileWriter *h, bool force);
+  // if l is given, it is dropped while data io for a regular file is
+  // issued; the caller must then hold h->lock
+  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+		   std::unique_lock<std::mutex> *l = nullptr);
+  int _flush(FileWriter *h, bool force,
+	     std::unique_lock<std::mutex> *l = nullptr);
   int _fsync(FileWriter *h, std::unique_lock<std::mutex>& l);
 
 #ifdef HAVE_LIBAIO
@@ -298,7 +302,7 @@ private:
   void flush_bdev(std::array<bool, MAX_BDEV>& dirty_bdevs);  // this is safe to call without a lock
 
   int _preallocate(FileRef f, uint64_t off, uint64_t len);
-  int _truncate(FileWriter *h, uint64_t off);
+  int _truncate(FileWriter *h, uint64_t off, std::unique_lock<std::mutex>& l);
 
   int _read(
     FileReader *h,   ///< [in] read from here
@@ -373,6 +377,10 @@ public:
     bool random = false);
 
   void close_writer(FileWriter *h) {
+#ifdef HAVE_LIBAIO
+    // drain outstanding aio before taking the lock
+    wait_for_aio(h);
+#endif
     std::lock_guard<std::mutex> l(lock);
     _close_writer(h);
   }
@@ -414,15 +422,20 @@ public:
   // handler for discard event
   void handle_discard(unsigned dev, interval_set<uint64_t>& to_release);
 
+  // writers are serialized by h->lock, which is taken before the global
+  // lock; the latter is dropped while file data is being written
   void flush(FileWriter *h) {
-    std::lock_guard<std::mutex> l(lock);
-    _flush(h, false);
+    std::lock_guard<std::mutex> hl(h->lock);
+    std::unique_lock<std::mutex> l(lock);
+    _flush(h, false, &l);
   }
   void flush_range(FileWriter *h, uint64_t offset, uint64_t length) {
-    std::lock_guard<std::mutex> l(lock);
-    _flush_range(h, offset, length);
+    std::lock_guard<std::mutex> hl(h->lock);
+    std::unique_lock<std::mutex> l(lock);
+    _flush_range(h, offset, length, &l);
   }
   int fsync(FileWriter *h) {
+    std::lock_guard<std::mutex> hl(h->lock);
     std::unique_lock<std::mutex> l(lock);
     return _fsync(h, l);
   }
@@ -449,8 +462,9 @@ public:
     return _preallocate(f, offset, len);
   }
   int truncate(FileWriter *h, uint64_t offset) {
-    std::lock_guard<std::mutex> l(lock);
-    return _truncate(h, offset);
+    std::lock_guard<std::mutex> hl(h->lock);
+    std::unique_lock<std::mutex> l(lock);
+    return _truncate(h, offset, l);
   }
 
 };
@@ -17,8 +17,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-
-#include "include/cpp-btree/btree_set.h"
+#include <unordered_set>
 
 #include "BlueStore.h"
 #include "os/kv.h"
@@ -28,6 +27,7 @@
 #include "include/str_map.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
+#include "common/admin_socket.h"
 #include "common/PriorityCache.h"
 #include "Allocator.h"
 #include "FreelistManager.h"
@@ -36,6 +36,10 @@
 #include "auth/Crypto.h"
 #include "common/EventTrace.h"
 
+#ifdef HAVE_SCHED
+#include <sched.h>
+#endif
+
 #define dout_context cct
 #define dout_subsys ceph_subsys_bluestore
 
@@ -782,16 +786,68 @@ BlueStore::Cache *BlueStore::Cache::create(CephContext* cct, string type,
   return c;
 }
 
+BlueStore::Cache::~Cache()
+{
+  if (shard_logger) {
+    cct->get_perfcounters_collection()->remove(shard_logger);
+    delete shard_logger;
+  }
+}
+
+void BlueStore::Cache::init_shard_logger(unsigned shard)
+{
+  assert(!shard_logger);
+  PerfCountersBuilder b(cct, "bluestore-cache-shard-" + stringify(shard),
+			l_bluestore_cache_shard_first,
+			l_bluestore_cache_shard_last);
+  b.add_u64(l_bluestore_cache_shard_onodes, "onodes",
+	    "Number of onodes in this cache shard");
+  b.add_u64_counter(l_bluestore_cache_shard_onode_hits, "onode_hits",
+		    "Sum for onode-lookups hit in this cache shard");
+  b.add_u64_counter(l_bluestore_cache_shard_onode_misses, "onode_misses",
+		    "Sum for onode-lookups missed in this cache shard");
+  b.add_u64(l_bluestore_cache_shard_buffers, "buffers",
+	    "Number of buffers in this cache shard");
+  b.add_u64(l_bluestore_cache_shard_buffer_bytes, "buffer_bytes",
+	    "Number of buffer bytes in this cache shard",
+	    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_cache_shard_buffer_hit_bytes,
+		    "buffer_hit_bytes",
+		    "Sum for bytes of read hit in this cache shard",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_cache_shard_buffer_miss_bytes,
+		    "buffer_miss_bytes",
+		    "Sum for bytes of read missed in this cache shard",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  shard_logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(shard_logger);
+}
+
+void BlueStore::Cache::update_shard_logger()
+{
+  if (!shard_logger) {
+    return;
+  }
+  uint64_t onodes = 0, extents = 0, blobs = 0, buffers = 0, bytes = 0;
+  add_stats(&onodes, &extents, &blobs, &buffers, &bytes);
+  shard_logger->set(l_bluestore_cache_shard_onodes, onodes);
+  shard_logger->set(l_bluestore_cache_shard_buffers, buffers);
+  shard_logger->set(l_bluestore_cache_shard_buffer_bytes, bytes);
+}
+
 void BlueStore::Cache::trim(uint64_t onode_max, uint64_t buffer_max)
 {
-  std::lock_guard<std::recursive_mutex> l(lock);
-  _trim(onode_max, buffer_max);
+  {
+    std::lock_guard<std::recursive_mutex> l(lock);
+    _trim_buffers(buffer_max);
+  }
+  std::lock_guard<std::recursive_mutex> l(onode_lock);
+  _trim_onodes(onode_max);
 }
 
 void BlueStore::Cache::trim_all()
 {
-  std::lock_guard<std::recursive_mutex> l(lock);
-  _trim(0, 0);
+  trim(0, 0);
 }
 
 // LRUCache
@@ -805,10 +861,9 @@ void BlueStore::LRUCache::_touch_onode(OnodeRef& o)
   onode_lru.push_front(*o);
 }
 
-void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
+void BlueStore::LRUCache::_trim_buffers(uint64_t buffer_max)
 {
-  dout(20) << __func__ << " onodes " << onode_lru.size() << " / " << onode_max
-	   << " buffers " << buffer_size << " / " << buffer_max
+  dout(20) << __func__ << " buffers " << buffer_size << " / " << buffer_max
 	   << dendl;
 
   _audit("trim start");
@@ -826,8 +881,13 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
     dout(20) << __func__ << " rm " << *b << dendl;
     b->space->_rm_buffer(this, b);
   }
+}
+
+void BlueStore::LRUCache::_trim_onodes(uint64_t onode_max)
+{
+  dout(20) << __func__ << " onodes " << onode_lru.size() << " / " << onode_max
+	   << dendl;
 
-  // onodes
   if (onode_max >= onode_lru.size()) {
     return; // don't even try
   }
@@ -1023,10 +1083,9 @@ void BlueStore::TwoQCache::_adjust_buffer_size(Buffer *b, int64_t delta)
   }
 }
 
-void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
+void BlueStore::TwoQCache::_trim_buffers(uint64_t buffer_max)
 {
-  dout(20) << __func__ << " onodes " << onode_lru.size() << " / " << onode_max
-	   << " buffers " << buffer_bytes << " / " << buffer_max
+  dout(20) << __func__ << " buffers " << buffer_bytes << " / " << buffer_max
 	   << dendl;
 
   _audit("trim start");
@@ -1123,8 +1182,13 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       b->space->_rm_buffer(this, b);
     }
   }
+}
+
+void BlueStore::TwoQCache::_trim_onodes(uint64_t onode_max)
+{
+  dout(20) << __func__ << " onodes " << onode_lru.size() << " / " << onode_max
+	   << dendl;
 
-  // onodes
   if (onode_max >= onode_lru.size()) {
     return; // don't even try
   }
@@ -1362,8 +1426,29 @@ void BlueStore::BufferSpace::read(
   uint64_t hit_bytes = res_intervals.size();
   assert(hit_bytes <= want_bytes);
   uint64_t miss_bytes = want_bytes - hit_bytes;
-  cache->logger->inc(l_bluestore_buffer_hit_bytes, hit_bytes);
-  cache->logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
+  cache->count_buffer_read(hit_bytes, miss_bytes);
+}
+
+uint32_t BlueStore::BufferSpace::cached_bytes(
+  Cache* cache,
+  uint32_t offset,
+  uint32_t length)
+{
+  uint32_t end = offset + length;
+  uint32_t cached = 0;
+  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  for (auto i = _data_lower_bound(offset);
+       i != buffer_map.end() && offset < end && i->first < end;
+       ++i) {
+    Buffer *b = i->second.get();
+    if (b->is_writing() || b->is_clean()) {
+      uint32_t b_off = std::max(offset, b->offset);
+      uint32_t b_end = std::min(end, b->end());
+      cached += b_end - b_off;
+      offset = b_end;
+    }
+  }
+  return cached;
 }
 
 void BlueStore::BufferSpace::finish_write(Cache* cache, uint64_t seq)
@@ -1457,7 +1542,7 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
 
 BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid, OnodeRef o)
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
   auto p = onode_map.find(oid);
   if (p != onode_map.end()) {
     ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
@@ -1478,7 +1563,7 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   bool hit = false;
 
   {
-    std::lock_guard<std::recursive_mutex> l(cache->lock);
+    std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
     if (p == onode_map.end()) {
       ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
@@ -1491,17 +1576,23 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
     }
   }
 
-  if (hit) {
-    cache->logger->inc(l_bluestore_onode_hits);
-  } else {
-    cache->logger->inc(l_bluestore_onode_misses);
-  }
+  cache->count_onode_lookup(hit);
   return o;
 }
 
+BlueStore::OnodeRef BlueStore::OnodeSpace::peek(const ghobject_t& oid)
+{
+  std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
+  auto p = onode_map.find(oid);
+  if (p == onode_map.end()) {
+    return OnodeRef();
+  }
+  return p->second;
+}
+
 void BlueStore::OnodeSpace::clear()
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
   ldout(cache->cct, 10) << __func__ << dendl;
   for (auto &p : onode_map) {
     cache->_rm_onode(p.second);
@@ -1511,7 +1602,7 @@ void BlueStore::OnodeSpace::clear()
 
 bool BlueStore::OnodeSpace::empty()
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
   return onode_map.empty();
 }
 
@@ -1521,7 +1612,7 @@ void BlueStore::OnodeSpace::rename(
   const ghobject_t& new_oid,
   const mempool::bluestore_cache_other::string& new_okey)
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1548,11 +1639,13 @@ void BlueStore::OnodeSpace::rename(
   cache->_touch_onode(o);
   o->oid = new_oid;
   o->key = new_okey;
+  // nothing is stored under the new key yet
+  o->reset_delta();
 }
 
 bool BlueStore::OnodeSpace::map_any(std::function<bool(OnodeRef)> f)
 {
-  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::lock_guard<std::recursive_mutex> l(cache->onode_lock);
   ldout(cache->cct, 20) << __func__ << dendl;
   for (auto& i : onode_map) {
     if (f(i.second)) {
@@ -1612,8 +1705,9 @@ void BlueStore::SharedBlob::put()
   again:
     auto coll_snap = coll;
     if (coll_snap) {
-      std::lock_guard<std::recursive_mutex> l(coll_snap->cache->lock);
-      if (coll_snap != coll) {
+      auto cache_snap = coll_snap->cache;
+      std::lock_guard<std::recursive_mutex> l(cache_snap->lock);
+      if (coll_snap != coll || cache_snap != coll_snap->cache) {
 	goto again;
       }
       coll_snap->shared_blob_set.remove(this);
@@ -1625,6 +1719,25 @@ void BlueStore::SharedBlob::put()
   }
 }
 
+void BlueStore::SharedBlob::finish_write(uint64_t seq)
+{
+  // called without coll->lock, so the collection may move to another
+  // cache shard (split_cache, move_cache) under us
+  while (true) {
+    auto coll_snap = coll;
+    auto cache_snap = coll_snap->cache;
+    std::lock_guard<std::recursive_mutex> l(cache_snap->lock);
+    if (coll_snap != coll || cache_snap != coll_snap->cache) {
+      ldout(coll_snap->store->cct, 20) << __func__
+				       << " raced with cache move, retrying"
+				       << dendl;
+      continue;
+    }
+    bc.finish_write(cache_snap, seq);
+    break;
+  }
+}
+
 void BlueStore::SharedBlob::get_ref(uint64_t offset, uint32_t length)
 {
   assert(persistent);
@@ -2244,8 +2357,8 @@ void BlueStore::ExtentMap::reshard(
   unsigned offset = needs_reshard_begin;
   vector<bluestore_onode_t::shard_info> new_shard_info;
   unsigned max_blob_end = 0;
-  Extent dummy(needs_reshard_begin);
-  for (auto e = extent_map.lower_bound(dummy);
+  for (auto e = extent_map.lower_bound(needs_reshard_begin,
+				       ExtentOffsetCmp());
        e != extent_map.end();
        ++e) {
     if (e->logical_offset >= needs_reshard_end) {
@@ -2359,8 +2472,10 @@ void BlueStore::ExtentMap::reshard(
     } else {
       shard_end = sp->offset;
     }
-    Extent dummy(needs_reshard_begin);
-    for (auto e = extent_map.lower_bound(dummy); e != extent_map.end(); ++e) {
+    for (auto e = extent_map.lower_bound(needs_reshard_begin,
+					 ExtentOffsetCmp());
+	 e != extent_map.end();
+	 ++e) {
       if (e->logical_offset >= needs_reshard_end) {
 	break;
       }
@@ -2438,8 +2553,7 @@ bool BlueStore::ExtentMap::encode_some(
   unsigned *pn)
 {
   auto cct = onode->c->store->cct; //used by dout
-  Extent dummy(offset);
-  auto start = extent_map.lower_bound(dummy);
+  auto start = extent_map.lower_bound(offset, ExtentOffsetCmp());
   uint32_t end = offset + length;
 
   __u8 struct_v = 2; // Version 2 differs from v1 in blob's ref_map
@@ -2565,6 +2679,9 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
   uint64_t pos = 0;
   uint64_t prev_len = 0;
   unsigned n = 0;
+  // a shard's extents are encoded in order and do not overlap any other
+  // loaded shard, so each one goes right after its predecessor
+  extent_map_t::iterator hint = extent_map.end();
 
   while (!p.end()) {
     Extent *le = new Extent();
@@ -2611,7 +2728,11 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
     }
     pos += prev_len;
     ++n;
-    extent_map.insert(*le);
+    if (hint == extent_map.end()) {
+      hint = extent_map.insert(*le).first;
+    } else {
+      hint = extent_map.insert(std::next(hint), *le);
+    }
   }
 
   assert(n == num);
@@ -2726,7 +2847,11 @@ void BlueStore::ExtentMap::fault_range(
 	       << p->shard_info->offset << std::dec
 	       << " (" << v.length() << " bytes)" << dendl;
       assert(p->dirty == false);
-      assert(v.length() == p->shard_info->bytes);
+      if (v.length() != p->shard_info->bytes) {
+	// the onode key may lag behind shard-only updates, see
+	// BlueStore::_record_onode
+	p->shard_info->bytes = v.length();
+      }
       onode->c->store->logger->inc(l_bluestore_onode_shard_misses);
     } else {
       onode->c->store->logger->inc(l_bluestore_onode_shard_hits);
@@ -2777,15 +2902,13 @@ void BlueStore::ExtentMap::dirty_range(
 BlueStore::extent_map_t::iterator BlueStore::ExtentMap::find(
   uint64_t offset)
 {
-  Extent dummy(offset);
-  return extent_map.find(dummy);
+  return extent_map.find((uint32_t)offset, ExtentOffsetCmp());
 }
 
 BlueStore::extent_map_t::iterator BlueStore::ExtentMap::seek_lextent(
   uint64_t offset)
 {
-  Extent dummy(offset);
-  auto fp = extent_map.lower_bound(dummy);
+  auto fp = extent_map.lower_bound((uint32_t)offset, ExtentOffsetCmp());
   if (fp != extent_map.begin()) {
     --fp;
     if (fp->logical_end() <= offset) {
@@ -2798,8 +2921,7 @@ BlueStore::extent_map_t::iterator BlueStore::ExtentMap::seek_lextent(
 BlueStore::extent_map_t::const_iterator BlueStore::ExtentMap::seek_lextent(
   uint64_t offset) const
 {
-  Extent dummy(offset);
-  auto fp = extent_map.lower_bound(dummy);
+  auto fp = extent_map.lower_bound((uint32_t)offset, ExtentOffsetCmp());
   if (fp != extent_map.begin()) {
     --fp;
     if (fp->logical_end() <= offset) {
@@ -3103,8 +3225,10 @@ void BlueStore::DeferredBatch::_discard(
 	n.bl.swap(tail);
 	n.seq = p->second.seq;
 	i->second -= length;
+	overwritten_bytes += length;
       } else {
 	i->second -= end - offset;
+	overwritten_bytes += end - offset;
       }
       assert(i->second >= 0);
       p->second.bl.swap(head);
@@ -3130,11 +3254,13 @@ void BlueStore::DeferredBatch::_discard(
       s.seq = p->second.seq;
       s.bl.substr_of(p->second.bl, drop_front, keep_tail);
       i->second -= drop_front;
+      overwritten_bytes += drop_front;
     } else {
       dout(20) << __func__ << "  drop " << p->second.seq
 	       << " 0x" << std::hex << p->first << "~" << p->second.bl.length()
 	       << std::dec << dendl;
       i->second -= p->second.bl.length();
+      overwritten_bytes += p->second.bl.length();
     }
     assert(i->second >= 0);
     p = iomap.erase(p);
@@ -3348,8 +3474,12 @@ void BlueStore::Collection::split_cache(
 {
   ldout(store->cct, 10) << __func__ << " to " << dest << dendl;
 
-  // lock (one or both) cache shards
-  std::lock(cache->lock, dest->cache->lock);
+  // lock (one or both) cache shards, onode and buffer side
+  std::lock(cache->onode_lock, dest->cache->onode_lock,
+	    cache->lock, dest->cache->lock);
+  std::lock_guard<std::recursive_mutex> ol(cache->onode_lock, std::adopt_lock);
+  std::lock_guard<std::recursive_mutex> ol2(dest->cache->onode_lock,
+					    std::adopt_lock);
   std::lock_guard<std::recursive_mutex> l(cache->lock, std::adopt_lock);
   std::lock_guard<std::recursive_mutex> l2(dest->cache->lock, std::adopt_lock);
 
@@ -3414,6 +3544,55 @@ void BlueStore::Collection::split_cache(
   }
 }
 
+void BlueStore::Collection::move_cache(Cache *dest)
+{
+  ldout(store->cct, 10) << __func__ << " " << cache << " -> " << dest << dendl;
+  assert(dest != cache);
+
+  std::lock(cache->onode_lock, dest->onode_lock, cache->lock, dest->lock);
+  std::lock_guard<std::recursive_mutex> ol(cache->onode_lock, std::adopt_lock);
+  std::lock_guard<std::recursive_mutex> ol2(dest->onode_lock, std::adopt_lock);
+  std::lock_guard<std::recursive_mutex> l(cache->lock, std::adopt_lock);
+  std::lock_guard<std::recursive_mutex> l2(dest->lock, std::adopt_lock);
+
+  // same walk as split_cache(), except that every onode moves and the
+  // collection stays the same.  a shared blob may be reachable from
+  // several onodes (clones), so only move it once.
+  std::unordered_set<SharedBlob*> moved;
+  uint64_t extents = 0;
+  for (auto& p : onode_map.onode_map) {
+    OnodeRef o = p.second;
+    cache->_rm_onode(o);
+    dest->_add_onode(o, 0);
+
+    extents += o->extent_map.extent_map.size();
+    vector<SharedBlob*> sbvec;
+    for (auto& e : o->extent_map.extent_map) {
+      sbvec.push_back(e.blob->shared_blob.get());
+    }
+    for (auto& b : o->extent_map.spanning_blob_map) {
+      sbvec.push_back(b.second->shared_blob.get());
+    }
+    for (auto sb : sbvec) {
+      if (sb->coll != this || !moved.insert(sb).second) {
+	continue;
+      }
+      for (auto& i : sb->bc.buffer_map) {
+	if (!i.second->is_writing()) {
+	  dest->_move_buffer(cache, i.second.get());
+	}
+      }
+    }
+  }
+  cache->num_extents -= extents;
+  dest->num_extents += extents;
+  cache->num_blobs -= moved.size();
+  dest->num_blobs += moved.size();
+
+  onode_map.cache = dest;
+  cache = dest;
+}
+
 // =======================================================
 
 // MempoolThread
@@ -3429,6 +3608,8 @@ void *BlueStore::MempoolThread::entry()
   caches.push_back(store->db);
   caches.push_back(&meta_cache);
   caches.push_back(&data_cache);
+  caches.push_back(&pri_meta_cache);
+  caches.push_back(&pri_data_cache);
 
   utime_t next_balance = ceph_clock_now();
   while (!stop) {
@@ -3462,20 +3643,27 @@ void BlueStore::MempoolThread::_adjust_cache_settings()
   store->db->set_cache_ratio(store->cache_kv_ratio);
   meta_cache.set_cache_ratio(store->cache_meta_ratio);
   data_cache.set_cache_ratio(store->cache_data_ratio);
+  // the priority class is sized by its reservation (PRI1); past that it
+  // only gets what the ratio-weighted caches leave over.
+  pri_meta_cache.set_cache_ratio(0);
+  pri_data_cache.set_cache_ratio(0);
 }
 
 void BlueStore::MempoolThread::_trim_shards(bool log_stats)
 {
   uint64_t cache_size = store->cache_size;
-  size_t num_shards = store->cache_shards.size();
   int64_t kv_alloc_bytes = 0;
   int64_t meta_alloc_bytes = 0;
   int64_t data_alloc_bytes = 0;
+  int64_t pri_meta_alloc_bytes = 0;
+  int64_t pri_data_alloc_bytes = 0;
 
   if (store->cache_autotune) {
     kv_alloc_bytes = store->db->get_cache_bytes();
     meta_alloc_bytes = meta_cache.get_cache_bytes();
     data_alloc_bytes = data_cache.get_cache_bytes();
+    pri_meta_alloc_bytes = pri_meta_cache.get_cache_bytes();
+    pri_data_alloc_bytes = pri_data_cache.get_cache_bytes();
   } else {
     kv_alloc_bytes = static_cast<int64_t>(
         store->db->get_cache_ratio() * cache_size);
@@ -3483,6 +3671,15 @@ void BlueStore::MempoolThread::_trim_shards(bool log_stats)
         meta_cache.get_cache_ratio() * cache_size);
     data_alloc_bytes = static_cast<int64_t>(
         data_cache.get_cache_ratio() * cache_size);
+    if (store->cache_pri_enabled) {
+      // carve the reservations out of the meta and data shares
+      pri_meta_alloc_bytes = std::min(meta_alloc_bytes,
+                                      pri_meta_cache._get_reserved_bytes());
+      pri_data_alloc_bytes = std::min(data_alloc_bytes,
+                                      pri_data_cache._get_reserved_bytes());
+      meta_alloc_bytes -= pri_meta_alloc_bytes;
+      data_alloc_bytes -= pri_data_alloc_bytes;
+    }
   }
   if (log_stats) {
     double kv_alloc_ratio = (double) kv_alloc_bytes / cache_size;
@@ -3499,16 +3696,42 @@ void BlueStore::MempoolThread::_trim_shards(bool log_stats)
                          << " meta_used: " << 100*meta_used_ratio << "%"
                          << " data_alloc: " << 100*data_alloc_ratio << "%"
                          << " data_used: " << 100*data_used_ratio << "%" << dendl;
+    if (store->cache_pri_enabled) {
+      double pri_meta_alloc_ratio = (double) pri_meta_alloc_bytes / cache_size;
+      double pri_data_alloc_ratio = (double) pri_data_alloc_bytes / cache_size;
+      double pri_meta_used_ratio =
+        (double) pri_meta_cache._get_used_bytes() / cache_size;
+      double pri_data_used_ratio =
+        (double) pri_data_cache._get_used_bytes() / cache_size;
+
+      ldout(store->cct, 5) << __func__ << " priority ratios -" << std::fixed << std::setprecision(1)
+                           << " meta_alloc: " << 100*pri_meta_alloc_ratio << "%"
+                           << " meta_used: " << 100*pri_meta_used_ratio << "%"
+                           << " data_alloc: " << 100*pri_data_alloc_ratio << "%"
+                           << " data_used: " << 100*pri_data_used_ratio << "%" << dendl;
+    }
   }
 
+  double bytes_per_onode = meta_cache.get_bytes_per_onode();
+  _trim_class(store->cache_shards, bytes_per_onode,
+              meta_alloc_bytes, data_alloc_bytes);
+  _trim_class(store->pri_cache_shards, bytes_per_onode,
+              pri_meta_alloc_bytes, pri_data_alloc_bytes);
+}
+
+void BlueStore::MempoolThread::_trim_class(
+    const vector<Cache*>& shards, double bytes_per_onode,
+    int64_t meta_alloc_bytes, int64_t data_alloc_bytes)
+{
+  size_t num_shards = shards.size();
   uint64_t max_shard_onodes = static_cast<uint64_t>(
-      (meta_alloc_bytes / (double) num_shards) / meta_cache.get_bytes_per_onode());
+      (meta_alloc_bytes / (double) num_shards) / bytes_per_onode);
   uint64_t max_shard_buffer = static_cast<uint64_t>(
       data_alloc_bytes / num_shards);
   ldout(store->cct, 30) << __func__ << " max_shard_onodes: " << max_shard_onodes
                         << " max_shard_buffer: " << max_shard_buffer << dendl;
 
-  for (auto i : store->cache_shards) {
+  for (auto i : shards) {
     i->trim(max_shard_onodes, max_shard_buffer);
   }
 }
@@ -3614,6 +3837,135 @@ void BlueStore::MempoolThread::_balance_cache_pri(int64_t *mem_avail,
 
 // =======================================================
 
+// DefragThread
+
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.DefragThread(" << this << ") "
+
+void *BlueStore::DefragThread::entry()
+{
+  Mutex::Locker l(lock);
+  CephContext *cct = store->cct;
+  utime_t next = ceph_clock_now();
+  next += cct->_conf->bluestore_defrag_interval;
+  while (!stop) {
+    // tiered placement moves misplaced extents on the same passes
+    if (kick ||
+	((cct->_conf->bluestore_defrag_enable ||
+	  cct->_conf->bluestore_tier_placement) &&
+	 ceph_clock_now() >= next)) {
+      kick = false;
+      abort = false;
+      running = true;
+      pass_start = ceph_clock_now();
+      scanned = rewritten = rewritten_bytes = 0;
+      dout(5) << __func__ << " starting pass" << dendl;
+      lock.Unlock();
+      store->_defrag_pass();
+      lock.Lock();
+      running = false;
+      pass_end = ceph_clock_now();
+      dout(5) << __func__ << " pass done, scanned " << scanned
+	      << " rewrote " << rewritten << " objects, " << rewritten_bytes
+	      << " bytes in " << (pass_end - pass_start) << dendl;
+      next = pass_end;
+      next += cct->_conf->bluestore_defrag_interval;
+      continue;
+    }
+    // the option may be toggled at runtime; recheck now and then
+    cond.WaitInterval(lock, utime_t(5, 0));
+  }
+  stop = false;
+  return NULL;
+}
+
+bool BlueStore::DefragThread::pause(utime_t t)
+{
+  Mutex::Locker l(lock);
+  if (!stop && !abort && t > utime_t()) {
+    cond.WaitInterval(lock, t);
+  }
+  return !stop && !abort;
+}
+
+void BlueStore::DefragThread::dump(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  f->dump_bool("enabled", store->cct->_conf->bluestore_defrag_enable);
+  f->dump_bool("running", running);
+  if (running) {
+    f->dump_stream("collection") << cur_cid;
+  }
+  f->dump_stream("pass_start") << pass_start;
+  f->dump_stream("pass_end") << pass_end;
+  f->dump_unsigned("scanned", scanned);
+  f->dump_unsigned("rewritten", rewritten);
+  f->dump_unsigned("rewritten_bytes", rewritten_bytes);
+}
+
+class BlueStore::DefragSocketHook : public AdminSocketHook {
+  BlueStore *store;
+  bool registered = false;
+
+public:
+  explicit DefragSocketHook(BlueStore *s) : store(s) {
+    AdminSocket *admin_socket = store->cct->get_admin_socket();
+    int r = admin_socket->register_command(
+      "bluestore defrag status",
+      "bluestore defrag status",
+      this,
+      "show progress of the background defragmenter");
+    if (r != 0) {
+      // another instance already owns these (e.g. in tests)
+      return;
+    }
+    registered = true;
+    r = admin_socket->register_command(
+      "bluestore defrag start",
+      "bluestore defrag start",
+      this,
+      "start a defragmentation pass now");
+    assert(r == 0);
+    r = admin_socket->register_command(
+      "bluestore defrag stop",
+      "bluestore defrag stop",
+      this,
+      "end the running defragmentation pass");
+    assert(r == 0);
+  }
+  ~DefragSocketHook() override {
+    if (registered) {
+      store->cct->get_admin_socket()->unregister_commands(this);
+    }
+  }
+
+  bool call(std::string_view command, const cmdmap_t& cmdmap,
+	    std::string_view format, bufferlist& out) override {
+    auto& t = store->defrag_thread;
+    if (command == "bluestore defrag start") {
+      Mutex::Locker l(t.lock);
+      t.kick = true;
+      t.cond.Signal();
+    } else if (command == "bluestore defrag stop") {
+      Mutex::Locker l(t.lock);
+      t.kick = false;
+      t.abort = true;
+      t.cond.Signal();
+    } else if (command != "bluestore defrag status") {
+      return false;
+    }
+    std::unique_ptr<Formatter> f(Formatter::create(format, "json-pretty",
+						   "json-pretty"));
+    f->open_object_section("defrag");
+    t.dump(f.get());
+    f->close_section();
+    f->flush(out);
+    return true;
+  }
+};
+
+// =======================================================
+
 // OmapIteratorImpl
 
 #undef dout_prefix
@@ -3751,7 +4103,8 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
     deferred_finisher(cct, "defered_finisher", "dfin"),
     kv_sync_thread(this),
     kv_finalize_thread(this),
-    mempool_thread(this)
+    mempool_thread(this),
+    defrag_thread(this)
 {
   _init_logger();
   cct->_conf.add_observer(this);
@@ -3772,7 +4125,8 @@ BlueStore::BlueStore(CephContext *cct,
     kv_finalize_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
-    mempool_thread(this)
+    mempool_thread(this),
+    defrag_thread(this)
 {
   _init_logger();
   cct->_conf.add_observer(this);
@@ -3797,6 +4151,10 @@ BlueStore::~BlueStore()
     delete i;
   }
   cache_shards.clear();
+  for (auto i : pri_cache_shards) {
+    delete i;
+  }
+  pri_cache_shards.clear();
 }
 
 const char **BlueStore::get_tracked_conf_keys() const
@@ -4052,6 +4410,16 @@ int BlueStore::_set_cache_sizes()
     // deal with floating point imprecision
     cache_data_ratio = 0;
   }
+
+  cache_pri_meta_ratio = cct->_conf->bluestore_cache_priority_meta_ratio;
+  cache_pri_data_ratio = cct->_conf->bluestore_cache_priority_data_ratio;
+  if (cache_pri_meta_ratio < 0 || cache_pri_data_ratio < 0 ||
+      cache_pri_meta_ratio + cache_pri_data_ratio > 1.0) {
+    derr << __func__ << " bluestore_cache_priority_meta_ratio ("
+	 << cache_pri_meta_ratio << ") + bluestore_cache_priority_data_ratio ("
+	 << cache_pri_data_ratio << ") must be in range [0,1.0]" << dendl;
+    return -EINVAL;
+  }
     
   dout(1) << __func__ << " cache_size " << cache_size
           << " meta " << cache_meta_ratio
@@ -4155,12 +4523,27 @@ void BlueStore::_init_logger()
     "Sum for beneficial compress ops");
   b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
     "Sum for compress ops rejected due to low net gain of space");
+  b.add_u64_counter(l_bluestore_compress_skipped_count, "compress_skipped_count",
+    "Sum for compress ops skipped because data looked incompressible");
+  b.add_u64_counter(l_bluestore_compress_skipped_bytes, "compress_skipped_bytes",
+		    "Sum for bytes not compressed because they looked incompressible",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_time(l_bluestore_compress_saved_time, "compress_saved_time",
+    "Estimated compressor time saved by skipping incompressible data");
+  b.add_time_avg(l_bluestore_compress_sample_lat, "compress_sample_lat",
+    "Average latency of the pre-compression entropy estimate");
   b.add_u64_counter(l_bluestore_write_pad_bytes, "write_pad_bytes",
 		    "Sum for write-op padded bytes", NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_deferred_write_ops, "deferred_write_ops",
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def", 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_write_merged, "deferred_write_merged",
+		    "Sum for deferred extents merged into an adjacent write");
+  b.add_u64_counter(l_bluestore_deferred_write_overwritten_bytes,
+		    "deferred_write_overwritten_bytes",
+		    "Sum for deferred bytes superseded before being written",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -4220,10 +4603,22 @@ void BlueStore::_init_logger()
 		    "cached) to fill out the block");
   b.add_u64_counter(l_bluestore_write_small_new, "bluestore_write_small_new",
 		    "Small write into new (sparse) blob");
+  b.add_u64_counter(l_bluestore_write_inline, "bluestore_write_inline",
+		    "Writes stored inline in the onode");
+  b.add_u64_counter(l_bluestore_write_inline_bytes,
+		    "bluestore_write_inline_bytes",
+		    "Bytes written inline in the onode");
+  b.add_u64_counter(l_bluestore_inline_promote, "bluestore_inline_promote",
+		    "Objects whose inline data was moved to blobs");
 
   b.add_u64_counter(l_bluestore_txc, "bluestore_txc", "Transactions committed");
   b.add_u64_counter(l_bluestore_onode_reshard, "bluestore_onode_reshard",
 		    "Onode extent map reshard events");
+  b.add_u64_counter(l_bluestore_onode_delta, "bluestore_onode_delta",
+		    "Onode updates recorded as extent map shard deltas only");
+  b.add_u64_counter(l_bluestore_onode_delta_saved_bytes,
+		    "bluestore_onode_delta_saved_bytes",
+		    "Onode key bytes not written thanks to shard deltas");
   b.add_u64_counter(l_bluestore_blob_split, "bluestore_blob_split",
 		    "Sum for blob splitting due to resharding");
   b.add_u64_counter(l_bluestore_extent_compress, "bluestore_extent_compress",
@@ -4231,12 +4626,61 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_gc_merged, "bluestore_gc_merged",
 		    "Sum for extents that have been merged due to garbage "
 		    "collection");
+  b.add_u64_counter(l_bluestore_tier_hot_allocs, "bluestore_tier_hot_allocs",
+		    "Extents of hot objects allocated in the fast zone");
+  b.add_u64_counter(l_bluestore_tier_migrated_bytes,
+		    "bluestore_tier_migrated_bytes",
+		    "Bytes rewritten to match object heat (fast/slow zone)");
   b.add_u64_counter(l_bluestore_read_eio, "bluestore_read_eio",
                     "Read EIO errors propagated to high level callers");
+  b.add_u64_counter(l_bluestore_read_zerocopy_bytes,
+		    "bluestore_read_zerocopy_bytes",
+		    "Read bytes returned by reference to cached or device "
+		    "buffers");
+  b.add_u64_counter(l_bluestore_read_copy_bytes, "bluestore_read_copy_bytes",
+		    "Read bytes materialized into new buffers (decompressed "
+		    "or zero filled)");
+  b.add_u64_counter(l_bluestore_read_copies, "bluestore_read_copies",
+		    "Buffers materialized while assembling read results");
   b.add_u64(l_bluestore_fragmentation, "bluestore_fragmentation_micros",
             "How fragmented bluestore free space is (free extents / max possible number of free extents) * 1000");
+  b.add_u64_counter(l_bluestore_defrag_scanned, "bluestore_defrag_scanned",
+		    "Objects scored by the defragmenter");
+  b.add_u64_counter(l_bluestore_defrag_rewritten, "bluestore_defrag_rewritten",
+		    "Objects rewritten by the defragmenter");
+  b.add_u64_counter(l_bluestore_defrag_rewritten_bytes,
+		    "bluestore_defrag_rewritten_bytes",
+		    "Bytes rewritten by the defragmenter",
+		    NULL, 0, unit_t(UNIT_BYTES));
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
+
+  for (auto& p : Compressor::compression_algorithms) {
+    if (p.second == Compressor::COMP_ALG_NONE) {
+      continue;
+    }
+    PerfCountersBuilder cb(cct, string("bluestore-compressor-") + p.first,
+			   l_bluestore_comp_first, l_bluestore_comp_last);
+    cb.add_u64_counter(l_bluestore_comp_in_bytes, "in_bytes",
+		       "Sum for bytes passed to the compressor",
+		       NULL, 0, unit_t(UNIT_BYTES));
+    cb.add_u64_counter(l_bluestore_comp_out_bytes, "out_bytes",
+		       "Sum for bytes produced by the compressor",
+		       NULL, 0, unit_t(UNIT_BYTES));
+    cb.add_u64_counter(l_bluestore_comp_rejected_bytes, "rejected_bytes",
+		       "Sum for bytes compressed but stored uncompressed",
+		       NULL, 0, unit_t(UNIT_BYTES));
+    cb.add_u64_counter(l_bluestore_comp_skipped_bytes, "skipped_bytes",
+		       "Sum for bytes not passed to the compressor",
+		       NULL, 0, unit_t(UNIT_BYTES));
+    cb.add_time_avg(l_bluestore_comp_lat, "lat",
+		    "Average compress latency");
+    cb.add_u64(l_bluestore_comp_ratio, "ratio",
+	       "Compressed size relative to input size (out / in) * 1000");
+    auto& cs = comp_stats[p.second];
+    cs.logger = cb.create_perf_counters();
+    cct->get_perfcounters_collection()->add(cs.logger);
+  }
 }
 
 int BlueStore::_reload_logger()
@@ -4256,6 +4700,13 @@ int BlueStore::_reload_logger()
 
 void BlueStore::_shutdown_logger()
 {
+  for (auto& cs : comp_stats) {
+    if (cs.logger) {
+      cct->get_perfcounters_collection()->remove(cs.logger);
+      delete cs.logger;
+      cs.logger = nullptr;
+    }
+  }
   cct->get_perfcounters_collection()->remove(logger);
   delete logger;
 }
@@ -4607,7 +5058,7 @@ int BlueStore::_open_alloc()
   assert(bdev->get_size());
   alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
                             bdev->get_size(),
-                            min_alloc_size);
+                            min_alloc_size, "block");
   if (!alloc) {
     lderr(cct) << __func__ << " Allocator::unknown alloc type "
                << cct->_conf->bluestore_allocator
@@ -4617,6 +5068,20 @@ int BlueStore::_open_alloc()
 
   uint64_t num = 0, bytes = 0;
 
+  if (bluefs) {
+    bool loaded = cct->_conf->bluestore_alloc_snapshot &&
+      _read_alloc_snapshot(&num, &bytes) == 0;
+    // a snapshot is only valid until the next allocation change; drop
+    // it before anything gets written so a crash can't leave it stale
+    _remove_alloc_snapshot();
+    if (loaded) {
+      dout(1) << __func__ << " loaded " << byte_u_t(bytes)
+	      << " in " << num << " extents from snapshot"
+	      << dendl;
+      return 0;
+    }
+  }
+
   dout(1) << __func__ << " opening allocation metadata" << dendl;
   // initialize from freelist
   fm->enumerate_reset();
@@ -4652,6 +5117,171 @@ void BlueStore::_close_alloc()
   alloc = NULL;
 }
 
+// Allocator snapshot layout (in BlueFS, ALLOC_SNAPSHOT_DIR/ALLOC_SNAPSHOT_FILE):
+//   header: versioned, device size, min_alloc_size
+//   N x (u64 offset, u64 length) free extents
+//   trailer: u64 N, u64 free bytes, u32 crc32c of everything before it
+static const string ALLOC_SNAPSHOT_DIR = "bluestore";
+static const string ALLOC_SNAPSHOT_FILE = "alloc_snapshot";
+static const size_t ALLOC_SNAPSHOT_TRAILER_LEN =
+  sizeof(uint64_t) * 2 + sizeof(uint32_t);
+
+int BlueStore::_write_alloc_snapshot()
+{
+  assert(bluefs);
+  assert(alloc);
+  dout(10) << __func__ << dendl;
+  utime_t start = ceph_clock_now();
+
+  if (!bluefs->dir_exists(ALLOC_SNAPSHOT_DIR)) {
+    int r = bluefs->mkdir(ALLOC_SNAPSHOT_DIR);
+    if (r < 0) {
+      derr << __func__ << " failed to create " << ALLOC_SNAPSHOT_DIR
+	   << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+  BlueFS::FileWriter *h;
+  int r = bluefs->open_for_write(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE,
+				 &h, false);
+  if (r < 0) {
+    derr << __func__ << " failed to open " << ALLOC_SNAPSHOT_FILE
+	 << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  bufferlist bl;
+  ENCODE_START(1, 1, bl);
+  encode(bdev->get_size(), bl);
+  encode(min_alloc_size, bl);
+  ENCODE_FINISH(bl);
+
+  uint32_t crc = -1;
+  uint64_t num = 0, bytes = 0;
+  const unsigned flush_bytes = 1 << 20;
+  alloc->dump([&](uint64_t offset, uint64_t length) {
+      encode(offset, bl);
+      encode(length, bl);
+      ++num;
+      bytes += length;
+      if (bl.length() >= flush_bytes) {
+	crc = bl.crc32c(crc);
+	h->append(bl);
+	bl.clear();
+	bluefs->flush(h);
+      }
+    });
+  encode(num, bl);
+  encode(bytes, bl);
+  crc = bl.crc32c(crc);
+  encode(crc, bl);
+  h->append(bl);
+  r = bluefs->fsync(h);
+  bluefs->close_writer(h);
+  if (r < 0) {
+    derr << __func__ << " failed to sync " << ALLOC_SNAPSHOT_FILE
+	 << ": " << cpp_strerror(r) << dendl;
+    _remove_alloc_snapshot();
+    return r;
+  }
+  bluefs->sync_metadata();
+  dout(1) << __func__ << " saved " << byte_u_t(bytes) << " in " << num
+	  << " extents in " << ceph_clock_now() - start << dendl;
+  return 0;
+}
+
+int BlueStore::_read_alloc_snapshot(uint64_t *pnum, uint64_t *pbytes)
+{
+  assert(bluefs);
+  assert(alloc);
+  dout(10) << __func__ << dendl;
+
+  uint64_t size = 0;
+  utime_t mtime;
+  int r = bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &size, &mtime);
+  if (r < 0) {
+    dout(1) << __func__ << " no snapshot, last shutdown was not clean"
+	    << dendl;
+    return r;
+  }
+  if (size < ALLOC_SNAPSHOT_TRAILER_LEN) {
+    derr << __func__ << " snapshot is too short (" << size << " bytes)"
+	 << dendl;
+    return -EIO;
+  }
+  BlueFS::FileReader *h;
+  r = bluefs->open_for_read(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &h);
+  if (r < 0) {
+    return r;
+  }
+  bufferlist bl;
+  h->buf.max_prefetch = size;
+  r = bluefs->read(h, &h->buf, 0, size, &bl, NULL);
+  delete h;
+  if (r < 0 || (uint64_t)r != size) {
+    derr << __func__ << " short read " << r << " of " << size << dendl;
+    return r < 0 ? r : -EIO;
+  }
+
+  bufferlist payload, trailer;
+  payload.substr_of(bl, 0, size - sizeof(uint32_t));
+  trailer.substr_of(bl, size - ALLOC_SNAPSHOT_TRAILER_LEN,
+		    ALLOC_SNAPSHOT_TRAILER_LEN);
+  uint64_t num, bytes;
+  uint32_t crc;
+  auto t = trailer.cbegin();
+  decode(num, t);
+  decode(bytes, t);
+  decode(crc, t);
+  if (crc != payload.crc32c(-1)) {
+    derr << __func__ << " bad crc on snapshot, ignoring it" << dendl;
+    return -EIO;
+  }
+
+  auto p = bl.cbegin();
+  uint64_t dev_size, alloc_size;
+  try {
+    DECODE_START(1, p);
+    decode(dev_size, p);
+    decode(alloc_size, p);
+    DECODE_FINISH(p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " unable to decode snapshot header" << dendl;
+    return -EIO;
+  }
+  if (dev_size != bdev->get_size() || alloc_size != min_alloc_size) {
+    derr << __func__ << " snapshot was taken for device size 0x" << std::hex
+	 << dev_size << " min_alloc_size 0x" << alloc_size
+	 << ", now 0x" << bdev->get_size() << " 0x" << min_alloc_size
+	 << std::dec << ", ignoring it" << dendl;
+    return -EINVAL;
+  }
+  if (p.get_off() + num * sizeof(uint64_t) * 2 +
+      ALLOC_SNAPSHOT_TRAILER_LEN != size) {
+    derr << __func__ << " snapshot length mismatch, ignoring it" << dendl;
+    return -EIO;
+  }
+  for (uint64_t i = 0; i < num; ++i) {
+    uint64_t offset, length;
+    decode(offset, p);
+    decode(length, p);
+    alloc->init_add_free(offset, length);
+  }
+  *pnum = num;
+  *pbytes = bytes;
+  return 0;
+}
+
+void BlueStore::_remove_alloc_snapshot()
+{
+  assert(bluefs);
+  int r = bluefs->unlink(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE);
+  if (r == 0) {
+    dout(10) << __func__ << dendl;
+    bluefs->sync_metadata();
+  }
+}
+
 int BlueStore::_open_fsid(bool create)
 {
   assert(fsid_fd < 0);
@@ -5068,16 +5698,7 @@ int BlueStore::_open_db(bool create, bool to_repair_db)
 
   if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
-
-    map<string,string> cf_map;
-    cct->_conf.with_val<string>("bluestore_rocksdb_cfs",
-                                 get_str_map,
-                                 &cf_map,
-                                 " \t");
-    for (auto& i : cf_map) {
-      dout(10) << "column family " << i.first << ": " << i.second << dendl;
-      cfs.push_back(KeyValueDB::ColumnFamily(i.first, i.second));
-    }
+    _get_db_cfs(&cfs);
   }
 
   db->init(options);
@@ -5110,6 +5731,37 @@ free_bluefs:
   return r;
 }
 
+void BlueStore::_get_db_cfs(vector<KeyValueDB::ColumnFamily> *cfs)
+{
+  map<string,string> cf_map;
+  cct->_conf.with_val<string>("bluestore_rocksdb_cfs",
+                               get_str_map,
+                               &cf_map,
+                               " \t");
+  for (auto& i : cf_map) {
+    dout(10) << "column family " << i.first << ": " << i.second << dendl;
+    cfs->push_back(KeyValueDB::ColumnFamily(i.first, i.second));
+  }
+}
+
+int BlueStore::reshard_db(ostream& out)
+{
+  KeyValueDB *kvdb;
+  int r = start_kv_only(&kvdb, false);
+  if (r < 0)
+    return r;
+  vector<KeyValueDB::ColumnFamily> cfs;
+  if (cct->_conf.get_val<bool>("bluestore_rocksdb_cf")) {
+    _get_db_cfs(&cfs);
+  }
+  r = kvdb->reshard(cfs, out);
+  if (r < 0) {
+    derr << __func__ << " failed: " << cpp_strerror(r) << dendl;
+  }
+  umount();
+  return r;
+}
+
 void BlueStore::_close_db()
 {
   assert(db);
@@ -5332,7 +5984,7 @@ int BlueStore::_open_collections(int *errors)
       CollectionRef c(
 	new Collection(
 	  this,
-	  cache_shards[cid.hash_to_shard(cache_shards.size())],
+	  _get_cache_shard(cid),
 	  cid));
       bufferlist bl = it->value();
       auto p = bl.cbegin();
@@ -5657,12 +6309,32 @@ void BlueStore::set_cache_shards(unsigned num)
   size_t old = cache_shards.size();
   assert(num >= old);
   cache_shards.resize(num);
-  for (unsigned i = old; i < num; ++i) {
-    cache_shards[i] = Cache::create(cct, cct->_conf->bluestore_cache_type,
-				    logger);
+  pri_cache_shards.resize(num);
+  for (unsigned i = 0; i < num; ++i) {
+    if (i >= old) {
+      cache_shards[i] = Cache::create(cct, cct->_conf->bluestore_cache_type,
+				      logger);
+      pri_cache_shards[i] = Cache::create(cct,
+					  cct->_conf->bluestore_cache_type,
+					  logger);
+    }
+    // per-shard counters are only interesting with more than one shard
+    if (num > 1 && !cache_shards[i]->shard_logger) {
+      cache_shards[i]->init_shard_logger(i);
+      pri_cache_shards[i]->init_shard_logger(num + i);
+    }
   }
 }
 
+BlueStore::Cache *BlueStore::_get_cache_shard(const coll_t& cid)
+{
+  // caller holds coll_lock
+  spg_t pgid;
+  bool pri = cid.is_pg(&pgid) && cache_pri_pools.count(pgid.pool());
+  vector<Cache*>& shards = pri ? pri_cache_shards : cache_shards;
+  return shards[cid.hash_to_shard(shards.size())];
+}
+
 int BlueStore::_mount(bool kv_only, bool open_db)
 {
   dout(1) << __func__ << " path " << path << dendl;
@@ -5753,6 +6425,8 @@ int BlueStore::_mount(bool kv_only, bool open_db)
     goto out_stop;
 
   mempool_thread.init();
+  defrag_thread.init();
+  defrag_asok_hook = new DefragSocketHook(this);
 
   mounted = true;
   return 0;
@@ -5781,6 +6455,13 @@ int BlueStore::umount()
   assert(_kv_only || mounted);
   dout(1) << __func__ << dendl;
 
+  if (!_kv_only) {
+    // no more background rewrites
+    delete defrag_asok_hook;
+    defrag_asok_hook = nullptr;
+    defrag_thread.shutdown();
+  }
+
   _osr_drain_all();
 
   mounted = false;
@@ -5791,6 +6472,12 @@ int BlueStore::umount()
     _flush_cache();
     dout(20) << __func__ << " closing" << dendl;
 
+    if (bluefs && cct->_conf->bluestore_alloc_snapshot) {
+      // nothing allocates past this point; wait for in-flight discards
+      // to hand their extents back before taking the snapshot
+      bdev->discard_drain();
+      _write_alloc_snapshot();
+    }
     _close_alloc();
     _close_fm();
   }
@@ -5865,7 +6552,7 @@ int BlueStore::_fsck_check_extents(
 	  bs.set(pos);
       });
       if (repairer) {
-	repairer->get_space_usage_tracker().set_used( e.offset, e.length, cid, oid);
+	repairer->note_used(e.offset, e.length, cid, oid);
       }
 
     if (e.end() > bdev->get_size()) {
@@ -5877,35 +6564,397 @@ int BlueStore::_fsck_check_extents(
   return errors;
 }
 
-/**
-An overview for currently implemented repair logics 
-performed in fsck in two stages: detection(+preparation) and commit.
-Detection stage (in processing order):
-  (Issue -> Repair action to schedule)
-  - Detect undecodable keys for Shared Blobs -> Remove
-  - Detect undecodable records for Shared Blobs -> Remove 
-    (might trigger missed Shared Blob detection below)
-  - Detect stray records for Shared Blobs -> Remove
-  - Detect misreferenced pextents -> Fix
-    Prepare Bloom-like filter to track cid/oid -> pextent 
-    Prepare list of extents that are improperly referenced
-    Enumerate Onode records that might use 'misreferenced' pextents
-    (Bloom-like filter applied to reduce computation)
-      Per each questinable Onode enumerate all blobs and identify broken ones 
-      (i.e. blobs having 'misreferences')
-      Rewrite each broken blob data by allocating another extents and 
-      copying data there
-      If blob is shared - unshare it and mark corresponding Shared Blob 
-      for removal
-      Release previously allocated space
-      Update Extent Map
-  - Detect missed Shared Blobs -> Recreate
-  - Detect undecodable deferred transaction -> Remove
-  - Detect Freelist Manager's 'false free' entries -> Mark as used
-  - Detect Freelist Manager's leaked entries -> Mark as free
-  - Detect statfs inconsistency - Update
-  Commit stage (separate DB commit per each step):
-  - Apply leaked FM entries fix
+void BlueStore::_fsck_check_object(
+  FSCKObjectCtx& ctx,
+  const string& key,
+  const vector<string>& shard_keys,
+  bool deep,
+  BlueStoreRepairer* repairer)
+{
+  vector<string> expecting_shards;
+  _fsck_check_onode(ctx, key, deep, repairer, &expecting_shards);
+
+  // both lists are in key order
+  auto e = expecting_shards.begin();
+  for (auto& k : shard_keys) {
+    while (e != expecting_shards.end() && *e < k) {
+      derr << "fsck error: missing shard key "
+	   << pretty_binary_string(*e) << dendl;
+      ++ctx.errors;
+      ++e;
+    }
+    if (e != expecting_shards.end() && *e == k) {
+      // all good
+      ++e;
+      continue;
+    }
+    uint32_t offset;
+    string okey;
+    get_key_extent_shard(k, &okey, &offset);
+    derr << "fsck error: stray shard 0x" << std::hex << offset
+	 << std::dec << " " << pretty_binary_string(k) << dendl;
+    ++ctx.errors;
+  }
+  for (; e != expecting_shards.end(); ++e) {
+    derr << "fsck error: missing shard key "
+	 << pretty_binary_string(*e) << dendl;
+    ++ctx.errors;
+  }
+}
+
+void BlueStore::_fsck_check_onode(
+  FSCKObjectCtx& ctx,
+  const string& key,
+  bool deep,
+  BlueStoreRepairer* repairer,
+  vector<string> *expecting_shards)
+{
+  int& errors = ctx.errors;
+  CollectionRef& c = ctx.c;
+  spg_t& pgid = ctx.pgid;
+
+  ghobject_t oid;
+  int r = get_key_object(key, &oid);
+  if (r < 0) {
+    derr << "fsck error: bad object key "
+	 << pretty_binary_string(key) << dendl;
+    ++errors;
+    return;
+  }
+  if (!c ||
+      oid.shard_id != pgid.shard ||
+      oid.hobj.pool != (int64_t)pgid.pool() ||
+      !c->contains(oid)) {
+    c = nullptr;
+    {
+      RWLock::RLocker l(coll_lock);
+      for (auto& p : coll_map) {
+	if (p.second->contains(oid)) {
+	  c = p.second;
+	  break;
+	}
+      }
+    }
+    if (!c) {
+      derr << "fsck error: stray object " << oid
+	   << " not owned by any collection" << dendl;
+      ++errors;
+      return;
+    }
+    c->cid.is_pg(&pgid);
+    dout(20) << __func__ << "  collection " << c->cid << " " << c->cnode
+	     << dendl;
+  }
+
+  dout(10) << __func__ << "  " << oid << dendl;
+  RWLock::RLocker l(c->lock);
+  OnodeRef o = c->get_onode(oid, false);
+  if (o->onode.nid) {
+    if (o->onode.nid > nid_max) {
+      derr << "fsck error: " << oid << " nid " << o->onode.nid
+	   << " > nid_max " << nid_max << dendl;
+      ++errors;
+    }
+    if (ctx.used_nids.count(o->onode.nid)) {
+      derr << "fsck error: " << oid << " nid " << o->onode.nid
+	   << " already in use" << dendl;
+      ++errors;
+      return; // go for next object
+    }
+    ctx.used_nids.insert(o->onode.nid);
+  }
+  ++ctx.num_objects;
+  ctx.num_spanning_blobs += o->extent_map.spanning_blob_map.size();
+  o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+  _dump_onode(o);
+  // shards
+  if (!o->extent_map.shards.empty()) {
+    ++ctx.num_sharded_objects;
+    ctx.num_object_shards += o->extent_map.shards.size();
+  }
+  for (auto& s : o->extent_map.shards) {
+    dout(20) << __func__ << "    shard " << *s.shard_info << dendl;
+    expecting_shards->push_back(string());
+    get_extent_shard_key(o->key, s.shard_info->offset,
+			 &expecting_shards->back());
+    if (s.shard_info->offset >= o->onode.size) {
+      derr << "fsck error: " << oid << " shard 0x" << std::hex
+	   << s.shard_info->offset << " past EOF at 0x" << o->onode.size
+	   << std::dec << dendl;
+      ++errors;
+    }
+  }
+  // lextents
+  map<BlobRef,bluestore_blob_t::unused_t> referenced;
+  uint64_t pos = 0;
+  mempool::bluestore_fsck::map<BlobRef,
+			       bluestore_blob_use_tracker_t> ref_map;
+  for (auto& l : o->extent_map.extent_map) {
+    dout(20) << __func__ << "    " << l << dendl;
+    if (l.logical_offset < pos) {
+      derr << "fsck error: " << oid << " lextent at 0x"
+	   << std::hex << l.logical_offset
+	   << " overlaps with the previous, which ends at 0x" << pos
+	   << std::dec << dendl;
+      ++errors;
+    }
+    if (o->extent_map.spans_shard(l.logical_offset, l.length)) {
+      derr << "fsck error: " << oid << " lextent at 0x"
+	   << std::hex << l.logical_offset << "~" << l.length
+	   << " spans a shard boundary"
+	   << std::dec << dendl;
+      ++errors;
+    }
+    pos = l.logical_offset + l.length;
+    ctx.expected_statfs.stored += l.length;
+    assert(l.blob);
+    const bluestore_blob_t& blob = l.blob->get_blob();
+
+    auto& ref = ref_map[l.blob];
+    if (ref.is_empty()) {
+      uint32_t min_release_size = blob.get_release_size(min_alloc_size);
+      uint32_t l = blob.get_logical_length();
+      ref.init(l, min_release_size);
+    }
+    ref.get(
+      l.blob_offset,
+      l.length);
+    ++ctx.num_extents;
+    if (blob.has_unused()) {
+      auto p = referenced.find(l.blob);
+      bluestore_blob_t::unused_t *pu;
+      if (p == referenced.end()) {
+	pu = &referenced[l.blob];
+      } else {
+	pu = &p->second;
+      }
+      uint64_t blob_len = blob.get_logical_length();
+      assert((blob_len % (sizeof(*pu)*8)) == 0);
+      assert(l.blob_offset + l.length <= blob_len);
+      uint64_t chunk_size = blob_len / (sizeof(*pu)*8);
+      uint64_t start = l.blob_offset / chunk_size;
+      uint64_t end =
+	round_up_to(l.blob_offset + l.length, chunk_size) / chunk_size;
+      for (auto i = start; i < end; ++i) {
+	(*pu) |= (1u << i);
+      }
+    }
+  }
+  for (auto &i : referenced) {
+    dout(20) << __func__ << "  referenced 0x" << std::hex << i.second
+	     << std::dec << " for " << *i.first << dendl;
+    const bluestore_blob_t& blob = i.first->get_blob();
+    if (i.second & blob.unused) {
+      derr << "fsck error: " << oid << " blob claims unused 0x"
+	   << std::hex << blob.unused
+	   << " but extents reference 0x" << i.second << std::dec
+	   << " on blob " << *i.first << dendl;
+      ++errors;
+    }
+    if (blob.has_csum()) {
+      uint64_t blob_len = blob.get_logical_length();
+      uint64_t unused_chunk_size = blob_len / (sizeof(blob.unused)*8);
+      unsigned csum_count = blob.get_csum_count();
+      unsigned csum_chunk_size = blob.get_csum_chunk_size();
+      for (unsigned p = 0; p < csum_count; ++p) {
+	unsigned pos = p * csum_chunk_size;
+	unsigned firstbit = pos / unused_chunk_size;    // [firstbit,lastbit]
+	unsigned lastbit = (pos + csum_chunk_size - 1) / unused_chunk_size;
+	unsigned mask = 1u << firstbit;
+	for (unsigned b = firstbit + 1; b <= lastbit; ++b) {
+	  mask |= 1u << b;
+	}
+	if ((blob.unused & mask) == mask) {
+	  // this csum chunk region is marked unused
+	  if (blob.get_csum_item(p) != 0) {
+	    derr << "fsck error: " << oid
+		 << " blob claims csum chunk 0x" << std::hex << pos
+		 << "~" << csum_chunk_size
+		 << " is unused (mask 0x" << mask << " of unused 0x"
+		 << blob.unused << ") but csum is non-zero 0x"
+		 << blob.get_csum_item(p) << std::dec << " on blob "
+		 << *i.first << dendl;
+	    ++errors;
+	  }
+	}
+      }
+    }
+  }
+  for (auto &i : ref_map) {
+    ++ctx.num_blobs;
+    const bluestore_blob_t& blob = i.first->get_blob();
+    bool equal = i.first->get_blob_use_tracker().equal(i.second);
+    if (!equal) {
+      derr << "fsck error: " << oid << " blob " << *i.first
+	   << " doesn't match expected ref_map " << i.second << dendl;
+      ++errors;
+    }
+    if (blob.is_compressed()) {
+      ctx.expected_statfs.compressed += blob.get_compressed_payload_length();
+      ctx.expected_statfs.compressed_original +=
+	i.first->get_referenced_bytes();
+    }
+    if (blob.is_shared()) {
+      if (i.first->shared_blob->get_sbid() > blobid_max) {
+	derr << "fsck error: " << oid << " blob " << blob
+	     << " sbid " << i.first->shared_blob->get_sbid() << " > blobid_max "
+	     << blobid_max << dendl;
+	++errors;
+      } else if (i.first->shared_blob->get_sbid() == 0) {
+	derr << "fsck error: " << oid << " blob " << blob
+	     << " marked as shared but has uninitialized sbid"
+	     << dendl;
+	++errors;
+      }
+      fsck_sb_info_t& sbi = ctx.sb_info[i.first->shared_blob->get_sbid()];
+      assert(sbi.cid == coll_t() || sbi.cid == c->cid);
+      sbi.cid = c->cid;
+      sbi.sb = i.first->shared_blob;
+      sbi.oids.push_back(oid);
+      sbi.compressed = blob.is_compressed();
+      for (auto e : blob.get_extents()) {
+	if (e.is_valid()) {
+	  sbi.ref_map.get(e.offset, e.length);
+	}
+      }
+    } else {
+      errors += _fsck_check_extents(c->cid, oid, blob.get_extents(),
+				    blob.is_compressed(),
+				    ctx.used_blocks,
+				    fm->get_alloc_size(),
+				    repairer,
+				    ctx.expected_statfs);
+    }
+  }
+  if (deep) {
+    bufferlist bl;
+    int r = _do_read(c.get(), o, 0, o->onode.size, bl, 0);
+    if (r < 0) {
+      ++errors;
+      derr << "fsck error: " << oid << " error during read: "
+	   << cpp_strerror(r) << dendl;
+    } else {
+      fsck_bytes_read += r;
+    }
+  }
+  // omap
+  if (o->onode.has_omap()) {
+    auto& m =
+      o->onode.is_pgmeta_omap() ? ctx.used_pgmeta_omap_head : ctx.used_omap_head;
+    if (m.count(o->onode.nid)) {
+      derr << "fsck error: " << oid << " omap_head " << o->onode.nid
+	   << " already in use" << dendl;
+      ++errors;
+    } else {
+      m.insert(o->onode.nid);
+    }
+  }
+  ++fsck_objects_checked;
+}
+
+void BlueStore::_fsck_merge(
+  FSCKObjectCtx& to,
+  FSCKObjectCtx& from,
+  BlueStoreRepairer* repairer)
+{
+  to.errors += from.errors;
+  to.num_objects += from.num_objects;
+  to.num_extents += from.num_extents;
+  to.num_blobs += from.num_blobs;
+  to.num_spanning_blobs += from.num_spanning_blobs;
+  to.num_sharded_objects += from.num_sharded_objects;
+  to.num_object_shards += from.num_object_shards;
+
+  for (auto nid : from.used_nids) {
+    if (!to.used_nids.insert(nid).second) {
+      derr << "fsck error: nid " << nid << " already in use" << dendl;
+      ++to.errors;
+    }
+  }
+  for (auto nid : from.used_omap_head) {
+    if (!to.used_omap_head.insert(nid).second) {
+      derr << "fsck error: omap_head " << nid << " already in use" << dendl;
+      ++to.errors;
+    }
+  }
+  for (auto nid : from.used_pgmeta_omap_head) {
+    if (!to.used_pgmeta_omap_head.insert(nid).second) {
+      derr << "fsck error: pgmeta omap_head " << nid << " already in use"
+	   << dendl;
+      ++to.errors;
+    }
+  }
+
+  // blocks claimed by objects checked in different threads
+  assert(to.used_blocks.size() == from.used_blocks.size());
+  auto dup = to.used_blocks & from.used_blocks;
+  for (auto pos = dup.find_first();
+       pos != mempool_dynamic_bitset::npos;
+       pos = dup.find_next(pos)) {
+    derr << "fsck error: block 0x" << std::hex
+	 << pos * fm->get_alloc_size() << std::dec
+	 << " is already allocated (misreferenced)" << dendl;
+    ++to.errors;
+    if (repairer) {
+      repairer->note_misreference(
+	pos * min_alloc_size, min_alloc_size, true);
+    }
+  }
+  to.used_blocks |= from.used_blocks;
+
+  for (auto& p : from.sb_info) {
+    fsck_sb_info_t& sbi = to.sb_info[p.first];
+    fsck_sb_info_t& fsbi = p.second;
+    assert(sbi.cid == coll_t() || sbi.cid == fsbi.cid);
+    sbi.cid = fsbi.cid;
+    sbi.sb = fsbi.sb;
+    sbi.oids.splice(sbi.oids.end(), fsbi.oids);
+    sbi.compressed = fsbi.compressed;
+    for (auto& r : fsbi.ref_map.ref_map) {
+      for (unsigned i = 0; i < r.second.refs; ++i) {
+	sbi.ref_map.get(r.first, r.second.length);
+      }
+    }
+  }
+
+  to.expected_statfs.allocated += from.expected_statfs.allocated;
+  to.expected_statfs.stored += from.expected_statfs.stored;
+  to.expected_statfs.compressed += from.expected_statfs.compressed;
+  to.expected_statfs.compressed_allocated +=
+    from.expected_statfs.compressed_allocated;
+  to.expected_statfs.compressed_original +=
+    from.expected_statfs.compressed_original;
+}
+
+/**
+An overview for currently implemented repair logics 
+performed in fsck in two stages: detection(+preparation) and commit.
+Detection stage (in processing order):
+  (Issue -> Repair action to schedule)
+  - Detect undecodable keys for Shared Blobs -> Remove
+  - Detect undecodable records for Shared Blobs -> Remove 
+    (might trigger missed Shared Blob detection below)
+  - Detect stray records for Shared Blobs -> Remove
+  - Detect misreferenced pextents -> Fix
+    Prepare Bloom-like filter to track cid/oid -> pextent 
+    Prepare list of extents that are improperly referenced
+    Enumerate Onode records that might use 'misreferenced' pextents
+    (Bloom-like filter applied to reduce computation)
+      Per each questinable Onode enumerate all blobs and identify broken ones 
+      (i.e. blobs having 'misreferences')
+      Rewrite each broken blob data by allocating another extents and 
+      copying data there
+      If blob is shared - unshare it and mark corresponding Shared Blob 
+      for removal
+      Release previously allocated space
+      Update Extent Map
+  - Detect missed Shared Blobs -> Recreate
+  - Detect undecodable deferred transaction -> Remove
+  - Detect Freelist Manager's 'false free' entries -> Mark as used
+  - Detect Freelist Manager's leaked entries -> Mark as free
+  - Detect statfs inconsistency - Update
+  Commit stage (separate DB commit per each step):
+  - Apply leaked FM entries fix
   - Apply 'false free' FM entries fix
   - Apply 'Remove' actions
   - Apply fix for misreference pextents
@@ -5922,27 +6971,13 @@ int BlueStore::_fsck(bool deep, bool repair)
   int errors = 0;
   unsigned repaired = 0;
 
-  typedef btree::btree_set<
-    uint64_t,std::less<uint64_t>,
-    mempool::bluestore_fsck::pool_allocator<uint64_t>> uint64_t_btree_t;
-  uint64_t_btree_t used_nids;
-  uint64_t_btree_t used_omap_head;
-  uint64_t_btree_t used_pgmeta_omap_head;
-  uint64_t_btree_t used_sbids;
+  fsck_uint64_btree_t used_omap_head;
+  fsck_uint64_btree_t used_pgmeta_omap_head;
 
   mempool_dynamic_bitset used_blocks;
   KeyValueDB::Iterator it;
   store_statfs_t expected_statfs, actual_statfs;
-  struct sb_info_t {
-    coll_t cid;
-    list<ghobject_t> oids;
-    SharedBlobRef sb;
-    bluestore_extent_ref_map_t ref_map;
-    bool compressed = false;
-    bool passed = false;
-    bool updated = false;
-  };
-  mempool::bluestore_fsck::map<uint64_t,sb_info_t> sb_info;
+  mempool::bluestore_fsck::map<uint64_t,fsck_sb_info_t> sb_info;
 
   uint64_t num_objects = 0;
   uint64_t num_extents = 0;
@@ -6043,299 +7078,142 @@ int BlueStore::_fsck(bool deep, bool repair)
 
   // walk PREFIX_OBJ
   dout(1) << __func__ << " walking object keyspace" << dendl;
-  it = db->get_iterator(PREFIX_OBJ);
-  if (it) {
-    CollectionRef c;
-    spg_t pgid;
-    mempool::bluestore_fsck::list<string> expecting_shards;
-    for (it->lower_bound(string()); it->valid(); it->next()) {
-      if (g_conf()->bluestore_debug_fsck_abort) {
-	goto out_scan;
-      }
-      dout(30) << __func__ << " key "
-               << pretty_binary_string(it->key()) << dendl;
-      if (is_extent_shard_key(it->key())) {
-	while (!expecting_shards.empty() &&
-	       expecting_shards.front() < it->key()) {
-	  derr << "fsck error: missing shard key "
-	       << pretty_binary_string(expecting_shards.front())
-	       << dendl;
-	  ++errors;
-	  expecting_shards.pop_front();
-	}
-	if (!expecting_shards.empty() &&
-	    expecting_shards.front() == it->key()) {
-	  // all good
-	  expecting_shards.pop_front();
-	  continue;
-	}
-
-        uint32_t offset;
-        string okey;
-        get_key_extent_shard(it->key(), &okey, &offset);
-        derr << "fsck error: stray shard 0x" << std::hex << offset
-	     << std::dec << dendl;
-        if (expecting_shards.empty()) {
-          derr << "fsck error: " << pretty_binary_string(it->key())
-               << " is unexpected" << dendl;
-          ++errors;
-          continue;
-        }
-	while (expecting_shards.front() > it->key()) {
-	  derr << "fsck error:   saw " << pretty_binary_string(it->key())
-	       << dendl;
-	  derr << "fsck error:   exp "
-	       << pretty_binary_string(expecting_shards.front()) << dendl;
-	  ++errors;
-	  expecting_shards.pop_front();
-	  if (expecting_shards.empty()) {
-	    break;
+  {
+    // onode keys (each with the shard keys that follow it) are handed
+    // out in batches to the fsck threads; the iterator running ahead of
+    // them doubles as kv prefetch.  every thread tracks used blocks,
+    // nids etc. on its own, overlaps are found when merging.
+    typedef vector<pair<string, vector<string>>> fsck_batch_t;
+    const unsigned num_threads =
+      std::max<unsigned>(cct->_conf->bluestore_fsck_threads, 1);
+    const size_t batch_size = 64;
+    BlueStoreRepairer *r_ptr = repair ? &repairer : nullptr;
+    vector<FSCKObjectCtx> thread_ctx(num_threads);
+    for (auto& t : thread_ctx) {
+      t.used_blocks.resize(used_blocks.size());
+    }
+    std::mutex qlock;
+    std::condition_variable qcond;
+    std::deque<fsck_batch_t> queue;
+    bool queue_done = false;
+    vector<std::thread> threads;
+    if (num_threads > 1) {
+      for (unsigned i = 0; i < num_threads; ++i) {
+	threads.push_back(make_named_thread("bstore_fsck", [&, i]() {
+	  std::unique_lock<std::mutex> l(qlock);
+	  while (true) {
+	    if (queue.empty()) {
+	      if (queue_done) {
+		break;
+	      }
+	      qcond.wait(l);
+	      continue;
+	    }
+	    fsck_batch_t batch = std::move(queue.front());
+	    queue.pop_front();
+	    qcond.notify_all();
+	    l.unlock();
+	    for (auto& o : batch) {
+	      _fsck_check_object(thread_ctx[i], o.first, o.second, deep, r_ptr);
+	    }
+	    l.lock();
 	  }
-	}
-	continue;
-      }
-
-      ghobject_t oid;
-      int r = get_key_object(it->key(), &oid);
-      if (r < 0) {
-        derr << "fsck error: bad object key "
-             << pretty_binary_string(it->key()) << dendl;
-	++errors;
-	continue;
+	}));
       }
-      if (!c ||
-	  oid.shard_id != pgid.shard ||
-	  oid.hobj.pool != (int64_t)pgid.pool() ||
-	  !c->contains(oid)) {
-	c = nullptr;
-	for (auto& p : coll_map) {
-	  if (p.second->contains(oid)) {
-	    c = p.second;
-	    break;
-	  }
+    }
+    fsck_objects_checked = 0;
+    fsck_bytes_read = 0;
+    auto last_report = mono_clock::now();
+    auto submit = [&](fsck_batch_t& batch) {
+      if (threads.empty()) {
+	for (auto& o : batch) {
+	  _fsck_check_object(thread_ctx[0], o.first, o.second, deep, r_ptr);
 	}
-	if (!c) {
-          derr << "fsck error: stray object " << oid
-               << " not owned by any collection" << dendl;
-	  ++errors;
-	  continue;
+      } else {
+	std::unique_lock<std::mutex> l(qlock);
+	while (queue.size() >= 2 * num_threads) {
+	  qcond.wait(l);
 	}
-	c->cid.is_pg(&pgid);
-	dout(20) << __func__ << "  collection " << c->cid << " " << c->cnode
-		 << dendl;
-      }
-
-      if (!expecting_shards.empty()) {
-	for (auto &k : expecting_shards) {
-	  derr << "fsck error: missing shard key "
-	       << pretty_binary_string(k) << dendl;
+	queue.emplace_back(std::move(batch));
+	qcond.notify_all();
+      }
+      batch.clear();
+      auto now = mono_clock::now();
+      if (now - last_report >= std::chrono::seconds(10)) {
+	last_report = now;
+	double elapsed = (double)(ceph_clock_now() - start);
+	dout(1) << __func__ << " checked " << fsck_objects_checked
+		<< " objects, read " << byte_u_t(fsck_bytes_read)
+		<< " in " << elapsed << " seconds" << dendl;
+	if (fsck_progress_cb) {
+	  fsck_progress_cb(fsck_objects_checked, fsck_bytes_read, elapsed);
 	}
-	++errors;
-	expecting_shards.clear();
       }
+    };
 
-      dout(10) << __func__ << "  " << oid << dendl;
-      RWLock::RLocker l(c->lock);
-      OnodeRef o = c->get_onode(oid, false);
-      if (o->onode.nid) {
-	if (o->onode.nid > nid_max) {
-	  derr << "fsck error: " << oid << " nid " << o->onode.nid
-	       << " > nid_max " << nid_max << dendl;
-	  ++errors;
-	}
-	if (used_nids.count(o->onode.nid)) {
-	  derr << "fsck error: " << oid << " nid " << o->onode.nid
-	       << " already in use" << dendl;
-	  ++errors;
-	  continue; // go for next object
-	}
-	used_nids.insert(o->onode.nid);
-      }
-      ++num_objects;
-      num_spanning_blobs += o->extent_map.spanning_blob_map.size();
-      o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
-      _dump_onode(o);
-      // shards
-      if (!o->extent_map.shards.empty()) {
-	++num_sharded_objects;
-	num_object_shards += o->extent_map.shards.size();
-      }
-      for (auto& s : o->extent_map.shards) {
-	dout(20) << __func__ << "    shard " << *s.shard_info << dendl;
-	expecting_shards.push_back(string());
-	get_extent_shard_key(o->key, s.shard_info->offset,
-			     &expecting_shards.back());
-	if (s.shard_info->offset >= o->onode.size) {
-	  derr << "fsck error: " << oid << " shard 0x" << std::hex
-	       << s.shard_info->offset << " past EOF at 0x" << o->onode.size
-	       << std::dec << dendl;
-	  ++errors;
-	}
-      }
-      // lextents
-      map<BlobRef,bluestore_blob_t::unused_t> referenced;
-      uint64_t pos = 0;
-      mempool::bluestore_fsck::map<BlobRef,
-				   bluestore_blob_use_tracker_t> ref_map;
-      for (auto& l : o->extent_map.extent_map) {
-	dout(20) << __func__ << "    " << l << dendl;
-	if (l.logical_offset < pos) {
-	  derr << "fsck error: " << oid << " lextent at 0x"
-	       << std::hex << l.logical_offset
-	       << " overlaps with the previous, which ends at 0x" << pos
-	       << std::dec << dendl;
-	  ++errors;
-	}
-	if (o->extent_map.spans_shard(l.logical_offset, l.length)) {
-	  derr << "fsck error: " << oid << " lextent at 0x"
-	       << std::hex << l.logical_offset << "~" << l.length
-	       << " spans a shard boundary"
-	       << std::dec << dendl;
-	  ++errors;
+    bool aborted = false;
+    it = db->get_iterator(PREFIX_OBJ);
+    if (it) {
+      fsck_batch_t batch;
+      for (it->lower_bound(string()); it->valid(); it->next()) {
+	if (g_conf()->bluestore_debug_fsck_abort) {
+	  aborted = true;
+	  break;
 	}
-	pos = l.logical_offset + l.length;
-	expected_statfs.stored += l.length;
-	assert(l.blob);
-	const bluestore_blob_t& blob = l.blob->get_blob();
-
-        auto& ref = ref_map[l.blob];
-        if (ref.is_empty()) {
-          uint32_t min_release_size = blob.get_release_size(min_alloc_size);
-          uint32_t l = blob.get_logical_length();
-          ref.init(l, min_release_size);
-        }
-	ref.get(
-	  l.blob_offset, 
-	  l.length);
-	++num_extents;
-	if (blob.has_unused()) {
-	  auto p = referenced.find(l.blob);
-	  bluestore_blob_t::unused_t *pu;
-	  if (p == referenced.end()) {
-	    pu = &referenced[l.blob];
+	dout(30) << __func__ << " key "
+		 << pretty_binary_string(it->key()) << dendl;
+	if (is_extent_shard_key(it->key())) {
+	  if (batch.empty()) {
+	    // batches only end before an onode key, so this shard has no
+	    // onode key in front of it at all
+	    derr << "fsck error: " << pretty_binary_string(it->key())
+		 << " is unexpected" << dendl;
+	    ++errors;
 	  } else {
-	    pu = &p->second;
-	  }
-	  uint64_t blob_len = blob.get_logical_length();
-	  assert((blob_len % (sizeof(*pu)*8)) == 0);
-	  assert(l.blob_offset + l.length <= blob_len);
-	  uint64_t chunk_size = blob_len / (sizeof(*pu)*8);
-	  uint64_t start = l.blob_offset / chunk_size;
-	  uint64_t end =
-	    round_up_to(l.blob_offset + l.length, chunk_size) / chunk_size;
-	  for (auto i = start; i < end; ++i) {
-	    (*pu) |= (1u << i);
+	    batch.back().second.push_back(it->key());
 	  }
+	  continue;
 	}
-      }
-      for (auto &i : referenced) {
-	dout(20) << __func__ << "  referenced 0x" << std::hex << i.second
-		 << std::dec << " for " << *i.first << dendl;
-	const bluestore_blob_t& blob = i.first->get_blob();
-	if (i.second & blob.unused) {
-	  derr << "fsck error: " << oid << " blob claims unused 0x"
-	       << std::hex << blob.unused
-	       << " but extents reference 0x" << i.second << std::dec
-	       << " on blob " << *i.first << dendl;
-	  ++errors;
-	}
-	if (blob.has_csum()) {
-	  uint64_t blob_len = blob.get_logical_length();
-	  uint64_t unused_chunk_size = blob_len / (sizeof(blob.unused)*8);
-	  unsigned csum_count = blob.get_csum_count();
-	  unsigned csum_chunk_size = blob.get_csum_chunk_size();
-	  for (unsigned p = 0; p < csum_count; ++p) {
-	    unsigned pos = p * csum_chunk_size;
-	    unsigned firstbit = pos / unused_chunk_size;    // [firstbit,lastbit]
-	    unsigned lastbit = (pos + csum_chunk_size - 1) / unused_chunk_size;
-	    unsigned mask = 1u << firstbit;
-	    for (unsigned b = firstbit + 1; b <= lastbit; ++b) {
-	      mask |= 1u << b;
-	    }
-	    if ((blob.unused & mask) == mask) {
-	      // this csum chunk region is marked unused
-	      if (blob.get_csum_item(p) != 0) {
-		derr << "fsck error: " << oid
-		     << " blob claims csum chunk 0x" << std::hex << pos
-		     << "~" << csum_chunk_size
-		     << " is unused (mask 0x" << mask << " of unused 0x"
-		     << blob.unused << ") but csum is non-zero 0x"
-		     << blob.get_csum_item(p) << std::dec << " on blob "
-		     << *i.first << dendl;
-		++errors;
-	      }
-	    }
-	  }
+	if (batch.size() >= batch_size) {
+	  submit(batch);
 	}
+	batch.emplace_back(it->key(), vector<string>());
       }
-      for (auto &i : ref_map) {
-	++num_blobs;
-	const bluestore_blob_t& blob = i.first->get_blob();
-	bool equal = i.first->get_blob_use_tracker().equal(i.second);
-	if (!equal) {
-	  derr << "fsck error: " << oid << " blob " << *i.first
-	       << " doesn't match expected ref_map " << i.second << dendl;
-	  ++errors;
-	}
-	if (blob.is_compressed()) {
-	  expected_statfs.compressed += blob.get_compressed_payload_length();
-	  expected_statfs.compressed_original += 
-	    i.first->get_referenced_bytes();
-	}
-	if (blob.is_shared()) {
-	  if (i.first->shared_blob->get_sbid() > blobid_max) {
-	    derr << "fsck error: " << oid << " blob " << blob
-		 << " sbid " << i.first->shared_blob->get_sbid() << " > blobid_max "
-		 << blobid_max << dendl;
-	    ++errors;
-	  } else if (i.first->shared_blob->get_sbid() == 0) {
-            derr << "fsck error: " << oid << " blob " << blob
-                 << " marked as shared but has uninitialized sbid"
-                 << dendl;
-            ++errors;
-          }
-	  sb_info_t& sbi = sb_info[i.first->shared_blob->get_sbid()];
-	  assert(sbi.cid == coll_t() || sbi.cid == c->cid);
-	  sbi.cid = c->cid;
-	  sbi.sb = i.first->shared_blob;
-	  sbi.oids.push_back(oid);
-	  sbi.compressed = blob.is_compressed();
-	  for (auto e : blob.get_extents()) {
-	    if (e.is_valid()) {
-	      sbi.ref_map.get(e.offset, e.length);
-	    }
-	  }
-	} else {
-	  errors += _fsck_check_extents(c->cid, oid, blob.get_extents(),
-					blob.is_compressed(),
-					used_blocks,
-					fm->get_alloc_size(),
-					repair ? &repairer : nullptr,
-					expected_statfs);
-        }
-      }
-      if (deep) {
-	bufferlist bl;
-	int r = _do_read(c.get(), o, 0, o->onode.size, bl, 0);
-	if (r < 0) {
-	  ++errors;
-	  derr << "fsck error: " << oid << " error during read: "
-	       << cpp_strerror(r) << dendl;
-	}
-      }
-      // omap
-      if (o->onode.has_omap()) {
-	auto& m =
-	  o->onode.is_pgmeta_omap() ? used_pgmeta_omap_head : used_omap_head;
-	if (m.count(o->onode.nid)) {
-	  derr << "fsck error: " << oid << " omap_head " << o->onode.nid
-	       << " already in use" << dendl;
-	  ++errors;
-	} else {
-	  m.insert(o->onode.nid);
-	}
+      if (!batch.empty()) {
+	submit(batch);
       }
     }
+    if (!threads.empty()) {
+      {
+	std::lock_guard<std::mutex> l(qlock);
+	queue_done = true;
+	qcond.notify_all();
+      }
+      for (auto& t : threads) {
+	t.join();
+      }
+    }
+    FSCKObjectCtx merged;
+    merged.used_blocks.swap(used_blocks);
+    merged.expected_statfs = expected_statfs;
+    for (auto& t : thread_ctx) {
+      _fsck_merge(merged, t, r_ptr);
+    }
+    used_blocks.swap(merged.used_blocks);
+    expected_statfs = merged.expected_statfs;
+    used_omap_head.swap(merged.used_omap_head);
+    used_pgmeta_omap_head.swap(merged.used_pgmeta_omap_head);
+    sb_info.swap(merged.sb_info);
+    errors += merged.errors;
+    num_objects = merged.num_objects;
+    num_extents = merged.num_extents;
+    num_blobs = merged.num_blobs;
+    num_spanning_blobs = merged.num_spanning_blobs;
+    num_sharded_objects = merged.num_sharded_objects;
+    num_object_shards = merged.num_object_shards;
+    if (aborted) {
+      goto out_scan;
+    }
   }
 
   dout(1) << __func__ << " checking shared_blobs" << dendl;
@@ -6363,7 +7241,7 @@ int BlueStore::_fsck(bool deep, bool repair)
 	++errors;
       } else {
 	++num_shared_blobs;
-	sb_info_t& sbi = p->second;
+	fsck_sb_info_t& sbi = p->second;
 	bluestore_shared_blob_t shared_blob(sbid);
 	bufferlist bl = it->value();
 	auto blp = bl.cbegin();
@@ -6545,12 +7423,12 @@ int BlueStore::_fsck(bool deep, bool repair)
 
 	    auto sb_it = sb_info.find(b->shared_blob->get_sbid());
 	    assert(sb_it != sb_info.end());
-	    sb_info_t& sbi = sb_it->second;
+	    fsck_sb_info_t& sbi = sb_it->second;
 
 	    for (auto& r : sbi.ref_map.ref_map) {
 	      expected_statfs.allocated -= r.second.length;
 	      if (sbi.compressed) {
-		// NB: it's crucial to use compressed flag from sb_info_t
+		// NB: it's crucial to use compressed flag from fsck_sb_info_t
 		// as we originally used that value while accumulating 
 		// expected_statfs
 		expected_statfs.compressed_allocated -= r.second.length;
@@ -6593,7 +7471,7 @@ int BlueStore::_fsck(bool deep, bool repair)
   } //if (repair && repairer.preprocess_misreference()) {
 
   for (auto &p : sb_info) {
-    sb_info_t& sbi = p.second;
+    fsck_sb_info_t& sbi = p.second;
     if (!sbi.passed) {
       derr << "fsck error: missing " << *sbi.sb << dendl;
       ++errors;
@@ -6807,6 +7685,11 @@ int BlueStore::_fsck(bool deep, bool repair)
 	  << dendl;
 
   utime_t duration = ceph_clock_now() - start;
+  if ((double)duration > 0) {
+    dout(2) << __func__ << " " << (double)num_objects / (double)duration
+	    << " objects/s, " << byte_u_t((uint64_t)(fsck_bytes_read / (double)duration))
+	    << "/s read" << dendl;
+  }
   dout(1) << __func__ << " <<<FINISH>>> with " << errors << " errors, " << repaired
 	  << " repaired, " << (errors - (int)repaired) << " remaining in "
 	  << duration << " seconds" << dendl;
@@ -7073,9 +7956,12 @@ void BlueStore::_update_cache_logger()
   uint64_t num_blobs = 0;
   uint64_t num_buffers = 0;
   uint64_t num_buffer_bytes = 0;
-  for (auto c : cache_shards) {
-    c->add_stats(&num_onodes, &num_extents, &num_blobs,
-		 &num_buffers, &num_buffer_bytes);
+  for (auto shards : { &cache_shards, &pri_cache_shards }) {
+    for (auto c : *shards) {
+      c->add_stats(&num_onodes, &num_extents, &num_blobs,
+		   &num_buffers, &num_buffer_bytes);
+      c->update_shard_logger();
+    }
   }
   logger->set(l_bluestore_onodes, num_onodes);
   logger->set(l_bluestore_extents, num_extents);
@@ -7098,7 +7984,7 @@ ObjectStore::CollectionHandle BlueStore::create_new_collection(
   RWLock::WLocker l(coll_lock);
   Collection *c = new Collection(
     this,
-    cache_shards[cid.hash_to_shard(cache_shards.size())],
+    _get_cache_shard(cid),
     cid);
   new_coll_map[cid] = c;
   return c;
@@ -7158,10 +8044,33 @@ int BlueStore::set_collection_opts(
 {
   Collection *c = static_cast<Collection *>(ch.get());
   dout(15) << __func__ << " " << ch->cid << " options " << opts << dendl;
-  if (!c->exists)
-    return -ENOENT;
+  Cache *dest = nullptr;
+  {
+    // remember the pool's cache class so that new collections (pg
+    // creation, splits) land in the right shards from the start.
+    RWLock::WLocker l(coll_lock);
+    spg_t pgid;
+    if (c->cid.is_pg(&pgid)) {
+      int pri = 0;
+      opts.get(pool_opts_t::CACHE_PRIORITY, &pri);
+      if (pri > 0) {
+	cache_pri_pools.insert(pgid.pool());
+      } else {
+	cache_pri_pools.erase(pgid.pool());
+      }
+      cache_pri_enabled = !cache_pri_pools.empty();
+    }
+    if (!c->exists && !new_coll_map.count(c->cid))
+      return -ENOENT;
+    dest = _get_cache_shard(c->cid);
+  }
   RWLock::WLocker l(c->lock);
   c->pool_opts = opts;
+  if (dest != c->cache) {
+    dout(10) << __func__ << " " << ch->cid << " moving to cache shard "
+	     << dest << dendl;
+    c->move_cache(dest);
+  }
   return 0;
 }
 
@@ -7197,6 +8106,9 @@ int BlueStore::read(
     if (offset == length && offset == 0)
       length = o->onode.size;
 
+    if (cct->_conf->bluestore_tier_placement) {
+      _tier_touch(o, 1);
+    }
     r = _do_read(c, o, offset, length, bl, op_flags);
     if (r == -EIO) {
       logger->inc(l_bluestore_read_eio);
@@ -7288,6 +8200,19 @@ int BlueStore::_do_read(
     length = o->onode.size - offset;
   }
 
+  if (o->onode.has_inline_data()) {
+    auto& d = o->onode.inline_data;
+    if (offset < d.length()) {
+      bl.substr_of(d, offset, std::min<uint64_t>(length, d.length() - offset));
+    }
+    if (bl.length() < length) {
+      bl.append_zero(length - bl.length());
+    }
+    dout(20) << __func__ << " inline 0x" << std::hex << offset << "~" << length
+	     << std::dec << dendl;
+    return bl.length();
+  }
+
   auto start = mono_clock::now();
   o->extent_map.fault_range(db, offset, length);
   logger->tinc(l_bluestore_read_onode_meta_lat, mono_clock::now() - start);
@@ -7295,6 +8220,12 @@ int BlueStore::_do_read(
 
   ready_regions_t ready_regions;
 
+  // result bytes handed out by reference vs. materialized into new
+  // buffers; the former is what we want for the large read path
+  uint64_t zerocopy_bytes = 0;
+  uint64_t copy_bytes = 0;
+  uint64_t copies = 0;
+
   // build blob-wise list to of stuff read (that isn't cached)
   blobs2read_t blobs2read;
   unsigned left = length;
@@ -7333,6 +8264,7 @@ int BlueStore::_do_read(
 	  pc->first == b_off) {
 	l = pc->second.length();
 	ready_regions[pos].claim(pc->second);
+	zerocopy_bytes += l;
 	dout(30) << __func__ << "    use cache 0x" << std::hex << pos << ": 0x"
 		 << b_off << "~" << l << std::dec << dendl;
 	++pc;
@@ -7411,37 +8343,348 @@ int BlueStore::_do_read(
 	if (tail) {
 	  r_len += chunk_size - tail;
 	}
-	dout(20) << __func__ << "    region 0x" << std::hex
-		 << reg.logical_offset
-		 << ": 0x" << reg.blob_xoffset << "~" << reg.length
-		 << " reading 0x" << reg.r_off << "~" << r_len << std::dec
-		 << dendl;
-
-	// read it
-	r = bptr->get_blob().map(
-	  reg.r_off, r_len,
-	  [&](uint64_t offset, uint64_t length) {
-	    int r;
-	    // use aio if there is more than one region to read
-	    if (num_regions > 1) {
-	      r = bdev->aio_read(offset, length, &reg.bl, &ioc);
-	    } else {
-	      r = bdev->read(offset, length, &reg.bl, &ioc, false);
-	    }
-	    if (r < 0)
-              return r;
-            return 0;
-	  });
-        if (r < 0) {
-          derr << __func__ << " bdev-read failed: " << cpp_strerror(r)
-               << dendl;
-          if (r == -EIO) {
-            // propagate EIO to caller
-            return r;
-          }
-          assert(r == 0);
-        }
-	assert(reg.bl.length() == r_len);
+	dout(20) << __func__ << "    region 0x" << std::hex
+		 << reg.logical_offset
+		 << ": 0x" << reg.blob_xoffset << "~" << reg.length
+		 << " reading 0x" << reg.r_off << "~" << r_len << std::dec
+		 << dendl;
+
+	// read it
+	r = bptr->get_blob().map(
+	  reg.r_off, r_len,
+	  [&](uint64_t offset, uint64_t length) {
+	    int r;
+	    // use aio if there is more than one region to read
+	    if (num_regions > 1) {
+	      r = bdev->aio_read(offset, length, &reg.bl, &ioc);
+	    } else {
+	      r = bdev->read(offset, length, &reg.bl, &ioc, false);
+	    }
+	    if (r < 0)
+              return r;
+            return 0;
+	  });
+        if (r < 0) {
+          derr << __func__ << " bdev-read failed: " << cpp_strerror(r)
+               << dendl;
+          if (r == -EIO) {
+            // propagate EIO to caller
+            return r;
+          }
+          assert(r == 0);
+        }
+	assert(reg.bl.length() == r_len);
+      }
+    }
+  }
+  if (ioc.has_pending_aios()) {
+    bdev->aio_submit(&ioc);
+    dout(20) << __func__ << " waiting for aio" << dendl;
+    ioc.aio_wait();
+    r = ioc.get_return_value();
+    if (r < 0) {
+      assert(r == -EIO); // no other errors allowed
+      return -EIO;
+    }
+  }
+  logger->tinc(l_bluestore_read_wait_aio_lat, mono_clock::now() - start);
+
+  // enumerate and decompress desired blobs
+  auto p = compressed_blob_bls.begin();
+  blobs2read_t::iterator b2r_it = blobs2read.begin();
+  while (b2r_it != blobs2read.end()) {
+    const BlobRef& bptr = b2r_it->first;
+    dout(20) << __func__ << "  blob " << *bptr << std::hex
+	     << " need 0x" << b2r_it->second << std::dec << dendl;
+    if (bptr->get_blob().is_compressed()) {
+      assert(p != compressed_blob_bls.end());
+      bufferlist& compressed_bl = *p++;
+      if (_verify_csum(o, &bptr->get_blob(), 0, compressed_bl,
+		       b2r_it->second.front().logical_offset) < 0) {
+	return -EIO;
+      }
+      bufferlist raw_bl;
+      r = _decompress(compressed_bl, &raw_bl);
+      if (r < 0)
+	return r;
+      if (buffered) {
+	bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(), 0,
+				       raw_bl);
+      }
+      for (auto& i : b2r_it->second) {
+	ready_regions[i.logical_offset].substr_of(
+	  raw_bl, i.blob_xoffset, i.length);
+	copy_bytes += i.length;
+      }
+      ++copies;
+    } else {
+      for (auto& reg : b2r_it->second) {
+	if (_verify_csum(o, &bptr->get_blob(), reg.r_off, reg.bl,
+			 reg.logical_offset) < 0) {
+	  return -EIO;
+	}
+	if (buffered) {
+	  bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(),
+					 reg.r_off, reg.bl);
+	}
+
+	// prune and keep result; this shares the (chunk aligned) device
+	// buffer, which may also be held by the buffer cache
+	ready_regions[reg.logical_offset].substr_of(
+	  reg.bl, reg.front, reg.length);
+	zerocopy_bytes += reg.length;
+      }
+    }
+    ++b2r_it;
+  }
+
+  // generate a resulting buffer
+  auto pr = ready_regions.begin();
+  auto pr_end = ready_regions.end();
+  pos = 0;
+  while (pos < length) {
+    if (pr != pr_end && pr->first == pos + offset) {
+      dout(30) << __func__ << " assemble 0x" << std::hex << pos
+	       << ": data from 0x" << pr->first << "~" << pr->second.length()
+	       << std::dec << dendl;
+      pos += pr->second.length();
+      bl.claim_append(pr->second);
+      ++pr;
+    } else {
+      uint64_t l = length - pos;
+      if (pr != pr_end) {
+        assert(pr->first > pos + offset);
+	l = pr->first - (pos + offset);
+      }
+      dout(30) << __func__ << " assemble 0x" << std::hex << pos
+	       << ": zeros for 0x" << (pos + offset) << "~" << l
+	       << std::dec << dendl;
+      bl.append_zero(l);
+      copy_bytes += l;
+      ++copies;
+      pos += l;
+    }
+  }
+  assert(bl.length() == length);
+  assert(pos == length);
+  assert(pr == pr_end);
+  logger->inc(l_bluestore_read_zerocopy_bytes, zerocopy_bytes);
+  logger->inc(l_bluestore_read_copy_bytes, copy_bytes);
+  logger->inc(l_bluestore_read_copies, copies);
+  r = bl.length();
+  return r;
+}
+
+bool BlueStore::is_cached(
+  CollectionHandle &c_,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t length)
+{
+  Collection *c = static_cast<Collection *>(c_.get());
+  if (!c->exists)
+    return false;
+
+  RWLock::RLocker l(c->lock);
+  // unlike get_onode, never go to the kv store; and leave the cache as
+  // it is, the read that follows (if any) touches what it uses
+  OnodeRef o = c->onode_map.peek(oid);
+  if (!o || !o->exists) {
+    return false;
+  }
+  if (length == 0 || offset >= o->onode.size ||
+      o->onode.has_inline_data()) {
+    return true;
+  }
+  length = std::min<uint64_t>(length, o->onode.size - offset);
+
+  auto& em = o->extent_map;
+  int shard = em.seek_shard(offset);
+  int last = em.seek_shard(offset + length);
+  if (shard >= 0) {
+    for (; shard <= last; ++shard) {
+      if (!em.shards[shard].loaded) {
+	return false;
+      }
+    }
+  }
+
+  uint64_t pos = offset;
+  uint64_t left = length;
+  auto lp = em.seek_lextent(offset);
+  while (left > 0 && lp != em.extent_map.end()) {
+    if (pos < lp->logical_offset) {
+      uint64_t hole = lp->logical_offset - pos;
+      if (hole >= left) {
+	break;
+      }
+      pos += hole;
+      left -= hole;
+    }
+    unsigned l_off = pos - lp->logical_offset;
+    unsigned b_off = l_off + lp->blob_offset;
+    unsigned b_len = std::min<uint64_t>(left, lp->length - l_off);
+    if (lp->blob->shared_blob->bc.cached_bytes(
+	  lp->blob->shared_blob->get_cache(), b_off, b_len) < b_len) {
+      return false;
+    }
+    pos += b_len;
+    left -= b_len;
+    ++lp;
+  }
+  return true;
+}
+
+int BlueStore::verify_checksums(
+  CollectionHandle &c_,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t length,
+  uint32_t op_flags)
+{
+  Collection *c = static_cast<Collection *>(c_.get());
+  dout(15) << __func__ << " " << c->cid << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length << std::dec
+	   << dendl;
+  if (!c->exists)
+    return -ENOENT;
+
+  int r;
+  {
+    RWLock::RLocker l(c->lock);
+    OnodeRef o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      r = -ENOENT;
+      goto out;
+    }
+    r = _do_verify_checksums(o, offset, length);
+    if (r == -EIO) {
+      logger->inc(l_bluestore_read_eio);
+    }
+  }
+
+ out:
+  if (r == 0 && _debug_data_eio(oid)) {
+    r = -EIO;
+    derr << __func__ << " " << c->cid << " " << oid << " INJECT EIO" << dendl;
+  }
+  dout(10) << __func__ << " " << c->cid << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length << std::dec
+	   << " = " << r << dendl;
+  return r;
+}
+
+int BlueStore::_do_verify_checksums(
+  OnodeRef o,
+  uint64_t offset,
+  size_t length)
+{
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << " size 0x" << o->onode.size << std::dec << dendl;
+  if (offset >= o->onode.size) {
+    return 0;
+  }
+  if (offset + length > o->onode.size) {
+    length = o->onode.size - offset;
+  }
+  if (o->onode.has_inline_data()) {
+    // inline data has no checksum of its own
+    return -EOPNOTSUPP;
+  }
+
+  o->extent_map.fault_range(db, offset, length);
+
+  // collect the blob ranges backing the extent that are not in the buffer
+  // cache.  cached data was either checked when it was read or has not
+  // reached the disk yet (deferred writes), so there is nothing to check.
+  blobs2read_t blobs2read;
+  unsigned left = length;
+  uint64_t pos = offset;
+  auto lp = o->extent_map.seek_lextent(offset);
+  while (left > 0 && lp != o->extent_map.extent_map.end()) {
+    if (pos < lp->logical_offset) {
+      unsigned hole = lp->logical_offset - pos;
+      if (hole >= left) {
+	break;
+      }
+      pos += hole;
+      left -= hole;
+    }
+    const BlobRef& bptr = lp->blob;
+    const bluestore_blob_t& blob = bptr->get_blob();
+    if (!blob.has_csum()) {
+      dout(20) << __func__ << "  blob " << *bptr << " has no csum" << dendl;
+      return -EOPNOTSUPP;
+    }
+    unsigned l_off = pos - lp->logical_offset;
+    unsigned b_off = l_off + lp->blob_offset;
+    unsigned b_len = std::min(left, lp->length - l_off);
+
+    ready_regions_t cache_res;
+    interval_set<uint32_t> cache_interval;
+    bptr->shared_blob->bc.read(
+      bptr->shared_blob->get_cache(), b_off, b_len, cache_res, cache_interval);
+    auto pc = cache_res.begin();
+    while (b_len > 0) {
+      unsigned l;
+      if (pc != cache_res.end() &&
+	  pc->first == b_off) {
+	l = pc->second.length();
+	++pc;
+      } else {
+	l = b_len;
+	if (pc != cache_res.end()) {
+	  assert(pc->first > b_off);
+	  l = pc->first - b_off;
+	}
+	auto& regions = blobs2read[bptr];
+	if (blob.is_compressed()) {
+	  // the csum covers the compressed blob as a whole
+	  if (regions.empty()) {
+	    regions.emplace_back(region_t(pos, 0, blob.get_ondisk_length()));
+	  }
+	} else {
+	  regions.emplace_back(region_t(pos, b_off, l));
+	}
+      }
+      pos += l;
+      b_off += l;
+      left -= l;
+      b_len -= l;
+    }
+    ++lp;
+  }
+
+  IOContext ioc(cct, NULL, true); // allow EIO
+  for (auto& p : blobs2read) {
+    const bluestore_blob_t& blob = p.first->get_blob();
+    uint64_t chunk_size = blob.get_chunk_size(block_size);
+    for (auto& reg : p.second) {
+      reg.r_off = reg.blob_xoffset;
+      uint64_t r_len = reg.length;
+      if (!blob.is_compressed()) {
+	reg.front = reg.r_off % chunk_size;
+	reg.r_off -= reg.front;
+	r_len += reg.front;
+	unsigned tail = r_len % chunk_size;
+	if (tail) {
+	  r_len += chunk_size - tail;
+	}
+      }
+      dout(20) << __func__ << "  blob " << *p.first << " region " << reg
+	       << " reading 0x" << std::hex << reg.r_off << "~" << r_len
+	       << std::dec << dendl;
+      int r = blob.map(
+	reg.r_off, r_len,
+	[&](uint64_t offset, uint64_t length) {
+	  return bdev->aio_read(offset, length, &reg.bl, &ioc);
+	});
+      if (r < 0) {
+	derr << __func__ << " bdev-read failed: " << cpp_strerror(r) << dendl;
+	if (r == -EIO) {
+	  return r;
+	}
+	assert(r == 0);
       }
     }
   }
@@ -7449,89 +8692,22 @@ int BlueStore::_do_read(
     bdev->aio_submit(&ioc);
     dout(20) << __func__ << " waiting for aio" << dendl;
     ioc.aio_wait();
-    r = ioc.get_return_value();
+    int r = ioc.get_return_value();
     if (r < 0) {
       assert(r == -EIO); // no other errors allowed
       return -EIO;
     }
   }
-  logger->tinc(l_bluestore_read_wait_aio_lat, mono_clock::now() - start);
 
-  // enumerate and decompress desired blobs
-  auto p = compressed_blob_bls.begin();
-  blobs2read_t::iterator b2r_it = blobs2read.begin();
-  while (b2r_it != blobs2read.end()) {
-    const BlobRef& bptr = b2r_it->first;
-    dout(20) << __func__ << "  blob " << *bptr << std::hex
-	     << " need 0x" << b2r_it->second << std::dec << dendl;
-    if (bptr->get_blob().is_compressed()) {
-      assert(p != compressed_blob_bls.end());
-      bufferlist& compressed_bl = *p++;
-      if (_verify_csum(o, &bptr->get_blob(), 0, compressed_bl,
-		       b2r_it->second.front().logical_offset) < 0) {
+  for (auto& p : blobs2read) {
+    for (auto& reg : p.second) {
+      if (_verify_csum(o, &p.first->get_blob(), reg.r_off, reg.bl,
+		       reg.logical_offset) < 0) {
 	return -EIO;
       }
-      bufferlist raw_bl;
-      r = _decompress(compressed_bl, &raw_bl);
-      if (r < 0)
-	return r;
-      if (buffered) {
-	bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(), 0,
-				       raw_bl);
-      }
-      for (auto& i : b2r_it->second) {
-	ready_regions[i.logical_offset].substr_of(
-	  raw_bl, i.blob_xoffset, i.length);
-      }
-    } else {
-      for (auto& reg : b2r_it->second) {
-	if (_verify_csum(o, &bptr->get_blob(), reg.r_off, reg.bl,
-			 reg.logical_offset) < 0) {
-	  return -EIO;
-	}
-	if (buffered) {
-	  bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(),
-					 reg.r_off, reg.bl);
-	}
-
-	// prune and keep result
-	ready_regions[reg.logical_offset].substr_of(
-	  reg.bl, reg.front, reg.length);
-      }
-    }
-    ++b2r_it;
-  }
-
-  // generate a resulting buffer
-  auto pr = ready_regions.begin();
-  auto pr_end = ready_regions.end();
-  pos = 0;
-  while (pos < length) {
-    if (pr != pr_end && pr->first == pos + offset) {
-      dout(30) << __func__ << " assemble 0x" << std::hex << pos
-	       << ": data from 0x" << pr->first << "~" << pr->second.length()
-	       << std::dec << dendl;
-      pos += pr->second.length();
-      bl.claim_append(pr->second);
-      ++pr;
-    } else {
-      uint64_t l = length - pos;
-      if (pr != pr_end) {
-        assert(pr->first > pos + offset);
-	l = pr->first - (pos + offset);
-      }
-      dout(30) << __func__ << " assemble 0x" << std::hex << pos
-	       << ": zeros for 0x" << (pos + offset) << "~" << l
-	       << std::dec << dendl;
-      bl.append_zero(l);
-      pos += l;
     }
   }
-  assert(bl.length() == length);
-  assert(pos == length);
-  assert(pr == pr_end);
-  r = bl.length();
-  return r;
+  return 0;
 }
 
 int BlueStore::_verify_csum(OnodeRef& o,
@@ -7634,6 +8810,14 @@ int BlueStore::_fiemap(
       length = o->onode.size - offset;
     }
 
+    if (o->onode.has_inline_data()) {
+      uint64_t inline_len = o->onode.inline_data.length();
+      if (offset < inline_len) {
+	destset.insert(offset, std::min<uint64_t>(length, inline_len - offset));
+      }
+      goto out;
+    }
+
     o->extent_map.fault_range(db, offset, length);
     eend = o->extent_map.extent_map.end();
     ep = o->extent_map.seek_lextent(offset);
@@ -8207,8 +9391,10 @@ ObjectMap::ObjectMapIterator BlueStore::get_omap_iterator(
 
 void BlueStore::_prepare_ondisk_format_super(KeyValueDB::Transaction& t)
 {
+  compat_ondisk_format = std::max(compat_ondisk_format,
+				  min_compat_ondisk_format);
   dout(10) << __func__ << " ondisk_format " << ondisk_format
-	   << " min_compat_ondisk_format " << min_compat_ondisk_format
+	   << " min_compat_ondisk_format " << compat_ondisk_format
 	   << dendl;
   assert(ondisk_format == latest_ondisk_format);
   {
@@ -8218,7 +9404,7 @@ void BlueStore::_prepare_ondisk_format_super(KeyValueDB::Transaction& t)
   }
   {
     bufferlist bl;
-    encode(min_compat_ondisk_format, bl);
+    encode(compat_ondisk_format, bl);
     t->set(PREFIX_SUPER, "min_compat_ondisk_format", bl);
   }
 }
@@ -8291,7 +9477,7 @@ int BlueStore::_open_super_meta()
   }
 
   // ondisk format
-  int32_t compat_ondisk_format = 0;
+  compat_ondisk_format = 0;
   {
     bufferlist bl;
     int r = db->get(PREFIX_SUPER, "ondisk_format", &bl);
@@ -8339,6 +9525,19 @@ int BlueStore::_open_super_meta()
       return r;
     }
   }
+  if (cct->_conf->bluestore_inline_data_max_size > 0 &&
+      compat_ondisk_format < min_compat_inline_ondisk_format) {
+    // older releases would read inline onodes as holes; shut them out
+    // before we write any
+    dout(1) << __func__ << " enabling inline data, raising"
+	    << " min_compat_ondisk_format from " << compat_ondisk_format
+	    << " to " << min_compat_inline_ondisk_format << dendl;
+    compat_ondisk_format = min_compat_inline_ondisk_format;
+    KeyValueDB::Transaction t = db->get_transaction();
+    _prepare_ondisk_format_super(t);
+    int r = db->submit_transaction_sync(t);
+    assert(r == 0);
+  }
 
   {
     bufferlist bl;
@@ -8377,6 +9576,7 @@ int BlueStore::_upgrade_super()
   assert(ondisk_format > 0);
   assert(ondisk_format < latest_ondisk_format);
 
+  KeyValueDB::Transaction t = db->get_transaction();
   if (ondisk_format == 1) {
     // changes:
     // - super: added ondisk_format
@@ -8384,7 +9584,6 @@ int BlueStore::_upgrade_super()
     // - super: added min_compat_ondisk_format
     // - super: added min_alloc_size
     // - super: removed min_min_alloc_size
-    KeyValueDB::Transaction t = db->get_transaction();
     {
       bufferlist bl;
       db->get(PREFIX_SUPER, "min_min_alloc_size", &bl);
@@ -8401,10 +9600,16 @@ int BlueStore::_upgrade_super()
       t->rmkey(PREFIX_SUPER, "min_min_alloc_size");
     }
     ondisk_format = 2;
-    _prepare_ondisk_format_super(t);
-    int r = db->submit_transaction_sync(t);
-    assert(r == 0);
   }
+  if (ondisk_format == 2) {
+    // changes:
+    // - onode: may carry inline data (FLAG_INLINE_DATA), only once
+    //   min_compat_ondisk_format has been raised to 3
+    ondisk_format = 3;
+  }
+  _prepare_ondisk_format_super(t);
+  int r = db->submit_transaction_sync(t);
+  assert(r == 0);
 
   // done
   dout(1) << __func__ << " done" << dendl;
@@ -8511,6 +9716,18 @@ void BlueStore::_txc_state_proc(TransContext *txc)
       }
       txc->log_state_latency(logger, l_bluestore_state_io_done_lat);
       txc->state = TransContext::STATE_KV_QUEUED;
+      if (!kv_lanes.empty()) {
+	// the lane submits (or hands over to the kv_sync thread) in order;
+	// we hold osr->qlock, so order within the sequencer is kept
+	KVSubmitLane *lane =
+	  kv_lanes[txc->osr->cid.hash_to_shard(kv_lanes.size())];
+	txc->kv_lane = lane->id;
+	txc->kv_lane_stamp = mono_clock::now();
+	std::lock_guard<std::mutex> l(lane->lock);
+	lane->q.push_back(txc);
+	lane->cond.notify_one();
+	return;
+      }
       if (cct->_conf->bluestore_sync_submit_transaction) {
 	if (txc->last_nid >= nid_max ||
 	    txc->last_blobid >= blobid_max) {
@@ -8759,7 +9976,7 @@ void BlueStore::_txc_finish(TransContext *txc)
   assert(txc->state == TransContext::STATE_FINISHING);
 
   for (auto& sb : txc->shared_blobs_written) {
-    sb->bc.finish_write(sb->get_cache(), txc->seq);
+    sb->finish_write(txc->seq);
   }
   txc->shared_blobs_written.clear();
 
@@ -8876,9 +10093,10 @@ void BlueStore::_osr_drain_preceding(TransContext *txc)
   ++deferred_aggressive; // FIXME: maybe osr-local aggressive flag?
   {
     // submit anything pending
+    OpSequencer *dosr = _deferred_osr(osr);
     deferred_lock.lock();
-    if (osr->deferred_pending && !osr->deferred_running) {
-      _deferred_submit_unlock(osr);
+    if (dosr->deferred_pending && !dosr->deferred_running) {
+      _deferred_submit_unlock(dosr);
     } else {
       deferred_lock.unlock();
     }
@@ -8970,6 +10188,51 @@ void BlueStore::_kv_start()
   for (auto f : finishers) {
     f->start();
   }
+  if (bdev->is_rotational() ?
+      cct->_conf->bluestore_deferred_coalesce_hdd :
+      cct->_conf->bluestore_deferred_coalesce_ssd) {
+    dout(10) << __func__ << " coalescing deferred ios" << dendl;
+    deferred_coalesce_osr = new OpSequencer(this, coll_t());
+  }
+  _kv_init_affinity();
+  unsigned num_lanes = cct->_conf->bluestore_kv_sync_lanes;
+  if (num_lanes > 1) {
+    dout(1) << __func__ << " " << num_lanes << " kv submit lanes" << dendl;
+    for (unsigned i = 0; i < num_lanes; ++i) {
+      KVSubmitLane *lane = new KVSubmitLane(this, i);
+      PerfCountersBuilder b(cct, "bluestore-kv-lane-" + stringify(i),
+			    l_bluestore_kv_lane_first,
+			    l_bluestore_kv_lane_last);
+      PerfHistogramCommon::axis_config_d lat_axis{
+	"Latency (usec)",
+	PerfHistogramCommon::SCALE_LOG2,
+	0,
+	10000,  // 10usec
+	32,
+      };
+      PerfHistogramCommon::axis_config_d size_axis{
+	"Transaction size (bytes)",
+	PerfHistogramCommon::SCALE_LOG2,
+	0,
+	512,
+	32,
+      };
+      b.add_u64_counter(l_bluestore_kv_lane_txc, "txc",
+			"Transactions submitted through this lane");
+      b.add_time_avg(l_bluestore_kv_lane_submit_lat, "submit_lat",
+		     "Average time from queueing to kv submission");
+      b.add_time_avg(l_bluestore_kv_lane_commit_lat, "commit_lat",
+		     "Average time from queueing to kv commit");
+      b.add_u64_counter_histogram(
+	l_bluestore_kv_lane_commit_lat_hist, "commit_lat_bytes_histogram",
+	lat_axis, size_axis,
+	"Histogram of kv commit latency + transaction size");
+      lane->logger = b.create_perf_counters();
+      cct->get_perfcounters_collection()->add(lane->logger);
+      kv_lanes.push_back(lane);
+      lane->create("bstore_kv_lane");
+    }
+  }
   kv_sync_thread.create("bstore_kv_sync");
   kv_finalize_thread.create("bstore_kv_final");
 }
@@ -8977,6 +10240,15 @@ void BlueStore::_kv_start()
 void BlueStore::_kv_stop()
 {
   dout(10) << __func__ << dendl;
+  // lanes drain into kv_queue, so they go first
+  for (auto lane : kv_lanes) {
+    {
+      std::lock_guard<std::mutex> l(lane->lock);
+      lane->stop = true;
+      lane->cond.notify_all();
+    }
+    lane->join();
+  }
   {
     std::unique_lock<std::mutex> l(kv_lock);
     while (!kv_sync_started) {
@@ -8995,6 +10267,12 @@ void BlueStore::_kv_stop()
   }
   kv_sync_thread.join();
   kv_finalize_thread.join();
+  for (auto lane : kv_lanes) {
+    cct->get_perfcounters_collection()->remove(lane->logger);
+    delete lane->logger;
+    delete lane;
+  }
+  kv_lanes.clear();
   assert(removed_collections.empty());
   {
     std::lock_guard<std::mutex> l(kv_lock);
@@ -9004,6 +10282,12 @@ void BlueStore::_kv_stop()
     std::lock_guard<std::mutex> l(kv_finalize_lock);
     kv_finalize_stop = false;
   }
+  if (deferred_coalesce_osr) {
+    std::lock_guard<std::mutex> l(deferred_lock);
+    assert(!deferred_coalesce_osr->deferred_pending);
+    assert(!deferred_coalesce_osr->deferred_running);
+    deferred_coalesce_osr.reset();
+  }
   dout(10) << __func__ << " stopping finishers" << dendl;
   deferred_finisher.wait_for_empty();
   deferred_finisher.stop();
@@ -9014,9 +10298,173 @@ void BlueStore::_kv_stop()
   dout(10) << __func__ << " stopped" << dendl;
 }
 
+static int read_numa_node_cpus(int node, vector<int> *cpus)
+{
+  char fn[PATH_MAX];
+  snprintf(fn, sizeof(fn), "/sys/devices/system/node/node%d/cpulist", node);
+  FILE *fp = fopen(fn, "r");
+  if (!fp) {
+    return -errno;
+  }
+  char buf[4096];
+  int r = 0;
+  if (!fgets(buf, sizeof(buf), fp)) {
+    r = -EINVAL;
+  }
+  fclose(fp);
+  if (r < 0) {
+    return r;
+  }
+  // e.g. "0-7,16-23"
+  list<string> ranges;
+  get_str_list(buf, ",\n", ranges);
+  for (auto& i : ranges) {
+    int from, to;
+    int n = sscanf(i.c_str(), "%d-%d", &from, &to);
+    if (n == 1) {
+      to = from;
+    } else if (n != 2 || from > to) {
+      return -EINVAL;
+    }
+    for (int c = from; c <= to; ++c) {
+      cpus->push_back(c);
+    }
+  }
+  return cpus->empty() ? -ENOENT : 0;
+}
+
+void BlueStore::_kv_init_affinity()
+{
+  kv_cpus.clear();
+  if (!cct->_conf->bluestore_kv_numa_affinity) {
+    return;
+  }
+  int node;
+  int r = bdev->get_numa_node(&node);
+  if (r < 0) {
+    dout(1) << __func__ << " numa node of main device unknown: "
+	    << cpp_strerror(r) << ", not binding kv threads" << dendl;
+    return;
+  }
+  r = read_numa_node_cpus(node, &kv_cpus);
+  if (r < 0) {
+    derr << __func__ << " failed to read cpus of numa node " << node
+	 << ": " << cpp_strerror(r) << dendl;
+    kv_cpus.clear();
+    return;
+  }
+  dout(1) << __func__ << " binding kv threads to numa node " << node
+	  << " cpus " << kv_cpus << dendl;
+}
+
+void BlueStore::_kv_bind_thread()
+{
+#ifdef HAVE_SCHED
+  if (kv_cpus.empty()) {
+    return;
+  }
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  for (auto c : kv_cpus) {
+    if (c < CPU_SETSIZE) {
+      CPU_SET(c, &cpuset);
+    }
+  }
+  if (sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0) {
+    int r = -errno;
+    derr << __func__ << " sched_setaffinity failed: " << cpp_strerror(r)
+	 << dendl;
+  }
+#endif
+}
+
+void BlueStore::_kv_lane_thread(KVSubmitLane *lane)
+{
+  dout(10) << __func__ << " " << lane->id << " start" << dendl;
+  _kv_bind_thread();
+  deque<TransContext*> submitting;
+  std::unique_lock<std::mutex> l(lane->lock);
+  while (true) {
+    if (lane->q.empty()) {
+      if (lane->stop)
+	break;
+      lane->cond.wait(l);
+      continue;
+    }
+    submitting.swap(lane->q);
+    l.unlock();
+    dout(20) << __func__ << " " << lane->id << " submitting "
+	     << submitting.size() << dendl;
+
+    // the kv record must not become durable before the data it points
+    // to; the kv_sync thread flushes before its own submissions, we do
+    // the same before ours.  concurrent flushes collapse in the bdev.
+    for (auto txc : submitting) {
+      if (txc->had_ios) {
+	bdev->flush();
+	break;
+      }
+    }
+
+    auto now = mono_clock::now();
+    for (auto txc : submitting) {
+      if (txc->last_nid >= nid_max ||
+	  txc->last_blobid >= blobid_max ||
+	  txc->osr->kv_committing_serially) {
+	// the kv_sync thread persists the {nid,blobid}_max bump along
+	// with this txc; later txcs of the sequencer have to follow it
+	++txc->osr->kv_committing_serially;
+	continue;
+      }
+      int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction(txc->t);
+      assert(r == 0);
+      _txc_applied_kv(txc);
+      txc->state = TransContext::STATE_KV_SUBMITTED;
+      if (txc->osr->kv_submitted_waiters) {
+	std::lock_guard<std::mutex> l(txc->osr->qlock);
+	if (txc->osr->_is_all_kv_submitted()) {
+	  txc->osr->qcond.notify_all();
+	}
+      }
+      lane->logger->tinc(l_bluestore_kv_lane_submit_lat,
+			 now - txc->kv_lane_stamp);
+    }
+    lane->logger->inc(l_bluestore_kv_lane_txc, submitting.size());
+
+    {
+      std::lock_guard<std::mutex> l(kv_lock);
+      for (auto txc : submitting) {
+	kv_queue.push_back(txc);
+	if (txc->state != TransContext::STATE_KV_SUBMITTED) {
+	  kv_queue_unsubmitted.push_back(txc);
+	}
+	if (txc->had_ios)
+	  kv_ios++;
+	kv_throttle_costs += txc->cost;
+      }
+      kv_cond.notify_one();
+    }
+    submitting.clear();
+    l.lock();
+  }
+  dout(10) << __func__ << " " << lane->id << " finish" << dendl;
+}
+
+void BlueStore::_kv_lane_committed(TransContext *txc)
+{
+  assert(txc->kv_lane >= 0 && txc->kv_lane < (int)kv_lanes.size());
+  PerfCounters *l = kv_lanes[txc->kv_lane]->logger;
+  auto lat = mono_clock::now() - txc->kv_lane_stamp;
+  l->tinc(l_bluestore_kv_lane_commit_lat, lat);
+  l->hinc(l_bluestore_kv_lane_commit_lat_hist,
+	  std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count(),
+	  txc->bytes);
+}
+
 void BlueStore::_kv_sync_thread()
 {
   dout(10) << __func__ << " start" << dendl;
+  _kv_bind_thread();
   deque<DeferredBatch*> deferred_stable_queue; ///< deferred ios done + stable
   std::unique_lock<std::mutex> l(kv_lock);
   assert(!kv_sync_started);
@@ -9261,6 +10709,7 @@ void BlueStore::_kv_finalize_thread()
   deque<TransContext*> kv_committed;
   deque<DeferredBatch*> deferred_stable;
   dout(10) << __func__ << " start" << dendl;
+  _kv_bind_thread();
   std::unique_lock<std::mutex> l(kv_finalize_lock);
   assert(!kv_finalize_started);
   kv_finalize_started = true;
@@ -9287,6 +10736,9 @@ void BlueStore::_kv_finalize_thread()
       while (!kv_committed.empty()) {
 	TransContext *txc = kv_committed.front();
 	assert(txc->state == TransContext::STATE_KV_SUBMITTED);
+	if (txc->kv_lane >= 0) {
+	  _kv_lane_committed(txc);
+	}
 	_txc_state_proc(txc);
 	kv_committed.pop_front();
       }
@@ -9336,30 +10788,31 @@ bluestore_deferred_op_t *BlueStore::_get_deferred_op(
 
 void BlueStore::_deferred_queue(TransContext *txc)
 {
-  dout(20) << __func__ << " txc " << txc << " osr " << txc->osr << dendl;
+  OpSequencer *osr = _deferred_osr(txc->osr.get());
+  dout(20) << __func__ << " txc " << txc << " osr " << osr << dendl;
   deferred_lock.lock();
-  if (!txc->osr->deferred_pending &&
-      !txc->osr->deferred_running) {
-    deferred_queue.push_back(*txc->osr);
+  if (!osr->deferred_pending &&
+      !osr->deferred_running) {
+    deferred_queue.push_back(*osr);
   }
-  if (!txc->osr->deferred_pending) {
-    txc->osr->deferred_pending = new DeferredBatch(cct, txc->osr.get());
+  if (!osr->deferred_pending) {
+    osr->deferred_pending = new DeferredBatch(cct, osr);
   }
   ++deferred_queue_size;
-  txc->osr->deferred_pending->txcs.push_back(*txc);
+  osr->deferred_pending->txcs.push_back(*txc);
   bluestore_deferred_transaction_t& wt = *txc->deferred_txn;
   for (auto opi = wt.ops.begin(); opi != wt.ops.end(); ++opi) {
     const auto& op = *opi;
     assert(op.op == bluestore_deferred_op_t::OP_WRITE);
     bufferlist::const_iterator p = op.data.begin();
     for (auto e : op.extents) {
-      txc->osr->deferred_pending->prepare_write(
+      osr->deferred_pending->prepare_write(
 	cct, wt.seq, e.offset, e.length, p);
     }
   }
   if (deferred_aggressive &&
-      !txc->osr->deferred_running) {
-    _deferred_submit_unlock(txc->osr.get());
+      !osr->deferred_running) {
+    _deferred_submit_unlock(osr);
   } else {
     deferred_lock.unlock();
   }
@@ -9375,6 +10828,18 @@ void BlueStore::deferred_try_submit()
   for (auto& osr : deferred_queue) {
     osrs.push_back(&osr);
   }
+  // submit in LBA order so that on rotational media the batches of a
+  // round make (roughly) one sweep rather than jumping around
+  auto first_lba = [](const OpSequencerRef& osr) -> uint64_t {
+    if (!osr->deferred_pending || osr->deferred_pending->iomap.empty()) {
+      return 0;
+    }
+    return osr->deferred_pending->iomap.begin()->first;
+  };
+  std::sort(osrs.begin(), osrs.end(),
+	    [&](const OpSequencerRef& a, const OpSequencerRef& b) {
+	      return first_lba(a) < first_lba(b);
+	    });
   for (auto& osr : osrs) {
     if (osr->deferred_pending) {
       if (!osr->deferred_running) {
@@ -9410,6 +10875,10 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   for (auto& txc : b->txcs) {
     txc.log_state_latency(logger, l_bluestore_state_deferred_queued_lat);
   }
+  if (b->overwritten_bytes) {
+    logger->inc(l_bluestore_deferred_write_overwritten_bytes,
+		b->overwritten_bytes);
+  }
   uint64_t start = 0, pos = 0;
   bufferlist bl;
   auto i = b->iomap.begin();
@@ -9438,6 +10907,8 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 	     << dendl;
     if (!bl.length()) {
       start = pos;
+    } else {
+      logger->inc(l_bluestore_deferred_write_merged);
     }
     pos += i->second.bl.length();
     bl.claim_append(i->second.bl);
@@ -9479,14 +10950,13 @@ void BlueStore::_deferred_aio_finish(OpSequencer *osr)
 
   {
     uint64_t costs = 0;
-    {
-      std::lock_guard<std::mutex> l2(osr->qlock);
-      for (auto& i : b->txcs) {
-	TransContext *txc = &i;
-	txc->log_state_latency(logger, l_bluestore_state_deferred_aio_wait_lat);
-	txc->state = TransContext::STATE_DEFERRED_CLEANUP;
-	costs += txc->cost;
-      }
+    for (auto& i : b->txcs) {
+      TransContext *txc = &i;
+      // not necessarily osr's, if deferred ios are coalesced
+      std::lock_guard<std::mutex> l2(txc->osr->qlock);
+      txc->log_state_latency(logger, l_bluestore_state_deferred_aio_wait_lat);
+      txc->state = TransContext::STATE_DEFERRED_CLEANUP;
+      costs += txc->cost;
     }
     throttle_deferred_bytes.put(costs);
     std::lock_guard<std::mutex> l(kv_lock);
@@ -9577,19 +11047,51 @@ int BlueStore::queue_transactions(
   OpSequencer *osr = c->osr.get();
   dout(10) << __func__ << " ch " << c << " " << c->cid << dendl;
 
-  // prepare
-  TransContext *txc = _txc_create(static_cast<Collection*>(ch.get()), osr,
-				  &on_commit);
+  // prepare
+  std::unique_lock<std::mutex> sl(c->submit_lock);
+  TransContext *txc = _txc_create(static_cast<Collection*>(ch.get()), osr,
+				  &on_commit);
+
+  for (vector<Transaction>::iterator p = tls.begin(); p != tls.end(); ++p) {
+    txc->bytes += (*p).get_num_bytes();
+    _txc_add_transaction(txc, &(*p));
+  }
+  _txc_calc_cost(txc);
+
+  _txc_write_nodes(txc, txc->t);
+  _txc_journal_deferred(txc);
+  _txc_finalize_kv(txc, txc->t);
+  sl.unlock();
+  if (handle)
+    handle->suspend_tp_timeout();
+
+  auto tstart = mono_clock::now();
+  _txc_throttle(txc);
+  auto tend = mono_clock::now();
+
+  if (handle)
+    handle->reset_tp_timeout();
+
+  logger->inc(l_bluestore_txc);
 
-  for (vector<Transaction>::iterator p = tls.begin(); p != tls.end(); ++p) {
-    txc->bytes += (*p).get_num_bytes();
-    _txc_add_transaction(txc, &(*p));
+  // execute (start)
+  _txc_state_proc(txc);
+
+  // we're immediately readable (unlike FileStore)
+  for (auto c : on_applied_sync) {
+    c->complete(0);
+  }
+  for (auto c : on_applied) {
+    finishers[osr->shard]->queue(c);
   }
-  _txc_calc_cost(txc);
 
-  _txc_write_nodes(txc, txc->t);
+  logger->tinc(l_bluestore_submit_lat, mono_clock::now() - start);
+  logger->tinc(l_bluestore_throttle_lat, tend - tstart);
+  return 0;
+}
 
-  // journal deferred items
+void BlueStore::_txc_journal_deferred(TransContext *txc)
+{
   if (txc->deferred_txn) {
     txc->deferred_txn->seq = ++deferred_seq;
     bufferlist bl;
@@ -9598,12 +11100,10 @@ int BlueStore::queue_transactions(
     get_deferred_key(txc->deferred_txn->seq, &key);
     txc->t->set(PREFIX_DEFERRED, key, bl);
   }
+}
 
-  _txc_finalize_kv(txc, txc->t);
-  if (handle)
-    handle->suspend_tp_timeout();
-
-  auto tstart = mono_clock::now();
+void BlueStore::_txc_throttle(TransContext *txc)
+{
   throttle_bytes.get(txc->cost);
   if (txc->deferred_txn) {
     // ensure we do not block here because of deferred writes
@@ -9621,27 +11121,6 @@ int BlueStore::queue_transactions(
       --deferred_aggressive;
    }
   }
-  auto tend = mono_clock::now();
-
-  if (handle)
-    handle->reset_tp_timeout();
-
-  logger->inc(l_bluestore_txc);
-
-  // execute (start)
-  _txc_state_proc(txc);
-
-  // we're immediately readable (unlike FileStore)
-  for (auto c : on_applied_sync) {
-    c->complete(0);
-  }
-  for (auto c : on_applied) {
-    finishers[osr->shard]->queue(c);
-  }
-
-  logger->tinc(l_bluestore_submit_lat, mono_clock::now() - start);
-  logger->tinc(l_bluestore_throttle_lat, tend - tstart);
-  return 0;
 }
 
 void BlueStore::_txc_aio_submit(TransContext *txc)
@@ -10546,6 +12025,28 @@ void BlueStore::_do_write_big(
   }
 }
 
+bool BlueStore::_compress_should_skip(OnodeRef& o, const bufferlist& bl)
+{
+  // after a run of rejects, only probe every so often in case the
+  // object's content changed
+  static constexpr uint32_t REPROBE_INTERVAL = 8;
+  uint32_t skip_after = cct->_conf->bluestore_compression_skip_after_rejects;
+  if (skip_after &&
+      o->comp_rejects >= skip_after &&
+      (o->comp_rejects - skip_after) % REPROBE_INTERVAL != 0) {
+    return true;
+  }
+  uint64_t sample_bytes = cct->_conf->bluestore_compression_sample_bytes;
+  if (!sample_bytes) {
+    return false;
+  }
+  auto start = mono_clock::now();
+  double entropy = Compressor::estimate_entropy(bl, sample_bytes);
+  logger->tinc(l_bluestore_compress_sample_lat, mono_clock::now() - start);
+  dout(30) << __func__ << " entropy " << entropy << dendl;
+  return entropy > cct->_conf->bluestore_compression_entropy_max;
+}
+
 int BlueStore::_do_alloc_write(
   TransContext *txc,
   CollectionRef coll,
@@ -10610,16 +12111,52 @@ int BlueStore::_do_alloc_write(
   auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
   for (auto& wi : wctx->writes) {
     if (c && wi.blob_length > min_alloc_size) {
-      auto start = mono_clock::now();
-
-      // compress
       assert(wi.b_off == 0);
       assert(wi.blob_length == wi.bl.length());
+      auto& cs = comp_stats[c->get_type()];
+
+      if (_compress_should_skip(o, wi.bl)) {
+	dout(20) << __func__ << std::hex << "  0x" << wi.blob_length
+		 << " looks incompressible (" << o->comp_rejects
+		 << " rejects in a row), leaving uncompressed"
+		 << std::dec << dendl;
+	++o->comp_rejects;
+	logger->inc(l_bluestore_compress_skipped_count);
+	logger->inc(l_bluestore_compress_skipped_bytes, wi.blob_length);
+	if (cs.logger) {
+	  cs.logger->inc(l_bluestore_comp_skipped_bytes, wi.blob_length);
+	}
+	uint64_t in_bytes = cs.in_bytes;
+	if (in_bytes) {
+	  // what compressing it would have cost at this algorithm's
+	  // average rate so far
+	  double nsec = (double)cs.nsec * wi.blob_length / in_bytes;
+	  logger->tinc(l_bluestore_compress_saved_time,
+		       ceph::timespan((uint64_t)nsec));
+	}
+	need += wi.blob_length;
+	continue;
+      }
+
+      auto start = mono_clock::now();
 
+      // compress
       // FIXME: memory alignment here is bad
       bufferlist t;
       int r = c->compress(wi.bl, t);
       assert(r == 0);
+      auto clat = mono_clock::now() - start;
+      cs.in_bytes += wi.blob_length;
+      cs.out_bytes += t.length();
+      cs.nsec += std::chrono::duration_cast<std::chrono::nanoseconds>(
+	clat).count();
+      if (cs.logger) {
+	cs.logger->inc(l_bluestore_comp_in_bytes, wi.blob_length);
+	cs.logger->inc(l_bluestore_comp_out_bytes, t.length());
+	cs.logger->tinc(l_bluestore_comp_lat, clat);
+	cs.logger->set(l_bluestore_comp_ratio,
+		       cs.out_bytes * 1000 / std::max<uint64_t>(1, cs.in_bytes));
+      }
 
       bluestore_compression_header_t chdr;
       chdr.type = c->get_type();
@@ -10644,6 +12181,7 @@ int BlueStore::_do_alloc_write(
 	txc->statfs_delta.compressed_original() += wi.blob_length;
 	txc->statfs_delta.compressed_allocated() += newlen;
 	logger->inc(l_bluestore_compress_success_count);
+	o->comp_rejects = 0;
 	wi.compressed = true;
 	need += newlen;
       } else {
@@ -10655,6 +12193,10 @@ int BlueStore::_do_alloc_write(
 		 << ", leaving uncompressed"
 		 << std::dec << dendl;
 	logger->inc(l_bluestore_compress_rejected_count);
+	if (cs.logger) {
+	  cs.logger->inc(l_bluestore_comp_rejected_bytes, wi.blob_length);
+	}
+	++o->comp_rejects;
 	need += wi.blob_length;
       }
       logger->tinc(l_bluestore_compress_lat,
@@ -10668,13 +12210,22 @@ int BlueStore::_do_alloc_write(
   int prealloc_left = 0;
   prealloc_left = alloc->allocate(
     need, min_alloc_size, need,
-    0, &prealloc);
+    wctx->alloc_hint, &prealloc);
   if (prealloc_left  < 0) {
     derr << __func__ << " failed to allocate 0x" << std::hex << need << std::dec
 	 << dendl;
     return -ENOSPC;
   }
   assert(prealloc_left == (int64_t)need);
+  if (wctx->alloc_hint && wctx->alloc_hint < (int64_t)_tier_fast_zone_end()) {
+    // the hint is only a starting point; count what actually landed there
+    uint64_t fast_end = _tier_fast_zone_end();
+    uint64_t placed = std::count_if(prealloc.begin(), prealloc.end(),
+      [fast_end](const bluestore_pextent_t& e) {
+	return e.offset < fast_end;
+      });
+    logger->inc(l_bluestore_tier_hot_allocs, placed);
+  }
 
   dout(20) << __func__ << " prealloc " << prealloc << dendl;
   auto prealloc_pos = prealloc.begin();
@@ -10936,6 +12487,15 @@ void BlueStore::_choose_write_options(
     wctx->buffered = true;
   }
 
+  if (cct->_conf->bluestore_tier_placement) {
+    // allocators treat a zero hint as "continue where you left off"
+    bool hot = _tier_is_hot(o);
+    wctx->alloc_hint = hot ? min_alloc_size : _tier_fast_zone_end();
+    dout(20) << __func__ << " " << (hot ? "hot" : "cold")
+	     << " alloc hint 0x" << std::hex << wctx->alloc_hint << std::dec
+	     << dendl;
+  }
+
   // apply basic csum block size
   wctx->csum_order = block_size_order;
 
@@ -11023,17 +12583,277 @@ void BlueStore::_choose_write_options(
            << std::dec << dendl;
 }
 
+uint32_t BlueStore::_tier_touch(OnodeRef& o, uint32_t hits)
+{
+  uint64_t interval = std::max<uint64_t>(
+    cct->_conf->bluestore_tier_decay_interval, 1);
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+    mono_clock::now().time_since_epoch()).count();
+  return o->touch_heat(now / interval, hits);
+}
+
+uint64_t BlueStore::_tier_fast_zone_end() const
+{
+  return p2align(
+    uint64_t(bdev->get_size() * cct->_conf->bluestore_tier_fast_zone_ratio),
+    (uint64_t)min_alloc_size);
+}
+
+void BlueStore::_tier_collect_misplaced(
+  OnodeRef o,
+  bool hot,
+  uint64_t offset,
+  uint64_t length,
+  uint64_t skip_start,
+  uint64_t skip_end,
+  uint64_t max_bytes,
+  vector<bluestore_pextent_t> *extents)
+{
+  uint64_t fast_end = _tier_fast_zone_end();
+  uint64_t end = offset + length;
+  uint64_t left = max_bytes;
+  for (auto ep = o->extent_map.seek_lextent(offset);
+       ep != o->extent_map.extent_map.end() && ep->logical_offset < end;
+       ++ep) {
+    // the freshly written range is placed already
+    if (ep->logical_offset < skip_end && ep->logical_end() > skip_start) {
+      continue;
+    }
+    auto& blob = ep->blob->get_blob();
+    if (blob.is_shared()) {
+      // moving it would unshare clone data
+      continue;
+    }
+    if (blob.is_compressed() && ep->length < blob.get_logical_length()) {
+      // rewriting part of a compressed blob frees nothing
+      continue;
+    }
+    auto& pe = blob.get_extents();
+    auto valid = std::find_if(pe.begin(), pe.end(),
+      [](const bluestore_pextent_t& e) { return e.is_valid(); });
+    if (valid == pe.end() || (valid->offset < fast_end) == hot) {
+      continue;
+    }
+    uint64_t l_start = std::max<uint64_t>(ep->logical_offset, offset);
+    uint64_t l_len = std::min<uint64_t>(ep->logical_end(), end) - l_start;
+    if (l_len > left) {
+      break;
+    }
+    extents->emplace_back(l_start, l_len);
+    left -= l_len;
+  }
+}
+
+double BlueStore::_defrag_score(
+  OnodeRef& o,
+  vector<bluestore_pextent_t> *runs)
+{
+  uint64_t bytes = 0;
+  uint64_t prev_end = 0;
+  unsigned n = 0;
+  auto count = [&](uint64_t off, uint64_t len) {
+    if (off != prev_end) {
+      ++n;
+    }
+    prev_end = off + len;
+    return 0;
+  };
+  for (auto& e : o->extent_map.extent_map) {
+    auto& blob = e.blob->get_blob();
+    if (blob.is_shared()) {
+      // rewriting would unshare clone data
+      return -1;
+    }
+    if (blob.is_compressed()) {
+      // the whole blob is read to get at any part of it, so a partly
+      // referenced one costs an extra run
+      for (auto& p : blob.get_extents()) {
+	if (p.is_valid()) {
+	  count(p.offset, p.length);
+	}
+      }
+      if (e.length < blob.get_logical_length()) {
+	++n;
+      }
+    } else {
+      blob.map(e.blob_offset, e.length, count);
+    }
+    if (!runs->empty() &&
+	runs->back().offset + runs->back().length == e.logical_offset) {
+      runs->back().length += e.length;
+    } else {
+      runs->emplace_back(e.logical_offset, e.length);
+    }
+    bytes += e.length;
+  }
+  if (!n) {
+    return 0;
+  }
+  uint64_t ideal = std::max<uint64_t>(
+    1, (bytes + max_blob_size - 1) / max_blob_size);
+  return (double)n / ideal;
+}
+
+int BlueStore::_defrag_onode(
+  CollectionRef& c,
+  const ghobject_t& oid,
+  uint64_t *bytes,
+  bool *migrated)
+{
+  // keep client transactions on this collection out until ours is built
+  std::unique_lock<std::mutex> sl(c->submit_lock);
+  TransContext *txc = nullptr;
+  {
+    RWLock::WLocker l(c->lock);
+    if (!c->exists) {
+      return -ENOENT;
+    }
+    OnodeRef o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      return -ENOENT;
+    }
+    if (o->onode.has_inline_data() ||
+	o->onode.size > cct->_conf->bluestore_defrag_max_object_size ||
+	alloc->get_free() < 2 * o->onode.size) {
+      return 0;
+    }
+    o->extent_map.fault_range(db, 0, o->onode.size);
+    vector<bluestore_pextent_t> runs;
+    double score = 0;
+    if (cct->_conf->bluestore_defrag_enable) {
+      score = _defrag_score(o, &runs);
+    }
+    if (score < cct->_conf->bluestore_defrag_min_score) {
+      runs.clear();
+      if (cct->_conf->bluestore_tier_placement) {
+	// move whatever sits in the wrong zone for the object's heat; the
+	// write options below steer the rewrite to the right one
+	_tier_collect_misplaced(o, _tier_is_hot(o), 0, o->onode.size, 0, 0,
+				o->onode.size, &runs);
+	*migrated = !runs.empty();
+      }
+      if (runs.empty()) {
+	dout(30) << __func__ << " " << c->cid << " " << oid
+		 << " score " << score << dendl;
+	return 0;
+      }
+    }
+    dout(10) << __func__ << " " << c->cid << " " << oid
+	     << " score " << score << (*migrated ? " migrating " : " rewriting ")
+	     << runs << dendl;
+
+    txc = _txc_create(c.get(), c->osr.get(), nullptr);
+    WriteContext wctx;
+    _choose_write_options(c, o, CEPH_OSD_OP_FLAG_FADVISE_DONTNEED, &wctx);
+    uint64_t dirty_start = o->onode.size;
+    uint64_t dirty_end = 0;
+    int r = _do_gc(txc, c, o, runs, wctx, &dirty_start, &dirty_end);
+    if (r < 0) {
+      derr << __func__ << " rewrite of " << oid << " failed with "
+	   << cpp_strerror(r) << dendl;
+      assert(0 == "unexpected error");
+    }
+    o->extent_map.compress_extent_map(dirty_start, dirty_end - dirty_start);
+    o->extent_map.dirty_range(dirty_start, dirty_end - dirty_start);
+    txc->write_onode(o);
+    for (auto& i : runs) {
+      txc->bytes += i.length;
+    }
+  }
+  _txc_calc_cost(txc);
+  _txc_write_nodes(txc, txc->t);
+  _txc_journal_deferred(txc);
+  _txc_finalize_kv(txc, txc->t);
+  sl.unlock();
+
+  // txc may be gone as soon as _txc_state_proc hands it off
+  *bytes = txc->bytes;
+  _txc_throttle(txc);
+  logger->inc(l_bluestore_txc);
+  _txc_state_proc(txc);
+  return 0;
+}
+
+void BlueStore::_defrag_pass()
+{
+  dout(10) << __func__ << dendl;
+  vector<CollectionRef> colls;
+  {
+    RWLock::RLocker l(coll_lock);
+    for (auto& i : coll_map) {
+      colls.push_back(i.second);
+    }
+  }
+  for (auto& c : colls) {
+    {
+      Mutex::Locker l(defrag_thread.lock);
+      defrag_thread.cur_cid = c->cid;
+    }
+    ghobject_t next;
+    while (next != ghobject_t::get_max()) {
+      vector<ghobject_t> ls;
+      {
+	RWLock::RLocker l(c->lock);
+	int r = _collection_list(c.get(), next, ghobject_t::get_max(), 64,
+				 &ls, &next);
+	if (r < 0) {
+	  break;
+	}
+      }
+      for (auto& oid : ls) {
+	// back off while client io keeps the store busy
+	uint64_t busy = cct->_conf->bluestore_defrag_busy_bytes;
+	while (busy && throttle_bytes.get_current() > (int64_t)busy) {
+	  if (!defrag_thread.pause(utime_t(0, 100000000))) {
+	    return;
+	  }
+	}
+	if (!defrag_thread.pause(utime_t())) {
+	  return;
+	}
+	uint64_t bytes = 0;
+	bool migrated = false;
+	_defrag_onode(c, oid, &bytes, &migrated);
+	{
+	  Mutex::Locker l(defrag_thread.lock);
+	  ++defrag_thread.scanned;
+	  if (bytes && !migrated) {
+	    ++defrag_thread.rewritten;
+	    defrag_thread.rewritten_bytes += bytes;
+	  }
+	}
+	logger->inc(l_bluestore_defrag_scanned);
+	if (!bytes) {
+	  continue;
+	}
+	if (migrated) {
+	  logger->inc(l_bluestore_tier_migrated_bytes, bytes);
+	} else {
+	  logger->inc(l_bluestore_defrag_rewritten);
+	  logger->inc(l_bluestore_defrag_rewritten_bytes, bytes);
+	}
+	uint64_t rate = cct->_conf->bluestore_defrag_bytes_per_sec;
+	if (rate) {
+	  utime_t t;
+	  t.set_from_double((double)bytes / rate);
+	  if (!defrag_thread.pause(t)) {
+	    return;
+	  }
+	}
+      }
+    }
+  }
+}
+
 int BlueStore::_do_gc(
   TransContext *txc,
   CollectionRef& c,
   OnodeRef o,
-  const GarbageCollector& gc,
+  const vector<bluestore_pextent_t>& extents_to_collect,
   const WriteContext& wctx,
   uint64_t *dirty_start,
   uint64_t *dirty_end)
 {
-  auto& extents_to_collect = gc.get_extents_to_collect();
-
   bool dirty_range_updated = false;
   WriteContext wctx_gc;
   wctx_gc.fork(wctx); // make a clone for garbage collection
@@ -11046,7 +12866,6 @@ int BlueStore::_do_gc(
     assert(r == (int)it->length);
 
     _do_write_data(txc, c, o, it->offset, it->length, bl, &wctx_gc);
-    logger->inc(l_bluestore_gc_merged, it->length);
 
     if (*dirty_start > it->offset) {
       *dirty_start = it->offset;
@@ -11074,6 +12893,56 @@ int BlueStore::_do_gc(
   return 0;
 }
 
+void BlueStore::_do_write_inline(
+  OnodeRef& o,
+  uint64_t offset,
+  const bufferlist& bl)
+{
+  auto& d = o->onode.inline_data;
+  uint64_t end = offset + bl.length();
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << bl.length()
+	   << " inline 0x" << d.length() << std::dec << dendl;
+  bufferlist n;
+  if (offset <= d.length()) {
+    n.substr_of(d, 0, offset);
+  } else {
+    n.append(d);
+    n.append_zero(offset - d.length());
+  }
+  n.append(bl);
+  if (end < d.length()) {
+    bufferlist tail;
+    tail.substr_of(d, end, d.length() - end);
+    n.claim_append(tail);
+  }
+  // keep a single private buffer so the cached onode does not pin
+  // client message memory
+  n.rebuild();
+  n.reassign_to_mempool(mempool::mempool_bluestore_cache_other);
+  d.swap(n);
+  o->onode.set_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  if (end > o->onode.size) {
+    o->onode.size = end;
+  }
+  logger->inc(l_bluestore_write_inline);
+  logger->inc(l_bluestore_write_inline_bytes, bl.length());
+}
+
+int BlueStore::_promote_inline(
+  TransContext *txc,
+  CollectionRef& c,
+  OnodeRef& o)
+{
+  dout(20) << __func__ << " " << o->oid << " inline 0x" << std::hex
+	   << o->onode.inline_data.length() << " size 0x" << o->onode.size
+	   << std::dec << dendl;
+  bufferlist bl;
+  bl.swap(o->onode.inline_data);
+  o->onode.clear_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  logger->inc(l_bluestore_inline_promote);
+  return _do_write(txc, c, o, 0, bl.length(), bl, 0);
+}
+
 int BlueStore::_do_write(
   TransContext *txc,
   CollectionRef& c,
@@ -11101,6 +12970,23 @@ int BlueStore::_do_write(
 
   uint64_t end = offset + length;
 
+  if (_can_inline(o, end)) {
+    if (bl.length() == length) {
+      _do_write_inline(o, offset, bl);
+    } else {
+      bufferlist t;
+      t.substr_of(bl, 0, length);
+      _do_write_inline(o, offset, t);
+    }
+    return 0;
+  }
+  if (o->onode.has_inline_data()) {
+    r = _promote_inline(txc, c, o);
+    if (r < 0) {
+      return r;
+    }
+  }
+
   GarbageCollector gc(c->store->cct);
   int64_t benefit;
   auto dirty_start = offset;
@@ -11136,16 +13022,47 @@ int BlueStore::_do_write(
     if (!gc.get_extents_to_collect().empty()) {
       dout(20) << __func__ << " perform garbage collection, "
                << "expected benefit = " << benefit << " AUs" << dendl;
-      r = _do_gc(txc, c, o, gc, wctx, &dirty_start, &dirty_end);
+      auto& to_collect = gc.get_extents_to_collect();
+      r = _do_gc(txc, c, o, to_collect, wctx, &dirty_start, &dirty_end);
       if (r < 0) {
         derr << __func__ << " _do_gc failed with " << cpp_strerror(r)
              << dendl;
         goto out;
       }
+      for (auto& e : to_collect) {
+	logger->inc(l_bluestore_gc_merged, e.length);
+      }
       dout(20)<<__func__<<" gc range is " << std::hex << dirty_start
 	      << "~" << dirty_end - dirty_start << std::dec << dendl;
     }
   }
+  if (cct->_conf->bluestore_tier_placement &&
+      cct->_conf->bluestore_tier_migrate_max_bytes) {
+    // move neighbouring extents that sit in the wrong zone for the
+    // object's current heat, reusing the gc rewrite path
+    uint64_t window = cct->_conf->bluestore_tier_migrate_max_bytes;
+    uint64_t win_start = offset > window ? offset - window : 0;
+    uint64_t win_end = std::min(end + window, (uint64_t)o->onode.size);
+    vector<bluestore_pextent_t> to_migrate;
+    if (win_end > win_start) {
+      o->extent_map.fault_range(db, win_start, win_end - win_start);
+      _tier_collect_misplaced(o, wctx.alloc_hint < (int64_t)_tier_fast_zone_end(),
+			      win_start, win_end - win_start,
+			      offset, end, window, &to_migrate);
+    }
+    if (!to_migrate.empty()) {
+      dout(20) << __func__ << " tier migrate " << to_migrate << dendl;
+      r = _do_gc(txc, c, o, to_migrate, wctx, &dirty_start, &dirty_end);
+      if (r < 0) {
+        derr << __func__ << " tier migration failed with " << cpp_strerror(r)
+             << dendl;
+        goto out;
+      }
+      for (auto& e : to_migrate) {
+	logger->inc(l_bluestore_tier_migrated_bytes, e.length);
+      }
+    }
+  }
   o->extent_map.compress_extent_map(dirty_start, dirty_end - dirty_start);
   o->extent_map.dirty_range(dirty_start, dirty_end - dirty_start);
 
@@ -11170,6 +13087,9 @@ int BlueStore::_write(TransContext *txc,
     r = -E2BIG;
   } else {
     _assign_nid(txc, o);
+    if (cct->_conf->bluestore_tier_placement) {
+      _tier_touch(o, 1);
+    }
     r = _do_write(txc, c, o, offset, length, bl, fadvise_flags);
     txc->write_onode(o);
   }
@@ -11212,6 +13132,27 @@ int BlueStore::_do_zero(TransContext *txc,
 
   _dump_onode(o);
 
+  if (o->onode.has_inline_data() && length > 0) {
+    if (offset >= o->onode.inline_data.length() ||
+	_can_inline(o, offset + length)) {
+      if (offset < o->onode.inline_data.length()) {
+	bufferlist zeros;
+	zeros.append_zero(
+	  std::min<uint64_t>(length, o->onode.inline_data.length() - offset));
+	_do_write_inline(o, offset, zeros);
+      }
+      if (offset + length > o->onode.size) {
+	o->onode.size = offset + length;
+      }
+      txc->write_onode(o);
+      return 0;
+    }
+    r = _promote_inline(txc, c, o);
+    if (r < 0) {
+      return r;
+    }
+  }
+
   WriteContext wctx;
   o->extent_map.fault_range(db, offset, length);
   o->extent_map.punch_hole(c, offset, length, &wctx.old_extents);
@@ -11243,7 +13184,17 @@ void BlueStore::_do_truncate(
   if (offset == o->onode.size)
     return;
 
-  if (offset < o->onode.size) {
+  if (o->onode.has_inline_data()) {
+    auto& d = o->onode.inline_data;
+    if (offset == 0) {
+      d.clear();
+      o->onode.clear_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+    } else if (offset < d.length()) {
+      bufferlist t;
+      t.substr_of(d, 0, offset);
+      d.swap(t);
+    }
+  } else if (offset < o->onode.size) {
     WriteContext wctx;
     uint64_t length = o->onode.size - offset;
     o->extent_map.fault_range(db, offset, length);
@@ -11317,6 +13268,7 @@ int BlueStore::_do_remove(
   txc->note_removed_object(o);
   o->extent_map.clear();
   o->onode = bluestore_onode_t();
+  o->reset_delta();
   _debug_obj_on_delete(o->oid);
 
   if (!is_gen || maybe_unshared_blobs.empty()) {
@@ -11700,7 +13652,11 @@ int BlueStore::_clone(TransContext *txc,
   // clone data
   oldo->flush();
   _do_truncate(txc, c, newo, 0);
-  if (cct->_conf->bluestore_clone_cow) {
+  if (oldo->onode.has_inline_data()) {
+    newo->onode.inline_data = oldo->onode.inline_data;
+    newo->onode.set_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+    newo->onode.size = oldo->onode.size;
+  } else if (cct->_conf->bluestore_clone_cow) {
     _do_clone_range(txc, c, oldo, newo, 0, oldo->onode.size, 0);
   } else {
     bufferlist bl;
@@ -11813,7 +13769,9 @@ int BlueStore::_clone_range(TransContext *txc,
   _assign_nid(txc, newo);
 
   if (length > 0) {
-    if (cct->_conf->bluestore_clone_cow) {
+    if (cct->_conf->bluestore_clone_cow &&
+	!oldo->onode.has_inline_data() &&
+	!newo->onode.has_inline_data()) {
       _do_zero(txc, c, newo, dstoff, length);
       _do_clone_range(txc, c, oldo, newo, srcoff, length, dstoff);
     } else {
@@ -12225,6 +14183,10 @@ void BlueStore::_flush_cache()
     i->trim_all();
     assert(i->empty());
   }
+  for (auto i : pri_cache_shards) {
+    i->trim_all();
+    assert(i->empty());
+  }
   for (auto& p : coll_map) {
     if (!p.second->onode_map.empty()) {
       derr << __func__ << " stray onodes on " << p.first << dendl;
@@ -12250,6 +14212,9 @@ void BlueStore::flush_cache()
   for (auto i : cache_shards) {
     i->trim_all();
   }
+  for (auto i : pri_cache_shards) {
+    i->trim_all();
+  }
 }
 
 void BlueStore::_apply_padding(uint64_t head_pad,
@@ -12313,10 +14278,55 @@ void BlueStore::_record_onode(OnodeRef &o, KeyValueDB::Transaction &txn)
 	    << extent_part << " bytes inline extents)"
 	    << dendl;
 
+  // If the onode is sharded and nothing but shard sizes changed since we
+  // last wrote its key, the dirty shard keys written above carry the
+  // whole update; skip rewriting the onode key.  Shard sizes in the
+  // onode are only hints (fault_range fixes them up on load) and get
+  // compacted back in with the next full write.
+  if (!o->onode.extent_map_shards.empty() &&
+      cct->_conf->bluestore_onode_delta_max > 0) {
+    uint32_t sig = _onode_delta_sig(o, bl, onode_part);
+    if (o->delta_sig_valid && o->delta_sig == sig &&
+	o->pending_deltas < cct->_conf->bluestore_onode_delta_max) {
+      ++o->pending_deltas;
+      dout(20) << __func__ << " onode " << o->oid << " unchanged but for"
+	       << " shard sizes, delta " << o->pending_deltas << dendl;
+      logger->inc(l_bluestore_onode_delta);
+      logger->inc(l_bluestore_onode_delta_saved_bytes, bl.length());
+      return;
+    }
+    o->delta_sig = sig;
+    o->delta_sig_valid = true;
+  } else {
+    o->delta_sig_valid = false;
+  }
+  o->pending_deltas = 0;
 
   txn->set(PREFIX_OBJ, o->key.c_str(), o->key.size(), bl);
 }
 
+uint32_t BlueStore::_onode_delta_sig(OnodeRef &o, const bufferlist& bl,
+				     unsigned onode_part)
+{
+  // crc of the encoded onode with shard sizes masked out, followed by
+  // the encoded spanning blobs as they are
+  auto& shards = o->onode.extent_map_shards;
+  std::vector<uint32_t> bytes;
+  bytes.reserve(shards.size());
+  for (auto& si : shards) {
+    bytes.push_back(si.bytes);
+    si.bytes = 0;
+  }
+  bufferlist masked;
+  encode(o->onode, masked);
+  for (size_t i = 0; i < shards.size(); ++i) {
+    shards[i].bytes = bytes[i];
+  }
+  bufferlist rest;
+  rest.substr_of(bl, onode_part, bl.length() - onode_part);
+  return rest.crc32c(masked.crc32c(-1));
+}
+
 // ===========================================
 // BlueStoreRepairer
 
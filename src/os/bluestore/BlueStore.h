@@ -32,6 +32,7 @@
 #include "include/assert.h"
 #include "include/unordered_map.h"
 #include "include/mempool.h"
+#include "include/cpp-btree/btree_set.h"
 #include "common/bloom_filter.hpp"
 #include "common/Finisher.h"
 #include "common/Throttle.h"
@@ -86,9 +87,15 @@ enum {
   l_bluestore_csum_lat,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
+  l_bluestore_compress_skipped_count,
+  l_bluestore_compress_skipped_bytes,
+  l_bluestore_compress_saved_time,
+  l_bluestore_compress_sample_lat,
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_write_merged,
+  l_bluestore_deferred_write_overwritten_bytes,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -115,16 +122,61 @@ enum {
   l_bluestore_write_small_deferred,
   l_bluestore_write_small_pre_read,
   l_bluestore_write_small_new,
+  l_bluestore_write_inline,
+  l_bluestore_write_inline_bytes,
+  l_bluestore_inline_promote,
   l_bluestore_txc,
   l_bluestore_onode_reshard,
+  l_bluestore_onode_delta,
+  l_bluestore_onode_delta_saved_bytes,
   l_bluestore_blob_split,
   l_bluestore_extent_compress,
   l_bluestore_gc_merged,
+  l_bluestore_tier_hot_allocs,
+  l_bluestore_tier_migrated_bytes,
   l_bluestore_read_eio,
+  l_bluestore_read_zerocopy_bytes,
+  l_bluestore_read_copy_bytes,
+  l_bluestore_read_copies,
   l_bluestore_fragmentation,
+  l_bluestore_defrag_scanned,
+  l_bluestore_defrag_rewritten,
+  l_bluestore_defrag_rewritten_bytes,
   l_bluestore_last
 };
 
+enum {
+  l_bluestore_cache_shard_first = 732800,
+  l_bluestore_cache_shard_onodes,
+  l_bluestore_cache_shard_onode_hits,
+  l_bluestore_cache_shard_onode_misses,
+  l_bluestore_cache_shard_buffers,
+  l_bluestore_cache_shard_buffer_bytes,
+  l_bluestore_cache_shard_buffer_hit_bytes,
+  l_bluestore_cache_shard_buffer_miss_bytes,
+  l_bluestore_cache_shard_last
+};
+
+enum {
+  l_bluestore_kv_lane_first = 732900,
+  l_bluestore_kv_lane_txc,
+  l_bluestore_kv_lane_submit_lat,
+  l_bluestore_kv_lane_commit_lat,
+  l_bluestore_kv_lane_commit_lat_hist,
+  l_bluestore_kv_lane_last
+};
+
+enum {
+  l_bluestore_comp_first = 732950,
+  l_bluestore_comp_in_bytes,
+  l_bluestore_comp_out_bytes,
+  l_bluestore_comp_rejected_bytes,
+  l_bluestore_comp_skipped_bytes,
+  l_bluestore_comp_lat,
+  l_bluestore_comp_ratio,
+  l_bluestore_comp_last
+};
+
 class BlueStore : public ObjectStore,
 		  public md_config_obs_t {
   // -----------------------------------------------------
@@ -347,6 +399,9 @@ public:
     void read(Cache* cache, uint32_t offset, uint32_t length,
 	      BlueStore::ready_regions_t& res,
 	      interval_set<uint32_t>& res_intervals);
+    /// bytes of offset~length read would return, without touching the
+    /// buffers or counting a cache hit or miss
+    uint32_t cached_bytes(Cache* cache, uint32_t offset, uint32_t length);
 
     void truncate(Cache* cache, uint32_t offset) {
       discard(cache, offset, (uint32_t)-1 - offset);
@@ -405,6 +460,9 @@ public:
     }
     void put();
 
+    /// move buffers written by txc seq to the clean list of our cache
+    void finish_write(uint64_t seq);
+
     /// get logical references
     void get_ref(uint64_t offset, uint32_t length);
 
@@ -710,6 +768,17 @@ public:
   };
   typedef boost::intrusive::set<Extent> extent_map_t;
 
+  /// compare Extents against a bare logical offset, so that lookups
+  /// need not construct (and tear down) a dummy Extent
+  struct ExtentOffsetCmp {
+    bool operator()(const Extent& e, uint32_t offset) const {
+      return e.logical_offset < offset;
+    }
+    bool operator()(uint32_t offset, const Extent& e) const {
+      return offset < e.logical_offset;
+    }
+  };
+
 
   friend ostream& operator<<(ostream& out, const Extent& e);
 
@@ -1028,6 +1097,40 @@ public:
 
     ExtentMap extent_map;
 
+    /// When only extent map shards change, the shard keys written by
+    /// ExtentMap::update() are the delta and the onode key itself is
+    /// left as is, with stale shard size hints (see _record_onode).
+    /// delta_sig identifies the last onode key we wrote, minus those
+    /// hints; pending_deltas counts updates since.
+    bool delta_sig_valid = false;
+    uint32_t delta_sig = 0;
+    unsigned pending_deltas = 0;
+
+    void reset_delta() {
+      delta_sig_valid = false;
+      pending_deltas = 0;
+    }
+
+    /// access heat for tiered placement: a hit count halved every
+    /// bluestore_tier_decay_interval seconds.  Updated from concurrent
+    /// readers without further locking; being off by a hit is harmless.
+    std::atomic<uint32_t> heat = {0};
+    std::atomic<uint32_t> heat_epoch = {0};
+
+    /// compressibility history: number of consecutive blobs of this
+    /// object that were either not worth compressing or skipped.  Kept
+    /// in memory only; it is rebuilt from scratch after a cache miss.
+    uint32_t comp_rejects = 0;
+
+    uint32_t touch_heat(uint32_t epoch, uint32_t hits) {
+      uint32_t last = heat_epoch.exchange(epoch);
+      if (last != epoch) {
+	uint32_t shift = std::min<uint32_t>(epoch - last, 31);
+	heat = heat >> shift;
+      }
+      return heat += hits;
+    }
+
     // track txc's that have not been committed to kv store (and whose
     // effects cannot be read via the kvdb read methods)
     std::atomic<int> flushing_count = {0};
@@ -1057,10 +1160,17 @@ public:
 
 
   /// a cache (shard) of onodes and buffers
+  ///
+  /// The onode and buffer halves of a shard are locked independently so
+  /// that onode lookups do not contend with buffer reads, writes and
+  /// trimming.  Lock order is onode_lock -> lock (dropping an onode may
+  /// release blobs and their buffers).
   struct Cache {
     CephContext* cct;
     PerfCounters *logger;
-    std::recursive_mutex lock;          ///< protect lru and other structures
+    PerfCounters *shard_logger = nullptr;  ///< per-shard stats, optional
+    std::recursive_mutex lock;          ///< protect buffer lru and BufferSpaces
+    std::recursive_mutex onode_lock;    ///< protect onode lru and OnodeSpaces
 
     std::atomic<uint64_t> num_extents = {0};
     std::atomic<uint64_t> num_blobs = {0};
@@ -1068,7 +1178,10 @@ public:
     static Cache *create(CephContext* cct, string type, PerfCounters *logger);
 
     Cache(CephContext* cct) : cct(cct), logger(nullptr) {}
-    virtual ~Cache() {}
+    virtual ~Cache();
+
+    void init_shard_logger(unsigned shard);
+    void update_shard_logger();
 
     virtual void _add_onode(OnodeRef& o, int level) = 0;
     virtual void _rm_onode(OnodeRef& o) = 0;
@@ -1101,15 +1214,39 @@ public:
 
     void trim_all();
 
-    virtual void _trim(uint64_t onode_max, uint64_t buffer_max) = 0;
+    virtual void _trim_onodes(uint64_t onode_max) = 0;
+    virtual void _trim_buffers(uint64_t buffer_max) = 0;
 
     virtual void add_stats(uint64_t *onodes, uint64_t *extents,
 			   uint64_t *blobs,
 			   uint64_t *buffers,
 			   uint64_t *bytes) = 0;
 
+    void count_onode_lookup(bool hit) {
+      if (hit) {
+	logger->inc(l_bluestore_onode_hits);
+      } else {
+	logger->inc(l_bluestore_onode_misses);
+      }
+      if (shard_logger) {
+	shard_logger->inc(hit ? l_bluestore_cache_shard_onode_hits :
+			  l_bluestore_cache_shard_onode_misses);
+      }
+    }
+    void count_buffer_read(uint64_t hit_bytes, uint64_t miss_bytes) {
+      logger->inc(l_bluestore_buffer_hit_bytes, hit_bytes);
+      logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
+      if (shard_logger) {
+	shard_logger->inc(l_bluestore_cache_shard_buffer_hit_bytes, hit_bytes);
+	shard_logger->inc(l_bluestore_cache_shard_buffer_miss_bytes,
+			  miss_bytes);
+      }
+    }
+
     bool empty() {
-      std::lock_guard<std::recursive_mutex> l(lock);
+      std::lock(onode_lock, lock);
+      std::lock_guard<std::recursive_mutex> l(onode_lock, std::adopt_lock);
+      std::lock_guard<std::recursive_mutex> l2(lock, std::adopt_lock);
       return _get_num_onodes() == 0 && _get_buffer_bytes() == 0;
     }
 
@@ -1193,14 +1330,18 @@ public:
       _audit("_touch_buffer end");
     }
 
-    void _trim(uint64_t onode_max, uint64_t buffer_max) override;
+    void _trim_onodes(uint64_t onode_max) override;
+    void _trim_buffers(uint64_t buffer_max) override;
 
     void add_stats(uint64_t *onodes, uint64_t *extents,
 		   uint64_t *blobs,
 		   uint64_t *buffers,
 		   uint64_t *bytes) override {
+      {
+	std::lock_guard<std::recursive_mutex> l(onode_lock);
+	*onodes += onode_lru.size();
+      }
       std::lock_guard<std::recursive_mutex> l(lock);
-      *onodes += onode_lru.size();
       *extents += num_extents;
       *blobs += num_blobs;
       *buffers += buffer_lru.size();
@@ -1288,14 +1429,18 @@ public:
       _audit("_touch_buffer end");
     }
 
-    void _trim(uint64_t onode_max, uint64_t buffer_max) override;
+    void _trim_onodes(uint64_t onode_max) override;
+    void _trim_buffers(uint64_t buffer_max) override;
 
     void add_stats(uint64_t *onodes, uint64_t *extents,
 		   uint64_t *blobs,
 		   uint64_t *buffers,
 		   uint64_t *bytes) override {
+      {
+	std::lock_guard<std::recursive_mutex> l(onode_lock);
+	*onodes += onode_lru.size();
+      }
       std::lock_guard<std::recursive_mutex> l(lock);
-      *onodes += onode_lru.size();
       *extents += num_extents;
       *blobs += num_blobs;
       *buffers += buffer_hot.size() + buffer_warm_in.size();
@@ -1324,6 +1469,8 @@ public:
 
     OnodeRef add(const ghobject_t& oid, OnodeRef o);
     OnodeRef lookup(const ghobject_t& o);
+    /// lookup, without touching the onode or counting the lookup
+    OnodeRef peek(const ghobject_t& o);
     void remove(const ghobject_t& oid) {
       onode_map.erase(oid);
     }
@@ -1349,6 +1496,10 @@ public:
     Cache *cache;       ///< our cache shard
     bluestore_cnode_t cnode;
     RWLock lock;
+    /// held while a txc on this collection is being built, so that
+    /// background rewrites (see _defrag_onode) do not interleave with
+    /// the ops of a queued transaction
+    std::mutex submit_lock;
 
     bool exists;
 
@@ -1397,6 +1548,8 @@ public:
     }
 
     void split_cache(Collection *dest);
+    /// move all cached onodes and buffers to another cache shard
+    void move_cache(Cache *dest);
 
     bool flush_commit(Context *c) override;
     void flush() override;
@@ -1588,6 +1741,9 @@ public:
     uint64_t last_nid = 0;     ///< if non-zero, highest new nid we allocated
     uint64_t last_blobid = 0;  ///< if non-zero, highest new blobid we allocated
 
+    int kv_lane = -1;          ///< kv submit lane we went through, if any
+    mono_time kv_lane_stamp;   ///< when queued to that lane
+
     explicit TransContext(CephContext* cct, Collection *c, OpSequencer *o,
 			  list<Context*> *on_commits)
       : ch(c),
@@ -1646,6 +1802,8 @@ public:
     IOContext ioc;                   ///< our aios
     /// bytes of pending io for each deferred seq (may be 0)
     map<uint64_t,int> seq_bytes;
+    /// bytes superseded by later writes in this batch (never written)
+    uint64_t overwritten_bytes = 0;
 
     void _discard(CephContext *cct, uint64_t offset, uint64_t length);
     void _audit(CephContext *cct);
@@ -1784,6 +1942,22 @@ public:
       return NULL;
     }
   };
+  /// submits the transactions of the sequencers mapped to it to the kv
+  /// store ahead of the kv_sync thread, which only does the sync commit
+  struct KVSubmitLane : public Thread {
+    BlueStore *store;
+    unsigned id;
+    std::mutex lock;
+    std::condition_variable cond;
+    deque<TransContext*> q;
+    bool stop = false;
+    PerfCounters *logger = nullptr;
+    KVSubmitLane(BlueStore *s, unsigned i) : store(s), id(i) {}
+    void *entry() override {
+      store->_kv_lane_thread(this);
+      return NULL;
+    }
+  };
 
   struct DBHistogram {
     struct value_dist {
@@ -1832,6 +2006,10 @@ private:
   map<coll_t,CollectionRef> new_coll_map;
 
   vector<Cache*> cache_shards;
+  vector<Cache*> pri_cache_shards;  ///< shards for cache_priority pools
+
+  set<int64_t> cache_pri_pools;     ///< pools with cache_priority (coll_lock)
+  std::atomic<bool> cache_pri_enabled = {false}; ///< !cache_pri_pools.empty()
 
   std::mutex zombie_osr_lock;              ///< protect zombie_osr_set
   std::map<coll_t,OpSequencerRef> zombie_osr_set; ///< set of OpSequencers for deleted collections
@@ -1852,6 +2030,17 @@ private:
   deferred_osr_queue_t deferred_queue; ///< osr's with deferred io pending
   int deferred_queue_size = 0;         ///< num txc's queued across all osrs
   atomic_int deferred_aggressive = {0}; ///< aggressive wakeup of kv thread
+
+  /// If set (bluestore_deferred_coalesce_{hdd,ssd}), the deferred ios of
+  /// all sequencers are batched here instead of per sequencer, so that
+  /// overlapping and adjacent extents are merged across collections and
+  /// each flush is a single LBA-ordered sweep.
+  OpSequencerRef deferred_coalesce_osr;
+
+  /// the sequencer whose DeferredBatch txcs on osr go into
+  OpSequencer *_deferred_osr(OpSequencer *osr) {
+    return deferred_coalesce_osr ? deferred_coalesce_osr.get() : osr;
+  }
   Finisher deferred_finisher;
 
   int m_finisher_num = 1;
@@ -1870,6 +2059,9 @@ private:
   deque<TransContext*> kv_committing;        ///< currently syncing
   deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
 
+  vector<KVSubmitLane*> kv_lanes; ///< empty unless bluestore_kv_sync_lanes > 1
+  vector<int> kv_cpus;            ///< cpus kv threads are bound to, if any
+
   KVFinalizeThread kv_finalize_thread;
   std::mutex kv_finalize_lock;
   std::condition_variable kv_finalize_cond;
@@ -1878,6 +2070,16 @@ private:
 
   PerfCounters *logger = nullptr;
 
+  /// per compression algorithm accounting, indexed by
+  /// Compressor::CompressionAlgorithm
+  struct CompressorStats {
+    PerfCounters *logger = nullptr;
+    std::atomic<uint64_t> in_bytes = {0};  ///< bytes fed to compress()
+    std::atomic<uint64_t> out_bytes = {0}; ///< bytes it returned
+    std::atomic<uint64_t> nsec = {0};      ///< time spent in compress()
+  };
+  std::array<CompressorStats, Compressor::COMP_ALG_LAST> comp_stats;
+
   list<CollectionRef> removed_collections;
 
   RWLock debug_read_error_lock = {"BlueStore::debug_read_error_lock"};
@@ -1925,6 +2127,8 @@ private:
   double cache_meta_ratio = 0;   ///< cache ratio dedicated to metadata
   double cache_kv_ratio = 0;     ///< cache ratio dedicated to kv (e.g., rocksdb)
   double cache_data_ratio = 0;   ///< cache ratio dedicated to object data
+  double cache_pri_meta_ratio = 0; ///< cache ratio reserved for cache_priority metadata
+  double cache_pri_data_ratio = 0; ///< cache ratio reserved for cache_priority data
   uint64_t cache_meta_min = 0;   ///< cache min dedicated to metadata
   uint64_t cache_kv_min = 0;     ///< cache min dedicated to kv (e.g., rocksdb)
   uint64_t cache_data_min = 0;   ///< cache min dedicated to object data
@@ -1945,23 +2149,47 @@ private:
 
     struct MempoolCache : public PriorityCache::PriCache {
       BlueStore *store;
+      bool priority_class;  ///< sizes the cache_priority shards
       int64_t cache_bytes[PriorityCache::Priority::LAST+1];
       double cache_ratio = 0;
 
-      MempoolCache(BlueStore *s) : store(s) {};
+      MempoolCache(BlueStore *s, bool p) : store(s), priority_class(p) {};
 
       virtual uint64_t _get_used_bytes() const = 0;
+      virtual int64_t _get_reserved_bytes() const = 0;
+
+      const vector<Cache*>& _get_shards() const {
+        return priority_class ? store->pri_cache_shards : store->cache_shards;
+      }
 
       virtual int64_t request_cache_bytes(
           PriorityCache::Priority pri, uint64_t chunk_bytes) const {
         int64_t assigned = get_cache_bytes(pri);
 
         switch (pri) {
-        // All cache items are currently shoved into the LAST priority 
+        // The priority class gets its reserved share ahead of everyone else
+        case PriorityCache::Priority::PRI1:
+          {
+            if (!priority_class || !store->cache_pri_enabled) {
+              break;
+            }
+            uint64_t usage = _get_used_bytes();
+            int64_t request = std::min<int64_t>(
+                PriorityCache::get_chunk(usage, chunk_bytes),
+                _get_reserved_bytes());
+            return(request > assigned) ? request - assigned : 0;
+          }
+        // All other cache items are currently shoved into the LAST priority 
         case PriorityCache::Priority::LAST:
           {
+            if (priority_class && !store->cache_pri_enabled) {
+              return 0;
+            }
             uint64_t usage = _get_used_bytes();
             int64_t request = PriorityCache::get_chunk(usage, chunk_bytes);
+            if (priority_class) {
+              request -= get_cache_bytes(PriorityCache::Priority::PRI1);
+            }
             return(request > assigned) ? request - assigned : 0;
           }
         default:
@@ -2001,15 +2229,29 @@ private:
     };
 
     struct MetaCache : public MempoolCache {
-      MetaCache(BlueStore *s) : MempoolCache(s) {};
+      MetaCache(BlueStore *s, bool p) : MempoolCache(s, p) {};
 
+      // onode and other metadata is not tracked per shard; split the
+      // mempool total between the classes by their share of onodes.
       virtual uint64_t _get_used_bytes() const {
-        return mempool::bluestore_cache_other::allocated_bytes() +
+        uint64_t bytes = mempool::bluestore_cache_other::allocated_bytes() +
             mempool::bluestore_cache_onode::allocated_bytes();
+        uint64_t pri_onodes = 0;
+        for (auto i : store->pri_cache_shards) {
+          pri_onodes += i->_get_num_onodes();
+        }
+        uint64_t pri_bytes = std::min<uint64_t>(
+            bytes, pri_onodes * get_bytes_per_onode());
+        return priority_class ? pri_bytes : bytes - pri_bytes;
+      }
+      virtual int64_t _get_reserved_bytes() const {
+        return static_cast<int64_t>(
+            store->cache_pri_meta_ratio * store->cache_size);
       }
 
       virtual string get_cache_name() const {
-        return "BlueStore Meta Cache";
+        return priority_class ? "BlueStore Priority Meta Cache" :
+                                "BlueStore Meta Cache";
       }
 
       uint64_t _get_num_onodes() const {
@@ -2019,31 +2261,40 @@ private:
       }
 
       double get_bytes_per_onode() const {
-        return (double)_get_used_bytes() / (double)_get_num_onodes();
+        uint64_t bytes = mempool::bluestore_cache_other::allocated_bytes() +
+            mempool::bluestore_cache_onode::allocated_bytes();
+        return (double)bytes / (double)_get_num_onodes();
       }
-    } meta_cache;
+    } meta_cache, pri_meta_cache;
 
     struct DataCache : public MempoolCache {
-      DataCache(BlueStore *s) : MempoolCache(s) {};
+      DataCache(BlueStore *s, bool p) : MempoolCache(s, p) {};
 
       virtual uint64_t _get_used_bytes() const {
         uint64_t bytes = 0;
-        for (auto i : store->cache_shards) {
+        for (auto i : _get_shards()) {
           bytes += i->_get_buffer_bytes();
         }
         return bytes; 
       }
+      virtual int64_t _get_reserved_bytes() const {
+        return static_cast<int64_t>(
+            store->cache_pri_data_ratio * store->cache_size);
+      }
       virtual string get_cache_name() const {
-        return "BlueStore Data Cache";
+        return priority_class ? "BlueStore Priority Data Cache" :
+                                "BlueStore Data Cache";
       }
-    } data_cache;
+    } data_cache, pri_data_cache;
 
   public:
     explicit MempoolThread(BlueStore *s)
       : store(s),
 	lock("BlueStore::MempoolThread::lock"),
-        meta_cache(MetaCache(s)),
-        data_cache(DataCache(s)) {}
+        meta_cache(MetaCache(s, false)),
+        pri_meta_cache(MetaCache(s, true)),
+        data_cache(DataCache(s, false)),
+        pri_data_cache(DataCache(s, true)) {}
 
     void *entry() override;
     void init() {
@@ -2061,12 +2312,56 @@ private:
   private:
     void _adjust_cache_settings();
     void _trim_shards(bool log_stats);
+    void _trim_class(const vector<Cache*>& shards, double bytes_per_onode,
+                     int64_t meta_alloc_bytes, int64_t data_alloc_bytes);
     void _balance_cache(const std::list<PriorityCache::PriCache *>& caches);
     void _balance_cache_pri(int64_t *mem_avail, 
                             const std::list<PriorityCache::PriCache *>& caches, 
                             PriorityCache::Priority pri);
   } mempool_thread;
 
+  struct DefragThread : public Thread {
+    BlueStore *store;
+
+    Cond cond;
+    Mutex lock;
+    bool stop = false;
+    bool kick = false;     ///< start a pass now (admin socket)
+    bool abort = false;    ///< end the running pass early (admin socket)
+
+    // progress of the running (or last) pass
+    bool running = false;
+    utime_t pass_start, pass_end;
+    coll_t cur_cid;
+    uint64_t scanned = 0;
+    uint64_t rewritten = 0;
+    uint64_t rewritten_bytes = 0;
+
+    explicit DefragThread(BlueStore *s)
+      : store(s),
+	lock("BlueStore::DefragThread::lock") {}
+
+    void *entry() override;
+    void init() {
+      assert(stop == false);
+      create("bstore_defrag");
+    }
+    void shutdown() {
+      lock.Lock();
+      stop = true;
+      cond.Signal();
+      lock.Unlock();
+      join();
+    }
+
+    /// sleep up to t; false if the pass should end
+    bool pause(utime_t t);
+    void dump(Formatter *f);
+  } defrag_thread;
+
+  class DefragSocketHook;
+  DefragSocketHook *defrag_asok_hook = nullptr;
+
   // --------------------------------------------------------
   // private methods
 
@@ -2074,6 +2369,8 @@ private:
   void _shutdown_logger();
   int _reload_logger();
 
+  Cache *_get_cache_shard(const coll_t& cid);
+
   int _open_path();
   void _close_path();
   int _open_fsid(bool create);
@@ -2092,11 +2389,15 @@ private:
    * hold the rocksdb's file lock.
    */
   int _open_db(bool create, bool to_repair_db=false);
+  void _get_db_cfs(vector<KeyValueDB::ColumnFamily> *cfs);
   void _close_db();
   int _open_fm(bool create);
   void _close_fm();
   int _open_alloc();
   void _close_alloc();
+  int _write_alloc_snapshot();
+  int _read_alloc_snapshot(uint64_t *num, uint64_t *bytes);
+  void _remove_alloc_snapshot();
   int _open_collections(int *errors=0);
   void _close_collections();
 
@@ -2139,6 +2440,8 @@ private:
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
+  void _txc_journal_deferred(TransContext *txc);
+  void _txc_throttle(TransContext *txc);
   void _txc_state_proc(TransContext *txc);
   void _txc_aio_submit(TransContext *txc);
 public:
@@ -2159,6 +2462,10 @@ private:
 
   void _kv_start();
   void _kv_stop();
+  void _kv_init_affinity();
+  void _kv_bind_thread();
+  void _kv_lane_thread(KVSubmitLane *lane);
+  void _kv_lane_committed(TransContext *txc);
   void _kv_sync_thread();
   void _kv_finalize_thread();
 
@@ -2176,7 +2483,53 @@ public:
     boost::dynamic_bitset<uint64_t,
 			  mempool::bluestore_fsck::pool_allocator<uint64_t>>;
 
+  /// periodic fsck progress: objects checked, bytes read (deep), seconds
+  typedef std::function<void(uint64_t, uint64_t, double)> fsck_progress_cb_t;
+  void set_fsck_progress_cb(fsck_progress_cb_t cb) {
+    fsck_progress_cb = cb;
+  }
+
 private:
+  fsck_progress_cb_t fsck_progress_cb;
+  std::atomic<uint64_t> fsck_objects_checked = {0};
+  std::atomic<uint64_t> fsck_bytes_read = {0};
+
+  struct fsck_sb_info_t {
+    coll_t cid;
+    list<ghobject_t> oids;
+    SharedBlobRef sb;
+    bluestore_extent_ref_map_t ref_map;
+    bool compressed = false;
+    bool passed = false;
+    bool updated = false;
+  };
+  typedef btree::btree_set<
+    uint64_t, std::less<uint64_t>,
+    mempool::bluestore_fsck::pool_allocator<uint64_t>> fsck_uint64_btree_t;
+
+  /// results of checking a part of the onode keyspace; each fsck thread
+  /// fills its own, they are merged once the walk is done
+  struct FSCKObjectCtx {
+    int errors = 0;
+    uint64_t num_objects = 0;
+    uint64_t num_extents = 0;
+    uint64_t num_blobs = 0;
+    uint64_t num_spanning_blobs = 0;
+    uint64_t num_sharded_objects = 0;
+    uint64_t num_object_shards = 0;
+
+    mempool_dynamic_bitset used_blocks;
+    fsck_uint64_btree_t used_nids;
+    fsck_uint64_btree_t used_omap_head;
+    fsck_uint64_btree_t used_pgmeta_omap_head;
+    store_statfs_t expected_statfs;
+    mempool::bluestore_fsck::map<uint64_t, fsck_sb_info_t> sb_info;
+
+    // collection lookup cache
+    CollectionRef c;
+    spg_t pgid;
+  };
+
   int _fsck_check_extents(
     const coll_t& cid,
     const ghobject_t& oid,
@@ -2186,6 +2539,22 @@ private:
     uint64_t granularity,
     BlueStoreRepairer* repairer,
     store_statfs_t& expected_statfs);
+  void _fsck_check_object(
+    FSCKObjectCtx& ctx,
+    const string& key,
+    const vector<string>& shard_keys,
+    bool deep,
+    BlueStoreRepairer* repairer);
+  void _fsck_check_onode(
+    FSCKObjectCtx& ctx,
+    const string& key,
+    bool deep,
+    BlueStoreRepairer* repairer,
+    vector<string> *expecting_shards);
+  void _fsck_merge(
+    FSCKObjectCtx& to,
+    FSCKObjectCtx& from,
+    BlueStoreRepairer* repairer);
 
   void _buffer_cache_write(
     TransContext *txc,
@@ -2217,15 +2586,20 @@ private:
 		      bufferlist& padded);
 
   void _record_onode(OnodeRef &o, KeyValueDB::Transaction &txn);
+  uint32_t _onode_delta_sig(OnodeRef &o, const bufferlist& bl,
+			    unsigned onode_part);
 
   // -- ondisk version ---
 public:
-  const int32_t latest_ondisk_format = 2;        ///< our version
+  const int32_t latest_ondisk_format = 3;        ///< our version
   const int32_t min_readable_ondisk_format = 1;  ///< what we can read
   const int32_t min_compat_ondisk_format = 2;    ///< who can read us
+  /// who can read us once onodes may carry inline data
+  const int32_t min_compat_inline_ondisk_format = 3;
 
 private:
   int32_t ondisk_format = 0;  ///< value detected on mount
+  int32_t compat_ondisk_format = 0;  ///< min compat format recorded in super
 
   int _upgrade_super();  ///< upgrade (called during open_super)
   void _prepare_ondisk_format_super(KeyValueDB::Transaction& t);
@@ -2281,6 +2655,10 @@ public:
     return 0;
   }
 
+  /// move the kv metadata into the column family layout configured by
+  /// bluestore_rocksdb_cf and bluestore_rocksdb_cfs; store must be unmounted
+  int reshard_db(ostream& out);
+
   int write_meta(const std::string& key, const std::string& value) override;
   int read_meta(const std::string& key, std::string *value) override;
 
@@ -2346,7 +2724,24 @@ public:
     bufferlist& bl,
     uint32_t op_flags = 0);
 
+  int verify_checksums(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    uint32_t op_flags = 0) override;
+
+  bool is_cached(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len) override;
+
 private:
+  int _do_verify_checksums(
+    OnodeRef o,
+    uint64_t offset,
+    size_t len);
   int _fiemap(CollectionHandle &c_, const ghobject_t& oid,
  	     uint64_t offset, size_t len, interval_set<uint64_t>& destset);
 public:
@@ -2531,6 +2926,7 @@ private:
     bool compress = false;          ///< compressed write
     uint64_t target_blob_size = 0;  ///< target (max) blob size
     unsigned csum_order = 0;        ///< target checksum chunk order
+    int64_t alloc_hint = 0;         ///< where to start looking for space
 
     old_extent_map_t old_extents;   ///< must deref these blobs
 
@@ -2579,6 +2975,7 @@ private:
       compress = other.compress;
       target_blob_size = other.target_blob_size;
       csum_order = other.csum_order;
+      alloc_hint = other.alloc_hint;
     }
     void write(
       uint64_t loffs,
@@ -2622,6 +3019,7 @@ private:
     uint64_t offset, uint64_t length,
     bufferlist::iterator& blp,
     WriteContext *wctx);
+  bool _compress_should_skip(OnodeRef& o, const bufferlist& bl);
   int _do_alloc_write(
     TransContext *txc,
     CollectionRef c,
@@ -2651,11 +3049,45 @@ private:
   int _do_gc(TransContext *txc,
              CollectionRef& c,
              OnodeRef o,
-             const GarbageCollector& gc,
+             const vector<bluestore_pextent_t>& extents_to_collect,
              const WriteContext& wctx,
              uint64_t *dirty_start,
              uint64_t *dirty_end);
 
+  // tiered placement: hot objects are allocated from the start of the
+  // main device (the fast zone), cold ones past it
+  uint32_t _tier_touch(OnodeRef& o, uint32_t hits);
+  bool _tier_is_hot(OnodeRef& o) {
+    return _tier_touch(o, 0) >= cct->_conf->bluestore_tier_hot_threshold;
+  }
+  uint64_t _tier_fast_zone_end() const;
+  void _tier_collect_misplaced(OnodeRef o, bool hot,
+			       uint64_t offset, uint64_t length,
+			       uint64_t skip_start, uint64_t skip_end,
+			       uint64_t max_bytes,
+			       vector<bluestore_pextent_t> *extents);
+
+  // background defragmentation, see DefragThread
+  /// fragmentation score of o (physical runs per ideal extent), or a
+  /// negative value if o cannot be defragmented; fills in its logical runs
+  double _defrag_score(OnodeRef& o, vector<bluestore_pextent_t> *runs);
+  /// rewrite oid if it is fragmented or, with tiered placement, has
+  /// extents in the wrong zone for its heat; *bytes is what was rewritten
+  int _defrag_onode(CollectionRef& c, const ghobject_t& oid, uint64_t *bytes,
+		    bool *migrated);
+  void _defrag_pass();
+
+  bool _can_inline(OnodeRef& o, uint64_t end) const {
+    return compat_ondisk_format >= min_compat_inline_ondisk_format &&
+      end <= cct->_conf->bluestore_inline_data_max_size &&
+      (o->onode.has_inline_data() ||
+       (o->onode.size == 0 &&
+	o->onode.extent_map_shards.empty() &&
+	o->extent_map.extent_map.empty()));
+  }
+  void _do_write_inline(OnodeRef& o, uint64_t offset, const bufferlist& bl);
+  int _promote_inline(TransContext *txc, CollectionRef& c, OnodeRef& o);
+
   int _do_write(TransContext *txc,
 		CollectionRef &c,
 		OnodeRef o,
@@ -2931,12 +3363,19 @@ public:
 
   unsigned apply(KeyValueDB* db);
 
+  // the two below may be called from several fsck threads at once
   void note_misreference(uint64_t offs, uint64_t len, bool inc_error) {
+    std::lock_guard<std::mutex> l(lock);
     misreferenced_extents.union_insert(offs, len);
     if (inc_error) {
       ++to_repair_cnt;
     }
   }
+  void note_used(uint64_t offset, uint64_t len,
+		 const coll_t& cid, const ghobject_t& oid) {
+    std::lock_guard<std::mutex> l(lock);
+    space_usage_tracker.set_used(offset, len, cid, oid);
+  }
 
   StoreSpaceTracker& get_space_usage_tracker() {
     return space_usage_tracker;
@@ -2949,6 +3388,7 @@ public:
   }
 
 private:
+  std::mutex lock;
   unsigned to_repair_cnt = 0;
   KeyValueDB::Transaction fix_fm_leaked_txn;
   KeyValueDB::Transaction fix_fm_false_free_txn;
@@ -0,0 +1,57 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_HYBRIDALLOCATOR_H
+#define CEPH_OS_BLUESTORE_HYBRIDALLOCATOR_H
+
+#include <mutex>
+
+#include "AvlAllocator.h"
+#include "BitmapAllocator.h"
+
+/// AvlAllocator with a bounded range tree; once the tree reaches its
+/// memory cap the smallest free extents spill over into a bitmap
+/// allocator, so memory stays bounded on badly fragmented devices
+/// while large extents keep the extent-tree allocation speed.
+class HybridAllocator : public AvlAllocator {
+  BitmapAllocator* bmap_alloc = nullptr;
+public:
+  HybridAllocator(CephContext* cct, int64_t device_size, int64_t _block_size,
+		  uint64_t max_mem)
+    : AvlAllocator(cct, device_size, _block_size, max_mem) {
+  }
+  ~HybridAllocator() override;
+
+  int64_t allocate(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    int64_t  hint,
+    PExtentVector *extents) override;
+  void release(const interval_set<uint64_t>& release_set) override;
+  uint64_t get_free() override;
+  double get_fragmentation(uint64_t alloc_unit) override;
+
+  void dump() override;
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+  void shutdown() override;
+
+protected:
+  // intended primarily for UT
+  BitmapAllocator* get_bmap() {
+    return bmap_alloc;
+  }
+  uint64_t get_avl_free() {
+    std::lock_guard<std::mutex> l(lock);
+    return _get_free();
+  }
+  uint64_t get_bmap_free() {
+    return bmap_alloc ? bmap_alloc->get_free() : 0;
+  }
+
+private:
+  void _spillover_range(uint64_t start, uint64_t end) override;
+};
+
+#endif
@@ -38,7 +38,6 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
     fd_buffered(-1),
     aio(false), dio(false),
     debug_lock("KernelDevice::debug_lock"),
-    aio_queue(cct->_conf->bdev_aio_max_queue_depth),
     discard_callback(d_cb),
     discard_callback_priv(d_cbpriv),
     aio_stop(false),
@@ -48,6 +47,22 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
     discard_thread(this),
     injecting_crash(0)
 {
+  unsigned int iodepth = cct->_conf->bdev_aio_max_queue_depth;
+
+  if (cct->_conf->bdev_ioring) {
+    if (ioring_queue_t::supported()) {
+      io_queue = std::make_unique<ioring_queue_t>(
+	iodepth,
+	cct->_conf->bdev_ioring_hipri,
+	cct->_conf->bdev_ioring_sqthread_poll);
+    } else {
+      derr << __func__ << " bdev_ioring is set but io_uring is not supported"
+	   << " by this build or kernel; falling back to libaio" << dendl;
+    }
+  }
+  if (!io_queue) {
+    io_queue = std::make_unique<aio_queue_t>(iodepth);
+  }
 }
 
 int KernelDevice::_lock()
@@ -188,6 +203,32 @@ int KernelDevice::get_devices(std::set<std::string> *ls)
   return 0;
 }
 
+int KernelDevice::get_numa_node(int *node) const
+{
+  if (devname.empty()) {
+    return -ENOENT;
+  }
+  if (devname.find("dm-") == 0) {
+    // use the parents' node if they all agree
+    std::set<std::string> parents;
+    get_dm_parents(devname, &parents);
+    int r = -ENOENT;
+    for (auto& p : parents) {
+      int n;
+      if (block_device_numa_node(p.c_str(), &n) < 0) {
+	return -ENOENT;
+      }
+      if (r == 0 && n != *node) {
+	return -ENOENT;
+      }
+      *node = n;
+      r = 0;
+    }
+    return r;
+  }
+  return block_device_numa_node(devname.c_str(), node);
+}
+
 void KernelDevice::close()
 {
   dout(1) << __func__ << dendl;
@@ -349,7 +390,8 @@ int KernelDevice::_aio_start()
 {
   if (aio) {
     dout(10) << __func__ << dendl;
-    int r = aio_queue.init();
+    std::vector<int> fds = { fd_direct, fd_buffered };
+    int r = io_queue->init(fds);
     if (r < 0) {
       if (r == -EAGAIN) {
 	derr << __func__ << " io_setup(2) failed with EAGAIN; "
@@ -371,7 +413,7 @@ void KernelDevice::_aio_stop()
     aio_stop = true;
     aio_thread.join();
     aio_stop = false;
-    aio_queue.shutdown();
+    io_queue->shutdown();
   }
 }
 
@@ -426,8 +468,8 @@ void KernelDevice::_aio_thread()
     dout(40) << __func__ << " polling" << dendl;
     int max = cct->_conf->bdev_aio_reap_max;
     aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
-					 aio, max);
+    int r = io_queue->get_next_completed(cct->_conf->bdev_aio_poll_ms,
+					      aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
       assert(0 == "got unexpected error from io_getevents");
@@ -658,7 +700,7 @@ void KernelDevice::aio_submit(IOContext *ioc)
 
   void *priv = static_cast<void*>(ioc);
   int r, retries = 0;
-  r = aio_queue.submit_batch(ioc->running_aios.begin(), e, 
+  r = io_queue->submit_batch(ioc->running_aios.begin(), e, 
 			     pending, priv, &retries);
   
   if (retries)
@@ -23,6 +23,7 @@
 #include "common/Cond.h"
 
 #include "aio.h"
+#include "io_uring.h"
 #include "BlockDevice.h"
 
 class KernelDevice : public BlockDevice {
@@ -41,7 +42,7 @@ class KernelDevice : public BlockDevice {
   std::atomic<bool> io_since_flush = {false};
   std::mutex flush_mutex;
 
-  aio_queue_t aio_queue;
+  std::unique_ptr<io_queue_t> io_queue;
   aio_callback_t discard_callback;
   void *discard_callback_priv;
   bool aio_stop;
@@ -118,6 +119,7 @@ public:
     return 0;
   }
   int get_devices(std::set<std::string> *ls) override;
+  int get_numa_node(int *node) const override;
 
   bool get_thin_utilization(uint64_t *total, uint64_t *avail) const override;
 
@@ -209,7 +209,7 @@ int main(int argc, char **argv)
     ;
   po::options_description po_positional("Positional options");
   po_positional.add_options()
-    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump")
+    ("command", po::value<string>(&action), "fsck, repair, reshard, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump")
     ;
   po::options_description po_all("All options");
   po_all.add(po_options).add(po_positional);
@@ -239,7 +239,7 @@ int main(int argc, char **argv)
     exit(EXIT_FAILURE);
   }
 
-  if (action == "fsck" || action == "repair") {
+  if (action == "fsck" || action == "repair" || action == "reshard") {
     if (path.empty()) {
       cerr << "must specify bluestore path" << std::endl;
       exit(EXIT_FAILURE);
@@ -324,6 +324,11 @@ int main(int argc, char **argv)
       action == "repair") {
     validate_path(cct.get(), path, false);
     BlueStore bluestore(cct.get(), path);
+    bluestore.set_fsck_progress_cb(
+      [](uint64_t objects, uint64_t bytes, double secs) {
+	cerr << "fsck: " << objects << " objects checked, "
+	     << byte_u_t(bytes) << " read in " << secs << "s" << std::endl;
+      });
     int r;
     if (action == "fsck") {
       r = bluestore.fsck(fsck_deep);
@@ -336,6 +341,16 @@ int main(int argc, char **argv)
     }
     cout << action << " success" << std::endl;
   }
+  else if (action == "reshard") {
+    validate_path(cct.get(), path, false);
+    BlueStore bluestore(cct.get(), path);
+    int r = bluestore.reshard_db(cout);
+    if (r < 0) {
+      cerr << "error from reshard: " << cpp_strerror(r) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << action << " success" << std::endl;
+  }
   else if (action == "prime-osd-dir") {
     bluestore_bdev_label_t label;
     int r = BlueStore::_read_bdev_label(cct.get(), devs.front(), &label);
@@ -1047,6 +1047,9 @@ void bluestore_onode_t::dump(Formatter *f) const
   }
   f->close_section();
   f->dump_string("flags", get_flags_string());
+  if (has_inline_data()) {
+    f->dump_unsigned("inline_data_len", inline_data.length());
+  }
   f->open_array_section("extent_map_shards");
   for (auto si : extent_map_shards) {
     f->dump_object("shard", si);
@@ -1060,6 +1063,11 @@ void bluestore_onode_t::dump(Formatter *f) const
 void bluestore_onode_t::generate_test_instances(list<bluestore_onode_t*>& o)
 {
   o.push_back(new bluestore_onode_t());
+  o.push_back(new bluestore_onode_t());
+  o.back()->nid = 1;
+  o.back()->size = 5;
+  o.back()->set_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  o.back()->inline_data.append("hello");
   // FIXME
 }
 
@@ -901,9 +901,15 @@ struct bluestore_onode_t {
 
   uint8_t flags = 0;
 
+  /// object data, if small enough to live in the onode (FLAG_INLINE_DATA).
+  /// The extent map is empty then; anything past the end of inline_data
+  /// and up to size reads as zeros.
+  bufferlist inline_data;
+
   enum {
     FLAG_OMAP = 1,       ///< object may have omap data
     FLAG_PGMETA_OMAP = 2,  ///< omap data is in meta omap prefix
+    FLAG_INLINE_DATA = 4,  ///< data is in inline_data, not in blobs
   };
 
   string get_flags_string() const {
@@ -911,6 +917,12 @@ struct bluestore_onode_t {
     if (flags & FLAG_OMAP) {
       s = "omap";
     }
+    if (flags & FLAG_INLINE_DATA) {
+      if (!s.empty()) {
+	s += "+";
+      }
+      s += "inline_data";
+    }
     return s;
   }
 
@@ -932,6 +944,9 @@ struct bluestore_onode_t {
   bool is_pgmeta_omap() const {
     return has_flag(FLAG_PGMETA_OMAP);
   }
+  bool has_inline_data() const {
+    return has_flag(FLAG_INLINE_DATA);
+  }
 
   void set_omap_flag() {
     set_flag(FLAG_OMAP);
@@ -942,7 +957,9 @@ struct bluestore_onode_t {
   }
 
   DENC(bluestore_onode_t, v, p) {
-    DENC_START(1, 1, p);
+    // compat is only raised for inline onodes; note that older decoders do
+    // not check it, the store's min_compat_ondisk_format keeps them out
+    DENC_START(2, v.has_inline_data() ? 2 : 1, p);
     denc_varint(v.nid, p);
     denc_varint(v.size, p);
     denc(v.attrs, p);
@@ -951,6 +968,9 @@ struct bluestore_onode_t {
     denc_varint(v.expected_object_size, p);
     denc_varint(v.expected_write_size, p);
     denc_varint(v.alloc_hint_flags, p);
+    if (struct_v >= 2 && v.has_inline_data()) {
+      denc(v.inline_data, p);
+    }
     DENC_FINISH(p);
   }
   void dump(Formatter *f) const;
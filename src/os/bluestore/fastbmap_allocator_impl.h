@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include <mutex>
 
 typedef uint64_t slot_t;
@@ -464,6 +465,46 @@ public:
     }
     return res * l0_granularity;
   }
+
+  // calls notify for every run of free l0 bits, adjacent runs
+  // spanning slot boundaries are merged
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify)
+  {
+    uint64_t run_start = 0;
+    uint64_t run_len = 0;
+    for (size_t i = 0; i < l0.size(); ++i) {
+      auto v = l0[i];
+      if (v == all_slot_clear) {
+	if (run_len) {
+	  notify(run_start * l0_granularity, run_len * l0_granularity);
+	  run_len = 0;
+	}
+	continue;
+      }
+      uint64_t base = i * bits_per_slot;
+      if (v == all_slot_set) {
+	if (!run_len) {
+	  run_start = base;
+	}
+	run_len += bits_per_slot;
+	continue;
+      }
+      for (size_t b = 0; b < bits_per_slot; ++b) {
+	if (v & (slot_t(1) << b)) {
+	  if (!run_len) {
+	    run_start = base + b;
+	  }
+	  ++run_len;
+	} else if (run_len) {
+	  notify(run_start * l0_granularity, run_len * l0_granularity);
+	  run_len = 0;
+	}
+      }
+    }
+    if (run_len) {
+      notify(run_start * l0_granularity, run_len * l0_granularity);
+    }
+  }
 };
 
 class AllocatorLevel01Compact : public AllocatorLevel01
@@ -501,6 +542,11 @@ public:
   {
     return l1.get_min_alloc_size();
   }
+  void foreach_free(std::function<void(uint64_t offset, uint64_t length)> notify)
+  {
+    std::lock_guard<std::mutex> l(lock);
+    l1.dump(notify);
+  }
 
 protected:
   std::mutex lock;
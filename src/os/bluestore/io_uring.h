@@ -0,0 +1,43 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include "acconfig.h"
+
+#include "include/types.h"
+#include "aio.h"
+
+struct ioring_data;
+
+/**
+ * io_uring based implementation of io_queue_t
+ *
+ * The block device fds are registered with the ring up front so that
+ * each submission can use IOSQE_FIXED_FILE and skip the per-IO fget/fput.
+ * All aios of a batch are queued into the SQ and handed to the kernel
+ * with a single io_uring_enter(2).  Optionally the kernel can poll the
+ * SQ (SQPOLL), in which case submission usually needs no syscall at all,
+ * or the device can be polled for completions (IOPOLL, "hipri").
+ */
+struct ioring_queue_t final : public io_queue_t {
+  std::unique_ptr<ioring_data> d;
+  unsigned iodepth = 0;
+  bool hipri = false;
+  bool sq_thread = false;
+
+  typedef list<aio_t>::iterator aio_iter;
+
+  // Returns true if we were built with liburing and the kernel supports it
+  static bool supported();
+
+  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_);
+  ~ioring_queue_t() final;
+
+  int init(std::vector<int> &fds) final;
+  void shutdown() final;
+
+  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+		   void *priv, int *retries) final;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+};
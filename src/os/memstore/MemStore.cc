@@ -46,14 +46,23 @@ int MemStore::mount()
   int r = _load();
   if (r < 0)
     return r;
-  finisher.start();
+  unsigned n = std::max<uint64_t>(1, cct->_conf->memstore_finisher_shards);
+  for (unsigned i = 0; i < n; ++i) {
+    finishers.push_back(new Finisher(cct, "memstore_finisher",
+				     "fn_memstore_" + stringify(i)));
+    finishers.back()->start();
+  }
   return 0;
 }
 
 int MemStore::umount()
 {
-  finisher.wait_for_empty();
-  finisher.stop();
+  for (auto f : finishers) {
+    f->wait_for_empty();
+    f->stop();
+    delete f;
+  }
+  finishers.clear();
   return _save();
 }
 
@@ -62,18 +71,18 @@ int MemStore::_save()
   dout(10) << __func__ << dendl;
   dump_all();
   set<coll_t> collections;
-  for (ceph::unordered_map<coll_t,CollectionRef>::iterator p = coll_map.begin();
-       p != coll_map.end();
-       ++p) {
-    dout(20) << __func__ << " coll " << p->first << " " << p->second << dendl;
-    collections.insert(p->first);
-    bufferlist bl;
-    assert(p->second);
-    p->second->encode(bl);
-    string fn = path + "/" + stringify(p->first);
-    int r = bl.write_file(fn.c_str());
-    if (r < 0)
-      return r;
+  for (auto& stripe : coll_stripes) {
+    for (auto p = stripe.coll_map.begin(); p != stripe.coll_map.end(); ++p) {
+      dout(20) << __func__ << " coll " << p->first << " " << p->second << dendl;
+      collections.insert(p->first);
+      bufferlist bl;
+      assert(p->second);
+      p->second->encode(bl);
+      string fn = path + "/" + stringify(p->first);
+      int r = bl.write_file(fn.c_str());
+      if (r < 0)
+	return r;
+    }
   }
 
   string fn = path + "/collections";
@@ -100,10 +109,12 @@ void MemStore::dump_all()
 
 void MemStore::dump(Formatter *f)
 {
+  map<coll_t,CollectionRef> colls;
+  for (auto& stripe : coll_stripes) {
+    colls.insert(stripe.coll_map.begin(), stripe.coll_map.end());
+  }
   f->open_array_section("collections");
-  for (ceph::unordered_map<coll_t,CollectionRef>::iterator p = coll_map.begin();
-       p != coll_map.end();
-       ++p) {
+  for (auto p = colls.begin(); p != colls.end(); ++p) {
     f->open_object_section("collection");
     f->dump_string("name", stringify(p->first));
 
@@ -160,7 +171,7 @@ int MemStore::_load()
     CollectionRef c(new Collection(cct, *q));
     auto p = cbl.cbegin();
     c->decode(p);
-    coll_map[*q] = c;
+    get_stripe(c->cid_hash).coll_map[*q] = c;
     used_bytes += c->used_bytes();
   }
 
@@ -239,18 +250,20 @@ objectstore_perf_stat_t MemStore::get_cur_stats()
 
 MemStore::CollectionRef MemStore::get_collection(const coll_t& cid)
 {
-  RWLock::RLocker l(coll_lock);
-  ceph::unordered_map<coll_t,CollectionRef>::iterator cp = coll_map.find(cid);
-  if (cp == coll_map.end())
+  auto& stripe = get_stripe(cid);
+  RWLock::RLocker l(stripe.coll_lock);
+  auto cp = stripe.coll_map.find(cid);
+  if (cp == stripe.coll_map.end())
     return CollectionRef();
   return cp->second;
 }
 
 ObjectStore::CollectionHandle MemStore::create_new_collection(const coll_t& cid)
 {
-  RWLock::WLocker l(coll_lock);
   Collection *c = new Collection(cct, cid);
-  new_coll_map[cid] = c;
+  auto& stripe = get_stripe(c->cid_hash);
+  RWLock::WLocker l(stripe.coll_lock);
+  stripe.new_coll_map[cid] = c;
   return c;
 }
 
@@ -394,11 +407,11 @@ int MemStore::getattrs(CollectionHandle &c_, const ghobject_t& oid,
 int MemStore::list_collections(vector<coll_t>& ls)
 {
   dout(10) << __func__ << dendl;
-  RWLock::RLocker l(coll_lock);
-  for (ceph::unordered_map<coll_t,CollectionRef>::iterator p = coll_map.begin();
-       p != coll_map.end();
-       ++p) {
-    ls.push_back(p->first);
+  for (auto& stripe : coll_stripes) {
+    RWLock::RLocker l(stripe.coll_lock);
+    for (auto p = stripe.coll_map.begin(); p != stripe.coll_map.end(); ++p) {
+      ls.push_back(p->first);
+    }
   }
   return 0;
 }
@@ -406,8 +419,9 @@ int MemStore::list_collections(vector<coll_t>& ls)
 bool MemStore::collection_exists(const coll_t& cid)
 {
   dout(10) << __func__ << " " << cid << dendl;
-  RWLock::RLocker l(coll_lock);
-  return coll_map.count(cid);
+  auto& stripe = get_stripe(cid);
+  RWLock::RLocker l(stripe.coll_lock);
+  return stripe.coll_map.count(cid);
 }
 
 int MemStore::collection_empty(CollectionHandle& ch, bool *empty)
@@ -629,6 +643,7 @@ int MemStore::queue_transactions(
   Collection *c = static_cast<Collection*>(ch.get());
   std::unique_lock<std::mutex> lock;
   lock = std::unique_lock<std::mutex>(c->sequencer_mutex);
+  Finisher *finisher = finishers[c->cid_hash % finishers.size()];
 
   for (vector<Transaction>::iterator p = tls.begin(); p != tls.end(); ++p) {
     // poke the TPHandle heartbeat just to exercise that code path
@@ -644,9 +659,9 @@ int MemStore::queue_transactions(
   if (on_apply_sync)
     on_apply_sync->complete(0);
   if (on_apply)
-    finisher.queue(on_apply);
+    finisher->queue(on_apply);
   if (on_commit)
-    finisher.queue(on_commit);
+    finisher->queue(on_commit);
   return 0;
 }
 
@@ -1285,24 +1300,26 @@ int MemStore::_omap_setheader(const coll_t& cid, const ghobject_t &oid,
 int MemStore::_create_collection(const coll_t& cid, int bits)
 {
   dout(10) << __func__ << " " << cid << dendl;
-  RWLock::WLocker l(coll_lock);
-  auto result = coll_map.insert(std::make_pair(cid, CollectionRef()));
+  auto& stripe = get_stripe(cid);
+  RWLock::WLocker l(stripe.coll_lock);
+  auto result = stripe.coll_map.insert(std::make_pair(cid, CollectionRef()));
   if (!result.second)
     return -EEXIST;
-  auto p = new_coll_map.find(cid);
-  assert(p != new_coll_map.end());
+  auto p = stripe.new_coll_map.find(cid);
+  assert(p != stripe.new_coll_map.end());
   result.first->second = p->second;
   result.first->second->bits = bits;
-  new_coll_map.erase(p);
+  stripe.new_coll_map.erase(p);
   return 0;
 }
 
 int MemStore::_destroy_collection(const coll_t& cid)
 {
   dout(10) << __func__ << " " << cid << dendl;
-  RWLock::WLocker l(coll_lock);
-  ceph::unordered_map<coll_t,CollectionRef>::iterator cp = coll_map.find(cid);
-  if (cp == coll_map.end())
+  auto& stripe = get_stripe(cid);
+  RWLock::WLocker l(stripe.coll_lock);
+  auto cp = stripe.coll_map.find(cid);
+  if (cp == stripe.coll_map.end())
     return -ENOENT;
   {
     RWLock::RLocker l2(cp->second->lock);
@@ -1311,7 +1328,7 @@ int MemStore::_destroy_collection(const coll_t& cid)
     cp->second->exists = false;
   }
   used_bytes -= cp->second->used_bytes();
-  coll_map.erase(cp);
+  stripe.coll_map.erase(cp);
   return 0;
 }
 
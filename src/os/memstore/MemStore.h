@@ -16,6 +16,7 @@
 #ifndef CEPH_MEMSTORE_H
 #define CEPH_MEMSTORE_H
 
+#include <atomic>
 #include <mutex>
 #include <boost/intrusive_ptr.hpp>
 
@@ -104,6 +105,7 @@ public:
     RWLock lock;   ///< for object_{map,hash}
     bool exists;
     std::mutex sequencer_mutex;
+    const size_t cid_hash;  ///< picks our coll_map stripe and finisher
 
     typedef boost::intrusive_ptr<Collection> Ref;
     friend void intrusive_ptr_add_ref(Collection *c) { c->get(); }
@@ -185,7 +187,8 @@ public:
 	cct(cct),
 	use_page_set(cct->_conf->memstore_page_set),
         lock("MemStore::Collection::lock", true, false),
-	exists(true) {}
+	exists(true),
+	cid_hash(std::hash<coll_t>()(c)) {}
   };
   typedef Collection::Ref CollectionRef;
 
@@ -193,15 +196,32 @@ private:
   class OmapIteratorImpl;
 
 
-  ceph::unordered_map<coll_t, CollectionRef> coll_map;
-  RWLock coll_lock;    ///< rwlock to protect coll_map
-  map<coll_t,CollectionRef> new_coll_map;
+  /// the collection map is striped by cid hash so that lookups for
+  /// different PGs (one per op) do not all bounce a single lock
+  static const unsigned COLL_STRIPES = 16;
+  struct CollStripe {
+    ceph::unordered_map<coll_t, CollectionRef> coll_map;
+    RWLock coll_lock;    ///< rwlock to protect coll_map
+    map<coll_t,CollectionRef> new_coll_map;
+
+    CollStripe() : coll_lock("MemStore::coll_lock") {}
+  };
+  CollStripe coll_stripes[COLL_STRIPES];
+
+  CollStripe& get_stripe(size_t cid_hash) {
+    return coll_stripes[cid_hash % COLL_STRIPES];
+  }
+  CollStripe& get_stripe(const coll_t& cid) {
+    return get_stripe(std::hash<coll_t>()(cid));
+  }
 
   CollectionRef get_collection(const coll_t& cid);
 
-  Finisher finisher;
+  /// completions are queued by collection (see Collection::cid_hash), so
+  /// that they stay ordered per collection but not across collections
+  vector<Finisher*> finishers;
 
-  uint64_t used_bytes;
+  std::atomic<uint64_t> used_bytes;
 
   void _do_transaction(Transaction& t);
 
@@ -243,8 +263,6 @@ private:
 public:
   MemStore(CephContext *cct, const string& path)
     : ObjectStore(cct, path),
-      coll_lock("MemStore::coll_lock"),
-      finisher(cct),
       used_bytes(0) {}
   ~MemStore() override { }
 
@@ -151,6 +151,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_read=" << rhs.pending_read
       << " remote_read=" << rhs.remote_read
       << " remote_read_result=" << rhs.remote_read_result
+      << " delta_write=" << rhs.delta_write
       << " pending_apply=" << rhs.pending_apply
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
@@ -1803,6 +1804,14 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
     },
     get_parent()->get_dpp());
 
+  if (cct->_conf->osd_ec_parity_delta_writes) {
+    ECTransaction::plan_parity_delta(
+      sinfo,
+      ec_impl,
+      op->plan,
+      get_parent()->get_dpp());
+  }
+
   dout(10) << __func__ << ": " << *op << dendl;
 
   waiting_state.push_back(*op);
@@ -1824,6 +1833,18 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
+  if (op->requires_rmw()) {
+    for (auto &&hpair: op->plan.to_read) {
+      if (cache.has_opaque_extents(hpair.first, hpair.second)) {
+	dout(20) << __func__ << ": blocking " << *op
+		 << " because it reads " << hpair.first
+		 << " extents pending a parity delta write"
+		 << dendl;
+	return false;
+      }
+    }
+  }
+
   if (op->invalidates_cache()) {
     dout(20) << __func__ << ": invalidating cache after this op"
 	     << dendl;
@@ -1839,6 +1860,11 @@ bool ECBackend::try_state_to_reads()
   if (op->using_cache) {
     cache.open_write_pin(op->pin);
 
+    if (try_start_delta_read(op)) {
+      dout(10) << __func__ << ": " << *op << dendl;
+      return true;
+    }
+
     extent_set empty;
     for (auto &&hpair: op->plan.will_write) {
       auto to_read_plan_iter = op->plan.to_read.find(hpair.first);
@@ -1869,21 +1895,169 @@ bool ECBackend::try_state_to_reads()
 
   dout(10) << __func__ << ": " << *op << dendl;
 
-  if (!op->remote_read.empty()) {
-    assert(get_parent()->get_pool().allows_ecoverwrites());
-    objects_read_async_no_cache(
-      op->remote_read,
-      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
-	for (auto &&i: results) {
-	  op->remote_read_result.emplace(i.first, i.second.second);
-	}
-	check_ops();
-      });
+  read_for_rmw(op);
+  return true;
+}
+
+void ECBackend::read_for_rmw(Op *op)
+{
+  if (op->remote_read.empty())
+    return;
+  assert(get_parent()->get_pool().allows_ecoverwrites());
+  objects_read_async_no_cache(
+    op->remote_read,
+    [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+      for (auto &&i: results) {
+	op->remote_read_result.emplace(i.first, i.second.second);
+      }
+      check_ops();
+    });
+}
+
+struct OnDeltaReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  OnDeltaReadComplete(ECBackend *ec, ceph_tid_t tid) : ec(ec), tid(tid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in)
+    override {
+    ec->handle_delta_read(tid, in.second);
+  }
+};
+
+/**
+ * A parity delta write reads the old content of the data chunks it
+ * modifies and of the coding chunks, and writes back only those.  The
+ * extents it pins are Write Opaque (see ExtentCache.h): it can't
+ * present them to the cache, so later writes needing to read them
+ * wait in waiting_state until it commits.  It is only attempted if no
+ * other write has those extents pinned, and if all shards involved
+ * are available; otherwise the op takes the usual rmw path.
+ */
+bool ECBackend::try_start_delta_read(Op *op)
+{
+  if (op->plan.delta_chunks.empty() ||
+      !cct->_conf->osd_ec_parity_delta_writes) {
+    return false;
+  }
+  assert(op->plan.to_read.size() == 1);
+  const hobject_t &hoid = op->plan.to_read.begin()->first;
+  const extent_set &to_read = op->plan.to_read.begin()->second;
+  if (!cache.is_unpinned(hoid, to_read)) {
+    dout(20) << __func__ << ": " << hoid << " " << to_read
+	     << " is pinned, not using a parity delta write" << dendl;
+    return false;
+  }
+
+  set<int> want = op->plan.delta_chunks;
+  for (int i = ec_impl->get_data_chunk_count();
+       i < (int)ec_impl->get_chunk_count();
+       ++i) {
+    want.insert(i);
   }
 
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  set<pg_shard_t> error_shards;
+  get_all_avail_shards(hoid, error_shards, have, shards, false);
+
+  vector<pair<int, int>> subchunks;
+  subchunks.push_back(make_pair(0, ec_impl->get_sub_chunk_count()));
+  map<pg_shard_t, vector<pair<int, int>>> need;
+  for (auto &&i: want) {
+    if (!have.count(i)) {
+      dout(20) << __func__ << ": " << hoid << " shard " << i
+	       << " unavailable, not using a parity delta write" << dendl;
+      return false;
+    }
+    need.insert(make_pair(shards[shard_id_t(i)], subchunks));
+  }
+
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > extents;
+  for (auto &&extent: to_read) {
+    extents.push_back(boost::make_tuple(extent.first, extent.second, 0));
+  }
+
+  cache.reserve_extents_for_delta(hoid, op->pin, op->plan.will_write[hoid]);
+  op->delta_write = true;
+  op->delta_read_pending = true;
+
+  map<hobject_t, set<int>> want_to_read;
+  want_to_read[hoid] = want;
+  map<hobject_t, read_request_t> for_read_op;
+  for_read_op.insert(
+    make_pair(
+      hoid,
+      read_request_t(
+	extents,
+	need,
+	false,
+	new OnDeltaReadComplete(this, op->tid))));
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    want_to_read,
+    for_read_op,
+    op->client_op,
+    false, false);
   return true;
 }
 
+void ECBackend::handle_delta_read(ceph_tid_t tid, read_result_t &res)
+{
+  auto opiter = tid_to_op_map.find(tid);
+  assert(opiter != tid_to_op_map.end());
+  Op *op = &(opiter->second);
+  assert(op->delta_read_pending);
+  assert(op->plan.to_read.size() == 1);
+  const hobject_t &hoid = op->plan.to_read.begin()->first;
+
+  set<int> want = op->plan.delta_chunks;
+  for (int i = ec_impl->get_data_chunk_count();
+       i < (int)ec_impl->get_chunk_count();
+       ++i) {
+    want.insert(i);
+  }
+
+  map<int, extent_map> result;
+  int r = res.r;
+  if (r == 0) {
+    for (auto &&extent: res.returned) {
+      pair<uint64_t, uint64_t> chunk_off_len =
+	sinfo.aligned_offset_len_to_chunk(
+	  make_pair(extent.get<0>(), extent.get<1>()));
+      for (auto &&i: extent.get<2>()) {
+	if (want.count(i.first.shard)) {
+	  if (i.second.length() != chunk_off_len.second) {
+	    r = -EIO;
+	    break;
+	  }
+	  result[i.first.shard].insert(
+	    chunk_off_len.first, chunk_off_len.second, i.second);
+	}
+      }
+    }
+    if (result.size() != want.size()) {
+      r = -EIO;
+    }
+  }
+
+  op->delta_read_pending = false;
+  if (r < 0) {
+    // some shard failed, reconstruct the stripes instead
+    dout(10) << __func__ << ": " << *op << " delta read failed with " << r
+	     << ", falling back to a plain rmw" << dendl;
+    op->delta_write = false;
+    cache.convert_delta_to_rmw(op->pin);
+    op->remote_read = op->plan.to_read;
+    read_for_rmw(op);
+    return;
+  }
+
+  op->delta_read_result[hoid] = std::move(result);
+  dout(20) << __func__ << ": " << *op << dendl;
+  check_ops();
+}
+
 bool ECBackend::try_reads_to_commit()
 {
   if (waiting_reads.empty())
@@ -1932,6 +2106,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -1959,7 +2134,14 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  assert(written_set == op->plan.will_write);
+  if (!op->delta_write) {
+    assert(written_set == op->plan.will_write);
+  } else {
+    // nothing can be presented to the cache, see try_start_delta_read
+    for (auto &&i: written_set) {
+      assert(i.second.empty());
+    }
+  }
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -1969,6 +2151,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   ObjectStore::Transaction empty;
   bool should_write_local = false;
@@ -2429,14 +2612,41 @@ int ECBackend::be_deep_scrub(
     sleeptime.sleep();
   }
 
-  if (pos.data_pos == 0) {
-    pos.data_hash = bufferhash(-1);
-  }
-
   uint64_t stride = cct->_conf->osd_deep_scrub_stride;
   if (stride % sinfo.get_chunk_size())
     stride += sinfo.get_chunk_size() - (stride % sinfo.get_chunk_size());
 
+  if (pos.data_pos == 0) {
+    pos.data_hash = bufferhash(-1);
+    if (pos.incremental &&
+	!get_parent()->get_pool().allows_ecoverwrites()) {
+      // the chunk hashes were recorded when the object was written; if
+      // the store's csums still match, they still describe this chunk
+      ECUtil::HashInfoRef hinfo = get_hash_info(poid, false, &o.attrs);
+      if (hinfo && hinfo->has_chunk_hash() &&
+	  hinfo->get_total_chunk_size() == o.size) {
+	pos.csum_only = true;
+	pos.stored_digest = hinfo->get_chunk_hash(0);
+      }
+    }
+  }
+  if (pos.csum_only) {
+    r = be_verify_checksums(poid, pos, o, stride);
+    if (r == -EINPROGRESS) {
+      return r;
+    }
+    if (r == -EIO) {
+      return 0;
+    }
+    if (r == 0) {
+      o.digest = pos.stored_digest;
+      o.digest_present = true;
+      o.omap_digest = -1;
+      o.omap_digest_present = true;
+      return 0;
+    }
+  }
+
   bufferlist bl;
   r = store->read(
     ch,
@@ -2462,6 +2672,7 @@ int ECBackend::be_deep_scrub(
     pos.data_hash << bl;
   }
   pos.data_pos += r;
+  pos.bytes_read += r;
   if (r == (int)stride) {
     return -EINPROGRESS;
   }
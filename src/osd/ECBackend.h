@@ -484,8 +484,15 @@ public:
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+
+    /// Parity delta write state, see try_state_to_reads
+    bool delta_write = false;
+    bool delta_read_pending = false;
+    map<hobject_t,map<int,extent_map>> delta_read_result;
+
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return delta_read_pending ||
+	(!remote_read.empty() && remote_read_result.empty());
     }
 
     /// In progress write state.
@@ -565,6 +572,10 @@ public:
   eversion_t committed_to;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
   bool try_state_to_reads();
+  void read_for_rmw(Op *op);
+  bool try_start_delta_read(Op *op);
+  friend struct OnDeltaReadComplete;
+  void handle_delta_read(ceph_tid_t tid, read_result_t &res);
   bool try_reads_to_commit();
   bool try_finish_rmw();
   void check_ops();
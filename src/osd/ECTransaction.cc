@@ -81,6 +81,169 @@ void encode_and_write(
   }
 }
 
+bufferlist get_chunk_range(
+  const extent_map &chunks,
+  uint64_t offset,
+  uint64_t length) {
+  bufferlist bl;
+  for (auto &&extent: chunks.intersect(offset, length)) {
+    assert(extent.get_off() == offset + bl.length());
+    bl.append(extent.get_val());
+  }
+  assert(bl.length() == length);
+  return bl;
+}
+
+void encode_delta_and_write(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const set<int> &delta_chunks,
+  uint64_t offset,
+  uint64_t length,
+  const extent_map &to_write,
+  const map<int, extent_map> &old_chunks,
+  uint32_t flags,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  assert(sinfo.logical_offset_is_stripe_aligned(offset));
+  assert(sinfo.logical_offset_is_stripe_aligned(length));
+  assert(length);
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const uint64_t chunk_off =
+    sinfo.aligned_logical_offset_to_chunk_offset(offset);
+  const uint64_t chunk_len =
+    sinfo.aligned_logical_offset_to_chunk_offset(length);
+
+  map<int, bufferlist> buffers;
+  for (int i = ecimpl->get_data_chunk_count();
+       i < (int)ecimpl->get_chunk_count();
+       ++i) {
+    auto iter = old_chunks.find(i);
+    assert(iter != old_chunks.end());
+    buffers[i] = get_chunk_range(iter->second, chunk_off, chunk_len);
+  }
+
+  map<int, bufferlist> deltas;
+  map<int, bufferlist> new_chunks;
+  for (auto &&i: delta_chunks) {
+    auto iter = old_chunks.find(i);
+    assert(iter != old_chunks.end());
+    bufferlist old_bl = get_chunk_range(iter->second, chunk_off, chunk_len);
+
+    // overlay the new data on chunk i of each stripe
+    bufferptr new_ptr(buffer::create(chunk_len));
+    old_bl.copy(0, chunk_len, new_ptr.c_str());
+    for (uint64_t stripe = 0; stripe < length / stripe_width; ++stripe) {
+      uint64_t logical = offset + stripe * stripe_width + i * chunk_size;
+      for (auto &&extent: to_write.intersect(logical, chunk_size)) {
+	extent.get_val().copy(
+	  0,
+	  extent.get_len(),
+	  new_ptr.c_str() + stripe * chunk_size +
+	  (extent.get_off() - logical));
+      }
+    }
+    bufferlist &new_bl = new_chunks[i];
+    new_bl.push_back(std::move(new_ptr));
+
+    int r = ecimpl->encode_delta(old_bl, new_bl, &deltas[i]);
+    assert(r == 0);
+  }
+
+  int r = ecimpl->apply_delta(deltas, &buffers);
+  assert(r == 0);
+  for (auto &&i: new_chunks) {
+    buffers[i.first].claim(i.second);
+  }
+
+  ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		     << " " << offset << "~" << length
+		     << " chunks " << delta_chunks
+		     << dendl;
+
+  for (auto &&i : *transactions) {
+    auto iter = buffers.find(i.first);
+    if (iter == buffers.end()) {
+      // unmodified data chunk
+      continue;
+    }
+    i.second.write(
+      coll_t(spg_t(pgid, i.first)),
+      ghobject_t(oid, ghobject_t::NO_GEN, i.first),
+      chunk_off,
+      chunk_len,
+      iter->second,
+      flags);
+  }
+}
+
+void ECTransaction::plan_parity_delta(
+  const ECUtil::stripe_info_t &sinfo,
+  const ErasureCodeInterfaceRef &ecimpl,
+  WritePlan &plan,
+  DoutPrefixProvider *dpp)
+{
+  plan.delta_chunks.clear();
+  if (!ecimpl->supports_parity_delta() ||
+      !ecimpl->get_chunk_mapping().empty()) {
+    return;
+  }
+  if (plan.invalidates_cache ||
+      !plan.t ||
+      plan.t->op_map.size() != 1 ||
+      plan.to_read.size() != 1) {
+    return;
+  }
+
+  const hobject_t &oid = plan.t->op_map.begin()->first;
+  const auto &op = plan.t->op_map.begin()->second;
+  if (!op.is_none() || op.truncate || op.buffer_updates.empty()) {
+    return;
+  }
+
+  // only partial stripes, nothing to append or write in full
+  auto riter = plan.to_read.find(oid);
+  auto witer = plan.will_write.find(oid);
+  if (riter == plan.to_read.end() ||
+      witer == plan.will_write.end() ||
+      !(riter->second == witer->second)) {
+    return;
+  }
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const unsigned k = ecimpl->get_data_chunk_count();
+  const unsigned m = ecimpl->get_coding_chunk_count();
+  set<int> chunks;
+  for (auto &&extent: op.buffer_updates) {
+    uint64_t end = extent.get_off() + extent.get_len();
+    for (uint64_t off = extent.get_off() - extent.get_off() % chunk_size;
+	 off < end && chunks.size() < k;
+	 off += chunk_size) {
+      chunks.insert((off % stripe_width) / chunk_size);
+    }
+  }
+
+  // a plain rmw reads the k data chunks and writes all k + m chunks of
+  // each stripe, a delta write reads and writes the modified data
+  // chunks and the m coding chunks
+  if (chunks.size() + m > k) {
+    ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		       << " modifies chunks " << chunks
+		       << ", using a plain rmw"
+		       << dendl;
+    return;
+  }
+  ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		     << " may update parity from chunks " << chunks
+		     << dendl;
+  plan.delta_chunks = std::move(chunks);
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -100,6 +263,7 @@ void ECTransaction::generate_transactions(
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<int,extent_map>> &delta_extents,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -535,6 +699,67 @@ void ECTransaction::generate_transactions(
       for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
 	want.insert(i);
       }
+      auto save_rollback_extent = [&](uint64_t off, uint64_t len) {
+	uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
+	  off);
+	uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
+	  len);
+	ldpp_dout(dpp, 20) << __func__ << ": overwriting "
+			   << restore_from << "~" << restore_len
+			   << dendl;
+	if (rollback_extents.empty()) {
+	  for (auto &&st : *transactions) {
+	    st.second.touch(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, entry->version.version, st.first));
+	  }
+	}
+	// the rollback is recorded in the log entry of every shard, so
+	// stash the extent even on shards a delta write leaves untouched
+	rollback_extents.emplace_back(make_pair(restore_from, restore_len));
+	for (auto &&st : *transactions) {
+	  st.second.clone_range(
+	    coll_t(spg_t(pgid, st.first)),
+	    ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	    ghobject_t(oid, entry->version.version, st.first),
+	    restore_from,
+	    restore_len,
+	    restore_from);
+	}
+      };
+
+      auto dextiter = delta_extents.find(oid);
+      if (dextiter != delta_extents.end()) {
+	// parity delta write, to_write only holds the new data
+	assert(pextiter == partial_extents.end());
+	assert(!plan.delta_chunks.empty());
+	assert(append_after == orig_size && new_size == orig_size);
+	const extent_set &stripes = plan.will_write.at(oid);
+	ldpp_dout(dpp, 20) << __func__ << ": delta writing " << stripes
+			   << " with " << to_write
+			   << dendl;
+	for (auto &&stripe: stripes) {
+	  assert(stripe.first + stripe.second <= append_after);
+	  if (entry) {
+	    save_rollback_extent(stripe.first, stripe.second);
+	  }
+	  encode_delta_and_write(
+	    pgid,
+	    oid,
+	    sinfo,
+	    ecimpl,
+	    plan.delta_chunks,
+	    stripe.first,
+	    stripe.second,
+	    to_write,
+	    dextiter->second,
+	    fadvise_flags,
+	    transactions,
+	    dpp);
+	}
+	to_write.clear();
+      }
+
       auto to_overwrite = to_write.intersect(0, append_after);
       ldpp_dout(dpp, 20) << __func__ << ": to_overwrite: "
 			 << to_overwrite
@@ -544,30 +769,7 @@ void ECTransaction::generate_transactions(
 	assert(sinfo.logical_offset_is_stripe_aligned(extent.get_off()));
 	assert(sinfo.logical_offset_is_stripe_aligned(extent.get_len()));
 	if (entry) {
-	  uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
-	    extent.get_off());
-	  uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
-	    extent.get_len());
-	  ldpp_dout(dpp, 20) << __func__ << ": overwriting "
-			     << restore_from << "~" << restore_len
-			     << dendl;
-	  if (rollback_extents.empty()) {
-	    for (auto &&st : *transactions) {
-	      st.second.touch(
-		coll_t(spg_t(pgid, st.first)),
-		ghobject_t(oid, entry->version.version, st.first));
-	    }
-	  }
-	  rollback_extents.emplace_back(make_pair(restore_from, restore_len));
-	  for (auto &&st : *transactions) {
-	    st.second.clone_range(
-	      coll_t(spg_t(pgid, st.first)),
-	      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
-	      ghobject_t(oid, entry->version.version, st.first),
-	      restore_from,
-	      restore_len,
-	      restore_from);
-	  }
+	  save_rollback_extent(extent.get_off(), extent.get_len());
 	}
 	encode_and_write(
 	  pgid,
@@ -30,6 +30,12 @@ namespace ECTransaction {
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    // Non-empty if this is a partial overwrite of the stripes in
+    // to_read of a single object touching only these data chunks, in
+    // which case the parity may be updated from the old and new
+    // content of those chunks alone (@see plan_parity_delta)
+    set<int> delta_chunks;
   };
 
   bool requires_overwrite(
@@ -182,12 +188,31 @@ namespace ECTransaction {
     return plan;
   }
 
+  /**
+   * Fills in plan.delta_chunks if the plan may be carried out as a
+   * parity delta write, i.e. by reading and writing only the data
+   * chunks it modifies and the coding chunks, and if that touches
+   * fewer shards than reading the full stripes would.
+   */
+  void plan_parity_delta(
+    const ECUtil::stripe_info_t &sinfo,
+    const ErasureCodeInterfaceRef &ecimpl,
+    WritePlan &plan,
+    DoutPrefixProvider *dpp);
+
+  /**
+   * partial_extents holds the stripes read for a plain rmw.  For a
+   * parity delta write, delta_extents instead holds, for each object,
+   * the content of the data chunks in plan.delta_chunks and of the
+   * coding chunks, by shard and keyed by chunk offset.
+   */
   void generate_transactions(
     WritePlan &plan,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const map<hobject_t,map<int,extent_map>> &delta_extents,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
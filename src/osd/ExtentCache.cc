@@ -156,6 +156,67 @@ extent_set ExtentCache::reserve_extents_for_rmw(
   return must_read;
 }
 
+bool ExtentCache::is_unpinned(
+  const hobject_t &oid,
+  const extent_set &to_check)
+{
+  auto *eset = get_if_exists(oid);
+  if (!eset) {
+    return true;
+  }
+  for (auto &&res: to_check) {
+    auto range = eset->get_containing_range(res.first, res.second);
+    if (range.first != range.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ExtentCache::has_opaque_extents(
+  const hobject_t &oid,
+  const extent_set &to_read)
+{
+  auto *eset = get_if_exists(oid);
+  if (!eset) {
+    return false;
+  }
+  for (auto &&res: to_read) {
+    auto range = eset->get_containing_range(res.first, res.second);
+    for (auto p = range.first; p != range.second; ++p) {
+      if (p->is_opaque()) {
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ExtentCache::reserve_extents_for_delta(
+  const hobject_t &oid,
+  write_pin &pin,
+  const extent_set &to_write)
+{
+  assert(pin.is_write());
+  assert(pin.pin_list.empty());
+  pin.pin_type = pin_state::DELTA_WRITE;
+  if (to_write.empty()) {
+    return;
+  }
+  auto &eset = get_or_create(oid);
+  for (auto &&res: to_write) {
+    eset.traverse_update(
+      pin,
+      res.first,
+      res.second,
+      [&](uint64_t off, uint64_t len,
+	  extent *ext, object_extent_set::update_action *action) {
+	assert(!ext);
+	action->action = object_extent_set::update_action::UPDATE_PIN;
+      });
+  }
+}
+
 extent_map ExtentCache::get_remaining_extents_for_rmw(
   const hobject_t &oid,
   write_pin &pin,
@@ -92,6 +92,18 @@
    All of the above suggests that there are 3 things users can
    ask of the cache corresponding to the 3 Write pipelines
    states.
+
+   Parity delta writes (see ECBackend::try_state_to_reads) read and
+   write only some of the shards, so they never learn the logical
+   content of the extents they overwrite.  They may only pin extents
+   which are Empty, and leave them in a fourth state:
+
+   3) Write Opaque N:
+      - Write reqid N is overwriting this extent, its content is
+        unknown to the cache
+      - The extent must persist until Write reqid N commits
+      - A later write may overwrite this extent entirely (moving it to
+        Write Pending), but must not read it until it is Empty again.
  */
 
 /// If someone wants these types, but not ExtentCache, move to another file
@@ -146,6 +158,11 @@ private:
       return parent_pin_state->is_write();
     }
 
+    bool is_opaque() const {
+      assert(parent_pin_state);
+      return is_pending() && parent_pin_state->is_delta_write();
+    }
+
     uint64_t pin_tid() const {
       assert(parent_pin_state);
       return parent_pin_state->tid;
@@ -351,9 +368,13 @@ private:
     enum pin_type_t {
       NONE,
       WRITE,
+      DELTA_WRITE,
     };
     pin_type_t pin_type = NONE;
-    bool is_write() const { return pin_type == WRITE; }
+    bool is_write() const {
+      return pin_type == WRITE || pin_type == DELTA_WRITE;
+    }
+    bool is_delta_write() const { return pin_type == DELTA_WRITE; }
 
     pin_state(const pin_state &other) = delete;
     pin_state &operator=(const pin_state &other) = delete;
@@ -433,6 +454,53 @@ public:
     const extent_set &to_write,
     const extent_set &to_read);
 
+  /**
+   * Returns true if no extent of to_check is pinned, i.e. no write in
+   * progress will modify any of it
+   */
+  bool is_unpinned(
+    const hobject_t &oid,
+    const extent_set &to_check);
+
+  /**
+   * Returns true if some extent of to_read is Write Opaque, in which
+   * case its content can't be obtained until that write commits
+   */
+  bool has_opaque_extents(
+    const hobject_t &oid,
+    const extent_set &to_read);
+
+  /**
+   * Reserves extents for a parity delta write
+   *
+   * Pins all extents in to_write without expecting them to ever be
+   * presented.  All of them must be unpinned (@see is_unpinned).
+   *
+   * Transition table:
+   * - Empty -> Write Opaque pin.reqid
+   * - other -> invalid
+   *
+   * @param oid [in] object undergoing the delta write
+   * @param pin [in,out] pin to use (obtained from create_write_pin)
+   * @param to_write [in] extents which will be written
+   */
+  void reserve_extents_for_delta(
+    const hobject_t &oid,
+    write_pin &pin,
+    const extent_set &to_write);
+
+  /**
+   * Turns a parity delta write back into a plain rmw
+   *
+   * All extents pinned by pin become Write Pending, the caller must
+   * then obtain them and present the update as for any rmw.
+   */
+  void convert_delta_to_rmw(
+    write_pin &pin) {
+    assert(pin.is_delta_write());
+    pin.pin_type = pin_state::WRITE;
+  }
+
   /**
    * Gets extents required for rmw not returned from
    * reserve_extents_for_rmw
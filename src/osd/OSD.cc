@@ -1208,6 +1208,24 @@ void OSDService::dec_scrubs_active()
   sched_scrub_lock.Unlock();
 }
 
+double OSDService::scrub_throttle(uint64_t bytes)
+{
+  uint64_t rate = cct->_conf->osd_scrub_max_bytes_per_sec;
+  if (!rate || !bytes) {
+    return 0;
+  }
+  Mutex::Locker l(sched_scrub_lock);
+  utime_t now = ceph_clock_now();
+  if (scrub_throttle_until < now) {
+    scrub_throttle_until = now;
+  }
+  scrub_throttle_until += (double)bytes / rate;
+  double wait = scrub_throttle_until - now;
+  dout(20) << __func__ << " " << bytes << " bytes at " << rate
+	   << "/s, wait " << wait << dendl;
+  return wait;
+}
+
 void OSDService::retrieve_epochs(epoch_t *_boot_epoch, epoch_t *_up_epoch,
                                  epoch_t *_bind_epoch) const
 {
@@ -3042,6 +3060,9 @@ void OSD::create_logger()
     "Latency of IO before calling queue(before really queue into ShardedOpWq)"); // client io before queue op_wq latency
   osd_plb.add_time_avg(l_osd_op_before_dequeue_op_lat, "op_before_dequeue_op_lat",
     "Latency of IO before calling dequeue_op(already dequeued and get PG lock)"); // client io before dequeue_op latency
+  osd_plb.add_u64_counter(
+    l_osd_op_inline, "op_inline",
+    "Client reads run to completion on the messenger thread");
 
   osd_plb.add_u64_counter(
     l_osd_sop, "subop", "Suboperations");
@@ -3864,6 +3885,7 @@ void OSD::load_pgs()
 
     // read pg state, log
     pg->read_state(store);
+    pg->update_store_with_options();
 
     if (pg->dne())  {
       dout(10) << "load_pgs " << *it << " deleting dne" << dendl;
@@ -3933,6 +3955,7 @@ PGRef OSD::handle_pg_create_info(const OSDMapRef& osdmap,
   pg->ch = store->create_new_collection(pg->coll);
 
   pg->lock(true);
+  pg->update_store_with_options();
 
   // we are holding the shard lock
   assert(!pg->is_deleted());
@@ -4082,6 +4105,7 @@ void OSD::build_initial_pg_history(
   h->last_scrub_stamp = created_stamp;
   h->last_deep_scrub_stamp = created_stamp;
   h->last_clean_scrub_stamp = created_stamp;
+  h->last_full_deep_scrub_stamp = created_stamp;
 
   OSDMapRef lastmap = service.get_map(created);
   int up_primary, acting_primary;
@@ -6474,11 +6498,12 @@ void OSD::ms_fast_dispatch(Message *m)
 
   if (m->get_connection()->has_features(CEPH_FEATUREMASK_RESEND_ON_SPLIT) ||
       m->get_type() != CEPH_MSG_OSD_OP) {
-    // queue it directly
-    enqueue_op(
-      static_cast<MOSDFastDispatchOp*>(m)->get_spg(),
-      op,
-      static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch());
+    // run it here if we can, otherwise queue it directly
+    spg_t pgid = static_cast<MOSDFastDispatchOp*>(m)->get_spg();
+    epoch_t epoch = static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch();
+    if (!maybe_run_op_inline(pgid, op, epoch)) {
+      enqueue_op(pgid, op, epoch);
+    }
   } else {
     // legacy client, and this is an MOSDOp (the *only* fast dispatch
     // message that didn't have an explicit spg_t); we need to map
@@ -8380,6 +8405,7 @@ void OSD::handle_fast_pg_create(MOSDPGCreate2 *m)
     h.last_scrub_stamp = created_stamp;
     h.last_deep_scrub_stamp = created_stamp;
     h.last_clean_scrub_stamp = created_stamp;
+    h.last_full_deep_scrub_stamp = created_stamp;
 
     enqueue_peering_evt(
       pgid,
@@ -8822,6 +8848,64 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch)
       epoch));
 }
 
+static bool is_inline_read(MOSDOp *m)
+{
+  try {
+    m->finish_decode();
+  } catch (const buffer::error &e) {
+    // let do_op complain about it
+    return false;
+  }
+  if (m->has_flag(CEPH_OSD_FLAG_WRITE) || m->ops.empty() ||
+      m->get_snapid() != CEPH_NOSNAP) {
+    return false;
+  }
+  // omap reads are left out: they go to the kv store, and we have no way
+  // to tell whether they would wait for the disk
+  for (auto& osd_op : m->ops) {
+    switch (osd_op.op.op) {
+    case CEPH_OSD_OP_STAT:
+    case CEPH_OSD_OP_READ:
+    case CEPH_OSD_OP_SYNC_READ:
+    case CEPH_OSD_OP_SPARSE_READ:
+    case CEPH_OSD_OP_GETXATTR:
+    case CEPH_OSD_OP_GETXATTRS:
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Run-to-completion fast path for simple client reads.  Called from
+ * ms_fast_dispatch; returns false if the op still needs to be queued.
+ */
+bool OSD::maybe_run_op_inline(spg_t pg, OpRequestRef& op, epoch_t epoch)
+{
+  if (!cct->_conf->osd_op_run_to_completion ||
+      op->get_req()->get_type() != CEPH_MSG_OSD_OP ||
+      !is_inline_read(static_cast<MOSDOp*>(op->get_req()))) {
+    return false;
+  }
+  utime_t latency = ceph_clock_now() - op->get_req()->get_recv_stamp();
+  OpQueueItem item(
+    unique_ptr<OpQueueItem::OpQueueable>(new PGOpItem(pg, op)),
+    op->get_req()->get_cost(),
+    op->get_req()->get_priority(),
+    op->get_req()->get_recv_stamp(),
+    op->get_req()->get_source().num(),
+    epoch);
+  if (!op_shardedwq.try_run_inline(
+	item, static_cast<const MOSDOp*>(op->get_req()))) {
+    return false;
+  }
+  logger->tinc(l_osd_op_before_queue_op_lat, latency);
+  logger->inc(l_osd_op_inline);
+  return true;
+}
+
 void OSD::enqueue_peering_evt(spg_t pgid, PGPeeringEventRef evt)
 {
   dout(15) << __func__ << " " << pgid << " " << evt->get_desc() << dendl;
@@ -9946,6 +10030,113 @@ void OSD::ShardedOpWQ::_enqueue_front(OpQueueItem&& item)
   sdata->sdata_wait_lock.Unlock();
 }
 
+OSD::ShardedOpWQ::~ShardedOpWQ()
+{
+  for (auto& p : inline_hb) {
+    osd->cct->get_heartbeat_map()->remove_worker(p.second);
+  }
+}
+
+heartbeat_handle_d *OSD::ShardedOpWQ::get_inline_hb()
+{
+  Mutex::Locker l(inline_hb_lock);
+  pthread_t self = pthread_self();
+  auto p = inline_hb.find(self);
+  if (p != inline_hb.end()) {
+    return p->second;
+  }
+  heartbeat_handle_d *hb = osd->cct->get_heartbeat_map()->add_worker(
+    "OSD::inline_op", self);
+  inline_hb[self] = hb;
+  return hb;
+}
+
+bool OSD::ShardedOpWQ::try_run_inline(OpQueueItem& item, const MOSDOp *m)
+{
+  const auto token = item.get_ordering_token();
+  auto& sdata = osd->shards[token.hash_to_shard(osd->shards.size())];
+  assert(sdata);
+
+  // anything already queued on this shard goes first: that covers earlier
+  // ops from the same client on this pg, and keeps the scheduler's
+  // priorities across pgs and clients intact.
+  auto idle_slot = [&]() -> OSDShardPGSlot* {
+    if (!sdata->pqueue->empty() ||
+	item.get_map_epoch() > sdata->shard_osdmap->get_epoch()) {
+      return nullptr;
+    }
+    auto p = sdata->pg_slots.find(token);
+    if (p == sdata->pg_slots.end()) {
+      return nullptr;
+    }
+    OSDShardPGSlot *slot = p->second.get();
+    if (!slot->pg ||
+	!slot->to_process.empty() ||
+	!slot->waiting.empty() ||
+	!slot->waiting_peering.empty() ||
+	slot->waiting_for_split ||
+	slot->num_running) {
+      return nullptr;
+    }
+    return slot;
+  };
+
+  sdata->shard_lock.Lock();
+  OSDShardPGSlot *slot = idle_slot();
+  if (!slot) {
+    sdata->shard_lock.Unlock();
+    return false;
+  }
+  PGRef pg = slot->pg;
+  uint64_t requeue_seq = slot->requeue_seq;
+  sdata->shard_lock.Unlock();
+
+  // a worker holds the pg lock for the whole time it runs an item, so a
+  // failed try_lock means the pg is busy and we should not wait for it.
+  if (!pg->try_lock()) {
+    return false;
+  }
+  // a cache miss would leave this messenger thread waiting for the disk;
+  // the probe runs without shard_lock so other pgs of the shard keep
+  // being dispatched meanwhile
+  if (!pg->is_active() || !pg->is_clean() || pg->is_deleting() ||
+      !pg->is_read_cached(m)) {
+    pg->unlock();
+    return false;
+  }
+
+  // pg lock before shard_lock, as in _process.  Anything queued for the
+  // pg or the shard while we were probing must still go first.
+  sdata->shard_lock.Lock();
+  slot = idle_slot();
+  if (!slot || slot->pg != pg || slot->requeue_seq != requeue_seq) {
+    pg->unlock();
+    sdata->shard_lock.Unlock();
+    return false;
+  }
+
+  // pass the item through the (empty) scheduler so that it is accounted
+  // for exactly as if a worker had dequeued it, e.g. mclock tags.
+  dout(20) << __func__ << " " << item << dendl;
+  unsigned priority = item.get_priority();
+  if (priority >= osd->op_prio_cutoff)
+    sdata->pqueue->enqueue_strict(
+      item.get_owner(), priority, std::move(item));
+  else
+    sdata->pqueue->enqueue(
+      item.get_owner(), priority, item.get_cost(), std::move(item));
+  OpQueueItem qi = sdata->pqueue->dequeue();
+  assert(sdata->pqueue->empty());
+  sdata->shard_lock.Unlock();
+
+  ThreadPool::TPHandle tp_handle(osd->cct, get_inline_hb(), timeout_interval,
+				 suicide_interval);
+  tp_handle.reset_tp_timeout();
+  qi.run(osd, sdata, pg, tp_handle);
+  tp_handle.suspend_tp_timeout();
+  return true;
+}
+
 namespace ceph { 
 namespace osd_cmds { 
 
@@ -103,6 +103,7 @@ enum {
 
   l_osd_op_before_queue_op_lat,
   l_osd_op_before_dequeue_op_lat,
+  l_osd_op_inline,
 
   l_osd_sop,
   l_osd_sop_inb,
@@ -439,6 +440,7 @@ private:
   Mutex sched_scrub_lock;
   int scrubs_pending;
   int scrubs_active;
+  utime_t scrub_throttle_until;  ///< when the scrub read budget is paid off
 
 public:
   struct ScrubJob {
@@ -518,6 +520,9 @@ public:
   void inc_scrubs_active(bool reserved);
   void dec_scrubs_pending();
   void dec_scrubs_active();
+  /// charge data read by scrub against osd_scrub_max_bytes_per_sec
+  /// @returns how long (seconds) the caller should wait before reading more
+  double scrub_throttle(uint64_t bytes);
 
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
@@ -1670,14 +1675,21 @@ protected:
   {
     OSD *osd;
 
+    /// heartbeat handles of the messenger threads that ran ops inline
+    Mutex inline_hb_lock;
+    map<pthread_t, heartbeat_handle_d*> inline_hb;
+    heartbeat_handle_d *get_inline_hb();
+
   public:
     ShardedOpWQ(OSD *o,
 		time_t ti,
 		time_t si,
 		ShardedThreadPool* tp)
       : ShardedThreadPool::ShardedWQ<OpQueueItem>(ti, si, tp),
-        osd(o) {
+        osd(o),
+	inline_hb_lock("OSD::ShardedOpWQ::inline_hb_lock") {
     }
+    ~ShardedOpWQ() override;
 
     void _add_slot_waiter(
       spg_t token,
@@ -1692,6 +1704,10 @@ protected:
 
     /// requeue an old item (at the front of the line)
     void _enqueue_front(OpQueueItem&& item) override;
+
+    /// run item in the calling thread if its pg is idle and m can be
+    /// served from cache; false if not run
+    bool try_run_inline(OpQueueItem& item, const MOSDOp *m);
       
     void return_waiting_threads() override {
       for(uint32_t i = 0; i < osd->num_shards; i++) {
@@ -1741,6 +1757,7 @@ protected:
 
 
   void enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch);
+  bool maybe_run_op_inline(spg_t pg, OpRequestRef& op, epoch_t epoch);
   void dequeue_op(
     PGRef pg, OpRequestRef op,
     ThreadPool::TPHandle &handle);
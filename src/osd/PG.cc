@@ -383,6 +383,18 @@ void PG::lock(bool no_lockdep) const
   dout(30) << "lock" << dendl;
 }
 
+bool PG::try_lock() const
+{
+  if (!_lock.TryLock()) {
+    return false;
+  }
+  assert(!dirty_info);
+  assert(!dirty_big_info);
+
+  dout(30) << "try_lock" << dendl;
+  return true;
+}
+
 std::ostream& PG::gen_prefix(std::ostream& out) const
 {
   OSDMapRef mapref = osdmap_ref;
@@ -1110,7 +1122,8 @@ PG::Scrubber::Scrubber()
    auto_repair(false),
    num_digest_updates_pending(0),
    state(INACTIVE),
-   deep(false)
+   deep(false),
+   deep_incremental(false)
 {}
 
 PG::Scrubber::~Scrubber() {}
@@ -4566,6 +4579,7 @@ int PG::build_scrub_map_chunk(
   // start
   while (pos.empty()) {
     pos.deep = deep;
+    pos.incremental = deep && scrubber.deep_incremental;
     map.valid_through = info.last_update;
 
     // objects
@@ -4598,6 +4612,9 @@ int PG::build_scrub_map_chunk(
   // finish
   dout(20) << __func__ << " finishing" << dendl;
   assert(pos.done());
+  // the next scrub read on this osd waits for what is still owed
+  osd->scrub_throttle(pos.bytes_read);
+  pos.bytes_read = 0;
   _repair_oinfo_oid(map);
   if (!is_primary()) {
     ScrubMap for_meta_scrub;
@@ -4708,6 +4725,7 @@ void PG::replica_scrub(
   scrubber.end = msg->end;
   scrubber.max_end = msg->end;
   scrubber.deep = msg->deep;
+  scrubber.deep_incremental = msg->deep && scrub_deep_incremental();
   scrubber.epoch_start = info.history.same_interval_since;
   if (msg->priority) {
     scrubber.priority = msg->priority;
@@ -4722,6 +4740,83 @@ void PG::replica_scrub(
   requeue_scrub(msg->high_priority);
 }
 
+/*
+ * Requeue scrub after a delay.  The sleep is async so that we don't block
+ * the op queue, and scrub stays marked as queued until we wake up.
+ */
+void PG::scrub_sleep(double seconds)
+{
+  ceph_assert(!scrubber.sleeping);
+  OSDService *osds = osd;
+  spg_t pgid = get_pgid();
+  int state = scrubber.state;
+  auto scrub_requeue_callback =
+      new FunctionContext([osds, pgid, state](int r) {
+        PGRef pg = osds->osd->lookup_lock_pg(pgid);
+        if (pg == nullptr) {
+          lgeneric_dout(osds->osd->cct, 20)
+              << "scrub_requeue_callback: Could not find "
+              << "PG " << pgid << " can't complete scrub requeue after sleep"
+              << dendl;
+          return;
+        }
+        pg->scrubber.sleeping = false;
+        pg->scrubber.needs_sleep = false;
+        lgeneric_dout(pg->cct, 20)
+            << "scrub_requeue_callback: slept for "
+            << ceph_clock_now() - pg->scrubber.sleep_start
+            << ", re-queuing scrub with state " << state << dendl;
+        pg->scrub_queued = false;
+        pg->requeue_scrub();
+        pg->scrubber.sleep_start = utime_t();
+        pg->unlock();
+      });
+  Mutex::Locker l(osd->sleep_lock);
+  osd->sleep_timer.add_event_after(seconds, scrub_requeue_callback);
+  scrub_queued = true;
+  scrubber.sleeping = true;
+  scrubber.sleep_start = ceph_clock_now();
+}
+
+/*
+ * Continue building a scrub map chunk, after paying for what it has read
+ * so far out of the osd's scrub read budget (osd_scrub_max_bytes_per_sec).
+ */
+void PG::requeue_scrub_paced(ScrubMapBuilder &pos)
+{
+  double wait = osd->scrub_throttle(pos.bytes_read);
+  pos.bytes_read = 0;
+  if (wait > 0) {
+    dout(20) << __func__ << " over scrub read budget, sleeping " << wait
+	     << dendl;
+    scrub_sleep(wait);
+  } else {
+    requeue_scrub();
+  }
+}
+
+/*
+ * Whether a deep scrub starting now may check store checksums instead of
+ * hashing object data (osd_deep_scrub_incremental).  Every so often one
+ * must hash everything, since the checksums cannot tell data that was
+ * stored wrong from data that was stored right.
+ */
+bool PG::scrub_deep_incremental() const
+{
+  if (!cct->_conf->osd_deep_scrub_incremental) {
+    return false;
+  }
+  double max_age = cct->_conf->osd_deep_scrub_incremental_max_age;
+  if (max_age > 0 &&
+      ceph_clock_now() >= info.history.last_full_deep_scrub_stamp + max_age) {
+    dout(10) << __func__ << " last full deep scrub "
+	     << info.history.last_full_deep_scrub_stamp
+	     << " is too old, hashing all data" << dendl;
+    return false;
+  }
+  return true;
+}
+
 /* Scrub:
  * PG_STATE_SCRUBBING is set when the scrub is queued
  * 
@@ -4734,39 +4829,8 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
       (scrubber.state == PG::Scrubber::NEW_CHUNK ||
        scrubber.state == PG::Scrubber::INACTIVE) &&
        scrubber.needs_sleep) {
-    ceph_assert(!scrubber.sleeping);
     dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
-
-    // Do an async sleep so we don't block the op queue
-    OSDService *osds = osd;
-    spg_t pgid = get_pgid();
-    int state = scrubber.state;
-    auto scrub_requeue_callback =
-        new FunctionContext([osds, pgid, state](int r) {
-          PGRef pg = osds->osd->lookup_lock_pg(pgid);
-          if (pg == nullptr) {
-            lgeneric_dout(osds->osd->cct, 20)
-                << "scrub_requeue_callback: Could not find "
-                << "PG " << pgid << " can't complete scrub requeue after sleep"
-                << dendl;
-            return;
-          }
-          pg->scrubber.sleeping = false;
-          pg->scrubber.needs_sleep = false;
-          lgeneric_dout(pg->cct, 20)
-              << "scrub_requeue_callback: slept for "
-              << ceph_clock_now() - pg->scrubber.sleep_start
-              << ", re-queuing scrub with state " << state << dendl;
-          pg->scrub_queued = false;
-          pg->requeue_scrub();
-          pg->scrubber.sleep_start = utime_t();
-          pg->unlock();
-        });
-    Mutex::Locker l(osd->sleep_lock);
-    osd->sleep_timer.add_event_after(cct->_conf->osd_scrub_sleep,
-                                           scrub_requeue_callback);
-    scrubber.sleeping = true;
-    scrubber.sleep_start = ceph_clock_now();
+    scrub_sleep(cct->_conf->osd_scrub_sleep);
     return;
   }
   if (pg_has_reset_since(queued)) {
@@ -4796,6 +4860,9 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
     assert(backfill_targets.empty());
 
     scrubber.deep = state_test(PG_STATE_DEEP_SCRUB);
+    // a repair wants every replica's real digest
+    scrubber.deep_incremental = scrubber.deep &&
+      !state_test(PG_STATE_REPAIR) && scrub_deep_incremental();
 
     dout(10) << "starting a new chunky scrub" << dendl;
   }
@@ -5102,7 +5169,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  scrubber.deep,
 	  handle);
 	if (ret == -EINPROGRESS) {
-	  requeue_scrub();
+	  requeue_scrub_paced(scrubber.primary_scrubmap_pos);
 	  done = true;
 	  break;
 	}
@@ -5206,7 +5273,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	    handle);
 	}
 	if (ret == -EINPROGRESS) {
-	  requeue_scrub();
+	  requeue_scrub_paced(scrubber.replica_scrubmap_pos);
 	  done = true;
 	  break;
 	}
@@ -5500,6 +5567,9 @@ void PG::scrub_finish()
   if (scrubber.deep) {
     info.history.last_deep_scrub = info.last_update;
     info.history.last_deep_scrub_stamp = now;
+    if (!scrubber.deep_incremental) {
+      info.history.last_full_deep_scrub_stamp = now;
+    }
   }
   // Since we don't know which errors were fixed, we can only clear them
   // when every one has been fixed.
@@ -6228,6 +6298,40 @@ ostream& operator<<(ostream& out, const PG& pg)
   return out;
 }
 
+bool PG::is_read_cached(const MOSDOp *m)
+{
+  if (m->get_snapid() != CEPH_NOSNAP) {
+    return false;
+  }
+  ghobject_t oid(m->get_hobj(), ghobject_t::NO_GEN, pg_whoami.shard);
+  // onode, xattrs and extent map shards
+  if (!osd->store->is_cached(ch, oid, 0, 0)) {
+    return false;
+  }
+  if (pool.info.is_erasure()) {
+    // data reads on an EC pool go out to the shards asynchronously
+    return true;
+  }
+  for (auto& osd_op : m->ops) {
+    switch (osd_op.op.op) {
+    case CEPH_OSD_OP_READ:
+    case CEPH_OSD_OP_SYNC_READ:
+    case CEPH_OSD_OP_SPARSE_READ:
+      {
+	uint64_t len = osd_op.op.extent.length;
+	if (!osd->store->is_cached(ch, oid, osd_op.op.extent.offset,
+				   len ? len : (size_t)-1)) {
+	  return false;
+	}
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
 bool PG::can_discard_op(OpRequestRef& op)
 {
   const MOSDOp *m = static_cast<const MOSDOp*>(op->get_req());
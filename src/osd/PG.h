@@ -281,6 +281,7 @@ public:
     handle.reset_tp_timeout();
   }
   void lock(bool no_lockdep = false) const;
+  bool try_lock() const;
   void unlock() const {
     //generic_dout(0) << this << " " << info.pgid << " unlock" << dendl;
     assert(!dirty_info);
@@ -445,6 +446,9 @@ public:
   void get_pg_stats(std::function<void(const pg_stat_t&, epoch_t lec)> f);
   void with_heartbeat_peers(std::function<void(int)> f);
 
+  /// true if the data the read-only op m touches is in the store cache
+  bool is_read_cached(const MOSDOp *m);
+
   void shutdown();
   virtual void on_shutdown() = 0;
 
@@ -1648,6 +1652,7 @@ public:
     std::unique_ptr<Scrub::Store> store;
     // deep scrub
     bool deep;
+    bool deep_incremental;  ///< trust store csums, see scrub_deep_incremental()
     int preempt_left;
     int preempt_divisor;
 
@@ -1710,6 +1715,7 @@ public:
       large_omap_objects = 0;
       fixed = 0;
       deep = false;
+      deep_incremental = false;
       run_callbacks();
       inconsistent.clear();
       missing.clear();
@@ -2844,9 +2850,10 @@ public:
 protected:
   void prepare_write_info(map<string,bufferlist> *km);
 
+public:
+  /// push pool options (compression, cache priority, ...) to the store
   void update_store_with_options();
 
-public:
   static int _prepare_write_info(
     CephContext* cct,
     map<string,bufferlist> *km,
@@ -2902,6 +2909,9 @@ protected:
   virtual void kick_snap_trim() = 0;
   virtual void snap_trimmer_scrub_complete() = 0;
   bool requeue_scrub(bool high_priority = false);
+  void requeue_scrub_paced(ScrubMapBuilder &pos);
+  bool scrub_deep_incremental() const;
+  void scrub_sleep(double seconds);
   void queue_recovery();
   bool queue_scrub();
   unsigned get_scrub_priority();
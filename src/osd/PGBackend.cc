@@ -617,6 +617,44 @@ int PGBackend::be_scan_list(
   return 0;
 }
 
+int PGBackend::be_verify_checksums(
+  const hobject_t &poid,
+  ScrubMapBuilder &pos,
+  ScrubMap::object &o,
+  uint64_t stride)
+{
+  assert(pos.csum_only);
+  uint64_t len = std::min<uint64_t>(stride, o.size - pos.data_pos);
+  int r = store->verify_checksums(
+    ch,
+    ghobject_t(
+      poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+    pos.data_pos,
+    len,
+    CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL | CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+  if (r == -EOPNOTSUPP) {
+    dout(20) << __func__ << "  " << poid << " store cannot verify, reading"
+	     << dendl;
+    pos.csum_only = false;
+    pos.data_pos = 0;
+    return r;
+  }
+  if (r < 0) {
+    dout(20) << __func__ << "  " << poid << " got "
+	     << r << " on verify, read_error" << dendl;
+    o.read_error = true;
+    return -EIO;
+  }
+  pos.data_pos += len;
+  pos.bytes_read += len;
+  if (pos.data_pos < (int64_t)o.size) {
+    return -EINPROGRESS;
+  }
+  dout(20) << __func__ << "  " << poid << " verified, stored digest 0x"
+	   << std::hex << pos.stored_digest << std::dec << dendl;
+  return 0;
+}
+
 bool PGBackend::be_compare_scrub_objects(
   pg_shard_t auth_shard,
   const ScrubMap::object &auth,
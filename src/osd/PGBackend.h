@@ -598,6 +598,20 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      ScrubMap &map,
      ScrubMapBuilder &pos,
      ScrubMap::object &o) = 0;
+   /**
+    * check the next stride of an object's data against the object store's
+    * checksums rather than reading and hashing it (pos.csum_only)
+    *
+    * @returns 0 once the whole object checked out, -EINPROGRESS if there is
+    * more to check, -EOPNOTSUPP if the store cannot check it (pos is rewound
+    * so the caller can hash the data instead), or -EIO after flagging
+    * o.read_error
+    */
+   int be_verify_checksums(
+     const hobject_t &oid,
+     ScrubMapBuilder &pos,
+     ScrubMap::object &o,
+     uint64_t stride);
    void be_large_omap_check(
      const map<pg_shard_t,ScrubMap*> &maps,
      const set<hobject_t> &master_set,
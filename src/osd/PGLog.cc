@@ -133,7 +133,7 @@ ostream& PGLog::IndexedLog::print(ostream& out) const
     assert(!p->reqid_is_indexed() || logged_req(p->reqid));
   }
 
-  for (list<pg_log_dup_t>::const_iterator p = dups.begin();
+  for (auto p = dups.begin();
        p != dups.end();
        ++p) {
     out << *p << std::endl;
@@ -499,19 +499,17 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 
 	auto log_tail_version = log.dups.back().version;
 
-	auto insert_cursor = log.dups.end();
-	eversion_t last_shared = eversion_t::max();
-	for (auto i = olog.dups.crbegin(); i != olog.dups.crend(); ++i) {
-	  if (i->version <= log_tail_version) break;
-	  log.dups.insert(insert_cursor, *i);
-	  last_shared = i->version;
-
-	  auto prev = insert_cursor;
-	  --prev;
+	// find the oldest olog dup newer than ours, then append from there
+	auto i = olog.dups.cend();
+	while (i != olog.dups.cbegin() &&
+	       std::prev(i)->version > log_tail_version) {
+	  --i;
+	}
+	eversion_t last_shared = i->version;
+	for (; i != olog.dups.cend(); ++i) {
+	  log.dups.push_back(*i);
 	  // be sure to pass reference of copy in log.dups
-	  log.index(*prev);
-
-	  --insert_cursor; // make sure we insert in reverse order
+	  log.index(log.dups.back());
 	}
 	mark_dirty_from_dups(last_shared);
       }
@@ -522,16 +520,19 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 	  olog.dups.front().version << dendl;
 	changed = true;
 
-	eversion_t last;
-	auto insert_cursor = log.dups.begin();
-	for (auto i = olog.dups.cbegin(); i != olog.dups.cend(); ++i) {
-	  if (i->version >= insert_cursor->version) break;
-	  log.dups.insert(insert_cursor, *i);
-	  last = i->version;
-	  auto prev = insert_cursor;
-	  --prev;
+	// find the newest olog dup older than ours, then prepend down to
+	// the oldest; push_front keeps references into log.dups valid
+	auto log_head_version = log.dups.front().version;
+	auto i = olog.dups.cbegin();
+	while (i != olog.dups.cend() && i->version < log_head_version) {
+	  ++i;
+	}
+	eversion_t last = std::prev(i)->version;
+	while (i != olog.dups.cbegin()) {
+	  --i;
+	  log.dups.push_front(*i);
 	  // be sure to pass address of copy in log.dups
-	  log.index(*prev);
+	  log.index(log.dups.front());
 	}
 	mark_dirty_to_dups(last);
       }
@@ -753,7 +754,7 @@ void PGLog::_write_log_and_missing_wo_missing(
     (*km)[entry.get_key_name()].claim(bl);
   }
 
-  for (list<pg_log_dup_t>::reverse_iterator p = log.dups.rbegin();
+  for (auto p = log.dups.rbegin();
        p != log.dups.rend() &&
 	 (p->version >= dirty_from_dups || p->version >= write_from_dups) &&
 	 p->version >= dirty_to_dups;
@@ -882,7 +883,7 @@ void PGLog::_write_log_and_missing(
     (*km)[entry.get_key_name()].claim(bl);
   }
 
-  for (list<pg_log_dup_t>::reverse_iterator p = log.dups.rbegin();
+  for (auto p = log.dups.rbegin();
        p != log.dups.rend() &&
 	 (p->version >= dirty_from_dups || p->version >= write_from_dups) &&
 	 p->version >= dirty_to_dups;
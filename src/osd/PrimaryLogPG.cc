@@ -1579,6 +1579,105 @@ void PrimaryLogPG::do_pg_op(OpRequestRef op)
   delete filter;
 }
 
+/*
+ * Client read of this shard's chunks of an ec object, bypassing the
+ * primary (see Objecter::_submit_ec_direct_read).  Only a stat and a
+ * read of the chunk range are allowed.  The stat returns the logical
+ * size from this shard's object_info_t and the reply carries its
+ * user_version, so that the client can check that all the shards it
+ * read from agree.  Anything unusual gets -EAGAIN, upon which the
+ * client falls back to a regular read through the primary.
+ */
+void PrimaryLogPG::do_ec_direct_read(OpRequestRef op)
+{
+  const MOSDOp *m = static_cast<const MOSDOp*>(op->get_req());
+  hobject_t soid = m->get_hobj();
+
+  dout(10) << __func__ << " " << *m << dendl;
+
+  if (!pool.info.is_erasure() ||
+      !op->may_read() ||
+      op->may_write() ||
+      op->may_cache() ||
+      m->get_snapid() != CEPH_NOSNAP ||
+      m->ops.size() != 2 ||
+      m->ops[0].op.op != CEPH_OSD_OP_STAT ||
+      m->ops[1].op.op != CEPH_OSD_OP_READ) {
+    osd->reply_op_error(op, -EINVAL);
+    return;
+  }
+
+  if (!is_active() ||
+      is_missing_object(soid) ||
+      (is_primary() && is_degraded_or_backfilling_object(soid))) {
+    dout(20) << __func__ << " " << soid << " not readable here" << dendl;
+    osd->reply_op_error(op, -EAGAIN);
+    return;
+  }
+
+  bufferlist bv;
+  int result = pgbackend->objects_get_attr(soid, OI_ATTR, &bv);
+  if (result < 0) {
+    osd->reply_op_error(op, result == -ENOENT ? -EAGAIN : result);
+    return;
+  }
+  object_info_t oi;
+  try {
+    oi.decode(bv);
+  } catch (buffer::error&) {
+    osd->reply_op_error(op, -EAGAIN);
+    return;
+  }
+  if (oi.soid != soid || oi.is_whiteout()) {
+    osd->reply_op_error(op, -EAGAIN);
+    return;
+  }
+  // this shard is not ordered against the writes going through the
+  // primary: only answer if the object's last write is complete here
+  // and has been rolled forward, i.e. committed by every shard, and no
+  // newer write is in flight on the primary
+  if (oi.version > info.last_complete ||
+      oi.version > pg_log.get_can_rollback_to() ||
+      (is_primary() && projected_log.logged_object(soid))) {
+    dout(20) << __func__ << " " << soid << " " << oi.version
+	     << " may be uncommitted, last_complete " << info.last_complete
+	     << " can_rollback_to " << pg_log.get_can_rollback_to() << dendl;
+    osd->reply_op_error(op, -EAGAIN);
+    return;
+  }
+
+  vector<OSDOp> ops = m->ops;
+  encode(oi.size, ops[0].outdata);
+  encode(oi.mtime, ops[0].outdata);
+
+  OSDOp &rd = ops[1];
+  result = osd->store->read(
+    ch,
+    ghobject_t(soid, ghobject_t::NO_GEN, pg_whoami.shard),
+    rd.op.extent.offset,
+    rd.op.extent.length,
+    rd.outdata,
+    rd.op.flags);
+  if (result >= 0) {
+    rd.op.extent.length = result;
+    rd.rval = 0;
+    result = 0;
+  } else {
+    dout(10) << __func__ << " " << soid << " read got " << result << dendl;
+    result = -EAGAIN;
+  }
+
+  MOSDOpReply *reply = new MOSDOpReply(m, 0, get_osdmap()->get_epoch(),
+				       CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK,
+				       false);
+  if (result == 0) {
+    reply->claim_op_out_data(ops);
+    reply->set_reply_versions(oi.version, oi.user_version);
+  }
+  reply->set_result(result);
+  osd->send_message_osd_client(reply, m->get_connection());
+}
+
 int PrimaryLogPG::do_scrub_ls(MOSDOp *m, OSDOp *osd_op)
 {
   if (m->get_pg() != info.pgid.pgid) {
@@ -1955,10 +2054,16 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
     }
   }
 
-  if ((m->get_flags() & (CEPH_OSD_FLAG_BALANCE_READS |
-			 CEPH_OSD_FLAG_LOCALIZE_READS)) &&
-      op->may_read() &&
-      !(op->may_write() || op->may_cache())) {
+  if (m->has_flag(CEPH_OSD_FLAG_EC_DIRECT_READ)) {
+    // shard chunk read; must be this shard
+    if (!is_acting(pg_whoami)) {
+      osd->handle_misdirected_op(this, op);
+      return;
+    }
+  } else if ((m->get_flags() & (CEPH_OSD_FLAG_BALANCE_READS |
+				CEPH_OSD_FLAG_LOCALIZE_READS)) &&
+	     op->may_read() &&
+	     !(op->may_write() || op->may_cache())) {
     // balanced reads; any replica will do
     if (!(is_primary() || is_replica())) {
       osd->handle_misdirected_op(this, op);
@@ -2018,6 +2123,11 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
     return;
   }
 
+  if (m->has_flag(CEPH_OSD_FLAG_EC_DIRECT_READ)) {
+    do_ec_direct_read(op);
+    return;
+  }
+
   // order this op as a write?
   bool write_ordered = op->rwordered();
 
@@ -608,11 +608,44 @@ int ReplicatedBackend::be_deep_scrub(
   }
 
   assert(poid == pos.ls[pos.pos]);
-  if (!pos.data_done()) {
-    if (pos.data_pos == 0) {
-      pos.data_hash = bufferhash(-1);
+  if (!pos.data_done() && pos.data_pos == 0) {
+    pos.data_hash = bufferhash(-1);
+    if (pos.incremental) {
+      // the data digest recorded in the object_info is as good as a hash
+      // of the data, provided the store vouches for what is on disk
+      auto p = o.attrs.find(OI_ATTR);
+      if (p != o.attrs.end()) {
+	bufferlist bv;
+	bv.push_back(p->second);
+	object_info_t oi;
+	try {
+	  auto bliter = bv.cbegin();
+	  decode(oi, bliter);
+	  if (oi.is_data_digest() && oi.size == o.size) {
+	    pos.csum_only = true;
+	    pos.stored_digest = oi.data_digest;
+	  }
+	} catch (buffer::error&) {
+	  // leave it to the object_info checks in be_compare_scrubmaps
+	}
+      }
     }
-
+  }
+  if (pos.csum_only && !pos.data_done()) {
+    r = be_verify_checksums(poid, pos, o, cct->_conf->osd_deep_scrub_stride);
+    if (r == -EINPROGRESS) {
+      return r;
+    }
+    if (r == -EIO) {
+      return 0;
+    }
+    if (r == 0) {
+      pos.data_pos = -1;
+      o.digest = pos.stored_digest;
+      o.digest_present = true;
+    }
+  }
+  if (!pos.data_done()) {
     bufferlist bl;
     r = store->read(
       ch,
@@ -631,6 +664,7 @@ int ReplicatedBackend::be_deep_scrub(
       pos.data_hash << bl;
     }
     pos.data_pos += r;
+    pos.bytes_read += r;
     if (r == cct->_conf->osd_deep_scrub_stride) {
       dout(20) << __func__ << "  " << poid << " more data, digest so far 0x"
 	       << std::hex << pos.data_hash.digest() << std::dec << dendl;
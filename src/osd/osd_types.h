@@ -752,9 +752,8 @@ namespace std {
   template<> struct hash<coll_t> {
     size_t operator()(const coll_t &c) const { 
       size_t h = 0;
-      string str(c.to_str());
-      std::string::const_iterator end(str.end());
-      for (std::string::const_iterator s = str.begin(); s != end; ++s) {
+      // hash the cached name in place rather than copying it
+      for (const char *s = c.c_str(); *s; ++s) {
 	h += *s;
 	h += (h << 10);
 	h ^= (h >> 6);
@@ -1062,6 +1061,7 @@ public:
     CSUM_TYPE,
     CSUM_MAX_BLOCK,
     CSUM_MIN_BLOCK,
+    CACHE_PRIORITY,
   };
 
   enum type_t {
@@ -2214,6 +2214,7 @@ struct pg_history_t {
   utime_t last_scrub_stamp;
   utime_t last_deep_scrub_stamp;
   utime_t last_clean_scrub_stamp;
+  utime_t last_full_deep_scrub_stamp; ///< last deep scrub that hashed all data
 
   friend bool operator==(const pg_history_t& l, const pg_history_t& r) {
     return
@@ -2232,7 +2233,8 @@ struct pg_history_t {
       l.last_deep_scrub == r.last_deep_scrub &&
       l.last_scrub_stamp == r.last_scrub_stamp &&
       l.last_deep_scrub_stamp == r.last_deep_scrub_stamp &&
-      l.last_clean_scrub_stamp == r.last_clean_scrub_stamp;
+      l.last_clean_scrub_stamp == r.last_clean_scrub_stamp &&
+      l.last_full_deep_scrub_stamp == r.last_full_deep_scrub_stamp;
   }
 
   pg_history_t()
@@ -2299,6 +2301,10 @@ struct pg_history_t {
       last_deep_scrub_stamp = other.last_deep_scrub_stamp;
       modified = true;
     }
+    if (other.last_full_deep_scrub_stamp > last_full_deep_scrub_stamp) {
+      last_full_deep_scrub_stamp = other.last_full_deep_scrub_stamp;
+      modified = true;
+    }
     if (other.last_clean_scrub_stamp > last_clean_scrub_stamp) {
       last_clean_scrub_stamp = other.last_clean_scrub_stamp;
       modified = true;
@@ -3515,8 +3521,10 @@ public:
   // the actual log
   mempool::osd_pglog::list<pg_log_entry_t> log;
 
-  // entries just for dup op detection ordered oldest to newest
-  mempool::osd_pglog::list<pg_log_dup_t> dups;
+  // entries just for dup op detection ordered oldest to newest.  these
+  // are only ever added and trimmed at the ends, so keep them in a deque
+  // rather than paying a list node per (small, fixed size) entry.
+  mempool::osd_pglog::deque<pg_log_dup_t> dups;
 
   pg_log_t() = default;
   pg_log_t(const eversion_t &last_update,
@@ -3524,7 +3532,7 @@ public:
 	   const eversion_t &can_rollback_to,
 	   const eversion_t &rollback_info_trimmed_to,
 	   mempool::osd_pglog::list<pg_log_entry_t> &&entries,
-	   mempool::osd_pglog::list<pg_log_dup_t> &&dup_entries)
+	   mempool::osd_pglog::deque<pg_log_dup_t> &&dup_entries)
     : head(last_update), tail(log_tail), can_rollback_to(can_rollback_to),
       rollback_info_trimmed_to(rollback_info_trimmed_to),
       log(std::move(entries)), dups(std::move(dup_entries)) {}
@@ -4998,6 +5006,10 @@ struct ScrubMapBuilder {
   bufferhash data_hash, omap_hash;  ///< accumulatinng hash value
   uint64_t omap_keys = 0;
   uint64_t omap_bytes = 0;
+  bool incremental = false;      ///< deep, but may trust the store's csums
+  bool csum_only = false;        ///< check store csums instead of hashing data
+  uint32_t stored_digest = 0;    ///< digest to report if csum_only
+  uint64_t bytes_read = 0;       ///< data read, not yet charged to the osd
 
   bool empty() {
     return ls.empty();
@@ -5019,6 +5031,7 @@ struct ScrubMapBuilder {
     omap_pos.clear();
     omap_keys = 0;
     omap_bytes = 0;
+    csum_only = false;
   }
 
   friend ostream& operator<<(ostream& out, const ScrubMapBuilder& pos) {
@@ -5035,6 +5048,9 @@ struct ScrubMapBuilder {
     if (pos.deep) {
       out << " deep";
     }
+    if (pos.csum_only) {
+      out << " csum";
+    }
     if (pos.ret) {
       out << " ret " << pos.ret;
     }
@@ -143,6 +143,9 @@ enum {
   l_osdc_osdop_omap_rd,
   l_osdc_osdop_omap_del,
 
+  l_osdc_ec_direct_read,
+  l_osdc_ec_direct_read_fallback,
+
   l_osdc_last,
 };
 
@@ -365,6 +368,12 @@ void Objecter::init()
     pcb.add_u64_counter(l_osdc_osdop_omap_del, "omap_del",
 			"OSD OMAP delete operations");
 
+    pcb.add_u64_counter(l_osdc_ec_direct_read, "ec_direct_read",
+			"EC reads served directly by the data shards");
+    pcb.add_u64_counter(l_osdc_ec_direct_read_fallback,
+			"ec_direct_read_fallback",
+			"EC direct reads retried through the primary");
+
     logger = pcb.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
   }
@@ -411,6 +420,18 @@ void Objecter::shutdown()
 
   unique_lock wl(rwlock);
 
+  // while their shard ops can still be cancelled
+  vector<ceph_tid_t> ec_direct_tids;
+  {
+    std::lock_guard<std::mutex> l(ec_direct_lock);
+    for (auto& p : ec_direct_reads) {
+      ec_direct_tids.push_back(p.first);
+    }
+  }
+  for (auto tid : ec_direct_tids) {
+    _cancel_ec_direct_read(tid, -ECANCELED);
+  }
+
   initialized = false;
 
   cct->_conf.remove_observer(this);
@@ -1093,6 +1114,9 @@ void Objecter::_scan_requests(
     case RECALC_OP_TARGET_POOL_DNE:
       _check_op_pool_dne(op, &sl);
       break;
+    case RECALC_OP_TARGET_EC_SHARD_DNE:
+      _check_op_ec_shard_dne(op, &sl);
+      break;
     }
   }
 
@@ -1287,6 +1311,9 @@ void Objecter::handle_osd_map(MOSDMap *m)
       if (r == RECALC_OP_TARGET_POOL_DNE) {
 	p = need_resend.erase(p);
 	_check_op_pool_dne(op, nullptr);
+      } else if (r == RECALC_OP_TARGET_EC_SHARD_DNE) {
+	p = need_resend.erase(p);
+	_check_op_ec_shard_dne(op, nullptr);
       } else {
 	++p;
       }
@@ -1578,6 +1605,39 @@ void Objecter::_check_op_pool_dne(Op *op, unique_lock *sl)
   }
 }
 
+void Objecter::_check_op_ec_shard_dne(Op *op, unique_lock *sl)
+{
+  // rwlock is locked
+
+  // the shard of a direct read left the acting set: fail it here rather
+  // than asking the primary, so that ECDirectRead falls back right away
+  ldout(cct, 10) << __func__ << " tid " << op->tid
+		 << " shard " << op->target.ec_shard
+		 << " of " << op->target.pgid << " is gone" << dendl;
+  _op_cancel_map_check(op);
+  Context *onfinish = op->onfinish;
+  op->onfinish = NULL;
+  if (onfinish) {
+    num_in_flight--;
+    onfinish->complete(-EAGAIN);
+  }
+
+  OSDSession *s = op->session;
+  if (s) {
+    assert(sl->mutex() == &s->lock);
+    bool session_locked = sl->owns_lock();
+    if (!session_locked) {
+      sl->lock();
+    }
+    _finish_op(op, 0);
+    if (!session_locked) {
+      sl->unlock();
+    }
+  } else {
+    _finish_op(op, 0);	// no session
+  }
+}
+
 void Objecter::_send_op_map_check(Op *op)
 {
   // rwlock is locked unique
@@ -2268,9 +2328,416 @@ void Objecter::op_submit(Op *op, ceph_tid_t *ptid, int *ctx_budget)
   if (!ptid)
     ptid = &tid;
   op->trace.event("op submit");
+  if (!ctx_budget && _submit_ec_direct_read(op, rl, ptid)) {
+    return;
+  }
   _op_submit_with_budget(op, rl, ptid, ctx_budget);
 }
 
+/**
+ * Reads of an erasure coded object may be served by its data shards
+ * directly: each of the k data shards returns its chunks of the
+ * stripes covering the read, which are interleaved back here.  This
+ * spares the primary from gathering and forwarding all the data.
+ *
+ * The original op is only submitted if a shard fails, is unavailable,
+ * or does not agree with the others on the object's size and version,
+ * in which case the primary serves it as usual.
+ *
+ * Until then the original op gets a tid but lives in ec_direct_reads
+ * rather than in a session; _cancel_ec_direct_read cancels its shard
+ * ops and completes it.
+ */
+struct Objecter::ECDirectRead {
+  struct C_Shard : public Context {
+    ECDirectRead *rd;
+    C_Shard(ECDirectRead *rd) : rd(rd) {}
+    void finish(int r) override {
+      bool done;
+      {
+	std::lock_guard<std::mutex> l(rd->lock);
+	if (r < 0)
+	  rd->failed = true;
+	done = --rd->pending == 0;
+      }
+      if (done)
+	rd->objecter->_finish_ec_direct_read(rd);
+    }
+  };
+
+  Objecter *objecter;
+  Op *op;               ///< original read, holds the budget
+  uint64_t off, len;    ///< logical range it asked for
+  uint64_t start;       ///< stripe aligned offset of the chunks read
+  uint64_t chunk_size;
+  unsigned k;
+
+  std::mutex lock;
+  unsigned pending;
+  bool failed = false;
+
+  // protected by Objecter::ec_direct_lock
+  int cancel_r = 0;      ///< completion code of a cancelled read
+  bool fallback = false; ///< shard ops done, waiting to be resubmitted
+
+  vector<Op*> shard_ops; ///< one per data shard, referenced until done
+  vector<bufferlist> stat_bl;
+  vector<bufferlist> chunks;
+  vector<int> stat_rval;
+  vector<int> read_rval;
+  vector<version_t> versions;
+
+  ECDirectRead(Objecter *objecter, Op *op, uint64_t off, uint64_t len,
+	       uint64_t start, uint64_t chunk_size, unsigned k)
+    : objecter(objecter), op(op), off(off), len(len), start(start),
+      chunk_size(chunk_size), k(k), pending(k),
+      stat_bl(k), chunks(k), stat_rval(k), read_rval(k), versions(k) {}
+};
+
+struct Objecter::C_ECDirectReadFallback : public Context {
+  Objecter *objecter;
+  ceph_tid_t tid;
+  C_ECDirectReadFallback(Objecter *objecter, ceph_tid_t tid)
+    : objecter(objecter), tid(tid) {}
+  void finish(int r) override {
+    objecter->_fallback_ec_direct_read(tid);
+  }
+};
+
+bool Objecter::_submit_ec_direct_read(Op *op, shunique_lock& sul,
+				      ceph_tid_t *ptid)
+{
+  // rwlock is locked
+  if (!cct->_conf->objecter_ec_direct_reads ||
+      op->ops.size() != 1 ||
+      op->ops[0].op.op != CEPH_OSD_OP_READ ||
+      op->ops[0].op.extent.length <
+        cct->_conf->objecter_ec_direct_read_min_bytes ||
+      op->ops[0].op.extent.truncate_seq != 0 ||
+      op->snapid != CEPH_NOSNAP ||
+      op->ctx_budgeted ||
+      op->target.precalc_pgid ||
+      (op->target.flags & CEPH_OSD_FLAG_WRITE) ||
+      !(op->target.flags & CEPH_OSD_FLAG_READ) ||
+      (op->target.flags & (CEPH_OSD_FLAG_RWORDERED |
+			   CEPH_OSD_FLAG_IGNORE_OVERLAY |
+			   CEPH_OSD_FLAG_REDIRECTED))) {
+    return false;
+  }
+  const pg_pool_t *pi = osdmap->get_pg_pool(op->target.base_oloc.pool);
+  if (!pi || !pi->is_erasure() || pi->has_read_tier()) {
+    return false;
+  }
+
+  // only codes storing the data chunks as is on shards 0..k-1
+  const auto &profile =
+    osdmap->get_erasure_code_profile(pi->erasure_code_profile);
+  auto plugin = profile.find("plugin");
+  auto kiter = profile.find("k");
+  if (plugin == profile.end() || plugin->second == "lrc" ||
+      profile.count("mapping") || kiter == profile.end()) {
+    return false;
+  }
+  unsigned k = atoi(kiter->second.c_str());
+  if (k == 0 || pi->stripe_width == 0 || pi->stripe_width % k) {
+    return false;
+  }
+  uint64_t stripe_width = pi->stripe_width;
+  uint64_t chunk_size = stripe_width / k;
+
+  pg_t pgid;
+  if (osdmap->object_locator_to_pg(op->target.base_oid, op->target.base_oloc,
+				   pgid) < 0) {
+    return false;
+  }
+  vector<int> acting;
+  int acting_primary;
+  osdmap->pg_to_acting_osds(pgid, &acting, &acting_primary);
+  if (acting.size() < k) {
+    return false;
+  }
+  for (unsigned i = 0; i < k; ++i) {
+    if (acting[i] == CRUSH_ITEM_NONE || !osdmap->is_up(acting[i])) {
+      return false;
+    }
+  }
+  // every shard, and the primary that orders them, must know how to
+  // serve and refuse a shard read
+  for (auto osd : acting) {
+    if (osd != CRUSH_ITEM_NONE &&
+	!HAVE_FEATURE(osdmap->get_xinfo(osd).features, OSD_EC_DIRECT_READ)) {
+      ldout(cct, 20) << __func__ << " osd." << osd
+		     << " lacks OSD_EC_DIRECT_READ" << dendl;
+      return false;
+    }
+  }
+
+  // the shards would not be ordered against our own unacked writes
+  vector<OSDSession*> sessions = { homeless_session };
+  auto siter = osd_sessions.find(acting_primary);
+  if (siter != osd_sessions.end())
+    sessions.push_back(siter->second);
+  for (auto s : sessions) {
+    OSDSession::shared_lock sl(s->lock);
+    for (auto& p : s->ops) {
+      const op_target_t& t = p.second->target;
+      if ((t.flags & CEPH_OSD_FLAG_WRITE) &&
+	  t.base_oid == op->target.base_oid &&
+	  t.base_oloc == op->target.base_oloc) {
+	ldout(cct, 20) << __func__ << " " << op->target.base_oid
+		       << " has write tid " << p.first << " in flight"
+		       << dendl;
+	return false;
+      }
+    }
+  }
+
+  const ceph_osd_op &rd_op = op->ops[0].op;
+  uint64_t off = rd_op.extent.offset;
+  uint64_t len = rd_op.extent.length;
+  uint64_t start = off - off % stripe_width;
+  uint64_t end = off + len;
+  if (end % stripe_width)
+    end += stripe_width - end % stripe_width;
+  uint64_t chunk_off = start / stripe_width * chunk_size;
+  uint64_t chunk_len = (end - start) / stripe_width * chunk_size;
+
+  ldout(cct, 10) << __func__ << " " << op->target.base_oid
+		 << " " << off << "~" << len
+		 << " from shards of " << pgid << " " << acting
+		 << " chunks " << chunk_off << "~" << chunk_len << dendl;
+
+  // the whole read is accounted to the original op
+  _take_op_budget(op, sul);
+
+  op->tid = ++last_tid;
+  if (osd_timeout > timespan(0)) {
+    auto tid = op->tid;
+    op->ontimeout = timer.add_event(osd_timeout,
+				    [this, tid]() {
+				      op_cancel(tid, -ETIMEDOUT); });
+  }
+  if (ptid)
+    *ptid = op->tid;
+
+  ECDirectRead *rd = new ECDirectRead(this, op, off, len, start,
+				      chunk_size, k);
+  for (unsigned i = 0; i < k; ++i) {
+    vector<OSDOp> ops(2);
+    ops[0].op.op = CEPH_OSD_OP_STAT;
+    ops[1].op.op = CEPH_OSD_OP_READ;
+    ops[1].op.extent.offset = chunk_off;
+    ops[1].op.extent.length = chunk_len;
+    ops[1].op.flags = rd_op.flags;
+    Op *o = new Op(op->target.base_oid, op->target.base_oloc, ops,
+		   op->target.flags | CEPH_OSD_FLAG_EC_DIRECT_READ,
+		   new ECDirectRead::C_Shard(rd), &rd->versions[i], nullptr,
+		   &op->trace);
+    o->target.ec_shard = shard_id_t(i);
+    o->priority = op->priority;
+    o->features = op->features;
+    o->ctx_budgeted = true;
+    o->out_bl[0] = &rd->stat_bl[i];
+    o->out_rval[0] = &rd->stat_rval[i];
+    o->out_bl[1] = &rd->chunks[i];
+    o->out_rval[1] = &rd->read_rval[i];
+    o->get();
+    rd->shard_ops.push_back(o);
+  }
+  {
+    std::lock_guard<std::mutex> l(ec_direct_lock);
+    ec_direct_reads[op->tid] = rd;
+  }
+  logger->inc(l_osdc_ec_direct_read);
+  for (auto o : rd->shard_ops) {
+    _op_submit_with_budget(o, sul, nullptr);
+  }
+  return true;
+}
+
+void Objecter::_finish_ec_direct_read(ECDirectRead *rd)
+{
+  // called from the completion of the last shard op, which may run
+  // with rwlock held: do not take it here
+  Op *op = rd->op;
+  bool ok = !rd->failed;
+  uint64_t size = 0;
+  version_t uv = 0;
+  for (unsigned i = 0; ok && i < rd->k; ++i) {
+    if (rd->stat_rval[i] < 0 ||
+	rd->read_rval[i] < 0) {
+      ok = false;
+      break;
+    }
+    uint64_t shard_size;
+    ceph::real_time mtime;
+    try {
+      auto p = rd->stat_bl[i].cbegin();
+      decode(shard_size, p);
+      decode(mtime, p);
+    } catch (buffer::error&) {
+      ok = false;
+      break;
+    }
+    if (i == 0) {
+      size = shard_size;
+      uv = rd->versions[i];
+    } else if (shard_size != size || rd->versions[i] != uv) {
+      ok = false;
+    }
+  }
+
+  bufferlist data;
+  if (ok && size > rd->off) {
+    uint64_t end = std::min(rd->off + rd->len, size);
+    uint64_t stripe_width = rd->chunk_size * rd->k;
+    uint64_t stripes = (end - rd->start + stripe_width - 1) / stripe_width;
+    bufferlist logical;
+    for (uint64_t s = 0; ok && s < stripes; ++s) {
+      for (unsigned i = 0; i < rd->k; ++i) {
+	if (rd->chunks[i].length() < (s + 1) * rd->chunk_size) {
+	  ok = false;
+	  break;
+	}
+	bufferlist bl;
+	bl.substr_of(rd->chunks[i], s * rd->chunk_size, rd->chunk_size);
+	logical.claim_append(bl);
+      }
+    }
+    if (ok)
+      data.substr_of(logical, rd->off - rd->start, end - rd->off);
+  }
+
+  int r;
+  {
+    std::lock_guard<std::mutex> l(ec_direct_lock);
+    r = rd->cancel_r;
+    if (!ok && !r) {
+      // resubmitting takes rwlock
+      ldout(cct, 10) << __func__ << " " << op->target.base_oid
+		     << " falling back to the primary" << dendl;
+      rd->fallback = true;
+      finisher->queue(new C_ECDirectReadFallback(this, op->tid));
+      return;
+    }
+    ec_direct_reads.erase(op->tid);
+  }
+
+  for (auto o : rd->shard_ops) {
+    o->put();
+  }
+  delete rd;
+
+  if (r) {
+    ldout(cct, 10) << __func__ << " " << op->target.base_oid
+		   << " cancelled, r=" << r << dendl;
+    _complete_ec_direct_read(op, r);
+    return;
+  }
+
+  ldout(cct, 10) << __func__ << " " << op->target.base_oid
+		 << " read " << data.length() << " bytes uv " << uv << dendl;
+  if (op->objver)
+    *op->objver = uv;
+  if (op->data_offset)
+    *op->data_offset = 0;
+  if (op->outbl) {
+    *op->outbl = data;
+    op->outbl = 0;
+  }
+  if (op->out_bl[0])
+    *op->out_bl[0] = data;
+  op->ops[0].op.extent.length = data.length();
+  if (op->out_rval[0])
+    *op->out_rval[0] = 0;
+  if (op->out_handler[0]) {
+    op->out_handler[0]->complete(0);
+    op->out_handler[0] = NULL;
+  }
+  _complete_ec_direct_read(op, 0);
+}
+
+void Objecter::_fallback_ec_direct_read(ceph_tid_t tid)
+{
+  shunique_lock sul(rwlock, ceph::acquire_shared);
+  ECDirectRead *rd;
+  {
+    std::lock_guard<std::mutex> l(ec_direct_lock);
+    auto p = ec_direct_reads.find(tid);
+    if (p == ec_direct_reads.end()) {
+      // cancelled meanwhile
+      return;
+    }
+    rd = p->second;
+    ec_direct_reads.erase(p);
+  }
+  Op *op = rd->op;
+  for (auto o : rd->shard_ops) {
+    o->put();
+  }
+  delete rd;
+
+  logger->inc(l_osdc_ec_direct_read_fallback);
+  // the budget is already taken, and op keeps its tid
+  _op_submit(op, sul, nullptr);
+}
+
+bool Objecter::_cancel_ec_direct_read(ceph_tid_t tid, int r)
+{
+  // rwlock is locked unique
+  vector<ceph_tid_t> shard_tids;
+  ECDirectRead *rd;
+  {
+    std::lock_guard<std::mutex> l(ec_direct_lock);
+    auto p = ec_direct_reads.find(tid);
+    if (p == ec_direct_reads.end()) {
+      return false;
+    }
+    rd = p->second;
+    if (!rd->fallback) {
+      // the last shard op to complete will complete the original op
+      rd->cancel_r = r;
+      for (auto o : rd->shard_ops) {
+	shard_tids.push_back(o->tid);
+      }
+      rd = nullptr;
+    } else {
+      ec_direct_reads.erase(p);
+    }
+  }
+
+  ldout(cct, 10) << __func__ << " tid " << tid << " r=" << r
+		 << " shard ops " << shard_tids << dendl;
+  if (rd) {
+    Op *op = rd->op;
+    for (auto o : rd->shard_ops) {
+      o->put();
+    }
+    delete rd;
+    _complete_ec_direct_read(op, r);
+  }
+  for (auto t : shard_tids) {
+    _op_cancel(t, r);
+  }
+  return true;
+}
+
+void Objecter::_complete_ec_direct_read(Op *op, int r)
+{
+  // op is in no session, see ECDirectRead
+  if (!op->ctx_budgeted && op->budget >= 0) {
+    put_op_budget_bytes(op->budget);
+    op->budget = -1;
+  }
+  if (op->ontimeout && r != -ETIMEDOUT)
+    timer.cancel_event(op->ontimeout);
+  Context *onfinish = op->onfinish;
+  op->onfinish = NULL;
+  op->put();
+  if (onfinish)
+    onfinish->complete(r);
+}
+
 void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 				      ceph_tid_t *ptid,
 				      int *ctx_budget)
@@ -2421,6 +2888,9 @@ void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
   assert(r == 0);
   assert(s);  // may be homeless
 
+  bool ec_shard_dne = op->target.ec_shard != shard_id_t::NO_SHARD &&
+    op->target.osd < 0;
+
   _send_op_account(op);
 
   // send?
@@ -2433,7 +2903,10 @@ void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
 
   bool need_send = false;
 
-  if (osdmap->get_epoch() < epoch_barrier) {
+  if (ec_shard_dne) {
+    ldout(cct, 10) << " ec shard gone " << op << " tid " << op->tid
+		   << dendl;
+  } else if (osdmap->get_epoch() < epoch_barrier) {
     ldout(cct, 10) << " barrier, paused " << op << " tid " << op->tid
 		   << dendl;
     op->target.paused = true;
@@ -2482,7 +2955,9 @@ void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
   // Last chance to touch Op here, after giving up session lock it can
   // be freed at any time by response handler.
   ceph_tid_t tid = op->tid;
-  if (check_for_latest_map) {
+  if (ec_shard_dne) {
+    _check_op_ec_shard_dne(op, &sl);
+  } else if (check_for_latest_map) {
     _send_op_map_check(op);
   }
   if (ptid)
@@ -2556,6 +3031,10 @@ int Objecter::_op_cancel(ceph_tid_t tid, int r)
   ldout(cct, 5) << __func__ << ": cancelling tid " << tid << " r=" << r
 		<< dendl;
 
+  if (_cancel_ec_direct_read(tid, r)) {
+    return 0;
+  }
+
 start:
 
   for (map<int, OSDSession *>::iterator siter = osd_sessions.begin();
@@ -2933,7 +3412,21 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
     } else {
       int osd;
       bool read = is_read && !is_write;
-      if (read && (t->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
+      if (t->ec_shard != shard_id_t::NO_SHARD) {
+	// direct read of an ec shard, see ECDirectRead
+	unsigned shard = t->ec_shard.id;
+	if (pi->is_erasure() &&
+	    shard < acting.size() &&
+	    acting[shard] != CRUSH_ITEM_NONE) {
+	  osd = acting[shard];
+	  t->actual_pgid.shard = t->ec_shard;
+	} else {
+	  // the shard is gone; the op is failed locally, see
+	  // _check_op_ec_shard_dne
+	  osd = -1;
+	}
+	t->used_replica = true;
+      } else if (read && (t->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
 	int p = rand() % acting.size();
 	if (p)
 	  t->used_replica = true;
@@ -2970,6 +3463,9 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
       t->osd = osd;
     }
   }
+  if (t->ec_shard != shard_id_t::NO_SHARD && t->osd < 0) {
+    return RECALC_OP_TARGET_EC_SHARD_DNE;
+  }
   if (legacy_change || unpaused || force_resend) {
     return RECALC_OP_TARGET_NEED_RESEND;
   }
@@ -3432,7 +3928,8 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     return;
   }
 
-  if (rc == -EAGAIN) {
+  if (rc == -EAGAIN &&
+      !(op->target.flags & CEPH_OSD_FLAG_EC_DIRECT_READ)) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
     if (op->onfinish)
       num_in_flight--;
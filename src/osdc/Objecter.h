@@ -1310,6 +1310,9 @@ public:
     bool used_replica = false;
     bool paused = false;
 
+    ///< ec shard to read from directly, if any (see ECDirectRead)
+    shard_id_t ec_shard = shard_id_t::NO_SHARD;
+
     int osd = -1;      ///< the final target osd, or -1
 
     epoch_t last_force_resend = 0;
@@ -1925,6 +1928,7 @@ public:
     RECALC_OP_TARGET_POOL_DNE,
     RECALC_OP_TARGET_OSD_DNE,
     RECALC_OP_TARGET_OSD_DOWN,
+    RECALC_OP_TARGET_EC_SHARD_DNE,
   };
   bool _osdmap_full_flag() const;
   bool _osdmap_has_pool_full() const;
@@ -1967,6 +1971,7 @@ public:
 
 private:
   void _check_op_pool_dne(Op *op, unique_lock *sl);
+  void _check_op_ec_shard_dne(Op *op, unique_lock *sl);
   void _send_op_map_check(Op *op);
   void _op_cancel_map_check(Op *op);
   void _check_linger_pool_dne(LingerOp *op, bool *need_unregister);
@@ -2155,6 +2160,17 @@ private:
   void _op_submit_with_budget(Op *op, shunique_lock& lc,
 			      ceph_tid_t *ptid,
 			      int *ctx_budget = NULL);
+
+  // ec direct reads
+  struct ECDirectRead;
+  struct C_ECDirectReadFallback;
+  std::mutex ec_direct_lock; ///< protects ec_direct_reads
+  map<ceph_tid_t, ECDirectRead*> ec_direct_reads; ///< by tid of original op
+  bool _submit_ec_direct_read(Op *op, shunique_lock& sul, ceph_tid_t *ptid);
+  void _finish_ec_direct_read(ECDirectRead *rd);
+  void _fallback_ec_direct_read(ceph_tid_t tid);
+  bool _cancel_ec_direct_read(ceph_tid_t tid, int r);
+  void _complete_ec_direct_read(Op *op, int r);
   // public interface
 public:
   void op_submit(Op *op, ceph_tid_t *ptid = NULL, int *ctx_budget = NULL);
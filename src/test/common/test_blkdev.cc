@@ -128,3 +128,17 @@ TEST(blkdev, is_rotational)
 }
 
 
+
+TEST(blkdev, numa_node)
+{
+  const char* env = getenv("CEPH_ROOT");
+  ASSERT_NE(env, nullptr) << "Environment Variable CEPH_ROOT not found!";
+  string root = string(env) + "/src/test/common/test_blkdev_sys_block";
+  set_block_device_sandbox_dir(root.c_str());
+
+  int node = -1;
+  ASSERT_EQ(0, block_device_numa_node("sda", &node));
+  ASSERT_EQ(1, node);
+  ASSERT_EQ(-ENOENT, block_device_numa_node("sdb", &node));
+  ASSERT_GT(0, block_device_numa_node("cciss!c0d1", &node));
+}
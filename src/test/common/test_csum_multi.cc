@@ -0,0 +1,193 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <iostream>
+#include <vector>
+#include <string.h>
+
+#include "include/types.h"
+#include "include/crc32c.h"
+#include "include/utime.h"
+#include "common/Clock.h"
+#include "common/Checksummer.h"
+#include "common/xxhash_multi.h"
+
+#include "gtest/gtest.h"
+
+static std::vector<unsigned char> random_bytes(size_t len)
+{
+  std::vector<unsigned char> v(len);
+  for (auto& c : v) {
+    c = rand();
+  }
+  return v;
+}
+
+TEST(CsumMulti, crc32c)
+{
+  auto buf = random_bytes(20 * 300);
+  for (unsigned n = 0; n <= 20; ++n) {
+    for (unsigned t = 0; t < 100; ++t) {
+      const unsigned char *data[20];
+      unsigned length[20];
+      uint32_t crc[20], expected[20];
+      for (unsigned i = 0; i < n; ++i) {
+	// unaligned, and uneven lengths in every other round
+	data[i] = &buf[i * 300 + i % 7];
+	length[i] = t % 2 ? rand() % 290 : t;
+	crc[i] = rand();
+	expected[i] = ceph_crc32c(crc[i], data[i], length[i]);
+      }
+      ceph_crc32c_multi(crc, data, length, n);
+      for (unsigned i = 0; i < n; ++i) {
+	ASSERT_EQ(expected[i], crc[i]);
+      }
+    }
+  }
+}
+
+TEST(CsumMulti, xxhash)
+{
+  auto buf = random_bytes(20 * 300);
+  for (unsigned len = 0; len < 290; ++len) {
+    for (unsigned n = 0; n <= 20; ++n) {
+      const unsigned char *data[20];
+      for (unsigned i = 0; i < n; ++i) {
+	data[i] = &buf[i * 300 + i % 7];
+      }
+      uint32_t out32[20];
+      uint64_t out64[20];
+      ceph_xxhash32_multi(len, data, len, n, out32);
+      ceph_xxhash64_multi(len, data, len, n, out64);
+      for (unsigned i = 0; i < n; ++i) {
+	ASSERT_EQ(XXH32(data[i], len, len), out32[i]);
+	ASSERT_EQ(XXH64(data[i], len, len), out64[i]);
+      }
+    }
+  }
+}
+
+template<class Alg>
+static void test_checksummer(size_t csum_block_size)
+{
+  for (unsigned t = 0; t < 50; ++t) {
+    // a mix of block aligned and straddling bufferptrs
+    bufferlist bl;
+    size_t length = csum_block_size * (1 + rand() % 40);
+    while (bl.length() < length) {
+      size_t l = std::min<size_t>(length - bl.length(),
+				  1 + rand() % (csum_block_size * 3));
+      if (t % 3 == 0) {
+	l = length - bl.length();
+      }
+      auto v = random_bytes(l);
+      bl.append(buffer::copy((const char*)v.data(), l));
+    }
+    size_t blocks = length / csum_block_size;
+    size_t vsize = sizeof(typename Alg::value_t);
+    bufferptr csum(blocks * vsize);
+    Checksummer::calculate<Alg>(csum_block_size, 0, length, bl, &csum);
+
+    auto p = bl.cbegin();
+    typename Alg::state_t state;
+    Alg::init(&state);
+    for (size_t i = 0; i < blocks; ++i) {
+      typename Alg::value_t v = Alg::calc(state, -1, csum_block_size, p);
+      ASSERT_EQ(0, memcmp(&v, csum.c_str() + i * vsize, vsize));
+    }
+    Alg::fini(&state);
+
+    ASSERT_EQ(-1, Checksummer::verify<Alg>(csum_block_size, 0, length, bl,
+					   csum));
+    size_t bad = rand() % blocks;
+    csum.c_str()[bad * vsize] ^= 1;
+    uint64_t bad_csum = 0;
+    ASSERT_EQ((int)(bad * csum_block_size),
+	      Checksummer::verify<Alg>(csum_block_size, 0, length, bl, csum,
+				       &bad_csum));
+  }
+}
+
+TEST(CsumMulti, checksummer)
+{
+  test_checksummer<Checksummer::crc32c>(4096);
+  test_checksummer<Checksummer::crc32c>(512);
+  test_checksummer<Checksummer::crc32c_16>(4096);
+  test_checksummer<Checksummer::crc32c_8>(16);
+  test_checksummer<Checksummer::xxhash32>(4096);
+  test_checksummer<Checksummer::xxhash32>(24);
+  test_checksummer<Checksummer::xxhash64>(4096);
+}
+
+TEST(CsumMulti, bufferlist)
+{
+  bufferlist a, b, c, d;
+  auto v = random_bytes(10000);
+  a.append(buffer::copy((const char*)v.data(), 3000));
+  b.append(buffer::copy((const char*)v.data() + 3000, 10));
+  c.append(buffer::copy((const char*)v.data(), 1000));
+  c.append(buffer::copy((const char*)v.data() + 5000, 5000));
+  const bufferlist *ls[4] = { &a, &b, &c, &d };
+  uint32_t crcs[4] = { 0, 1, 2, 3 };
+  bufferlist::crc32c_multi(4, ls, crcs);
+  EXPECT_EQ(a.crc32c(0), crcs[0]);
+  EXPECT_EQ(b.crc32c(1), crcs[1]);
+  EXPECT_EQ(c.crc32c(2), crcs[2]);
+  EXPECT_EQ(3u, crcs[3]);
+  // again, now hitting the crc cache
+  uint32_t again[4] = { 0, 1, 2, 3 };
+  bufferlist::crc32c_multi(4, ls, again);
+  for (unsigned i = 0; i < 4; ++i) {
+    EXPECT_EQ(crcs[i], again[i]);
+  }
+}
+
+/*
+ * microbenchmark: checksum a 4 MB blob in csum blocks, one block at a
+ * time vs. batched
+ */
+template<class Alg>
+static void bench_checksummer(const char *name, size_t csum_block_size)
+{
+  const size_t length = 4 << 20;
+  const int iterations = 100;
+  auto v = random_bytes(length);
+  bufferlist bl;
+  bl.append(buffer::copy((const char*)v.data(), length));
+  size_t blocks = length / csum_block_size;
+  bufferptr csum(blocks * sizeof(typename Alg::value_t));
+
+  utime_t start = ceph_clock_now();
+  for (int i = 0; i < iterations; ++i) {
+    auto p = bl.cbegin();
+    typename Alg::state_t state;
+    Alg::init(&state);
+    auto pv = reinterpret_cast<typename Alg::value_t*>(csum.c_str());
+    for (size_t b = 0; b < blocks; ++b) {
+      pv[b] = Alg::calc(state, -1, csum_block_size, p);
+    }
+    Alg::fini(&state);
+  }
+  utime_t end = ceph_clock_now();
+  float single = (float)length * iterations / (1024*1024) / (float)(end - start);
+
+  start = ceph_clock_now();
+  for (int i = 0; i < iterations; ++i) {
+    Checksummer::calculate<Alg>(csum_block_size, 0, length, bl, &csum);
+  }
+  end = ceph_clock_now();
+  float multi = (float)length * iterations / (1024*1024) / (float)(end - start);
+
+  std::cout << name << " " << csum_block_size << "b blocks: single = "
+	    << single << " MB/sec, batched = " << multi << " MB/sec"
+	    << std::endl;
+}
+
+TEST(CsumMulti, Performance)
+{
+  for (size_t bs : {512, 4096, 65536}) {
+    bench_checksummer<Checksummer::crc32c>("crc32c", bs);
+    bench_checksummer<Checksummer::xxhash32>("xxhash32", bs);
+    bench_checksummer<Checksummer::xxhash64>("xxhash64", bs);
+  }
+}
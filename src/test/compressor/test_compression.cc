@@ -403,6 +403,39 @@ TEST(CompressionPlugin, all)
   }
 }
 
+TEST(Compressor, estimate_entropy)
+{
+  bufferlist empty;
+  EXPECT_EQ(0.0, Compressor::estimate_entropy(empty, 4096));
+
+  bufferlist zeros;
+  zeros.append_zero(65536);
+  EXPECT_EQ(0.0, Compressor::estimate_entropy(zeros, 4096));
+
+  bufferlist text;
+  while (text.length() < 65536) {
+    text.append("the quick brown fox jumps over the lazy dog. ");
+  }
+  double e = Compressor::estimate_entropy(text, 4096);
+  EXPECT_GT(e, 3.0);
+  EXPECT_LT(e, 5.0);
+
+  // random data, fragmented across many buffers
+  srand(42);
+  bufferlist rnd;
+  for (int i = 0; i < 64; ++i) {
+    char buf[1000];
+    for (auto& c : buf) {
+      c = rand() % 256;
+    }
+    rnd.append(buf, sizeof(buf));
+  }
+  EXPECT_GT(Compressor::estimate_entropy(rnd, 16384), 7.8);
+  // a short sample, and one larger than the input
+  EXPECT_GT(Compressor::estimate_entropy(rnd, 1), 5.0);
+  EXPECT_GT(Compressor::estimate_entropy(rnd, 1 << 20), 7.9);
+}
+
 #ifdef __x86_64__
 
 TEST(ZlibCompressor, isal_compress_zlib_decompress_random)
@@ -277,6 +277,70 @@ TEST(ErasureCodeTest, encode)
   }
 }
 
+template <typename T>
+void check_parity_delta(const char *w)
+{
+  T jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  profile["w"] = w;
+  ASSERT_EQ(0, jerasure.init(profile, &cerr));
+  ASSERT_TRUE(jerasure.supports_parity_delta());
+
+  unsigned chunk_size = jerasure.get_alignment();
+  bufferlist in;
+  for (unsigned i = 0; i < chunk_size * 4; i++)
+    in.append((char)(i * 7 + 3));
+  set<int> want_to_encode;
+  for (int i = 0; i < 6; i++)
+    want_to_encode.insert(i);
+  map<int, bufferlist> encoded;
+  ASSERT_EQ(0, jerasure.encode(want_to_encode, in, &encoded));
+  ASSERT_EQ(chunk_size, encoded[0].length());
+
+  //
+  // Overwrite data chunks 1 and 3 and update the coding chunks from
+  // their delta alone, the result must match a full encode.
+  //
+  bufferlist modified;
+  modified.append(in.c_str(), chunk_size);
+  modified.append(string(chunk_size, 'X'));
+  modified.append(in.c_str() + 2 * chunk_size, chunk_size);
+  modified.append(string(chunk_size, 'Y'));
+  map<int, bufferlist> reencoded;
+  ASSERT_EQ(0, jerasure.encode(want_to_encode, modified, &reencoded));
+
+  map<int, bufferlist> deltas;
+  for (int i: { 1, 3 }) {
+    bufferlist new_data;
+    new_data.substr_of(modified, i * chunk_size, chunk_size);
+    ASSERT_EQ(0, jerasure.encode_delta(encoded[i], new_data, &deltas[i]));
+  }
+  map<int, bufferlist> coding;
+  coding[4] = encoded[4];
+  coding[5] = encoded[5];
+  ASSERT_EQ(0, jerasure.apply_delta(deltas, &coding));
+  EXPECT_TRUE(reencoded[4].contents_equal(coding[4]));
+  EXPECT_TRUE(reencoded[5].contents_equal(coding[5]));
+
+  // a coding chunk is missing
+  coding.erase(5);
+  EXPECT_EQ(-EINVAL, jerasure.apply_delta(deltas, &coding));
+}
+
+TEST(ErasureCodeTest, parity_delta)
+{
+  check_parity_delta<ErasureCodeJerasureReedSolomonVandermonde>("8");
+  check_parity_delta<ErasureCodeJerasureReedSolomonVandermonde>("16");
+  check_parity_delta<ErasureCodeJerasureReedSolomonRAID6>("8");
+
+  ErasureCodeJerasureCauchyGood cauchy;
+  EXPECT_FALSE(cauchy.supports_parity_delta());
+  map<int, bufferlist> deltas, coding;
+  EXPECT_EQ(-EOPNOTSUPP, cauchy.apply_delta(deltas, &coding));
+}
+
 TEST(ErasureCodeTest, create_rule)
 {
   std::unique_ptr<CrushWrapper> c = std::make_unique<CrushWrapper>();
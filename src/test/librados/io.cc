@@ -1323,3 +1323,126 @@ TEST_F(LibRadosIoECPP, CmpExtMismatchPP) {
   ASSERT_EQ(0, ioctx.operate("foo", &read, &bl));
   ASSERT_EQ(0, memcmp(bl.c_str(), "ceph", 4));
 }
+
+class LibRadosIoECDirectReadPP : public RadosTestECPP {
+protected:
+  void SetUp() override {
+    RadosTestECPP::SetUp();
+    // a second client, reading straight from the data shards
+    ASSERT_EQ(0, direct_cluster.init("admin"));
+    ASSERT_EQ(0, direct_cluster.conf_read_file(NULL));
+    ASSERT_EQ(0, direct_cluster.conf_parse_env(NULL));
+    ASSERT_EQ(0, direct_cluster.conf_set("objecter_ec_direct_reads", "true"));
+    ASSERT_EQ(0, direct_cluster.conf_set("objecter_ec_direct_read_min_bytes",
+					 "1"));
+    ASSERT_EQ(0, direct_cluster.connect());
+    ASSERT_EQ(0, direct_cluster.ioctx_create(pool_name.c_str(),
+					     direct_ioctx));
+    direct_ioctx.set_namespace(nspace);
+  }
+  void TearDown() override {
+    direct_ioctx.close();
+    direct_cluster.shutdown();
+    RadosTestECPP::TearDown();
+  }
+
+  static bufferlist pattern(size_t len, unsigned seed) {
+    bufferlist bl;
+    for (size_t i = 0; i < len; ++i) {
+      bl.append((char)((i + seed) % 251));
+    }
+    return bl;
+  }
+
+  librados::Rados direct_cluster;
+  librados::IoCtx direct_ioctx;
+};
+
+TEST_F(LibRadosIoECDirectReadPP, UnalignedReadPP) {
+  size_t size = alignment * 3 + 123;
+  bufferlist bl = pattern(size, 0);
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+
+  std::vector<std::pair<uint64_t, uint64_t>> extents = {
+    {0, size},
+    {1, alignment},
+    {alignment / 2 + 7, alignment + 100},
+    {alignment - 1, 2},
+    {size - 10, 10},
+    {size - 10, alignment},  // short read
+  };
+  for (auto& e : extents) {
+    bufferlist out;
+    uint64_t expect = std::min<uint64_t>(e.second, size - e.first);
+    ASSERT_EQ((int)expect, direct_ioctx.read("foo", out, e.second, e.first));
+    bufferlist want;
+    want.substr_of(bl, e.first, expect);
+    ASSERT_TRUE(want.contents_equal(out));
+  }
+
+  bufferlist out;
+  ASSERT_EQ(0, direct_ioctx.read("foo", out, alignment, size + alignment));
+  ASSERT_EQ(0U, out.length());
+}
+
+TEST_F(LibRadosIoECDirectReadPP, ReadAfterTruncatePP) {
+  // ec pools without overwrites only shrink objects through write_full,
+  // which truncates the object before writing it
+  size_t size = alignment * 4;
+  bufferlist big = pattern(size, 0);
+  ASSERT_EQ(0, ioctx.write_full("foo", big));
+  bufferlist out;
+  ASSERT_EQ((int)size, direct_ioctx.read("foo", out, size, 0));
+
+  size_t small = alignment + 17;
+  bufferlist bl = pattern(small, 1);
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+  out.clear();
+  ASSERT_EQ((int)small, direct_ioctx.read("foo", out, size, 0));
+  ASSERT_TRUE(bl.contents_equal(out));
+  out.clear();
+  ASSERT_EQ(0, direct_ioctx.read("foo", out, alignment, alignment * 2));
+
+  // the same client reads its own shrinking write
+  big = pattern(size, 2);
+  ASSERT_EQ(0, direct_ioctx.write_full("foo", big));
+  bl = pattern(small, 3);
+  ASSERT_EQ(0, direct_ioctx.write_full("foo", bl));
+  out.clear();
+  ASSERT_EQ((int)small, direct_ioctx.read("foo", out, size, 0));
+  ASSERT_TRUE(bl.contents_equal(out));
+}
+
+TEST_F(LibRadosIoECDirectReadPP, ReadWithWritesInFlightPP) {
+  size_t size = alignment * 2 + 5;
+  std::vector<bufferlist> versions;
+  versions.push_back(pattern(size, 0));
+  ASSERT_EQ(0, ioctx.write_full("foo", versions.back()));
+
+  // a read racing with a write must see the object either before or
+  // after it, never a mix of shards from both; a read issued after a
+  // write completed must see it
+  for (unsigned i = 1; i <= 20; ++i) {
+    versions.push_back(pattern(size, i));
+    // alternate between another client's writes, which the shards have
+    // to order against, and our own, which we should not read directly
+    IoCtx& wr = i % 2 ? ioctx : direct_ioctx;
+    AioCompletion *wc = librados::Rados::aio_create_completion();
+    ASSERT_EQ(0, wr.aio_write_full("foo", wc, versions.back()));
+    AioCompletion *rc = librados::Rados::aio_create_completion();
+    bufferlist racing;
+    ASSERT_EQ(0, direct_ioctx.aio_read("foo", rc, &racing, size, 0));
+    ASSERT_EQ(0, wc->wait_for_complete());
+    ASSERT_EQ(0, wc->get_return_value());
+    wc->release();
+    ASSERT_EQ(0, rc->wait_for_complete());
+    ASSERT_EQ((int)size, rc->get_return_value());
+    rc->release();
+    ASSERT_TRUE(racing.contents_equal(versions[i - 1]) ||
+		racing.contents_equal(versions[i]));
+
+    bufferlist out;
+    ASSERT_EQ((int)size, direct_ioctx.read("foo", out, size, 0));
+    ASSERT_TRUE(out.contents_equal(versions[i]));
+  }
+}
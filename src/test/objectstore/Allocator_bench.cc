@@ -329,10 +329,90 @@ TEST_P(AllocTest, test_alloc_bench_10_300)
   doOverwriteTest(capacity, prefill, overwrite);
 }
 
+TEST_P(AllocTest, test_alloc_bench_aged_fragmentation)
+{
+  // Ages the allocator with small random overwrites, then replays large
+  // allocations against the resulting free space layout.
+  uint64_t capacity = uint64_t(64) * 1024 * 1024 * 1024;
+  uint64_t alloc_unit = 4096;
+  PExtentVector tmp;
+  AllocTracker at(capacity, alloc_unit);
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+
+  gen_type rng(time(NULL));
+  boost::uniform_int<> u1(0, 4); // 4K-64K
+
+  // prefill 90% of the capacity with small extents
+  auto prefill = capacity - capacity / 10;
+  for (uint64_t i = 0; i < prefill; ) {
+    uint32_t want = alloc_unit << u1(rng);
+    tmp.clear();
+    auto r = alloc->allocate(want, alloc_unit, 0, 0, &tmp);
+    if (r < want) {
+      break;
+    }
+    i += r;
+    for (auto a : tmp) {
+      bool full = !at.push(a.offset, a.length);
+      EXPECT_EQ(full, false);
+    }
+  }
+
+  // overwrite the capacity once with random frees and small allocations
+  for (uint64_t i = 0; i < capacity; ) {
+    uint64_t o = 0;
+    uint32_t l = 0;
+    if (!at.pop_random(rng, &o, &l)) {
+      break;
+    }
+    interval_set<uint64_t> release_set;
+    release_set.insert(o, l);
+    alloc->release(release_set);
+
+    uint32_t want = alloc_unit << u1(rng);
+    tmp.clear();
+    auto r = alloc->allocate(want, alloc_unit, 0, 0, &tmp);
+    if (r < want) {
+      break;
+    }
+    i += r;
+    for (auto a : tmp) {
+      bool full = !at.push(a.offset, a.length);
+      EXPECT_EQ(full, false);
+    }
+  }
+  std::cout << "Aged: avail " << alloc->get_free() / _1m << " MB"
+	    << " fragmentation " << alloc->get_fragmentation(alloc_unit)
+	    << " score " << alloc->get_fragmentation_score() << std::endl;
+
+  // replay large writes: how many extents and how long does it take
+  // to hand out half of the remaining free space in 4M chunks
+  uint64_t extents = 0;
+  uint64_t allocated = 0;
+  auto target = alloc->get_free() / 2;
+  utime_t start = ceph_clock_now();
+  while (allocated < target) {
+    tmp.clear();
+    auto r = alloc->allocate(4 * _1m, alloc_unit, 0, 0, &tmp);
+    if (r <= 0) {
+      break;
+    }
+    allocated += r;
+    extents += tmp.size();
+  }
+  std::cout << "Large allocations executed in " << ceph_clock_now() - start
+	    << ", " << allocated / _1m << " MB in " << extents << " extents"
+	    << std::endl;
+  std::cout << "Final score " << alloc->get_fragmentation_score() << std::endl;
+  dump_mempools();
+}
+
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl", "hybrid"));
 
 #else
 
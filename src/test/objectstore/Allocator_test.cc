@@ -316,10 +316,72 @@ TEST_P(AllocTest, test_alloc_bug_24598)
   EXPECT_EQ(tmp.size(), 1);
 }
 
+TEST_P(AllocTest, test_alloc_fragmentation_score)
+{
+  uint64_t capacity = 4 * 1024 * 1024;
+  uint64_t alloc_unit = 4096;
+  PExtentVector allocated, tmp;
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+  // a single free extent
+  EXPECT_EQ(0.0, alloc->get_fragmentation_score());
+
+  for (size_t i = 0; i < capacity / alloc_unit; ++i) {
+    tmp.clear();
+    EXPECT_EQ((int64_t)alloc_unit,
+	      alloc->allocate(alloc_unit, alloc_unit, 0, 0, &tmp));
+    allocated.insert(allocated.end(), tmp.begin(), tmp.end());
+  }
+  // nothing free
+  EXPECT_EQ(0.0, alloc->get_fragmentation_score());
+
+  uint64_t free_extents = 0;
+  for (size_t i = 0; i < allocated.size(); i += 2) {
+    interval_set<uint64_t> release_set;
+    release_set.insert(allocated[i].offset, allocated[i].length);
+    alloc->release(release_set);
+  }
+  alloc->dump([&](uint64_t offset, uint64_t length) {
+    EXPECT_EQ(alloc_unit, length);
+    ++free_extents;
+  });
+  EXPECT_EQ(allocated.size() / 2, free_extents);
+  // 512 4K extents vs. a single 2M one
+  double score = alloc->get_fragmentation_score();
+  EXPECT_LT(0.66, score);
+  EXPECT_GT(0.67, score);
+}
+
+TEST_P(AllocTest, test_alloc_hint)
+{
+  uint64_t capacity = 16 * 1024 * 1024;
+  uint64_t alloc_unit = 4096;
+  uint64_t want = 64 * 1024;
+  PExtentVector tmp;
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+
+  // the upper half
+  uint64_t hint = capacity / 2;
+  EXPECT_EQ((int64_t)want, alloc->allocate(want, alloc_unit, 0, hint, &tmp));
+  for (auto& e : tmp) {
+    EXPECT_LE(hint, e.offset);
+  }
+  // and back to the lower one
+  tmp.clear();
+  hint = alloc_unit;
+  EXPECT_EQ((int64_t)want, alloc->allocate(want, alloc_unit, 0, hint, &tmp));
+  for (auto& e : tmp) {
+    EXPECT_GT(capacity / 2, e.offset);
+  }
+}
+
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl", "hybrid"));
 
 #else
 
@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include "global/global_context.h"
+#include "os/bluestore/HybridAllocator.h"
+
+class TestHybridAllocator : public HybridAllocator {
+public:
+  // cap the range tree at max_entries segments
+  TestHybridAllocator(CephContext* cct,
+                      int64_t device_size,
+                      int64_t _block_size,
+                      uint64_t max_entries)
+    : HybridAllocator(cct, device_size, _block_size,
+                      max_entries * sizeof(range_seg_t)) {
+  }
+
+  uint64_t get_bmap_free() {
+    return HybridAllocator::get_bmap_free();
+  }
+  uint64_t get_avl_free() {
+    return HybridAllocator::get_avl_free();
+  }
+  bool has_bmap() {
+    return get_bmap() != nullptr;
+  }
+};
+
+const uint64_t _1m = 1024 * 1024;
+const uint64_t _4k = 4096;
+
+TEST(HybridAllocator, spillover)
+{
+  TestHybridAllocator ha(g_ceph_context, 64 * _1m, _4k, 4);
+
+  ha.init_add_free(8 * _4k, _4k);
+  ha.init_add_free(4 * _4k, _4k);
+  ha.init_add_free(6 * _4k, _4k);
+  ha.init_add_free(2 * _4k, _4k);
+  ASSERT_EQ(4 * _4k, ha.get_free());
+  ASSERT_FALSE(ha.has_bmap());
+
+  // same length as the shortest one in the tree, goes to bitmap
+  ha.init_add_free(0, _4k);
+  ASSERT_TRUE(ha.has_bmap());
+  ASSERT_EQ(4 * _4k, ha.get_avl_free());
+  ASSERT_EQ(_4k, ha.get_bmap_free());
+
+  // longer extent evicts the shortest one with the lowest offset
+  ha.init_add_free(16 * _4k, 2 * _4k);
+  ASSERT_EQ(5 * _4k, ha.get_avl_free());
+  ASSERT_EQ(2 * _4k, ha.get_bmap_free());
+  ASSERT_EQ(7 * _4k, ha.get_free());
+
+  PExtentVector extents;
+  // served by the tree (best-fit)
+  EXPECT_EQ((int64_t)(2 * _4k), ha.allocate(2 * _4k, _4k, 0, 0, &extents));
+  ASSERT_EQ(1u, extents.size());
+  EXPECT_EQ(16 * _4k, extents[0].offset);
+  EXPECT_EQ(2 * _4k, extents[0].length);
+  ASSERT_EQ(3 * _4k, ha.get_avl_free());
+
+  // drains the tree and completes from the bitmap
+  extents.clear();
+  EXPECT_EQ((int64_t)(5 * _4k), ha.allocate(5 * _4k, _4k, 0, 0, &extents));
+  ASSERT_EQ(0u, ha.get_free());
+  EXPECT_EQ(-ENOSPC, ha.allocate(_4k, _4k, 0, 0, &extents));
+
+  interval_set<uint64_t> release_set;
+  for (auto& e : extents) {
+    release_set.insert(e.offset, e.length);
+  }
+  ha.release(release_set);
+  ASSERT_EQ(5 * _4k, ha.get_free());
+}
+
+TEST(HybridAllocator, init_rm_free_across)
+{
+  TestHybridAllocator ha(g_ceph_context, 64 * _1m, _4k, 4);
+
+  ha.init_add_free(2 * _4k, _4k);
+  ha.init_add_free(4 * _4k, _4k);
+  ha.init_add_free(6 * _4k, _4k);
+  ha.init_add_free(10 * _4k, _4k);
+  // spills over
+  ha.init_add_free(8 * _4k, _4k);
+  // merges with 10 * _4k in the tree
+  ha.init_add_free(9 * _4k, _4k);
+  ASSERT_EQ(5 * _4k, ha.get_avl_free());
+  ASSERT_EQ(_4k, ha.get_bmap_free());
+
+  // free space at [8, 11) blocks is split between bitmap and tree
+  ha.init_rm_free(8 * _4k, 3 * _4k);
+  ASSERT_EQ(3 * _4k, ha.get_avl_free());
+  ASSERT_EQ(0u, ha.get_bmap_free());
+}
+
+TEST(HybridAllocator, dump)
+{
+  TestHybridAllocator ha(g_ceph_context, 64 * _1m, _4k, 2);
+
+  ha.init_add_free(0, _4k);
+  ha.init_add_free(2 * _4k, 2 * _4k);
+  ha.init_add_free(8 * _4k, 4 * _4k);
+  ASSERT_TRUE(ha.has_bmap());
+
+  uint64_t total = 0;
+  size_t count = 0;
+  ha.dump([&](uint64_t offset, uint64_t length) {
+    total += length;
+    ++count;
+  });
+  EXPECT_EQ(7 * _4k, total);
+  EXPECT_EQ(3u, count);
+}
@@ -5715,6 +5715,72 @@ TEST_P(StoreTest, BluestoreOnOffCSumTest) {
     ASSERT_EQ(r, 0);
   }
 }
+
+TEST_P(StoreTest, BluestoreVerifyChecksumsTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_csum_type", "crc32c");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  ghobject_t hoid3(hobject_t(sobject_t("Object 3", CEPH_NOSNAP)));
+  size_t len = 256*1024;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(len, 'a'));
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    cerr << "Write protected data" << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    SetVal(g_conf(), "bluestore_csum_type", "none");
+    g_conf().apply_changes(nullptr);
+
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(len, 'b'));
+    t.write(cid, hoid2, 0, bl.length(), bl);
+    cerr << "Write unprotected data" << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    SetVal(g_conf(), "bluestore_csum_type", "crc32c");
+    g_conf().apply_changes(nullptr);
+  }
+  // remount so that nothing is served from the buffer cache
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+  ch = store->open_collection(cid);
+
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, 0, len));
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, 4096, 8192));
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, len, 4096));
+  ASSERT_EQ(-EOPNOTSUPP, store->verify_checksums(ch, hoid2, 0, len));
+  ASSERT_EQ(-ENOENT, store->verify_checksums(ch, hoid3, 0, len));
+
+  store->inject_data_error(hoid);
+  ASSERT_EQ(-EIO, store->verify_checksums(ch, hoid, 0, len));
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
 #endif
 
 INSTANTIATE_TEST_CASE_P(
@@ -6459,6 +6525,178 @@ TEST_P(StoreTestSpecificAUSize, SmallWriteOnShardedExtents) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, OnodeDeltaUpdates) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_max_blob_size", "4096");
+  SetVal(g_conf(), "bluestore_extent_map_shard_max_size", "300");
+  SetVal(g_conf(), "bluestore_extent_map_shard_target_size", "150");
+  SetVal(g_conf(), "bluestore_extent_map_shard_min_size", "60");
+  SetVal(g_conf(), "bluestore_onode_delta_max", "8");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  const unsigned blocks = 256;
+  bufferlist expected;
+  {
+    // one blob per block, enough of them to get the extent map sharded
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < blocks; ++i) {
+      bufferlist bl;
+      bl.append(std::string(block_size, 'a' + i % 26));
+      t.write(cid, hoid, i * block_size, bl.length(), bl);
+      expected.append(bl);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto deltas = logger->get(l_bluestore_onode_delta);
+  for (unsigned i = 0; i < 32; ++i) {
+    // small overwrites touching one shard at a time
+    ObjectStore::Transaction t;
+    unsigned off = ((i * 37) % blocks) * block_size;
+    bufferlist bl, tail;
+    bl.append(std::string(block_size, 'A' + i % 26));
+    t.write(cid, hoid, off, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    bufferlist head;
+    head.substr_of(expected, 0, off);
+    tail.substr_of(expected, off + block_size,
+		   expected.length() - off - block_size);
+    expected.clear();
+    expected.claim_append(head);
+    expected.append(bl);
+    expected.claim_append(tail);
+  }
+  ASSERT_GT(logger->get(l_bluestore_onode_delta), deltas);
+
+  // reload the onode from the (partially stale) onode key + shards
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+  ch = store->open_collection(cid);
+  {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, expected.length(), bl);
+    ASSERT_EQ(r, (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+}
+
+TEST_P(StoreTestSpecificAUSize, ExtentMapManyShards) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_max_blob_size", "4096");
+  SetVal(g_conf(), "bluestore_extent_map_shard_max_size", "300");
+  SetVal(g_conf(), "bluestore_extent_map_shard_target_size", "150");
+  SetVal(g_conf(), "bluestore_extent_map_shard_min_size", "60");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // one blob per block, each tagged with its number, so that the extent
+  // map is cut into many shards and a misplaced extent shows in the data
+  const unsigned blocks = 1024;
+  bufferlist expected;
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < blocks; ++i) {
+      bufferlist bl;
+      char tag[9];
+      snprintf(tag, sizeof(tag), "%08u", i);
+      for (unsigned j = 0; j < block_size / 8; ++j) {
+	bl.append(tag, 8);
+      }
+      t.write(cid, hoid, i * block_size, bl.length(), bl);
+      expected.append(bl);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  auto remount = [&]() {
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(r, 0);
+    r = store->mount();
+    ASSERT_EQ(r, 0);
+    ch = store->open_collection(cid);
+  };
+  // reads straddling a block boundary, each faults in at most two shards
+  auto check = [&](unsigned i) {
+    uint64_t off = i * block_size + block_size / 2;
+    uint64_t len = std::min<uint64_t>(block_size, expected.length() - off);
+    bufferlist bl, want;
+    r = store->read(ch, hoid, off, len, bl);
+    ASSERT_EQ(r, (int)len);
+    want.substr_of(expected, off, len);
+    ASSERT_TRUE(bl_eq(want, bl));
+  };
+
+  // fault shards in a scattered order: each decoded shard lands between
+  // already loaded ones
+  remount();
+  auto misses = logger->get(l_bluestore_onode_shard_misses);
+  for (unsigned i = 0; i < blocks; ++i) {
+    check((i * 37) % blocks);
+  }
+  ASSERT_GT(logger->get(l_bluestore_onode_shard_misses), misses + 16);
+
+  // and from the end backwards: each one lands before all the others
+  remount();
+  for (unsigned i = blocks; i > 0; --i) {
+    check(i - 1);
+  }
+  {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, expected.length(), bl);
+    ASSERT_EQ(r, (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+}
+
 TEST_P(StoreTestSpecificAUSize, ExcessiveFragmentation) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -6985,44 +7223,509 @@ TEST_P(StoreTest, BluestoreRepairTest) {
   cerr << "Completing" << std::endl;
   bstore->mount();
 }
-TEST_P(StoreTest, BluestoreStatistics) {
+TEST_P(StoreTest, BluestoreParallelFsck) {
   if (string(GetParam()) != "bluestore")
     return;
+  SetVal(g_conf(), "bluestore_fsck_on_mount", "false");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  SetVal(g_conf(), "bluestore_extent_map_shard_max_size", "1200");
+  g_ceph_context->_conf.apply_changes(nullptr);
 
-  SetVal(g_conf(), "rocksdb_perf", "true");
-  SetVal(g_conf(), "rocksdb_collect_compaction_stats", "true");
-  SetVal(g_conf(), "rocksdb_collect_extended_stats","true");
-  SetVal(g_conf(), "rocksdb_collect_memory_stats","true");
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
 
-  // disable cache
-  SetVal(g_conf(), "bluestore_cache_size_ssd", "0");
-  SetVal(g_conf(), "bluestore_cache_size_hdd", "0");
-  SetVal(g_conf(), "bluestore_cache_size", "0");
+  coll_t cid(spg_t(pg_t(0,555), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  bl.append(string(4096, 'a'));
+  for (unsigned i = 0; i < 500; ++i) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					CEPH_NOSNAP)));
+    // sparse writes make some of the objects sharded
+    for (unsigned j = 0; j < (i % 8) + 1; ++j) {
+      t.write(cid, hoid, j * 0x10000, bl.length(), bl);
+    }
+    if (i % 3 == 0) {
+      map<string, bufferlist> m;
+      m["key"] = bl;
+      t.omap_setkeys(cid, hoid, m);
+    }
+    if (i % 50 == 0) {
+      ghobject_t clone = hoid;
+      clone.hobj.snap = 1;
+      t.clone(cid, hoid, clone);
+    }
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  bstore->umount();
+
+  for (auto threads : {"1", "4"}) {
+    SetVal(g_conf(), "bluestore_fsck_threads", threads);
+    g_ceph_context->_conf.apply_changes(nullptr);
+    ASSERT_EQ(bstore->fsck(false), 0);
+    ASSERT_EQ(bstore->fsck(true), 0);
+  }
+
+  // errors found after the walk are unaffected by the number of threads
+  bstore->mount();
+  bstore->inject_leaked(0x30000);
+  bstore->umount();
+  SetVal(g_conf(), "bluestore_fsck_threads", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(bstore->fsck(false), 1);
+  SetVal(g_conf(), "bluestore_fsck_threads", "4");
   g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(bstore->fsck(false), 1);
+  ASSERT_EQ(bstore->repair(false), 0);
+  ASSERT_EQ(bstore->fsck(false), 0);
 
-  int r = store->umount();
-  ASSERT_EQ(r, 0);
-  r = store->mount();
-  ASSERT_EQ(r, 0);
+  SetVal(g_conf(), "bluestore_fsck_threads", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  bstore->mount();
+}
 
-  BlueStore* bstore = NULL;
-  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+TEST_P(StoreTest, BluestoreAllocSnapshotTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_alloc_snapshot", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
 
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
   coll_t cid;
-  ghobject_t hoid(hobject_t("test_db_statistics", "", CEPH_NOSNAP, 0, 0, ""));
-  auto ch = bstore->create_new_collection(cid);
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
   bufferlist bl;
-  bl.append("0123456789abcdefghi");
+  bl.append(std::string(65536, 'a'));
+  const unsigned count = 32;
+  auto make_oid = [](unsigned round, unsigned i) {
+    return ghobject_t(hobject_t(sobject_t(
+      "Object " + stringify(round) + "." + stringify(i), CEPH_NOSNAP)));
+  };
+  // round 0 is written on the freelist-built allocator, later rounds
+  // on the allocator restored from the snapshot; every other object of
+  // the previous round is removed to leave holes for the next one
+  for (unsigned round = 0; round < 3; ++round) {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; round > 0 && i < count; i += 2) {
+      t.remove(cid, make_oid(round - 1, i));
+    }
+    for (unsigned i = 0; i < count; ++i) {
+      t.write(cid, make_oid(round, i), 0, bl.length(), bl);
+    }
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(r, 0);
+    r = store->mount();
+    ASSERT_EQ(r, 0);
+    ch = store->open_collection(cid);
+  }
+  for (unsigned round = 0; round < 3; ++round) {
+    for (unsigned i = 0; i < count; ++i) {
+      if (round < 2 && i % 2 == 0) {
+	continue;
+      }
+      bufferlist readback;
+      int r = store->read(ch, make_oid(round, i), 0, bl.length(), readback);
+      ASSERT_EQ(r, (int)bl.length());
+      ASSERT_TRUE(bl_eq(bl, readback));
+    }
+  }
+  ch.reset();
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTest, BluestoreReadZeroCopy) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_compression_mode", "none");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  bufferlist bl;
+  bl.append(std::string(65536, 'a'));
   {
     ObjectStore::Transaction t;
     t.create_collection(cid, 0);
-    t.touch(cid, hoid);
     t.write(cid, hoid, 0, bl.length(), bl);
-    cerr << "Write object" << std::endl;
-    r = queue_transaction(bstore, ch, std::move(t));
+    int r = queue_transaction(store, ch, std::move(t));
     ASSERT_EQ(r, 0);
   }
-  {
+  // drop the buffers cached by the write
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+
+  auto zc = logger->get(l_bluestore_read_zerocopy_bytes);
+  auto copied = logger->get(l_bluestore_read_copy_bytes);
+  bufferlist from_disk, from_cache;
+  int r = store->read(ch, hoid, 0, bl.length(), from_disk,
+		      CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+  ASSERT_EQ(r, (int)bl.length());
+  ASSERT_TRUE(bl_eq(bl, from_disk));
+  r = store->read(ch, hoid, 0, bl.length(), from_cache);
+  ASSERT_EQ(r, (int)bl.length());
+  ASSERT_TRUE(bl_eq(bl, from_cache));
+  // the cached read hands out the very buffer the device read filled
+  ASSERT_EQ(from_disk.front().c_str(), from_cache.front().c_str());
+  ASSERT_EQ(logger->get(l_bluestore_read_zerocopy_bytes), zc + 2 * bl.length());
+  ASSERT_EQ(logger->get(l_bluestore_read_copy_bytes), copied);
+
+  // holes are still zero filled
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 2 * bl.length(), bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto copies = logger->get(l_bluestore_read_copies);
+  copied = logger->get(l_bluestore_read_copy_bytes);
+  bufferlist with_hole;
+  r = store->read(ch, hoid, 0, 3 * bl.length(), with_hole);
+  ASSERT_EQ(r, 3 * (int)bl.length());
+  ASSERT_EQ(logger->get(l_bluestore_read_copy_bytes), copied + bl.length());
+  ASSERT_EQ(logger->get(l_bluestore_read_copies), copies + 1);
+}
+
+TEST_P(StoreTest, BluestoreTierPlacement) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_tier_placement", "true");
+  SetVal(g_conf(), "bluestore_tier_fast_zone_ratio", ".5");
+  SetVal(g_conf(), "bluestore_tier_hot_threshold", "4");
+  SetVal(g_conf(), "bluestore_tier_decay_interval", "3600");
+  SetVal(g_conf(), "bluestore_tier_migrate_max_bytes", "1048576");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  bufferlist bl;
+  bl.append(std::string(256 * 1024, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // first write lands in the slow zone; reads heat the object up
+  auto hot_allocs = logger->get(l_bluestore_tier_hot_allocs);
+  auto migrated = logger->get(l_bluestore_tier_migrated_bytes);
+  for (unsigned i = 0; i < 4; ++i) {
+    bufferlist readback;
+    int r = store->read(ch, hoid, 0, bl.length(), readback);
+    ASSERT_EQ(r, (int)bl.length());
+  }
+  // an overwrite now allocates from the fast zone and drags the rest
+  // of the object along
+  bufferlist small;
+  small.append(std::string(65536, 'b'));
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, small.length(), small);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_GT(logger->get(l_bluestore_tier_hot_allocs), hot_allocs);
+  ASSERT_GT(logger->get(l_bluestore_tier_migrated_bytes), migrated);
+
+  bufferlist expected;
+  expected.append(small);
+  expected.append(std::string(bl.length() - small.length(), 'a'));
+  {
+    bufferlist readback;
+    int r = store->read(ch, hoid, 0, expected.length(), readback);
+    ASSERT_EQ(r, (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, readback));
+  }
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  {
+    bufferlist readback;
+    int r = store->read(ch, hoid, 0, expected.length(), readback);
+    ASSERT_EQ(r, (int)expected.length());
+    ASSERT_TRUE(bl_eq(expected, readback));
+  }
+}
+
+TEST_P(StoreTest, BluestoreTierReadHeatMigration) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_tier_placement", "true");
+  SetVal(g_conf(), "bluestore_tier_fast_zone_ratio", ".5");
+  SetVal(g_conf(), "bluestore_tier_hot_threshold", "4");
+  SetVal(g_conf(), "bluestore_tier_decay_interval", "3600");
+  SetVal(g_conf(), "bluestore_tier_migrate_max_bytes", "0");
+  SetVal(g_conf(), "bluestore_defrag_interval", "1");
+  SetVal(g_conf(), "bluestore_defrag_busy_bytes", "0");
+  SetVal(g_conf(), "bluestore_defrag_bytes_per_sec", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  // the defrag thread picks up the interval when it starts
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  bufferlist bl;
+  bl.append(std::string(256 * 1024, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // cold data lands in the slow zone; reads alone make the object hot
+  // and the background pass moves it without any further write
+  auto migrated = logger->get(l_bluestore_tier_migrated_bytes);
+  for (unsigned i = 0; i < 8; ++i) {
+    bufferlist readback;
+    int r = store->read(ch, hoid, 0, bl.length(), readback);
+    ASSERT_EQ(r, (int)bl.length());
+  }
+  for (unsigned i = 0; i < 300; ++i) {
+    if (logger->get(l_bluestore_tier_migrated_bytes) > migrated)
+      break;
+    usleep(100000);
+  }
+  ASSERT_GT(logger->get(l_bluestore_tier_migrated_bytes), migrated);
+  {
+    bufferlist readback;
+    int r = store->read(ch, hoid, 0, bl.length(), readback);
+    ASSERT_EQ(r, (int)bl.length());
+    ASSERT_TRUE(bl_eq(bl, readback));
+  }
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTest, BluestoreKVSyncLanes) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_kv_sync_lanes", "4");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+
+  const unsigned num_colls = 8;
+  const unsigned num_objs = 32;
+  vector<coll_t> cids;
+  vector<ObjectStore::CollectionHandle> chs;
+  for (unsigned i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(i, 1), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    cids.push_back(cid);
+    chs.push_back(ch);
+  }
+  // small overwrites (deferred), appends (aio) and omap-only updates,
+  // interleaved across sequencers so every lane has work
+  for (unsigned j = 0; j < num_objs; ++j) {
+    for (unsigned i = 0; i < num_colls; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(j),
+					  CEPH_NOSNAP)));
+      bufferlist bl;
+      bl.append(string(4096, 'a' + (i + j) % 26));
+      ObjectStore::Transaction t;
+      t.write(cids[i], hoid, 0, bl.length(), bl);
+      t.write(cids[i], hoid, 0x10000 * (j % 4 + 1), bl.length(), bl);
+      map<string, bufferlist> m;
+      m["key"] = bl;
+      t.omap_setkeys(cids[i], hoid, m);
+      store->queue_transaction(chs[i], std::move(t));
+    }
+  }
+  for (unsigned i = 0; i < num_colls; ++i) {
+    chs[i]->flush();
+  }
+  for (unsigned j = 0; j < num_objs; ++j) {
+    for (unsigned i = 0; i < num_colls; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(j),
+					  CEPH_NOSNAP)));
+      bufferlist expected, readback;
+      expected.append(string(4096, 'a' + (i + j) % 26));
+      int r = store->read(chs[i], hoid, 0, expected.length(), readback);
+      ASSERT_EQ(r, (int)expected.length());
+      ASSERT_TRUE(bl_eq(expected, readback));
+    }
+  }
+  chs.clear();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  SetVal(g_conf(), "bluestore_kv_sync_lanes", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTest, BluestoreInlineData) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_inline_data_max_size", "4096");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  // inline data is only enabled at mount
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  struct store_statfs_t statfs0;
+  ASSERT_EQ(store->statfs(&statfs0), 0);
+  auto inline_writes = logger->get(l_bluestore_write_inline);
+
+  // expected content of hoid as we go
+  std::string expected(1000, 'a');
+  {
+    bufferlist bl;
+    bl.append(expected);
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    bufferlist o;
+    o.append(std::string(100, 'b'));
+    t.write(cid, hoid, 500, o.length(), o);
+    t.zero(cid, hoid, 900, 200);
+    t.truncate(cid, hoid, 2000);
+    t.clone(cid, hoid, hoid2);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected.replace(500, 100, std::string(100, 'b'));
+    expected.replace(900, 100, std::string(100, '\0'));
+    expected.append(std::string(1000, '\0'));
+  }
+  ASSERT_EQ(logger->get(l_bluestore_write_inline), inline_writes + 3);
+  {
+    struct store_statfs_t statfs;
+    ASSERT_EQ(store->statfs(&statfs), 0);
+    ASSERT_EQ(statfs.allocated, statfs0.allocated);
+  }
+  auto check = [&](const ghobject_t& oid) {
+    bufferlist readback;
+    int r = store->read(ch, oid, 0, expected.size(), readback);
+    ASSERT_EQ(r, (int)expected.size());
+    ASSERT_EQ(expected, readback.to_str());
+    readback.clear();
+    r = store->read(ch, oid, 450, 100, readback);
+    ASSERT_EQ(r, 100);
+    ASSERT_EQ(expected.substr(450, 100), readback.to_str());
+  };
+  check(hoid);
+  check(hoid2);
+
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  check(hoid);
+  check(hoid2);
+
+  // growing past the limit moves the data to a blob
+  auto promoted = logger->get(l_bluestore_inline_promote);
+  {
+    bufferlist bl;
+    bl.append(std::string(8192, 'c'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 4096, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected.append(std::string(4096 - expected.size(), '\0'));
+    expected.append(bl.to_str());
+  }
+  ASSERT_EQ(logger->get(l_bluestore_inline_promote), promoted + 1);
+  check(hoid);
+
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  check(hoid);
+}
+
+TEST_P(StoreTest, BluestoreStatistics) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "rocksdb_perf", "true");
+  SetVal(g_conf(), "rocksdb_collect_compaction_stats", "true");
+  SetVal(g_conf(), "rocksdb_collect_extended_stats","true");
+  SetVal(g_conf(), "rocksdb_collect_memory_stats","true");
+
+  // disable cache
+  SetVal(g_conf(), "bluestore_cache_size_ssd", "0");
+  SetVal(g_conf(), "bluestore_cache_size_hdd", "0");
+  SetVal(g_conf(), "bluestore_cache_size", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+
+  BlueStore* bstore = NULL;
+  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test_db_statistics", "", CEPH_NOSNAP, 0, 0, ""));
+  auto ch = bstore->create_new_collection(cid);
+  bufferlist bl;
+  bl.append("0123456789abcdefghi");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.touch(cid, hoid);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    cerr << "Write object" << std::endl;
+    r = queue_transaction(bstore, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
     bufferlist readback;
     r = store->read(ch, hoid, 0, bl.length(), readback);
     ASSERT_EQ(r, bl.length());
@@ -7033,6 +7736,492 @@ TEST_P(StoreTest, BluestoreStatistics) {
   f->flush(cout);
   cout << std::endl;
 }
+
+TEST_P(StoreTest, BluestoreCachePriority) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  coll_t cid(spg_t(pg_t(0, 7), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  bl.append(std::string(8192, 'a'));
+  auto write_and_check = [&](unsigned first, unsigned n) {
+    ObjectStore::Transaction t;
+    for (unsigned i = first; i < first + n; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+      t.write(cid, hoid, 0, bl.length(), bl);
+    }
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    for (unsigned i = 0; i < first + n; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+      bufferlist readback;
+      r = store->read(ch, hoid, 0, bl.length(), readback);
+      ASSERT_EQ(r, (int)bl.length());
+      ASSERT_TRUE(bl_eq(bl, readback));
+    }
+  };
+  write_and_check(0, 10);
+
+  // move the collection, with cached onodes and buffers, to the priority
+  // shards and back again
+  pool_opts_t opts;
+  opts.set(pool_opts_t::CACHE_PRIORITY, static_cast<int>(1));
+  ASSERT_EQ(0, store->set_collection_opts(ch, opts));
+  write_and_check(10, 10);
+
+  opts.unset(pool_opts_t::CACHE_PRIORITY);
+  ASSERT_EQ(0, store->set_collection_opts(ch, opts));
+  write_and_check(20, 10);
+
+  // a collection created while its pool is in the priority class
+  opts.set(pool_opts_t::CACHE_PRIORITY, static_cast<int>(1));
+  ASSERT_EQ(0, store->set_collection_opts(ch, opts));
+  coll_t cid2(spg_t(pg_t(1, 7), shard_id_t::NO_SHARD));
+  auto ch2 = store->create_new_collection(cid2);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid2, 0);
+    ghobject_t hoid(hobject_t(sobject_t("obj", CEPH_NOSNAP)));
+    t.write(cid2, hoid, 0, bl.length(), bl);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // umount flushes and checks every cache shard
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+}
+
+TEST_P(StoreTest, BluestoreCachePriorityUnderLoad) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // keep written buffers cached, so that every commit adds them to the
+  // collection's cache shard of the moment
+  SetVal(g_conf(), "bluestore_default_buffered_write", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  coll_t cid(spg_t(pg_t(0, 7), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  const unsigned num_objects = 16;
+  bufferlist bl;
+  bl.append(std::string(4096, 'a'));
+  pool_opts_t opts;
+  for (unsigned round = 0; round < 200; ++round) {
+    // flip the pool's cache class while these writes are in flight
+    for (unsigned i = 0; i < 8; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t(
+	"obj" + stringify(rand() % num_objects), CEPH_NOSNAP)));
+      ObjectStore::Transaction t;
+      t.write(cid, hoid, (rand() % 16) * bl.length(), bl.length(), bl);
+      int r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    if (round % 2) {
+      opts.unset(pool_opts_t::CACHE_PRIORITY);
+    } else {
+      opts.set(pool_opts_t::CACHE_PRIORITY, static_cast<int>(1));
+    }
+    ASSERT_EQ(0, store->set_collection_opts(ch, opts));
+  }
+  {
+    C_SaferCond done;
+    ObjectStore::Transaction t;
+    t.register_on_commit(&done);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    done.wait();
+  }
+  for (unsigned i = 0; i < num_objects; ++i) {
+    ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+    struct stat st;
+    if (store->stat(ch, hoid, &st) < 0) {
+      continue;
+    }
+    for (uint64_t off = 0; off < (uint64_t)st.st_size; off += bl.length()) {
+      bufferlist readback;
+      int r = store->read(ch, hoid, off, bl.length(), readback);
+      ASSERT_EQ(r, (int)bl.length());
+      // holes read back as zeros
+      bufferlist zeros;
+      zeros.append_zero(bl.length());
+      ASSERT_TRUE(bl_eq(bl, readback) || bl_eq(zeros, readback));
+    }
+  }
+
+  // umount flushes and checks every cache shard: a buffer left behind in
+  // the old shard trips its accounting
+  ch.reset();
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+}
+
+TEST_P(StoreTest, BluestoreIsCached) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("obj", CEPH_NOSNAP)));
+  ghobject_t missing(hobject_t(sobject_t("missing", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  bufferlist bl;
+  bl.append(std::string(65536, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // the probe must neither promote anything in the cache nor count as
+  // a hit or a miss
+  const PerfCounters* logger = store->get_perf_counters();
+  auto counters = [&]() {
+    return std::make_tuple(logger->get(l_bluestore_onode_hits),
+			   logger->get(l_bluestore_onode_misses),
+			   logger->get(l_bluestore_buffer_hit_bytes),
+			   logger->get(l_bluestore_buffer_miss_bytes));
+  };
+  auto before = counters();
+  EXPECT_TRUE(store->is_cached(ch, hoid, 0, 0));
+  EXPECT_FALSE(store->is_cached(ch, missing, 0, 0));
+  store->is_cached(ch, hoid, 0, bl.length());
+  EXPECT_EQ(before, counters());
+
+  ch.reset();
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+  ch = store->open_collection(cid);
+
+  before = counters();
+  EXPECT_FALSE(store->is_cached(ch, hoid, 0, 0));
+  EXPECT_EQ(before, counters());
+
+  // a read fills the cache
+  bufferlist readback;
+  r = store->read(ch, hoid, 0, bl.length(), readback);
+  ASSERT_EQ(r, (int)bl.length());
+  ASSERT_TRUE(bl_eq(bl, readback));
+  before = counters();
+  EXPECT_TRUE(store->is_cached(ch, hoid, 0, 0));
+  EXPECT_TRUE(store->is_cached(ch, hoid, 0, bl.length()));
+  EXPECT_TRUE(store->is_cached(ch, hoid, 4096, 8192));
+  // past the end of the object there is nothing to read
+  EXPECT_TRUE(store->is_cached(ch, hoid, bl.length(), 4096));
+  EXPECT_EQ(before, counters());
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, BluestoreDefrag) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_max_blob_size", "65536");
+  SetVal(g_conf(), "bluestore_inline_data_max_size", "0");
+  SetVal(g_conf(), "bluestore_defrag_enable", "true");
+  SetVal(g_conf(), "bluestore_defrag_interval", "1");
+  SetVal(g_conf(), "bluestore_defrag_min_score", "4");
+  SetVal(g_conf(), "bluestore_defrag_busy_bytes", "0");
+  SetVal(g_conf(), "bluestore_defrag_bytes_per_sec", "0");
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // interleaved appends leave each object in 4k pieces on disk
+  const unsigned num_blocks = 64;
+  ghobject_t hoid[2] = {
+    ghobject_t(hobject_t(sobject_t("Object 1", CEPH_NOSNAP))),
+    ghobject_t(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)))
+  };
+  bufferlist expected[2];
+  for (unsigned i = 0; i < num_blocks; ++i) {
+    for (unsigned j = 0; j < 2; ++j) {
+      bufferlist bl;
+      bl.append(string(block_size, 'a' + (i + j) % 26));
+      ObjectStore::Transaction t;
+      t.write(cid, hoid[j], i * block_size, bl.length(), bl);
+      int r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+      expected[j].append(bl);
+    }
+  }
+  const PerfCounters* logger = store->get_perf_counters();
+  for (unsigned i = 0;
+       i < 30 && logger->get(l_bluestore_defrag_rewritten) < 2;
+       ++i) {
+    sleep(1);
+  }
+  ASSERT_GE(logger->get(l_bluestore_defrag_rewritten), 2u);
+  for (unsigned j = 0; j < 2; ++j) {
+    bufferlist readback;
+    int r = store->read(ch, hoid[j], 0, expected[j].length(), readback);
+    ASSERT_EQ(r, (int)expected[j].length());
+    ASSERT_TRUE(bl_eq(expected[j], readback));
+  }
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTestSpecificAUSize, BluestoreDefragUnderLoad) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_max_blob_size", "65536");
+  SetVal(g_conf(), "bluestore_inline_data_max_size", "0");
+  SetVal(g_conf(), "bluestore_defrag_enable", "true");
+  SetVal(g_conf(), "bluestore_defrag_interval", "1");
+  SetVal(g_conf(), "bluestore_defrag_min_score", "4");
+  SetVal(g_conf(), "bluestore_defrag_busy_bytes", "0");
+  SetVal(g_conf(), "bluestore_defrag_bytes_per_sec", "0");
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  const unsigned num_objects = 4;
+  const unsigned num_blocks = 64;
+  vector<ghobject_t> hoid;
+  vector<bufferlist> expected(num_objects);
+  for (unsigned j = 0; j < num_objects; ++j) {
+    hoid.push_back(ghobject_t(hobject_t(sobject_t(
+      "Object " + stringify(j), CEPH_NOSNAP))));
+  }
+  auto write_block = [&](unsigned j, unsigned i, char c, bool wait) {
+    bufferlist bl;
+    bl.append(string(block_size, c));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid[j], i * block_size, bl.length(), bl);
+    C_SaferCond done;
+    if (wait) {
+      t.register_on_commit(&done);
+    }
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    if (i * block_size == expected[j].length()) {
+      expected[j].append(bl);
+    } else {
+      bufferlist head, tail;
+      head.substr_of(expected[j], 0, i * block_size);
+      tail.substr_of(expected[j], (i + 1) * block_size,
+		     expected[j].length() - (i + 1) * block_size);
+      expected[j] = head;
+      expected[j].append(bl);
+      expected[j].append(tail);
+    }
+    if (wait) {
+      done.wait();
+    }
+  };
+  // interleaved appends leave each object in 4k pieces on disk
+  for (unsigned i = 0; i < num_blocks; ++i) {
+    for (unsigned j = 0; j < num_objects; ++j) {
+      write_block(j, i, 'a' + (i + j) % 26, false);
+    }
+  }
+
+  // keep client writes to the same objects in flight while the
+  // defragmenter rewrites them
+  const PerfCounters* logger = store->get_perf_counters();
+  for (unsigned round = 0;
+       round < 300 && (round < 20 ||
+		       logger->get(l_bluestore_defrag_rewritten) < 2);
+       ++round) {
+    for (unsigned n = 0; n < 32; ++n) {
+      write_block(rand() % num_objects, rand() % num_blocks,
+		  'A' + rand() % 26, n == 31);
+    }
+    usleep(20000);
+  }
+  ASSERT_GE(logger->get(l_bluestore_defrag_rewritten), 2u);
+  for (unsigned j = 0; j < num_objects; ++j) {
+    bufferlist readback;
+    int r = store->read(ch, hoid[j], 0, expected[j].length(), readback);
+    ASSERT_EQ(r, (int)expected[j].length());
+    ASSERT_TRUE(bl_eq(expected[j], readback));
+  }
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTestSpecificAUSize, BluestoreDeferredCoalesce) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // the test device may look like either kind of media
+  SetVal(g_conf(), "bluestore_deferred_coalesce_hdd", "true");
+  SetVal(g_conf(), "bluestore_deferred_coalesce_ssd", "true");
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  // keep everything in one batch until it is explicitly drained
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", "1000");
+  SetVal(g_conf(), "bluestore_inline_data_max_size", "0");
+  size_t block_size = 4096;
+  StartDeferred(4 * block_size);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  coll_t cid1(spg_t(pg_t(0, 52), shard_id_t::NO_SHARD));
+  coll_t cid2(spg_t(pg_t(1, 52), shard_id_t::NO_SHARD));
+  coll_t tid(spg_t(pg_t(16, 52), shard_id_t::NO_SHARD));
+  auto ch1 = store->create_new_collection(cid1);
+  auto ch2 = store->create_new_collection(cid2);
+  auto tch = store->create_new_collection(tid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid1, 4);
+    int r = queue_transaction(store, ch1, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid2, 4);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(tid, 5);
+    int r = queue_transaction(store, tch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  const unsigned num_objects = 4;
+  vector<ghobject_t> a, b;
+  vector<bufferlist> a_data(num_objects), b_data(num_objects);
+  for (unsigned i = 0; i < num_objects; ++i) {
+    a.push_back(ghobject_t(hobject_t("a" + stringify(i), "", CEPH_NOSNAP,
+				     0, 52, "")));
+    b.push_back(ghobject_t(hobject_t("b" + stringify(i), "", CEPH_NOSNAP,
+				     1, 52, "")));
+  }
+  // the a objects use the last block of their allocation unit and the
+  // b objects the first one, so that writes to a[i] and b[i] end up next
+  // to each other on disk
+  const uint64_t a_off = 3 * block_size;
+  auto write = [&](ObjectStore::CollectionHandle& ch, const coll_t& cid,
+		   const ghobject_t& oid, uint64_t off, bufferlist *data,
+		   char c) {
+    data->clear();
+    data->append(std::string(block_size, c));
+    ObjectStore::Transaction t;
+    t.write(cid, oid, off, data->length(), *data);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  };
+
+  auto deferred_ops = logger->get(l_bluestore_deferred_write_ops);
+  for (unsigned i = 0; i < num_objects; ++i) {
+    write(ch1, cid1, a[i], a_off, &a_data[i], 'a' + i);
+    write(ch2, cid2, b[i], 0, &b_data[i], 'A' + i);
+  }
+  ASSERT_GE(logger->get(l_bluestore_deferred_write_ops),
+	    deferred_ops + 2 * num_objects);
+  // overwrite one block in place twice within the same batch
+  write(ch1, cid1, a[0], a_off, &a_data[0], 'x');
+  write(ch2, cid2, b[1], 0, &b_data[1], 'X');
+  write(ch1, cid1, a[0], a_off, &a_data[0], 'y');
+
+  // a split drains the preceding txcs of its sequencer, which are
+  // parked in the shared batch and only complete once it is written
+  auto merged = logger->get(l_bluestore_deferred_write_merged);
+  auto overwritten = logger->get(l_bluestore_deferred_write_overwritten_bytes);
+  {
+    ObjectStore::Transaction t;
+    t.split_collection(cid1, 5, 1 << 4, tid);
+    int r = queue_transaction(store, ch1, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_GT(logger->get(l_bluestore_deferred_write_merged), merged);
+  ASSERT_GE(logger->get(l_bluestore_deferred_write_overwritten_bytes),
+	    overwritten + 2 * block_size);
+
+  // remove a collection while its deferred writes are still batched
+  // with another one's, then bring it back
+  write(ch2, cid2, b[2], 0, &b_data[2], 'Y');
+  write(ch1, cid1, a[1], a_off, &a_data[1], 'z');
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < num_objects; ++i) {
+      t.remove(cid2, b[i]);
+    }
+    t.remove_collection(cid2);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch2.reset();
+  ch2 = store->create_new_collection(cid2);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid2, 4);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  write(ch2, cid2, b[0], 0, &b_data[0], 'Z');
+
+  ch1.reset();
+  ch2.reset();
+  tch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ch1 = store->open_collection(cid1);
+  ch2 = store->open_collection(cid2);
+  for (unsigned i = 0; i < num_objects; ++i) {
+    bufferlist readback;
+    int r = store->read(ch1, a[i], a_off, block_size, readback);
+    ASSERT_EQ(r, (int)block_size);
+    ASSERT_TRUE(bl_eq(a_data[i], readback));
+  }
+  {
+    bufferlist readback;
+    int r = store->read(ch2, b[0], 0, block_size, readback);
+    ASSERT_EQ(r, (int)block_size);
+    ASSERT_TRUE(bl_eq(b_data[0], readback));
+    ASSERT_FALSE(store->exists(ch2, b[1]));
+  }
+}
 #endif  // WITH_BLUESTORE
 
 int main(int argc, char **argv) {
@@ -567,6 +567,83 @@ TEST(BlueFS, test_replay) {
   rm_temp_bdev(fn);
 }
 
+void write_sst(BlueFS &fs, const string& dir, unsigned n, uint64_t size,
+	       std::atomic<bool> *stop)
+{
+  const uint64_t chunk = 1048576;
+  std::unique_ptr<char[]> buf = gen_buffer(chunk);
+  for (unsigned j = 0; !*stop; ++j) {
+    string file = "file." + to_string(n) + "." + to_string(j) + ".sst";
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.open_for_write(dir, file, &h, false));
+    for (uint64_t pos = 0; pos < size; pos += chunk) {
+      h->append(buf.get(), chunk);
+      fs.flush(h);
+    }
+    ASSERT_EQ(0, fs.fsync(h));
+    fs.close_writer(h);
+    fs.unlink(dir, file);
+  }
+}
+
+TEST(BlueFS, test_wal_fsync_vs_sst_writes) {
+  uint64_t size = 1048576 * 512;
+  string fn = get_temp_bdev(size);
+  g_ceph_context->_conf.set_val(
+    "bluefs_alloc_size",
+    "1048576");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn, false));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("db"));
+  ASSERT_EQ(0, fs.mkdir("db.wal"));
+  {
+    // compaction-like writers stream large files while the "kv sync
+    // thread" below appends to the wal and fsyncs it
+    std::atomic<bool> stop = {false};
+    std::vector<std::thread> sst_threads;
+    for (unsigned i = 0; i < 3; ++i) {
+      sst_threads.push_back(
+	std::thread(write_sst, std::ref(fs), "db", i, 64 * 1048576, &stop));
+    }
+
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.open_for_write("db.wal", "000001.log", &h, false));
+    std::unique_ptr<char[]> rec = gen_buffer(4096);
+    bufferlist expected;
+    for (unsigned i = 0; i < 2000; ++i) {
+      h->append(rec.get(), 4096);
+      expected.append(rec.get(), 4096);
+      ASSERT_EQ(0, fs.fsync(h));
+    }
+    fs.close_writer(h);
+    stop = true;
+    join_all(sst_threads);
+
+    BlueFS::FileReader *r;
+    ASSERT_EQ(0, fs.open_for_read("db.wal", "000001.log", &r));
+    bufferlist got;
+    ASSERT_EQ((int)expected.length(),
+	      fs.read(r, &r->buf, 0, expected.length(), &got, NULL));
+    ASSERT_TRUE(expected.contents_equal(got));
+    delete r;
+  }
+  fs.umount();
+  ASSERT_EQ(0, fs.mount());
+  {
+    uint64_t wal_size;
+    ASSERT_EQ(0, fs.stat("db.wal", "000001.log", &wal_size, NULL));
+    ASSERT_EQ(2000u * 4096, wal_size);
+  }
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -312,6 +312,64 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, RMRangeThreshold) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  // fall back to a range tombstone after two point deletes
+  g_ceph_context->_conf.set_val("rocksdb_delete_range_threshold", "2");
+  fini();
+  init();
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 10; ++i) {
+      t->set("prefix", "key" + stringify(i), value);
+      t->set("other", "key" + stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "key2", "key7");
+    db->submit_transaction_sync(t);
+    bufferlist v;
+    ASSERT_EQ(0, db->get("prefix", "key1", &v));
+    for (unsigned i = 2; i < 7; ++i) {
+      ASSERT_EQ(-ENOENT, db->get("prefix", "key" + stringify(i), &v));
+    }
+    ASSERT_EQ(0, db->get("prefix", "key7", &v));
+  }
+
+  {
+    // below the threshold; point deletes only
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "key7", "key9");
+    db->submit_transaction_sync(t);
+    bufferlist v;
+    ASSERT_EQ(-ENOENT, db->get("prefix", "key8", &v));
+    ASSERT_EQ(0, db->get("prefix", "key9", &v));
+  }
+
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("other");
+    db->submit_transaction_sync(t);
+    bufferlist v;
+    for (unsigned i = 0; i < 10; ++i) {
+      ASSERT_EQ(-ENOENT, db->get("other", "key" + stringify(i), &v));
+    }
+    ASSERT_EQ(0, db->get("prefix", "key1", &v));
+    ASSERT_EQ(0, db->get("prefix", "key9", &v));
+  }
+
+  fini();
+  g_ceph_context->_conf.rm_val("rocksdb_delete_range_threshold");
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -467,6 +525,114 @@ TEST_P(KVTest, RocksDBCFMerge) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBShardedCF) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("M(4,0-2)", ""));
+  cfs.push_back(KeyValueDB::ColumnFamily("P", ""));
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  const unsigned num = 200;
+  auto make_key = [](unsigned i) {
+    char k[16];
+    snprintf(k, sizeof(k), "%02x.%04u", i % 37, i);
+    return string(k);
+  };
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < num; ++i) {
+      bufferlist v;
+      v.append(stringify(i));
+      t->set("M", make_key(i), v);
+      t->set("P", make_key(i), v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  auto check = [&](unsigned expected) {
+    std::set<string> keys;
+    for (unsigned i = 0; i < num; ++i) {
+      keys.insert(make_key(i));
+    }
+    KeyValueDB::Iterator it = db->get_iterator("M");
+    unsigned n = 0;
+    auto p = keys.begin();
+    for (it->seek_to_first(); it->valid(); it->next(), ++p, ++n) {
+      ASSERT_TRUE(p != keys.end());
+      ASSERT_EQ(*p, it->key());
+    }
+    ASSERT_EQ(expected, n);
+    // walk backwards from the middle, then forward again
+    it->lower_bound(make_key(40));
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ(make_key(40), it->key());
+    string at = it->key();
+    ASSERT_EQ(0, it->prev());
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ(*std::prev(keys.find(at)), it->key());
+    ASSERT_EQ(0, it->next());
+    ASSERT_EQ(at, it->key());
+    ASSERT_EQ(0, it->next());
+    ASSERT_EQ(*std::next(keys.find(at)), it->key());
+    it->seek_to_last();
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ(*keys.rbegin(), it->key());
+    bufferlist v;
+    ASSERT_EQ(0, db->get("M", make_key(7), &v));
+    ASSERT_EQ("7", _bl_to_str(v));
+    v.clear();
+    ASSERT_EQ(0, db->get("P", make_key(7), &v));
+    ASSERT_EQ("7", _bl_to_str(v));
+  };
+  check(num);
+  {
+    // all keys of one hashed 2-byte group are in the same shard
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("M", "05.", "05/");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    KeyValueDB::Iterator it = db->get_iterator("M");
+    it->lower_bound("05.");
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("06.", it->key().substr(0, 3));
+    t = db->get_transaction();
+    for (unsigned i = 5; i < num; i += 37) {
+      bufferlist v;
+      v.append(stringify(i));
+      t->set("M", make_key(i), v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  check(num);
+  fini();
+
+  cout << "reshard M over 2 shards hashing the whole key" << std::endl;
+  cfs.clear();
+  cfs.push_back(KeyValueDB::ColumnFamily("M(2)", ""));
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->reshard(cfs, cout));
+  check(num);
+  fini();
+
+  cout << "reshard everything back into the default column family" << std::endl;
+  cfs.clear();
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->reshard(cfs, cout));
+  fini();
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  check(num);
+  fini();
+}
+
 INSTANTIATE_TEST_CASE_P(
   KeyValueDB,
   KVTest,
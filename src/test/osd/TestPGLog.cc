@@ -2912,6 +2912,47 @@ TEST_F(PGLogTrimTest, TestGetRequest) {
   EXPECT_FALSE(result);
 }
 
+TEST_F(PGLogTrimTest, TestTrimManyMempool) {
+  constexpr unsigned num_entries = 5000;
+  constexpr unsigned dups_tracked = 1000;
+  SetUp(1, 2, dups_tracked);
+
+  size_t bytes_before = mempool::osd_pglog::allocated_bytes();
+  {
+    PGLog::IndexedLog log;
+    log.head = mk_evt(1, 0);
+    log.skip_can_rollback_to_to_head();
+
+    entity_name_t client = entity_name_t::CLIENT(777);
+    for (unsigned i = 1; i <= num_entries; ++i) {
+      log.add(mk_ple_mod(mk_obj(i % 100), mk_evt(1, i), mk_evt(1, i - 1),
+			 osd_reqid_t(client, 8, i)));
+    }
+
+    // the indexes are accounted to the pglog pool along with the entries
+    size_t bytes_unindexed = mempool::osd_pglog::allocated_bytes();
+    EXPECT_LT(bytes_before, bytes_unindexed);
+    log.index();
+    size_t bytes_indexed = mempool::osd_pglog::allocated_bytes();
+    EXPECT_LT(bytes_unindexed, bytes_indexed);
+
+    log.trim(cct, mk_evt(1, num_entries - 10), nullptr, nullptr, nullptr);
+
+    EXPECT_EQ(10u, log.log.size());
+    EXPECT_EQ(dups_tracked - 9, log.dups.size());
+    EXPECT_EQ(log.dups.size(), log.dup_index.size());
+    EXPECT_GT(bytes_indexed, mempool::osd_pglog::allocated_bytes());
+
+    // dup_index points into log.dups, which must have stayed put
+    for (auto& d : log.dups) {
+      auto i = log.dup_index.find(d.reqid);
+      ASSERT_NE(log.dup_index.end(), i);
+      EXPECT_EQ(&d, i->second);
+    }
+  }
+  EXPECT_EQ(bytes_before, mempool::osd_pglog::allocated_bytes());
+}
+
 TEST_F(PGLogTest, _merge_object_divergent_entries) {
   {
     // Test for issue 20843
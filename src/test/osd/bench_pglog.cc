@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "include/types.h"
+#include "include/stringify.h"
+#include "common/Clock.h"
+#include "common/config.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "osd/PGLog.h"
+
+/*
+ * Append to a pg log and trim it the way a busy pg does, to time
+ * PGLog::IndexedLog::add/trim and report the osd_pglog mempool usage.
+ *
+ *   ceph_bench_pglog <ops> <max entries> <min entries> <dups tracked>
+ */
+
+static pg_log_entry_t mk_entry(unsigned num_objects, version_t v)
+{
+  pg_log_entry_t e;
+  e.mark_unrollbackable();
+  e.op = pg_log_entry_t::MODIFY;
+  e.soid.oid = "obj_" + stringify(v % num_objects);
+  e.soid.set_hash(v % num_objects);
+  e.soid.pool = 1;
+  e.version = eversion_t(1, v);
+  e.prior_version = eversion_t(1, v - 1);
+  e.reqid = osd_reqid_t(entity_name_t::CLIENT(777), 8, v);
+  return e;
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 5) {
+    cerr << "usage: " << argv[0]
+	 << " <ops> <max entries> <min entries> <dups tracked>" << std::endl;
+    return 1;
+  }
+  unsigned ops = atoi(argv[1]);
+  unsigned max_entries = atoi(argv[2]);
+  unsigned min_entries = atoi(argv[3]);
+  string dups_tracked = argv[4];
+
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  g_ceph_context->_conf.set_val_or_die("osd_pg_log_dups_tracked",
+				       dups_tracked);
+
+  cout << ops << " ops, trim from " << max_entries << " to " << min_entries
+       << " entries, " << dups_tracked << " dups tracked" << std::endl;
+
+  PGLog::IndexedLog log;
+  log.head = eversion_t(1, 0);
+  log.skip_can_rollback_to_to_head();
+  log.index();
+
+  size_t bytes_before = mempool::osd_pglog::allocated_bytes();
+  size_t bytes_max = 0;
+  utime_t add_time, trim_time;
+  unsigned trims = 0;
+  for (unsigned v = 1; v <= ops; ++v) {
+    utime_t start = ceph_clock_now();
+    log.add(mk_entry(1000, v));
+    add_time += ceph_clock_now() - start;
+
+    if (log.log.size() > max_entries) {
+      bytes_max = std::max(bytes_max, mempool::osd_pglog::allocated_bytes());
+      start = ceph_clock_now();
+      log.trim(g_ceph_context, eversion_t(1, v - min_entries),
+	       nullptr, nullptr, nullptr);
+      trim_time += ceph_clock_now() - start;
+      ++trims;
+    }
+  }
+
+  bytes_max = std::max(bytes_max, mempool::osd_pglog::allocated_bytes());
+
+  cout << "add: " << add_time << " total, "
+       << (double)add_time / ops * 1000000 << " us/op" << std::endl;
+  cout << "trim: " << trims << " trims, " << trim_time << " total";
+  if (trims) {
+    cout << ", " << (double)trim_time / trims * 1000000 << " us/trim";
+  }
+  cout << std::endl;
+  cout << "osd_pglog mempool: " << log.log.size() << " entries, "
+       << log.dups.size() << " dups, peak "
+       << (bytes_max - bytes_before) << " bytes" << std::endl;
+  return 0;
+}
@@ -278,3 +278,77 @@ TEST(extentcache, write_write_overlap2)
 
   c.release_write_pin(pin3);
 }
+
+TEST(extentcache, delta_write)
+{
+  hobject_t oid;
+
+  ExtentCache c;
+  ExtentCache::write_pin pin;
+  c.open_write_pin(pin);
+
+  // start delta write 1
+  auto to_write = iset_from_vector({{0, 10}});
+  ASSERT_TRUE(c.is_unpinned(oid, to_write));
+  c.reserve_extents_for_delta(oid, pin, to_write);
+  ASSERT_FALSE(c.is_unpinned(oid, iset_from_vector({{8, 4}})));
+  ASSERT_TRUE(c.is_unpinned(oid, iset_from_vector({{10, 4}})));
+  ASSERT_TRUE(c.has_opaque_extents(oid, iset_from_vector({{8, 4}})));
+  ASSERT_FALSE(c.has_opaque_extents(oid, iset_from_vector({{10, 4}})));
+
+  c.print(std::cerr);
+
+  // write 2 overwrites part of it without reading it
+  ExtentCache::write_pin pin2;
+  c.open_write_pin(pin2);
+  auto to_write2 = iset_from_vector({{4, 2}});
+  auto must_read2 = c.reserve_extents_for_rmw(
+    oid, pin2, to_write2, extent_set());
+  ASSERT_TRUE(must_read2.empty());
+  ASSERT_FALSE(c.has_opaque_extents(oid, iset_from_vector({{4, 2}})));
+  ASSERT_TRUE(c.has_opaque_extents(oid, iset_from_vector({{0, 10}})));
+
+  c.print(std::cerr);
+
+  // write 1 commits without presenting anything
+  c.release_write_pin(pin);
+  ASSERT_FALSE(c.has_opaque_extents(oid, iset_from_vector({{0, 10}})));
+
+  c.present_rmw_update(oid, pin2, imap_from_iset(to_write2));
+  c.release_write_pin(pin2);
+  ASSERT_TRUE(c.is_unpinned(oid, iset_from_vector({{0, 10}})));
+}
+
+TEST(extentcache, delta_write_fallback)
+{
+  hobject_t oid;
+
+  ExtentCache c;
+  ExtentCache::write_pin pin;
+  c.open_write_pin(pin);
+
+  auto to_write = iset_from_vector({{0, 10}});
+  c.reserve_extents_for_delta(oid, pin, to_write);
+  ASSERT_TRUE(c.has_opaque_extents(oid, to_write));
+
+  // the delta read failed, the write becomes a plain rmw
+  c.convert_delta_to_rmw(pin);
+  ASSERT_FALSE(c.has_opaque_extents(oid, to_write));
+
+  // a later write may now read it from the cache
+  ExtentCache::write_pin pin2;
+  c.open_write_pin(pin2);
+  auto to_read2 = iset_from_vector({{8, 4}});
+  auto must_read2 = c.reserve_extents_for_rmw(
+    oid, pin2, iset_from_vector({{8, 8}}), to_read2);
+  ASSERT_EQ(must_read2, iset_from_vector({{10, 2}}));
+
+  c.present_rmw_update(oid, pin, imap_from_iset(to_write));
+  auto pending2 = c.get_remaining_extents_for_rmw(
+    oid, pin2, iset_from_vector({{8, 2}}));
+  ASSERT_EQ(pending2, imap_from_vector({{8, 2}}));
+  c.present_rmw_update(oid, pin2, imap_from_vector({{8, 8}}));
+
+  c.release_write_pin(pin);
+  c.release_write_pin(pin2);
+}
@@ -78,6 +78,10 @@ TEST(Arch, all)
   expected = strstr(flags, " sse2 ") ? 1 : 0;
   EXPECT_EQ(expected, ceph_arch_intel_sse2);
 
+  // the kernel hides avx2 from /proc/cpuinfo if it does not save ymm state
+  expected = strstr(flags, " avx2 ") ? 1 : 0;
+  EXPECT_EQ(expected, ceph_arch_intel_avx2);
+
 #endif
 
 #endif